@@ -875,7 +875,7 @@ class StatsObserverWrapper : public StatsObserver {
       ScopedLocalRef<jstring> j_name(
           jni, JavaStringFromStdString(jni, value.name));
       ScopedLocalRef<jstring> j_value(
-          jni, JavaStringFromStdString(jni, value.value));
+          jni, JavaStringFromStdString(jni, value.value()));
       ScopedLocalRef<jobject> j_element_value(jni, jni->NewObject(
           *j_value_class_, j_value_ctor_, *j_name, *j_value));
       jni->SetObjectArrayElement(j_values, i, *j_element_value);
@@ -145,7 +145,8 @@ CreatePeerConnectionFactory(
 PeerConnectionFactory::PeerConnectionFactory()
     : owns_ptrs_(true),
       signaling_thread_(new talk_base::Thread),
-      worker_thread_(new talk_base::Thread) {
+      worker_ss_(new talk_base::PhysicalSocketServer),
+      worker_thread_(new talk_base::Thread(worker_ss_.get())) {
   bool result = signaling_thread_->Start();
   ASSERT(result);
   result = worker_thread_->Start();
@@ -224,7 +225,8 @@ void PeerConnectionFactory::OnMessage(talk_base::Message* msg) {
 bool PeerConnectionFactory::Initialize_s() {
   talk_base::InitRandom(talk_base::Time());
 
-  allocator_factory_ = PortAllocatorFactory::Create(worker_thread_);
+  allocator_factory_ = PortAllocatorFactory::Create(worker_thread_,
+                                                    worker_ss_.get());
   if (!allocator_factory_)
     return false;
 
@@ -31,6 +31,7 @@
 
 #include "talk/app/webrtc/mediastreaminterface.h"
 #include "talk/app/webrtc/peerconnectioninterface.h"
+#include "talk/base/physicalsocketserver.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/thread.h"
 #include "talk/session/media/channelmanager.h"
@@ -107,6 +108,9 @@ class PeerConnectionFactory : public PeerConnectionFactoryInterface,
 
   bool owns_ptrs_;
   talk_base::Thread* signaling_thread_;
+  // Socket server of |worker_thread_| when the factory created that thread
+  // itself, NULL otherwise.
+  talk_base::scoped_ptr<talk_base::PhysicalSocketServer> worker_ss_;
   talk_base::Thread* worker_thread_;
   talk_base::scoped_refptr<PortAllocatorFactoryInterface> allocator_factory_;
   // External Audio device used for audio playback.
@@ -42,14 +42,25 @@ using talk_base::scoped_ptr;
 talk_base::scoped_refptr<PortAllocatorFactoryInterface>
 PortAllocatorFactory::Create(
     talk_base::Thread* worker_thread) {
+  return Create(worker_thread, NULL);
+}
+
+talk_base::scoped_refptr<PortAllocatorFactoryInterface>
+PortAllocatorFactory::Create(
+    talk_base::Thread* worker_thread,
+    talk_base::PhysicalSocketServer* worker_ss) {
   talk_base::RefCountedObject<PortAllocatorFactory>* allocator =
-        new talk_base::RefCountedObject<PortAllocatorFactory>(worker_thread);
+        new talk_base::RefCountedObject<PortAllocatorFactory>(worker_thread,
+                                                              worker_ss);
   return allocator;
 }
 
-PortAllocatorFactory::PortAllocatorFactory(talk_base::Thread* worker_thread)
+PortAllocatorFactory::PortAllocatorFactory(
+    talk_base::Thread* worker_thread,
+    talk_base::PhysicalSocketServer* worker_ss)
     : network_manager_(new talk_base::BasicNetworkManager()),
       socket_factory_(new talk_base::BasicPacketSocketFactory(worker_thread)) {
+  network_manager_->set_network_monitor_socket_server(worker_ss);
 }
 
 PortAllocatorFactory::~PortAllocatorFactory() {}
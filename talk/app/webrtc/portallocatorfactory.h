@@ -43,6 +43,7 @@ class PortAllocator;
 namespace talk_base {
 class BasicNetworkManager;
 class BasicPacketSocketFactory;
+class PhysicalSocketServer;
 }
 
 namespace webrtc {
@@ -51,13 +52,19 @@ class PortAllocatorFactory : public PortAllocatorFactoryInterface {
  public:
   static talk_base::scoped_refptr<PortAllocatorFactoryInterface> Create(
       talk_base::Thread* worker_thread);
+  // |worker_ss| is the socket server run by |worker_thread|. When given,
+  // network interface changes are watched for instead of polled.
+  static talk_base::scoped_refptr<PortAllocatorFactoryInterface> Create(
+      talk_base::Thread* worker_thread,
+      talk_base::PhysicalSocketServer* worker_ss);
 
   virtual cricket::PortAllocator* CreatePortAllocator(
       const std::vector<StunConfiguration>& stun,
       const std::vector<TurnConfiguration>& turn);
 
  protected:
-  explicit PortAllocatorFactory(talk_base::Thread* worker_thread);
+  PortAllocatorFactory(talk_base::Thread* worker_thread,
+                       talk_base::PhysicalSocketServer* worker_ss);
   ~PortAllocatorFactory();
 
  private:
@@ -27,9 +27,11 @@
 
 #include "talk/app/webrtc/statscollector.h"
 
-#include <utility>
+#include <algorithm>
 #include <vector>
 
+#include "talk/base/common.h"
+#include "talk/base/thread.h"
 #include "talk/session/media/channel.h"
 
 namespace webrtc {
@@ -81,19 +83,28 @@ const char StatsReport::kStatsValueNameFrameRateSent[] = "googFrameRateSent";
 const char StatsReport::kStatsValueNameFrameWidthReceived[] =
     "googFrameWidthReceived";
 const char StatsReport::kStatsValueNameFrameWidthSent[] = "googFrameWidthSent";
+const char StatsReport::kStatsValueNameHandlerTimeMax[] =
+    "googHandlerTimeMaxUs";
 const char StatsReport::kStatsValueNameInitiator[] = "googInitiator";
 const char StatsReport::kStatsValueNameJitterReceived[] = "googJitterReceived";
 const char StatsReport::kStatsValueNameLocalAddress[] = "googLocalAddress";
+const char StatsReport::kStatsValueNameMessagesHandled[] =
+    "googMessagesHandled";
 const char StatsReport::kStatsValueNameNacksReceived[] = "googNacksReceived";
 const char StatsReport::kStatsValueNameNacksSent[] = "googNacksSent";
 const char StatsReport::kStatsValueNamePacketsReceived[] = "packetsReceived";
 const char StatsReport::kStatsValueNamePacketsSent[] = "packetsSent";
 const char StatsReport::kStatsValueNamePacketsLost[] = "packetsLost";
+const char StatsReport::kStatsValueNameQueueDelayMax[] = "googQueueDelayMaxUs";
+const char StatsReport::kStatsValueNameQueueDelayMedian[] =
+    "googQueueDelayMedianUs";
+const char StatsReport::kStatsValueNameQueueDepthMax[] = "googQueueDepthMax";
 const char StatsReport::kStatsValueNameReadable[] = "googReadable";
 const char StatsReport::kStatsValueNameRemoteAddress[] = "googRemoteAddress";
 const char StatsReport::kStatsValueNameRetransmitBitrate[] =
     "googRetransmitBitrate";
 const char StatsReport::kStatsValueNameRtt[] = "googRtt";
+const char StatsReport::kStatsValueNameSendDelayMax[] = "googSendDelayMaxUs";
 const char StatsReport::kStatsValueNameTargetEncBitrate[] =
     "googTargetEncBitrate";
 const char StatsReport::kStatsValueNameTransmitBitrate[] =
@@ -112,27 +123,69 @@ const char StatsReport::kStatsReportTypeIceCandidate[] = "iceCandidate";
 const char StatsReport::kStatsReportTypeTransport[] = "googTransport";
 const char StatsReport::kStatsReportTypeComponent[] = "googComponent";
 const char StatsReport::kStatsReportTypeCandidatePair[] = "googCandidatePair";
+const char StatsReport::kStatsReportTypeThread[] = "googThread";
 
 const char StatsReport::kStatsReportVideoBweId[] = "bweforvideo";
 
 // Implementations of functions in statstypes.h
+const std::string& StatsReport::Value::value() const {
+  // None of the typed values formats as an empty string.
+  if (value_.empty()) {
+    switch (type) {
+      case kInt64:
+        value_ = talk_base::ToString<int64>(int_val);
+        break;
+      case kFloat:
+        value_ = talk_base::ToString<double>(float_val);
+        break;
+      case kBool:
+        value_ = bool_val ? "true" : "false";
+        break;
+      case kString:
+        break;
+    }
+  }
+  return value_;
+}
+
 void StatsReport::AddValue(const std::string& name, const std::string& value) {
-  Value temp;
-  temp.name = name;
-  temp.value = value;
-  values.push_back(temp);
+  values.push_back(Value());
+  values.back().name = name;
+  values.back().value_ = value;
 }
 
 void StatsReport::AddValue(const std::string& name, int64 value) {
-  AddValue(name, talk_base::ToString<int64>(value));
+  values.push_back(Value());
+  values.back().name = name;
+  values.back().type = Value::kInt64;
+  values.back().int_val = value;
+}
+
+void StatsReport::AddFloat(const std::string& name, double value) {
+  values.push_back(Value());
+  values.back().name = name;
+  values.back().type = Value::kFloat;
+  values.back().float_val = value;
 }
 
 void StatsReport::AddBoolean(const std::string& name, bool value) {
-  AddValue(name, value ? "true" : "false");
+  values.push_back(Value());
+  values.back().name = name;
+  values.back().type = Value::kBool;
+  values.back().bool_val = value;
+}
+
+const StatsReport::Value* StatsReport::FindValue(
+    const std::string& name) const {
+  for (Values::const_iterator it = values.begin(); it != values.end(); ++it) {
+    if (it->name == name) {
+      return &(*it);
+    }
+  }
+  return NULL;
 }
 
 namespace {
-typedef std::map<std::string, StatsReport> StatsMap;
 
 std::string StatsId(const std::string& type, const std::string& id) {
   return type + "_" + id;
@@ -142,27 +195,64 @@ bool ExtractValueFromReport(
     const StatsReport& report,
     const std::string& name,
     std::string* value) {
-  StatsReport::Values::const_iterator it = report.values.begin();
-  for (; it != report.values.end(); ++it) {
-    if (it->name == name) {
-      *value = it->value;
-      return true;
-    }
+  const StatsReport::Value* found = report.FindValue(name);
+  if (!found) {
+    return false;
+  }
+  *value = found->value();
+  return true;
+}
+
+bool ReportIdLess(const StatsReport& report, const std::string& id) {
+  return report.id < id;
+}
+
+// Returns the report with |id| in |reports|, which is sorted by id, or NULL if
+// there is none.
+const StatsReport* FindReport(const StatsReports& reports,
+                              const std::string& id) {
+  StatsReports::const_iterator it =
+      std::lower_bound(reports.begin(), reports.end(), id, ReportIdLess);
+  if (it == reports.end() || it->id != id) {
+    return NULL;
+  }
+  return &(*it);
+}
+
+// Returns the report with |id| in |reports|, inserting an empty one in sorted
+// position if there is none. The pointer is only valid until the next report
+// is inserted.
+StatsReport* FindOrAddReport(StatsReports* reports, const std::string& id) {
+  StatsReports::iterator it =
+      std::lower_bound(reports->begin(), reports->end(), id, ReportIdLess);
+  if (it == reports->end() || it->id != id) {
+    it = reports->insert(it, StatsReport());
+    it->id = id;
+  }
+  return &(*it);
+}
+
+// Clears the values gathered into |report| by an earlier UpdateStats call,
+// keeping their storage.
+void ResetReport(const char* type, double timestamp, StatsReport* report) {
+  report->type = type;
+  if (report->timestamp != timestamp) {
+    report->values.clear();
+    report->timestamp = timestamp;
   }
-  return false;
 }
 
 template <class TrackVector>
-void CreateTrackReports(const TrackVector& tracks, StatsMap* reports) {
+void CreateTrackReports(const TrackVector& tracks, StatsReports* reports) {
   for (size_t j = 0; j < tracks.size(); ++j) {
     webrtc::MediaStreamTrackInterface* track = tracks[j];
     // Adds an empty track report.
-    StatsReport report;
-    report.type = StatsReport::kStatsReportTypeTrack;
-    report.id = StatsId(StatsReport::kStatsReportTypeTrack, track->id());
-    report.AddValue(StatsReport::kStatsValueNameTrackId,
-                    track->id());
-    (*reports)[report.id] = report;
+    StatsReport* report = FindOrAddReport(
+        reports, StatsId(StatsReport::kStatsReportTypeTrack, track->id()));
+    report->type = StatsReport::kStatsReportTypeTrack;
+    report->values.clear();
+    report->AddValue(StatsReport::kStatsValueNameTrackId,
+                     track->id());
   }
 }
 
@@ -189,8 +279,8 @@ void ExtractStats(const cricket::VoiceSenderInfo& info, StatsReport* report) {
   report->AddValue(StatsReport::kStatsValueNameJitterReceived,
                    info.jitter_ms);
   report->AddValue(StatsReport::kStatsValueNameRtt, info.rtt_ms);
-  report->AddValue(StatsReport::kStatsValueNameEchoCancellationQualityMin,
-                   talk_base::ToString<float>(info.aec_quality_min));
+  report->AddFloat(StatsReport::kStatsValueNameEchoCancellationQualityMin,
+                   info.aec_quality_min);
   report->AddValue(StatsReport::kStatsValueNameEchoDelayMedian,
                    info.echo_delay_median_ms);
   report->AddValue(StatsReport::kStatsValueNameEchoDelayStdDev,
@@ -251,14 +341,9 @@ void ExtractStats(const cricket::VideoSenderInfo& info, StatsReport* report) {
 void ExtractStats(const cricket::BandwidthEstimationInfo& info,
                   double stats_gathering_started,
                   StatsReport* report) {
-  report->id = StatsReport::kStatsReportVideoBweId;
-  report->type = StatsReport::kStatsReportTypeBwe;
-
   // Clear out stats from previous GatherStats calls if any.
-  if (report->timestamp != stats_gathering_started) {
-    report->values.clear();
-    report->timestamp = stats_gathering_started;
-  }
+  ResetReport(StatsReport::kStatsReportTypeBwe, stats_gathering_started,
+              report);
 
   report->AddValue(StatsReport::kStatsValueNameAvailableSendBandwidth,
                    info.available_send_bandwidth);
@@ -276,6 +361,26 @@ void ExtractStats(const cricket::BandwidthEstimationInfo& info,
                    info.bucket_delay);
 }
 
+void ExtractStats(const talk_base::MessageQueueStats& stats,
+                  double stats_gathering_started,
+                  StatsReport* report) {
+  ResetReport(StatsReport::kStatsReportTypeThread, stats_gathering_started,
+              report);
+
+  report->AddValue(StatsReport::kStatsValueNameMessagesHandled,
+                   stats.handler_time.count());
+  report->AddValue(StatsReport::kStatsValueNameQueueDelayMedian,
+                   static_cast<int64>(stats.queue_latency.Percentile(50)));
+  report->AddValue(StatsReport::kStatsValueNameQueueDelayMax,
+                   static_cast<int64>(stats.queue_latency.max_us()));
+  report->AddValue(StatsReport::kStatsValueNameSendDelayMax,
+                   static_cast<int64>(stats.send_latency.max_us()));
+  report->AddValue(StatsReport::kStatsValueNameHandlerTimeMax,
+                   static_cast<int64>(stats.handler_time.max_us()));
+  report->AddValue(StatsReport::kStatsValueNameQueueDepthMax,
+                   static_cast<int64>(stats.max_depth));
+}
+
 uint32 ExtractSsrc(const cricket::VoiceReceiverInfo& info) {
   return info.ssrc;
 }
@@ -332,40 +437,36 @@ bool StatsCollector::GetStats(MediaStreamTrackInterface* track,
   ASSERT(reports != NULL);
   reports->clear();
 
-  StatsMap::iterator it;
   if (!track) {
-    for (it = reports_.begin(); it != reports_.end(); ++it) {
-      reports->push_back(it->second);
-    }
+    *reports = reports_;
     return true;
   }
 
-  it = reports_.find(StatsId(StatsReport::kStatsReportTypeSession,
-                             session_->id()));
-  if (it != reports_.end()) {
-    reports->push_back(it->second);
+  const StatsReport* report = FindReport(
+      reports_, StatsId(StatsReport::kStatsReportTypeSession, session_->id()));
+  if (report) {
+    reports->push_back(*report);
   }
 
-  it = reports_.find(StatsId(StatsReport::kStatsReportTypeTrack, track->id()));
+  report = FindReport(
+      reports_, StatsId(StatsReport::kStatsReportTypeTrack, track->id()));
 
-  if (it == reports_.end()) {
+  if (!report) {
     LOG(LS_WARNING) << "No StatsReport is available for "<< track->id();
     return false;
   }
 
-  reports->push_back(it->second);
+  reports->push_back(*report);
 
-  std::string track_id;
-  for (it = reports_.begin(); it != reports_.end(); ++it) {
-    if (it->second.type != StatsReport::kStatsReportTypeSsrc) {
+  for (StatsReports::const_iterator it = reports_.begin();
+       it != reports_.end(); ++it) {
+    if (it->type != StatsReport::kStatsReportTypeSsrc) {
       continue;
     }
-    if (ExtractValueFromReport(it->second,
-                               StatsReport::kStatsValueNameTrackId,
-                               &track_id)) {
-      if (track_id == track->id()) {
-        reports->push_back(it->second);
-      }
+    const StatsReport::Value* track_id =
+        it->FindValue(StatsReport::kStatsValueNameTrackId);
+    if (track_id && track_id->value() == track->id()) {
+      reports->push_back(*it);
     }
   }
 
@@ -386,17 +487,18 @@ void StatsCollector::UpdateStats() {
     ExtractSessionInfo();
     ExtractVoiceInfo();
     ExtractVideoInfo();
+    ExtractThreadInfo();
   }
 }
 
 StatsReport* StatsCollector::PrepareReport(uint32 ssrc,
                                            const std::string& transport_id) {
-  std::string ssrc_id = talk_base::ToString<uint32>(ssrc);
-  StatsMap::iterator it = reports_.find(StatsId(
-      StatsReport::kStatsReportTypeSsrc, ssrc_id));
+  std::string id = StatsId(StatsReport::kStatsReportTypeSsrc,
+                           talk_base::ToString<uint32>(ssrc));
+  const StatsReport* old_report = FindReport(reports_, id);
 
   std::string track_id;
-  if (it == reports_.end()) {
+  if (!old_report) {
     if (!session()->GetTrackIdBySsrc(ssrc, &track_id)) {
       LOG(LS_ERROR) << "The SSRC " << ssrc
                     << " is not associated with a track";
@@ -405,23 +507,18 @@ StatsReport* StatsCollector::PrepareReport(uint32 ssrc,
   } else {
     // Keeps the old track id since we want to report the stats for inactive
     // tracks.
-    ExtractValueFromReport(it->second,
+    ExtractValueFromReport(*old_report,
                            StatsReport::kStatsValueNameTrackId,
                            &track_id);
   }
 
-  StatsReport* report = &reports_[
-      StatsId(StatsReport::kStatsReportTypeSsrc, ssrc_id)];
-  report->id = StatsId(StatsReport::kStatsReportTypeSsrc, ssrc_id);
-  report->type = StatsReport::kStatsReportTypeSsrc;
+  StatsReport* report = FindOrAddReport(&reports_, id);
 
   // Clear out stats from previous GatherStats calls if any.
-  if (report->timestamp != stats_gathering_started_) {
-    report->values.clear();
-    report->timestamp = stats_gathering_started_;
-  }
+  ResetReport(StatsReport::kStatsReportTypeSsrc, stats_gathering_started_,
+              report);
 
-  report->AddValue(StatsReport::kStatsValueNameSsrc, ssrc_id);
+  report->AddValue(StatsReport::kStatsValueNameSsrc, ssrc);
   report->AddValue(StatsReport::kStatsValueNameTrackId, track_id);
   // Add the mapping of SSRC to transport.
   report->AddValue(StatsReport::kStatsValueNameTransportId,
@@ -431,15 +528,13 @@ StatsReport* StatsCollector::PrepareReport(uint32 ssrc,
 
 void StatsCollector::ExtractSessionInfo() {
   // Extract information from the base session.
-  StatsReport report;
-  report.id = StatsId(StatsReport::kStatsReportTypeSession, session_->id());
-  report.type = StatsReport::kStatsReportTypeSession;
-  report.timestamp = stats_gathering_started_;
-  report.values.clear();
-  report.AddBoolean(StatsReport::kStatsValueNameInitiator,
-                    session_->initiator());
-
-  reports_[report.id] = report;
+  StatsReport* session_report = FindOrAddReport(
+      &reports_,
+      StatsId(StatsReport::kStatsReportTypeSession, session_->id()));
+  ResetReport(StatsReport::kStatsReportTypeSession, stats_gathering_started_,
+              session_report);
+  session_report->AddBoolean(StatsReport::kStatsValueNameInitiator,
+                             session_->initiator());
 
   cricket::SessionStats stats;
   if (session_->GetStats(&stats)) {
@@ -453,46 +548,43 @@ void StatsCollector::ExtractSessionInfo() {
                = transport_iter->second.channel_stats.begin();
            channel_iter != transport_iter->second.channel_stats.end();
            ++channel_iter) {
-        StatsReport channel_report;
         std::ostringstream ostc;
         ostc << "Channel-" << transport_iter->second.content_name
              << "-" << channel_iter->component;
-        channel_report.id = ostc.str();
-        channel_report.type = StatsReport::kStatsReportTypeComponent;
-        channel_report.timestamp = stats_gathering_started_;
-        channel_report.AddValue(StatsReport::kStatsValueNameComponent,
-                                channel_iter->component);
-        reports_[channel_report.id] = channel_report;
+        std::string channel_id = ostc.str();
+        StatsReport* channel_report = FindOrAddReport(&reports_, channel_id);
+        ResetReport(StatsReport::kStatsReportTypeComponent,
+                    stats_gathering_started_, channel_report);
+        channel_report->AddValue(StatsReport::kStatsValueNameComponent,
+                                 channel_iter->component);
         for (size_t i = 0;
              i < channel_iter->connection_infos.size();
              ++i) {
-          StatsReport report;
           const cricket::ConnectionInfo& info
               = channel_iter->connection_infos[i];
           std::ostringstream ost;
           ost << "Conn-" << transport_iter->first << "-"
               << channel_iter->component << "-" << i;
-          report.id = ost.str();
-          report.type = StatsReport::kStatsReportTypeCandidatePair;
-          report.timestamp = stats_gathering_started_;
+          StatsReport* report = FindOrAddReport(&reports_, ost.str());
+          ResetReport(StatsReport::kStatsReportTypeCandidatePair,
+                      stats_gathering_started_, report);
           // Link from connection to its containing channel.
-          report.AddValue(StatsReport::kStatsValueNameChannelId,
-                          channel_report.id);
-          report.AddValue(StatsReport::kStatsValueNameBytesSent,
-                          info.sent_total_bytes);
-          report.AddValue(StatsReport::kStatsValueNameBytesReceived,
-                          info.recv_total_bytes);
-          report.AddBoolean(StatsReport::kStatsValueNameWritable,
-                            info.writable);
-          report.AddBoolean(StatsReport::kStatsValueNameReadable,
-                            info.readable);
-          report.AddBoolean(StatsReport::kStatsValueNameActiveConnection,
-                            info.best_connection);
-          report.AddValue(StatsReport::kStatsValueNameLocalAddress,
-                          info.local_candidate.address().ToString());
-          report.AddValue(StatsReport::kStatsValueNameRemoteAddress,
-                          info.remote_candidate.address().ToString());
-          reports_[report.id] = report;
+          report->AddValue(StatsReport::kStatsValueNameChannelId,
+                           channel_id);
+          report->AddValue(StatsReport::kStatsValueNameBytesSent,
+                           info.sent_total_bytes);
+          report->AddValue(StatsReport::kStatsValueNameBytesReceived,
+                           info.recv_total_bytes);
+          report->AddBoolean(StatsReport::kStatsValueNameWritable,
+                             info.writable);
+          report->AddBoolean(StatsReport::kStatsValueNameReadable,
+                             info.readable);
+          report->AddBoolean(StatsReport::kStatsValueNameActiveConnection,
+                             info.best_connection);
+          report->AddValue(StatsReport::kStatsValueNameLocalAddress,
+                           info.local_candidate.address().ToString());
+          report->AddValue(StatsReport::kStatsValueNameRemoteAddress,
+                           info.remote_candidate.address().ToString());
         }
       }
     }
@@ -540,12 +632,32 @@ void StatsCollector::ExtractVideoInfo() {
   if (video_info.bw_estimations.size() != 1) {
     LOG(LS_ERROR) << "BWEs count: " << video_info.bw_estimations.size();
   } else {
-    StatsReport* report = &reports_[StatsReport::kStatsReportVideoBweId];
+    StatsReport* report =
+        FindOrAddReport(&reports_, StatsReport::kStatsReportVideoBweId);
     ExtractStats(
         video_info.bw_estimations[0], stats_gathering_started_, report);
   }
 }
 
+void StatsCollector::ExtractThreadInfo() {
+  const char* names[] = { "signaling", "worker" };
+  talk_base::Thread* threads[] = { session_->signaling_thread(),
+                                   session_->worker_thread() };
+  for (int i = 0; i < ARRAY_SIZE(threads); ++i) {
+    // The signaling thread may do the work as well.
+    if (!threads[i] || (i > 0 && threads[i] == threads[0]) ||
+        !threads[i]->stats_enabled()) {
+      continue;
+    }
+    talk_base::MessageQueueStats stats;
+    if (threads[i]->GetStats(&stats)) {
+      StatsReport* report = FindOrAddReport(
+          &reports_, StatsId(StatsReport::kStatsReportTypeThread, names[i]));
+      ExtractStats(stats, stats_gathering_started_, report);
+    }
+  }
+}
+
 double StatsCollector::GetTimeNow() {
   return timing_.WallTimeNow() * talk_base::kNumMillisecsPerSec;
 }
@@ -32,7 +32,6 @@
 #define TALK_APP_WEBRTC_STATSCOLLECTOR_H_
 
 #include <string>
-#include <map>
 
 #include "talk/app/webrtc/mediastreaminterface.h"
 #include "talk/app/webrtc/statstypes.h"
@@ -78,11 +77,13 @@ class StatsCollector {
   void ExtractSessionInfo();
   void ExtractVoiceInfo();
   void ExtractVideoInfo();
+  void ExtractThreadInfo();
   double GetTimeNow();
   void BuildSsrcToTransportId();
 
-  // A map from the report id to the report.
-  std::map<std::string, webrtc::StatsReport> reports_;
+  // All reports, sorted by id. Reports are kept across UpdateStats calls so
+  // that their storage is reused.
+  StatsReports reports_;
   // Raw pointer to the session the statistics are gathered from.
   WebRtcSession* session_;
   double stats_gathering_started_;
@@ -46,15 +46,45 @@ class StatsReport {
   std::string id;  // See below for contents.
   std::string type;  // See below for contents.
 
+  // A single named statistic, added through AddValue() and friends. Numbers
+  // and booleans are stored as such and only formatted when value() is first
+  // called.
   struct Value {
+    enum Type {
+      kInt64,
+      kFloat,
+      kBool,
+      kString
+    };
+
+    Value() : type(kString), int_val(0) { }
+
+    // Returns the value in the string form stats have always been reported
+    // in, e.g. "12345", "0.5" or "true".
+    const std::string& value() const;
+
     std::string name;
-    std::string value;
+    Type type;
+    union {
+      int64 int_val;
+      double float_val;
+      bool bool_val;
+    };
+
+   private:
+    friend class StatsReport;
+    // The formatted value. Strings are stored here right away.
+    mutable std::string value_;
   };
 
   void AddValue(const std::string& name, const std::string& value);
   void AddValue(const std::string& name, int64 value);
+  void AddFloat(const std::string& name, double value);
   void AddBoolean(const std::string& name, bool value);
 
+  // Returns the value called |name|, or NULL if there is none.
+  const Value* FindValue(const std::string& name) const;
+
   double timestamp;  // Time since 1970-01-01T00:00:00Z in milliseconds.
   typedef std::vector<Value> Values;
   Values values;
@@ -96,6 +126,12 @@ class StatsReport {
   // ICE Candidate. It links to its transport.
   static const char kStatsReportTypeIceCandidate[];
 
+  // StatsReport of |type| = "googThread" is statistics on the message queue
+  // of the signaling or the worker thread, whichever |id| says. It is only
+  // there while the thread collects stats, see
+  // talk_base::MessageQueue::EnableStats().
+  static const char kStatsReportTypeThread[];
+
   // The id of StatsReport of type VideoBWE.
   static const char kStatsReportVideoBweId[];
 
@@ -151,6 +187,14 @@ class StatsReport {
   static const char kStatsValueNameChannelId[];
   static const char kStatsValueNameTrackId[];
   static const char kStatsValueNameSsrc[];
+
+  // Message queue stats of a thread. Durations are in microseconds.
+  static const char kStatsValueNameMessagesHandled[];
+  static const char kStatsValueNameQueueDelayMedian[];
+  static const char kStatsValueNameQueueDelayMax[];
+  static const char kStatsValueNameSendDelayMax[];
+  static const char kStatsValueNameHandlerTimeMax[];
+  static const char kStatsValueNameQueueDepthMax[];
 };
 
 typedef std::vector<StatsReport> StatsReports;
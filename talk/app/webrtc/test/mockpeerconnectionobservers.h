@@ -156,7 +156,7 @@ class MockStatsObserver : public webrtc::StatsObserver {
           reports_[i].values.begin();
       for (; it != reports_[i].values.end(); ++it) {
         if (it->name == name) {
-          return talk_base::FromString<int>(it->value);
+          return talk_base::FromString<int>(it->value());
         }
       }
     }
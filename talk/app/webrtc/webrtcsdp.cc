@@ -211,14 +211,13 @@ static const char kDefaultSctpFmtProtocol[] = "webrtc-datachannel";
 
 struct SsrcInfo {
   SsrcInfo()
-      : msid_identifier(kDefaultMsid),
-        // TODO(ronghuawu): What should we do if the appdata doesn't appear?
-        // Create random string (which will be used as track label later)?
-        msid_appdata(talk_base::CreateRandomString(8)) {
+      : msid_identifier(kDefaultMsid) {
   }
   uint32 ssrc_id;
   std::string cname;
   std::string msid_identifier;
+  // Empty if the msid has no appdata. A random track id is made up for it
+  // when the tracks are created.
   std::string msid_appdata;
 
   // For backward compatibility.
@@ -229,15 +228,16 @@ struct SsrcInfo {
 typedef std::vector<SsrcInfo> SsrcInfoVec;
 typedef std::vector<SsrcGroup> SsrcGroupVec;
 
-// Serializes the passed in SessionDescription to a SDP string.
+// Serializes the passed in SessionDescription and its candidates to |message|.
 // desc - The SessionDescription object to be serialized.
-static std::string SdpSerializeSessionDescription(
-    const JsepSessionDescription& jdesc);
+static void SdpSerializeSessionDescription(
+    const JsepSessionDescription& jdesc, std::string* message);
 template <class T>
 static void AddFmtpLine(const T& codec, std::string* message);
 static void BuildMediaDescription(const ContentInfo* content_info,
                                   const TransportInfo* transport_info,
                                   const MediaType media_type,
+                                  const std::vector<Candidate>& candidates,
                                   std::string* message);
 static void BuildSctpContentAttributes(std::string* message);
 static void BuildRtpContentAttributes(
@@ -428,13 +428,10 @@ static bool GetLine(const std::string& message,
   if (line_end == std::string::npos) {
     return false;
   }
-  // Update the new start position
-  *pos = line_end + 1;
+  size_t next_pos = line_end + 1;
   if (line_end > 0 && (message.at(line_end - 1) == kReturn)) {
     --line_end;
   }
-  *line = message.substr(line_begin, (line_end - line_begin));
-  const char* cline = line->c_str();
   // RFC 4566
   // An SDP session description consists of a number of lines of text of
   // the form:
@@ -442,12 +439,19 @@ static bool GetLine(const std::string& message,
   // where <type> MUST be exactly one case-significant character and
   // <value> is structured text whose format depends on <type>.
   // Whitespace MUST NOT be used on either side of the "=" sign.
-  if (cline[0] == kSdpDelimiterSpace ||
-      cline[1] != kSdpDelimiterEqual ||
-      cline[2] == kSdpDelimiterSpace) {
-    *pos = line_begin;
+  // Checked in place, as the line is only copied out once it is valid.
+  const size_t length = line_end - line_begin;
+  if (length < 2 ||
+      message[line_begin] == kSdpDelimiterSpace ||
+      message[line_begin + 1] != kSdpDelimiterEqual ||
+      (length > 2 && message[line_begin + 2] == kSdpDelimiterSpace)) {
     return false;
   }
+  // Update the new start position
+  *pos = next_pos;
+  // Callers read every line into the same |line|, so assign() reuses its
+  // storage instead of allocating a new string per line.
+  line->assign(message, line_begin, length);
   return true;
 }
 
@@ -511,9 +515,10 @@ static bool GetLineWithType(const std::string& message, size_t* pos,
   return true;
 }
 
-static bool HasAttribute(const std::string& line,
-                         const std::string& attribute) {
-  return (line.compare(kLinePrefixLength, attribute.size(), attribute) == 0);
+// Takes a plain C string so that the long chains of attribute checks in the
+// parser don't construct a temporary std::string per check.
+static bool HasAttribute(const std::string& line, const char* attribute) {
+  return (line.compare(kLinePrefixLength, strlen(attribute), attribute) == 0);
 }
 
 // Verifies the candiate to be of the format candidate:<blah>
@@ -535,11 +540,21 @@ static bool AddSsrcLine(uint32 ssrc_id, const std::string& attribute,
                         const std::string& value, std::string* message) {
   // RFC 5576
   // a=ssrc:<ssrc-id> <attribute>:<value>
-  std::ostringstream os;
-  InitAttrLine(kAttributeSsrc, &os);
-  os << kSdpDelimiterColon << ssrc_id << kSdpDelimiterSpace
-     << attribute << kSdpDelimiterColon << value;
-  return AddLine(os.str(), message);
+  // There are several of these lines per ssrc, so they are appended to
+  // |message| directly rather than formatted through a stream.
+  char ssrc_id_buf[16];
+  talk_base::sprintfn(ssrc_id_buf, sizeof(ssrc_id_buf), "%u", ssrc_id);
+  message->push_back(kLineTypeAttributes);
+  message->push_back(kSdpDelimiterEqual);
+  message->append(kAttributeSsrc);
+  message->push_back(kSdpDelimiterColon);
+  message->append(ssrc_id_buf);
+  message->push_back(kSdpDelimiterSpace);
+  message->append(attribute);
+  message->push_back(kSdpDelimiterColon);
+  message->append(value);
+  message->append(kLineBreak);
+  return true;
 }
 
 // Split the message into two parts by the first delimiter.
@@ -558,28 +573,50 @@ static bool SplitByDelimiter(const std::string& message,
   return true;
 }
 
+// Splits |line| from |start| on |delimiter| into |fields|, like
+// talk_base::split does for line.substr(start) but without copying the line.
+static size_t SplitLine(const std::string& line, size_t start,
+                        const char delimiter,
+                        std::vector<std::string>* fields) {
+  fields->clear();
+  size_t last = std::min(start, line.length());
+  for (size_t i = last; i < line.length(); ++i) {
+    if (line[i] == delimiter) {
+      fields->push_back(line.substr(last, i - last));
+      last = i + 1;
+    }
+  }
+  fields->push_back(line.substr(last));
+  return fields->size();
+}
+
 // Get value only from <attribute>:<value>.
-static bool GetValue(const std::string& message, const std::string& attribute,
+static bool GetValue(const std::string& message, const char* attribute,
                      std::string* value, SdpParseError* error) {
-  std::string leftpart;
-  if (!SplitByDelimiter(message, kSdpDelimiterColon, &leftpart, value)) {
+  size_t colon = message.find(kSdpDelimiterColon);
+  if (colon == std::string::npos) {
     return ParseFailedGetValue(message, attribute, error);
   }
   // The left part should end with the expected attribute.
-  if (leftpart.length() < attribute.length() ||
-      leftpart.compare(leftpart.length() - attribute.length(),
-                       attribute.length(), attribute) != 0) {
+  const size_t attribute_length = strlen(attribute);
+  if (colon < attribute_length ||
+      message.compare(colon - attribute_length, attribute_length,
+                      attribute) != 0) {
     return ParseFailedGetValue(message, attribute, error);
   }
+  value->assign(message, colon + 1, std::string::npos);
   return true;
 }
 
-static bool CaseInsensitiveFind(std::string str1, std::string str2) {
-  std::transform(str1.begin(), str1.end(), str1.begin(),
-                 ::tolower);
-  std::transform(str2.begin(), str2.end(), str2.begin(),
-                 ::tolower);
-  return str1.find(str2) != std::string::npos;
+static bool CaseInsensitiveCharEquals(char c1, char c2) {
+  return ::tolower(static_cast<unsigned char>(c1)) ==
+      ::tolower(static_cast<unsigned char>(c2));
+}
+
+static bool CaseInsensitiveFind(const std::string& str1,
+                                const std::string& str2) {
+  return std::search(str1.begin(), str1.end(), str2.begin(), str2.end(),
+                     CaseInsensitiveCharEquals) != str1.end();
 }
 
 void CreateTracksFromSsrcInfos(const SsrcInfoVec& ssrc_infos,
@@ -605,6 +642,11 @@ void CreateTracksFromSsrcInfos(const SsrcInfoVec& ssrc_infos,
       // The appdata consists of the "id" attribute of a MediaStreamTrack, which
       // is corresponding to the "id" attribute of StreamParams.
       track_id = ssrc_info->msid_appdata;
+      if (track_id.empty()) {
+        // TODO(ronghuawu): What should we do if the appdata doesn't appear?
+        // Create random string (which will be used as track label later)?
+        track_id = talk_base::CreateRandomString(8);
+      }
     }
     if (sync_label.empty() || track_id.empty()) {
       ASSERT(false);
@@ -692,47 +734,23 @@ static bool GetDefaultDestination(const std::vector<Candidate>& candidates,
   return true;
 }
 
-// Update the media default destination.
-static void UpdateMediaDefaultDestination(
-    const std::vector<Candidate>& candidates, std::string* mline) {
+// Adds the c line and, for RTP, the a=rtcp line of the media default
+// destination to |message|.
+static void AddMediaDefaultDestination(
+    const std::vector<Candidate>& candidates, bool is_rtp,
+    const std::string& rtp_ip, std::string* message) {
+  // RFC 5245
+  // The default candidates are added to the SDP as the default
+  // destination for media.  For streams based on RTP, this is done by
+  // placing the IP address and port of the RTP candidate into the c and m
+  // lines, respectively.
+  // Add the c line.
   // RFC 4566
-  // m=<media> <port> <proto> <fmt> ...
-  std::vector<std::string> fields;
-  talk_base::split(*mline, kSdpDelimiterSpace, &fields);
-  if (fields.size() < 3) {
-    return;
-  }
-
-  bool is_rtp =
-      fields[2].empty() ||
-      talk_base::starts_with(fields[2].data(),
-                             cricket::kMediaProtocolRtpPrefix);
-
+  // c=<nettype> <addrtype> <connection-address>
   std::ostringstream os;
-  std::string rtp_port, rtp_ip;
-  if (GetDefaultDestination(candidates, ICE_CANDIDATE_COMPONENT_RTP,
-                            &rtp_port, &rtp_ip)) {
-    // Found default RTP candidate.
-    // RFC 5245
-    // The default candidates are added to the SDP as the default
-    // destination for media.  For streams based on RTP, this is done by
-    // placing the IP address and port of the RTP candidate into the c and m
-    // lines, respectively.
-
-    // Update the port in the m line.
-    // If this is a m-line with port equal to 0, we don't change it.
-    if (fields[1] != kMediaPortRejected) {
-      mline->replace(fields[0].size() + 1,
-                     fields[1].size(),
-                     rtp_port);
-    }
-    // Add the c line.
-    // RFC 4566
-    // c=<nettype> <addrtype> <connection-address>
-    InitLine(kLineTypeConnection, kConnectionNettype, &os);
-    os << " " << kConnectionAddrtype << " " << rtp_ip;
-    AddLine(os.str(), mline);
-  }
+  InitLine(kLineTypeConnection, kConnectionNettype, &os);
+  os << " " << kConnectionAddrtype << " " << rtp_ip;
+  AddLine(os.str(), message);
 
   if (is_rtp) {
     std::string rtcp_port, rtcp_ip;
@@ -752,7 +770,7 @@ static void UpdateMediaDefaultDestination(
          << kConnectionNettype << " "
          << kConnectionAddrtype << " "
          << rtcp_ip;
-      AddLine(os.str(), mline);
+      AddLine(os.str(), message);
     }
   }
 }
@@ -772,45 +790,28 @@ static void GetCandidatesByMindex(const SessionDescriptionInterface& desci,
 }
 
 std::string SdpSerialize(const JsepSessionDescription& jdesc) {
-  std::string sdp = SdpSerializeSessionDescription(jdesc);
-
-  std::string sdp_with_candidates;
-  size_t pos = 0;
-  std::string line;
-  int mline_index = -1;
-  while (GetLine(sdp, &pos, &line)) {
-    if (IsLineType(line, kLineTypeMedia)) {
-      ++mline_index;
-      std::vector<Candidate> candidates;
-      GetCandidatesByMindex(jdesc, mline_index, &candidates);
-      // Media line may append other lines inside the
-      // UpdateMediaDefaultDestination call, so add the kLineBreak here first.
-      line.append(kLineBreak);
-      UpdateMediaDefaultDestination(candidates, &line);
-      sdp_with_candidates.append(line);
-      // Build the a=candidate lines.
-      BuildCandidate(candidates, &sdp_with_candidates);
-    } else {
-      // Copy old line to new sdp without change.
-      AddLine(line, &sdp_with_candidates);
-    }
-  }
-  sdp = sdp_with_candidates;
-
+  std::string sdp;
+  SdpSerialize(jdesc, &sdp);
   return sdp;
 }
 
-std::string SdpSerializeSessionDescription(
-    const JsepSessionDescription& jdesc) {
+void SdpSerialize(const JsepSessionDescription& jdesc, std::string* message) {
+  ASSERT(message != NULL);
+  // Keep the capacity of |message| so that a caller serializing repeatedly
+  // into the same string doesn't reallocate it.
+  message->clear();
+  SdpSerializeSessionDescription(jdesc, message);
+}
+
+void SdpSerializeSessionDescription(
+    const JsepSessionDescription& jdesc, std::string* message) {
   const cricket::SessionDescription* desc = jdesc.description();
   if (!desc) {
-    return "";
+    return;
   }
 
-  std::string message;
-
   // Session Description.
-  AddLine(kSessionVersion, &message);
+  AddLine(kSessionVersion, message);
   // Session Origin
   // RFC 4566
   // o=<username> <sess-id> <sess-version> <nettype> <addrtype>
@@ -824,11 +825,11 @@ std::string SdpSerializeSessionDescription(
   os << " " << session_id << " " << session_version << " "
      << kSessionOriginNettype << " " << kSessionOriginAddrtype << " "
      << kSessionOriginAddress;
-  AddLine(os.str(), &message);
-  AddLine(kSessionName, &message);
+  AddLine(os.str(), message);
+  AddLine(kSessionName, message);
 
   // Time Description.
-  AddLine(kTimeDescription, &message);
+  AddLine(kTimeDescription, message);
 
   // Group
   if (desc->HasGroup(cricket::GROUP_TYPE_BUNDLE)) {
@@ -842,7 +843,7 @@ std::string SdpSerializeSessionDescription(
       group_line.append(" ");
       group_line.append(*it);
     }
-    AddLine(group_line, &message);
+    AddLine(group_line, message);
   }
 
   // MediaStream semantics
@@ -859,30 +860,37 @@ std::string SdpSerializeSessionDescription(
       media_stream_labels.begin(); it != media_stream_labels.end(); ++it) {
     os << " " << *it;
   }
-  AddLine(os.str(), &message);
+  AddLine(os.str(), message);
 
+  // The candidates of the m-lines are written along with them, by the index of
+  // the m-line in |message|.
+  int mline_index = -1;
+  std::vector<Candidate> candidates;
   if (audio_content) {
+    candidates.clear();
+    GetCandidatesByMindex(jdesc, ++mline_index, &candidates);
     BuildMediaDescription(audio_content,
                           desc->GetTransportInfoByName(audio_content->name),
-                          cricket::MEDIA_TYPE_AUDIO, &message);
+                          cricket::MEDIA_TYPE_AUDIO, candidates, message);
   }
 
 
   if (video_content) {
+    candidates.clear();
+    GetCandidatesByMindex(jdesc, ++mline_index, &candidates);
     BuildMediaDescription(video_content,
                           desc->GetTransportInfoByName(video_content->name),
-                          cricket::MEDIA_TYPE_VIDEO, &message);
+                          cricket::MEDIA_TYPE_VIDEO, candidates, message);
   }
 
   const ContentInfo* data_content = GetFirstDataContent(desc);
   if (data_content) {
+    candidates.clear();
+    GetCandidatesByMindex(jdesc, ++mline_index, &candidates);
     BuildMediaDescription(data_content,
                           desc->GetTransportInfoByName(data_content->name),
-                          cricket::MEDIA_TYPE_DATA, &message);
+                          cricket::MEDIA_TYPE_DATA, candidates, message);
   }
-
-
-  return message;
 }
 
 // Serializes the passed in IceCandidateInterface to a SDP string.
@@ -1089,8 +1097,7 @@ bool ParseExtmap(const std::string& line, RtpHeaderExtension* extmap,
   // RFC 5285
   // a=extmap:<value>["/"<direction>] <URI> <extensionattributes>
   std::vector<std::string> fields;
-  talk_base::split(line.substr(kLinePrefixLength),
-                   kSdpDelimiterSpace, &fields);
+  SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
   const size_t expected_min_fields = 2;
   if (fields.size() < expected_min_fields) {
     return ParseFailedExpectMinFieldNum(line, expected_min_fields, error);
@@ -1112,6 +1119,7 @@ bool ParseExtmap(const std::string& line, RtpHeaderExtension* extmap,
 void BuildMediaDescription(const ContentInfo* content_info,
                            const TransportInfo* transport_info,
                            const MediaType media_type,
+                           const std::vector<Candidate>& candidates,
                            std::string* message) {
   ASSERT(message != NULL);
   if (content_info == NULL || message == NULL) {
@@ -1184,13 +1192,15 @@ void BuildMediaDescription(const ContentInfo* content_info,
     fmt = " 0";
   }
 
-  // The port number in the m line will be updated later when associate with
-  // the candidates.
+  // The port number in the m line is the one of the default RTP candidate.
   // RFC 3264
   // To reject an offered stream, the port number in the corresponding stream in
   // the answer MUST be set to zero.
+  std::string rtp_port, rtp_ip;
+  GetDefaultDestination(candidates, ICE_CANDIDATE_COMPONENT_RTP,
+                        &rtp_port, &rtp_ip);
   const std::string port = content_info->rejected ?
-      kMediaPortRejected : kDefaultPort;
+      kMediaPortRejected : rtp_port;
 
   talk_base::SSLFingerprint* fp = (transport_info) ?
       transport_info->description.identity_fingerprint.get() : NULL;
@@ -1199,6 +1209,15 @@ void BuildMediaDescription(const ContentInfo* content_info,
   os << " " << port << " " << media_desc->protocol() << fmt;
   AddLine(os.str(), message);
 
+  const std::string& protocol = media_desc->protocol();
+  const bool is_rtp =
+      protocol.empty() ||
+      talk_base::starts_with(protocol.data(),
+                             cricket::kMediaProtocolRtpPrefix);
+  AddMediaDefaultDestination(candidates, is_rtp, rtp_ip, message);
+  // Build the a=candidate lines.
+  BuildCandidate(candidates, message);
+
   // Use the transport_info to build the media level ice-ufrag and ice-pwd.
   if (transport_info) {
     // RFC 5245
@@ -1373,13 +1392,10 @@ void BuildRtpContentAttributes(
       // a=ssrc:<ssrc-id> msid:identifier [appdata]
       // The appdata consists of the "id" attribute of a MediaStreamTrack, which
       // is corresponding to the "name" attribute of StreamParams.
-      std::string appdata = track->id;
-      std::ostringstream os;
-      InitAttrLine(kAttributeSsrc, &os);
-      os << kSdpDelimiterColon << ssrc << kSdpDelimiterSpace
-         << kSsrcAttributeMsid << kSdpDelimiterColon << track->sync_label
-         << kSdpDelimiterSpace << appdata;
-      AddLine(os.str(), message);
+      std::string msid = track->sync_label;
+      msid.push_back(kSdpDelimiterSpace);
+      msid.append(track->id);
+      AddSsrcLine(ssrc, kSsrcAttributeMsid, msid, message);
 
       // TODO(ronghuawu): Remove below code which is for backward compatibility.
       // draft-alvestrand-rtcweb-mid-01
@@ -1686,8 +1702,7 @@ bool ParseSessionDescription(const std::string& message, size_t* pos,
                                  std::string(), error);
   }
   std::vector<std::string> fields;
-  talk_base::split(line.substr(kLinePrefixLength),
-                   kSdpDelimiterSpace, &fields);
+  SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
   const size_t expected_fields = 6;
   if (fields.size() != expected_fields) {
     return ParseFailedExpectFieldNum(line, expected_fields, error);
@@ -1820,8 +1835,7 @@ bool ParseGroupAttribute(const std::string& line,
   // RFC 5888 and draft-holmberg-mmusic-sdp-bundle-negotiation-00
   // a=group:BUNDLE video voice
   std::vector<std::string> fields;
-  talk_base::split(line.substr(kLinePrefixLength),
-                   kSdpDelimiterSpace, &fields);
+  SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
   std::string semantics;
   if (!GetValue(fields[0], kAttributeGroup, &semantics, error)) {
     return false;
@@ -1844,8 +1858,7 @@ static bool ParseFingerprintAttribute(const std::string& line,
   }
 
   std::vector<std::string> fields;
-  talk_base::split(line.substr(kLinePrefixLength),
-                   kSdpDelimiterSpace, &fields);
+  SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
   const size_t expected_fields = 2;
   if (fields.size() != expected_fields) {
     return ParseFailedExpectFieldNum(line, expected_fields, error);
@@ -2007,8 +2020,7 @@ bool ParseMediaDescription(const std::string& message,
     ++mline_index;
 
     std::vector<std::string> fields;
-    talk_base::split(line.substr(kLinePrefixLength),
-                     kSdpDelimiterSpace, &fields);
+    SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
     const size_t expected_min_fields = 4;
     if (fields.size() < expected_min_fields) {
       return ParseFailedExpectMinFieldNum(line, expected_min_fields, error);
@@ -2551,11 +2563,17 @@ bool ParseSsrcAttribute(const std::string& line, SsrcInfoVec* ssrc_infos,
   }
 
   // Check if there's already an item for this |ssrc_id|. Create a new one if
-  // there isn't.
-  SsrcInfoVec::iterator ssrc_info = ssrc_infos->begin();
-  for (; ssrc_info != ssrc_infos->end(); ++ssrc_info) {
-    if (ssrc_info->ssrc_id == ssrc_id) {
-      break;
+  // there isn't. The attributes of an ssrc are normally on consecutive lines,
+  // so try the last item before searching the others.
+  SsrcInfoVec::iterator ssrc_info = ssrc_infos->end();
+  if (!ssrc_infos->empty() && ssrc_infos->back().ssrc_id == ssrc_id) {
+    --ssrc_info;
+  } else {
+    for (ssrc_info = ssrc_infos->begin(); ssrc_info != ssrc_infos->end();
+         ++ssrc_info) {
+      if (ssrc_info->ssrc_id == ssrc_id) {
+        break;
+      }
     }
   }
   if (ssrc_info == ssrc_infos->end()) {
@@ -2603,8 +2621,7 @@ bool ParseSsrcGroupAttribute(const std::string& line,
   // RFC 5576
   // a=ssrc-group:<semantics> <ssrc-id> ...
   std::vector<std::string> fields;
-  talk_base::split(line.substr(kLinePrefixLength),
-                   kSdpDelimiterSpace, &fields);
+  SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
   const size_t expected_min_fields = 2;
   if (fields.size() < expected_min_fields) {
     return ParseFailedExpectMinFieldNum(line, expected_min_fields, error);
@@ -2626,8 +2643,7 @@ bool ParseCryptoAttribute(const std::string& line,
                           MediaContentDescription* media_desc,
                           SdpParseError* error) {
   std::vector<std::string> fields;
-  talk_base::split(line.substr(kLinePrefixLength),
-                   kSdpDelimiterSpace, &fields);
+  SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
   // RFC 4568
   // a=crypto:<tag> <crypto-suite> <key-params> [<session-params>]
   const size_t expected_min_fields = 3;
@@ -2690,8 +2706,7 @@ bool ParseRtpmapAttribute(const std::string& line,
                           MediaContentDescription* media_desc,
                           SdpParseError* error) {
   std::vector<std::string> fields;
-  talk_base::split(line.substr(kLinePrefixLength),
-                   kSdpDelimiterSpace, &fields);
+  SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
   // RFC 4566
   // a=rtpmap:<payload type> <encoding name>/<clock rate>[/<encodingparameters>]
   const size_t expected_min_fields = 2;
@@ -2799,8 +2814,7 @@ bool ParseFmtpAttributes(const std::string& line, const MediaType media_type,
     return true;
   }
   std::vector<std::string> fields;
-  talk_base::split(line.substr(kLinePrefixLength),
-                   kSdpDelimiterSpace, &fields);
+  SplitLine(line, kLinePrefixLength, kSdpDelimiterSpace, &fields);
 
   // RFC 5576
   // a=fmtp:<format> <format specific parameters>
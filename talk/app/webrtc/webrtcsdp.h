@@ -53,6 +53,11 @@ struct SdpParseError;
 // return - SDP string serialized from the arguments.
 std::string SdpSerialize(const JsepSessionDescription& jdesc);
 
+// Same as above, but serializes into |message|, replacing its contents. The
+// storage of |message| is reused, which saves reallocating it when the same
+// string is used for serializing repeatedly.
+void SdpSerialize(const JsepSessionDescription& jdesc, std::string* message);
+
 // Serializes the passed in IceCandidateInterface to a SDP string.
 // candidate - The candidate to be serialized.
 std::string SdpSerializeCandidate(const IceCandidateInterface& candidate);
@@ -38,6 +38,7 @@
 #include "talk/base/sslfingerprint.h"
 #include "talk/base/stringencode.h"
 #include "talk/base/stringutils.h"
+#include "talk/base/timeutils.h"
 #include "talk/media/base/constants.h"
 #include "talk/p2p/base/constants.h"
 #include "talk/session/media/mediasession.h"
@@ -370,6 +371,50 @@ static bool SdpDeserializeCandidate(const std::string& message,
   return webrtc::SdpDeserializeCandidate(message, candidate, NULL);
 }
 
+// Builds an SDP with |sections| m-lines, alternating audio and video, each
+// with two candidates and |streams| single-ssrc tracks.
+static std::string MakeMultiStreamSdp(int sections, int streams) {
+  std::string sdp =
+      "v=0\r\n"
+      "o=- 18446744069414584320 18446462598732840960 IN IP4 127.0.0.1\r\n"
+      "s=-\r\n"
+      "t=0 0\r\n"
+      "a=msid-semantic: WMS local_stream_1\r\n";
+  for (int i = 0; i < sections; ++i) {
+    const bool audio = (i % 2 == 0);
+    sdp.append(audio ? "m=audio 2345 RTP/SAVPF 111 103 104\r\n" :
+                       "m=video 3457 RTP/SAVPF 120\r\n");
+    sdp.append(
+        "c=IN IP4 74.125.127.126\r\n"
+        "a=rtcp:2347 IN IP4 74.125.127.126\r\n"
+        "a=candidate:a0+B/1 1 udp 2130706432 192.168.1.5 1234 typ host "
+        "generation 2\r\n"
+        "a=candidate:a0+B/3 1 udp 2130706432 74.125.127.126 2345 typ srflx "
+        "raddr 192.168.1.5 rport 2346 generation 2\r\n"
+        "a=ice-ufrag:ufrag_voice\r\na=ice-pwd:pwd_voice\r\n");
+    sdp.append("a=mid:content_" + talk_base::ToString<int>(i) + "\r\n");
+    sdp.append(
+        "a=sendrecv\r\n"
+        "a=rtcp-mux\r\n"
+        "a=crypto:1 AES_CM_128_HMAC_SHA1_32 "
+        "inline:NzB4d1BINUAvLEw6UzF3WSJ+PSdFcGdUJShpX1Zj|2^20|1:32\r\n");
+    sdp.append(audio ? "a=rtpmap:111 opus/48000/2\r\n"
+                       "a=rtpmap:103 ISAC/16000\r\n"
+                       "a=rtpmap:104 CELT/32000/2\r\n" :
+                       "a=rtpmap:120 VP8/90000\r\n");
+    for (int j = 0; j < streams; ++j) {
+      const std::string ssrc = talk_base::ToString<int>(i * streams + j + 1);
+      const std::string track = (audio ? "audio_track_" : "video_track_") +
+          ssrc;
+      sdp.append("a=ssrc:" + ssrc + " cname:stream_1_cname\r\n");
+      sdp.append("a=ssrc:" + ssrc + " msid:local_stream_1 " + track + "\r\n");
+      sdp.append("a=ssrc:" + ssrc + " mslabel:local_stream_1\r\n");
+      sdp.append("a=ssrc:" + ssrc + " label:" + track + "\r\n");
+    }
+  }
+  return sdp;
+}
+
 // Add some extra |newlines| to the |message| after |line|.
 static void InjectAfter(const std::string& line,
                         const std::string& newlines,
@@ -1959,3 +2004,47 @@ TEST_F(WebRtcSdpTest, RoundTripSdpWithSctpDataChannelsWithCandidates) {
   EXPECT_TRUE(SdpDeserialize(sdp_with_data, &jdesc_output));
   EXPECT_EQ(sdp_with_data, webrtc::SdpSerialize(jdesc_output));
 }
+
+// Measures parsing and serializing an SDP with dozens of m-lines and
+// hundreds of ssrcs. The serializer writes only the first audio and video
+// m-lines, so the serialized SDP is smaller than the parsed one.
+TEST_F(WebRtcSdpTest, ParseAndSerializeMultiStreamSdpPerf) {
+  const int kSections = 24;
+  const int kStreams = 16;
+  const int kIterations = 200;
+  const std::string sdp = MakeMultiStreamSdp(kSections, kStreams);
+
+  uint64 parse_ns = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    JsepSessionDescription jdesc(kDummyString);
+    uint64 start = talk_base::TimeNanos();
+    ASSERT_TRUE(SdpDeserialize(sdp, &jdesc));
+    parse_ns += talk_base::TimeNanos() - start;
+  }
+
+  JsepSessionDescription jdesc(kDummyString);
+  ASSERT_TRUE(SdpDeserialize(sdp, &jdesc));
+  ASSERT_EQ(static_cast<size_t>(kSections),
+            jdesc.description()->contents().size());
+  const cricket::MediaContentDescription* video =
+      static_cast<const cricket::MediaContentDescription*>(
+          jdesc.description()->contents()[1].description);
+  EXPECT_EQ(static_cast<size_t>(kStreams), video->streams().size());
+
+  std::string message;
+  uint64 serialize_ns = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    uint64 start = talk_base::TimeNanos();
+    webrtc::SdpSerialize(jdesc, &message);
+    serialize_ns += talk_base::TimeNanos() - start;
+  }
+  // The serialized SDP parses back to the same first two m-lines.
+  JsepSessionDescription jdesc_output(kDummyString);
+  EXPECT_TRUE(SdpDeserialize(message, &jdesc_output));
+  EXPECT_EQ(message, webrtc::SdpSerialize(jdesc_output));
+
+  LOG(LS_INFO) << "Parsed " << sdp.size() << " bytes in "
+               << parse_ns / kIterations / 1000 << " us, serialized "
+               << message.size() << " bytes in "
+               << serialize_ns / kIterations / 1000 << " us";
+}
@@ -0,0 +1,285 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/base/asynclogger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include "talk/base/common.h"
+
+namespace talk_base {
+
+const int AsyncLogger::kDefaultRingSize;
+const int AsyncLogger::kWriteIntervalMs;
+const int AsyncLogger::kMaxRings;
+
+// A single-producer, single-consumer ring of records. Each record is a
+// RecordHeader followed by the message, padded to a multiple of 4 bytes. One
+// byte is always left free, so that a full ring can be told from an empty one.
+struct AsyncLogger::Ring {
+  explicit Ring(int size)
+      : buffer(new char[size]), size(size), read(0), write(0), in_use(1),
+        next(NULL) {
+  }
+
+  // Copies |length| bytes in at or out from |pos|, wrapping around the end.
+  void CopyIn(int pos, const void* data, int length) {
+    int first = std::min(length, size - pos);
+    memcpy(buffer.get() + pos, data, first);
+    memcpy(buffer.get(), static_cast<const char*>(data) + first,
+           length - first);
+  }
+  void CopyOut(int pos, void* data, int length) const {
+    int first = std::min(length, size - pos);
+    memcpy(data, buffer.get() + pos, first);
+    memcpy(static_cast<char*>(data) + first, buffer.get(), length - first);
+  }
+
+  scoped_array<char> buffer;
+  int size;
+  // Advanced by the writer and by the owning thread respectively.
+  volatile int read;
+  volatile int write;
+  // Whether a thread owns the ring.
+  int in_use;
+  // Rings are never unlinked until the logger goes away.
+  Ring* next;
+};
+
+namespace {
+
+struct RecordHeader {
+  int length;
+  int severity;
+  int sequence;
+};
+
+int RecordSize(int length) {
+  return static_cast<int>(sizeof(RecordHeader)) + ((length + 3) & ~3);
+}
+
+}  // namespace
+
+AsyncLogger::AsyncLogger(int ring_size)
+    : ring_size_(ring_size), rings_(NULL), ring_count_(0), sequence_(0),
+      dropped_(0),
+      reported_dropped_(0), wake_(false, false) {
+#if defined(WIN32)
+  // Unlike TLS, FLS calls back when a thread exits.
+  key_ = FlsAlloc(&AsyncLogger::ReleaseRing);
+#elif defined(POSIX)
+  pthread_key_create(&key_, &AsyncLogger::ReleaseRing);
+#endif
+}
+
+AsyncLogger::~AsyncLogger() {
+  Stop();
+#if defined(WIN32)
+  FlsFree(key_);
+#elif defined(POSIX)
+  pthread_key_delete(key_);
+#endif
+  Ring* ring = rings_;
+  while (ring) {
+    Ring* next = ring->next;
+    delete ring;
+    ring = next;
+  }
+}
+
+void AsyncLogger::Start() {
+  if (writer_) {
+    return;
+  }
+  writer_.reset(new Thread());
+  writer_->Start(this);
+}
+
+void AsyncLogger::Stop() {
+  if (!writer_) {
+    return;
+  }
+  writer_->Quit();
+  wake_.Set();
+  writer_->Stop();
+  writer_.reset();
+  Flush();
+}
+
+bool AsyncLogger::Log(LoggingSeverity sev, const std::string& str) {
+  Ring* ring = GetRing();
+  if (!ring) {
+    AtomicOps::Increment(&dropped_);
+    return false;
+  }
+  int length = static_cast<int>(str.size());
+  int record_size = RecordSize(length);
+  int used = (ring->write - AtomicOps::AcquireLoad(&ring->read) +
+              ring->size) % ring->size;
+  if (record_size > ring->size - 1 - used) {
+    AtomicOps::Increment(&dropped_);
+    return false;
+  }
+
+  RecordHeader header;
+  header.length = length;
+  header.severity = sev;
+  header.sequence = AtomicOps::Increment(&sequence_);
+  int pos = ring->write;
+  ring->CopyIn(pos, &header, sizeof(header));
+  pos = (pos + static_cast<int>(sizeof(header))) % ring->size;
+  ring->CopyIn(pos, str.data(), length);
+  AtomicOps::ReleaseStore(&ring->write,
+                          (ring->write + record_size) % ring->size);
+
+  // Get the writer going if the ring is more than half full.
+  int half = ring->size / 2;
+  if (used <= half && used + record_size > half) {
+    wake_.Set();
+  }
+  return true;
+}
+
+void AsyncLogger::Flush() {
+  CritScope cs(&flush_crit_);
+  for (Ring* ring = AtomicOps::AcquireLoadPtr(&rings_); ring;
+       ring = ring->next) {
+    int read = ring->read;
+    int write = AtomicOps::AcquireLoad(&ring->write);
+    while (read != write) {
+      RecordHeader header;
+      ring->CopyOut(read, &header, sizeof(header));
+      records_.push_back(Record());
+      Record& record = records_.back();
+      record.sequence = header.sequence;
+      record.severity = static_cast<LoggingSeverity>(header.severity);
+      record.str.resize(header.length);
+      if (header.length > 0) {
+        ring->CopyOut((read + static_cast<int>(sizeof(header))) % ring->size,
+                      &record.str[0], header.length);
+      }
+      read = (read + RecordSize(header.length)) % ring->size;
+    }
+    AtomicOps::ReleaseStore(&ring->read, read);
+  }
+
+  // Within a ring the records are in order already, so merge the rings.
+  std::stable_sort(records_.begin(), records_.end(), RecordOrder());
+  for (size_t i = 0; i < records_.size(); ++i) {
+    LogMessage::OutputToStreams(records_[i].str, records_[i].severity);
+  }
+  records_.clear();
+
+  int dropped = dropped_count();
+  if (dropped != reported_dropped_) {
+    std::ostringstream ss;
+    ss << "Dropped " << dropped - reported_dropped_
+       << " log messages, the log buffer was full." << std::endl;
+    LogMessage::OutputToStreams(ss.str(), LS_WARNING);
+    reported_dropped_ = dropped;
+  }
+}
+
+int AsyncLogger::dropped_count() const {
+  return AtomicOps::AcquireLoad(&dropped_);
+}
+
+void AsyncLogger::Run(Thread* thread) {
+  while (!thread->IsQuitting()) {
+    wake_.Wait(kWriteIntervalMs);
+    Flush();
+  }
+}
+
+AsyncLogger::Ring* AsyncLogger::GetRing() {
+#if defined(WIN32)
+  Ring* ring = static_cast<Ring*>(FlsGetValue(key_));
+#elif defined(POSIX)
+  Ring* ring = static_cast<Ring*>(pthread_getspecific(key_));
+#endif
+  if (ring) {
+    return ring;
+  }
+
+  // Take over the ring of a thread that has exited, if the writer has emptied
+  // it. Only when there are too many rings already share one that still has
+  // messages in it; failing that, the messages of this thread are dropped
+  // until a ring frees up.
+  ring = ClaimRing(true);
+  if (!ring) {
+    if (AtomicOps::Increment(&ring_count_) <= kMaxRings) {
+      ring = new Ring(ring_size_);
+      Ring* head;
+      do {
+        head = AtomicOps::AcquireLoadPtr(&rings_);
+        ring->next = head;
+      } while (AtomicOps::CompareAndSwapPtr(&rings_, head, ring) != head);
+    } else {
+      AtomicOps::Decrement(&ring_count_);
+      ring = ClaimRing(false);
+    }
+  }
+  if (!ring) {
+    return NULL;
+  }
+#if defined(WIN32)
+  FlsSetValue(key_, ring);
+#elif defined(POSIX)
+  pthread_setspecific(key_, ring);
+#endif
+  return ring;
+}
+
+AsyncLogger::Ring* AsyncLogger::ClaimRing(bool empty_only) {
+  for (Ring* ring = AtomicOps::AcquireLoadPtr(&rings_); ring;
+       ring = ring->next) {
+    if (empty_only &&
+        AtomicOps::AcquireLoad(&ring->read) !=
+        AtomicOps::AcquireLoad(&ring->write)) {
+      continue;
+    }
+    if (AtomicOps::CompareAndSwap(&ring->in_use, 0, 1) == 0) {
+      return ring;
+    }
+  }
+  return NULL;
+}
+
+#if defined(WIN32)
+void WINAPI AsyncLogger::ReleaseRing(void* ring) {
+#elif defined(POSIX)
+void AsyncLogger::ReleaseRing(void* ring) {
+#endif
+  if (ring) {
+    AtomicOps::ReleaseStore(&static_cast<Ring*>(ring)->in_use, 0);
+  }
+}
+
+}  // namespace talk_base
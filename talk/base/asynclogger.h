@@ -0,0 +1,136 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TALK_BASE_ASYNCLOGGER_H_
+#define TALK_BASE_ASYNCLOGGER_H_
+
+#if defined(POSIX)
+#include <pthread.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/criticalsection.h"
+#include "talk/base/event.h"
+#include "talk/base/logging.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/thread.h"
+
+namespace talk_base {
+
+// Writes log messages to the LogMessage streams from a background thread, so
+// that the threads that log neither wait for each other nor for the streams.
+//
+// Each thread that logs appends its messages to a ring buffer of its own,
+// without locking. The writer thread takes the messages out of all the rings
+// every few milliseconds, or sooner when one of them fills up, puts them back
+// in the order they were logged in and writes them out. A message that does
+// not fit into its thread's ring is dropped and counted, so a slow stream
+// costs at most one ring per thread of memory instead of blocking threads.
+//
+// The ring of a thread that exits is reused by a thread that starts logging
+// later. There are at most kMaxRings rings; threads that find none free drop
+// their messages.
+class AsyncLogger : public Runnable {
+ public:
+  static const int kDefaultRingSize = 64 * 1024;
+  static const int kMaxRings = 256;
+
+  explicit AsyncLogger(int ring_size);
+  // Stops the writer thread. No thread may log through the logger anymore.
+  virtual ~AsyncLogger();
+
+  void Start();
+  // Stops the writer thread, and writes out the messages still queued.
+  void Stop();
+  bool running() const { return writer_.get() != NULL; }
+
+  // Queues a formatted message. Returns false if it was dropped.
+  bool Log(LoggingSeverity sev, const std::string& str);
+  // Writes out the messages queued so far, on the calling thread.
+  void Flush();
+  // The number of messages dropped because a ring was full.
+  int dropped_count() const;
+
+  // From Runnable.
+  virtual void Run(Thread* thread);
+
+ private:
+  struct Ring;
+  struct Record {
+    int sequence;
+    LoggingSeverity severity;
+    std::string str;
+  };
+  struct RecordOrder {
+    bool operator()(const Record& a, const Record& b) const {
+      // Sequence numbers may wrap around.
+      return static_cast<int>(static_cast<uint32>(a.sequence) -
+                              static_cast<uint32>(b.sequence)) < 0;
+    }
+  };
+
+  static const int kWriteIntervalMs = 10;
+
+  // Returns the ring of the calling thread, or NULL if there is none to spare.
+  Ring* GetRing();
+  // Takes a ring that no thread owns, if there is one.
+  Ring* ClaimRing(bool empty_only);
+  // Hands the ring of an exiting thread back.
+#if defined(WIN32)
+  static void WINAPI ReleaseRing(void* ring);
+#elif defined(POSIX)
+  static void ReleaseRing(void* ring);
+#endif
+
+  int ring_size_;
+  Ring* volatile rings_;
+  int ring_count_;
+  int sequence_;
+  int dropped_;
+  int reported_dropped_;
+#if defined(WIN32)
+  DWORD key_;
+#elif defined(POSIX)
+  pthread_key_t key_;
+#endif
+  Event wake_;
+  scoped_ptr<Thread> writer_;
+  // Taken by whoever writes out the queued messages.
+  CriticalSection flush_crit_;
+  std::vector<Record> records_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncLogger);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_ASYNCLOGGER_H_
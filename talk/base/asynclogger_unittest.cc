@@ -0,0 +1,122 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string>
+
+#include "talk/base/asynclogger.h"
+#include "talk/base/gunit.h"
+#include "talk/base/logging.h"
+#include "talk/base/stream.h"
+#include "talk/base/thread.h"
+
+namespace talk_base {
+
+TEST(AsyncLoggerTest, DropsWhenRingIsFull) {
+  std::string str;
+  StringStream stream(str);
+  LogMessage::AddLogToStream(&stream, LS_INFO);
+
+  // Each message takes 12 bytes of header and 52 bytes of text, so three of
+  // them fit into 256 bytes but four don't.
+  AsyncLogger logger(256);
+  std::string message(50, 'X');
+  message += "\n";
+  EXPECT_TRUE(logger.Log(LS_INFO, message + "1"));
+  EXPECT_TRUE(logger.Log(LS_INFO, message + "2"));
+  EXPECT_TRUE(logger.Log(LS_INFO, message + "3"));
+  EXPECT_FALSE(logger.Log(LS_INFO, message + "4"));
+  EXPECT_EQ(1, logger.dropped_count());
+  EXPECT_TRUE(str.empty());
+
+  logger.Flush();
+  EXPECT_EQ(message + "1" + message + "2" + message + "3",
+            str.substr(0, 3 * (message.size() + 1)));
+  EXPECT_NE(std::string::npos, str.find("Dropped 1 log messages"));
+
+  // Flushing made room again, also across the end of the ring.
+  str.clear();
+  EXPECT_TRUE(logger.Log(LS_INFO, message + "5"));
+  EXPECT_TRUE(logger.Log(LS_VERBOSE, message + "6"));
+  logger.Flush();
+  EXPECT_EQ(message + "5", str);
+
+  LogMessage::RemoveLogToStream(&stream);
+}
+
+TEST(AsyncLoggerTest, WriterThread) {
+  std::string str;
+  StringStream stream(str);
+  LogMessage::AddLogToStream(&stream, LS_INFO);
+
+  AsyncLogger logger(AsyncLogger::kDefaultRingSize);
+  logger.Start();
+  EXPECT_TRUE(logger.running());
+  EXPECT_TRUE(logger.Log(LS_INFO, "message\n"));
+  // Stopping writes out what is left.
+  logger.Stop();
+  EXPECT_FALSE(logger.running());
+  EXPECT_EQ("message\n", str);
+
+  LogMessage::RemoveLogToStream(&stream);
+}
+
+class LoggingHandler : public MessageHandler {
+ public:
+  explicit LoggingHandler(AsyncLogger* logger) : logger_(logger) {}
+  virtual void OnMessage(Message* msg) {
+    logger_->Log(LS_INFO, "message\n");
+  }
+
+ private:
+  AsyncLogger* logger_;
+};
+
+// The rings of threads that have exited are handed to new threads, so more
+// than kMaxRings threads can log one after another.
+TEST(AsyncLoggerTest, ReusesRingsOfExitedThreads) {
+  std::string str;
+  StringStream stream(str);
+  LogMessage::AddLogToStream(&stream, LS_INFO);
+
+  AsyncLogger logger(1024);
+  LoggingHandler handler(&logger);
+  for (int i = 0; i < AsyncLogger::kMaxRings + 10; ++i) {
+    Thread thread;
+    thread.Start();
+    thread.Send(&handler);
+    thread.Stop();
+  }
+  EXPECT_EQ(0, logger.dropped_count());
+  logger.Flush();
+  EXPECT_EQ(static_cast<size_t>(AsyncLogger::kMaxRings + 10) * 8,
+            str.size());
+
+  LogMessage::RemoveLogToStream(&stream);
+}
+
+}  // namespace talk_base
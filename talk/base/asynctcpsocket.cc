@@ -72,7 +72,8 @@ AsyncTCPSocketBase::AsyncTCPSocketBase(AsyncSocket* socket, bool listen,
       insize_(max_packet_size),
       inpos_(0),
       outsize_(max_packet_size),
-      outpos_(0) {
+      outhead_(0),
+      outlen_(0) {
   inbuf_ = new char[insize_];
   outbuf_ = new char[outsize_];
 
@@ -152,38 +153,103 @@ int AsyncTCPSocketBase::SendTo(const void *pv, size_t cb,
 }
 
 int AsyncTCPSocketBase::SendRaw(const void * pv, size_t cb) {
-  if (outpos_ + cb > outsize_) {
-    socket_->SetError(EMSGSIZE);
+  Socket::IoVec iov = { pv, cb };
+  return SendPacket(&iov, 1);
+}
+
+int AsyncTCPSocketBase::SendPacket(const Socket::IoVec* iov, int count) {
+  size_t cb = 0;
+  for (int i = 0; i < count; ++i)
+    cb += iov[i].length;
+
+  // A framed packet that doesn't fit the output ring could not be queued
+  // after a partial write.
+  if (cb > outsize_) {
+    SetError(EMSGSIZE);
     return -1;
   }
 
-  memcpy(outbuf_ + outpos_, pv, cb);
-  outpos_ += cb;
-
-  return FlushOutBuffer();
-}
+  if (outlen_ > 0) {
+    FlushOutBuffer();
+  }
+  if (outlen_ > 0) {
+    // Keep the byte stream in order behind what's still queued. If that
+    // doesn't leave room for the packet, reject it; SignalReadyToSend fires
+    // once the ring has drained.
+    if (outlen_ + cb > outsize_) {
+      SetError(EWOULDBLOCK);
+      return -1;
+    }
+    for (int i = 0; i < count; ++i)
+      AppendToOutBuffer(iov[i].data, iov[i].length);
+    return static_cast<int>(cb);
+  }
 
-int AsyncTCPSocketBase::FlushOutBuffer() {
-  int res = socket_->Send(outbuf_, outpos_);
+  int res = socket_->SendV(iov, count);
   if (res <= 0) {
+    // Drop the packet if we made no progress.
     return res;
   }
-  if (static_cast<size_t>(res) <= outpos_) {
-    outpos_ -= res;
-  } else {
-    ASSERT(false);
-    return -1;
+
+  // Queue whatever the socket didn't take; a partial packet can't be
+  // dropped without corrupting the stream.
+  size_t skip = static_cast<size_t>(res);
+  for (int i = 0; i < count; ++i) {
+    if (skip >= iov[i].length) {
+      skip -= iov[i].length;
+      continue;
+    }
+    AppendToOutBuffer(static_cast<const char*>(iov[i].data) + skip,
+                      iov[i].length - skip);
+    skip = 0;
   }
-  if (outpos_ > 0) {
-    memmove(outbuf_, outbuf_ + res, outpos_);
+  FlushOutBuffer();
+
+  // We claim to have sent the whole thing, even if we only sent partial
+  return static_cast<int>(cb);
+}
+
+int AsyncTCPSocketBase::FlushOutBuffer() {
+  // Keep writing until the ring is empty or the socket would block. Only a
+  // blocked write arms the write event that brings us back here, so
+  // stopping after a partial write could leave data stuck in the ring.
+  int total = 0;
+  while (outlen_ > 0) {
+    // The queued bytes are at most two runs: up to the end of the ring, and
+    // from its start.
+    Socket::IoVec iov[2];
+    int count = 1;
+    size_t first = _min(outlen_, outsize_ - outhead_);
+    iov[0].data = outbuf_ + outhead_;
+    iov[0].length = first;
+    if (first < outlen_) {
+      iov[1].data = outbuf_;
+      iov[1].length = outlen_ - first;
+      count = 2;
+    }
+
+    int res = socket_->SendV(iov, count);
+    if (res <= 0) {
+      return (total > 0) ? total : res;
+    }
+    if (static_cast<size_t>(res) > outlen_) {
+      ASSERT(false);
+      return -1;
+    }
+    outlen_ -= res;
+    outhead_ = (outlen_ > 0) ? (outhead_ + res) % outsize_ : 0;
+    total += res;
   }
-  return res;
+  return total;
 }
 
 void AsyncTCPSocketBase::AppendToOutBuffer(const void* pv, size_t cb) {
-  ASSERT(outpos_ + cb < outsize_);
-  memcpy(outbuf_ + outpos_, pv, cb);
-  outpos_ += cb;
+  ASSERT(outlen_ + cb <= outsize_);
+  size_t tail = (outhead_ + outlen_) % outsize_;
+  size_t first = _min(cb, outsize_ - tail);
+  memcpy(outbuf_ + tail, pv, first);
+  memcpy(outbuf_, static_cast<const char*>(pv) + first, cb - first);
+  outlen_ += cb;
 }
 
 void AsyncTCPSocketBase::OnConnectEvent(AsyncSocket* socket) {
@@ -232,11 +298,11 @@ void AsyncTCPSocketBase::OnReadEvent(AsyncSocket* socket) {
 void AsyncTCPSocketBase::OnWriteEvent(AsyncSocket* socket) {
   ASSERT(socket_.get() == socket);
 
-  if (outpos_ > 0) {
+  if (outlen_ > 0) {
     FlushOutBuffer();
   }
 
-  if (outpos_ == 0) {
+  if (outlen_ == 0) {
     SignalReadyToSend(this);
   }
 }
@@ -267,42 +333,34 @@ int AsyncTCPSocket::Send(const void *pv, size_t cb) {
     return -1;
   }
 
-  // If we are blocking on send, then silently drop this packet
-  if (!IsOutBufferEmpty())
-    return static_cast<int>(cb);
-
+  // Write the length prefix and the packet together, without copying.
   PacketLength pkt_len = HostToNetwork16(static_cast<PacketLength>(cb));
-  AppendToOutBuffer(&pkt_len, kPacketLenSize);
-  AppendToOutBuffer(pv, cb);
-
-  int res = FlushOutBuffer();
+  Socket::IoVec iov[2] = { { &pkt_len, kPacketLenSize }, { pv, cb } };
+  int res = SendPacket(iov, 2);
   if (res <= 0) {
-    // drop packet if we made no progress
-    ClearOutBuffer();
     return res;
   }
-
-  // We claim to have sent the whole thing, even if we only sent partial
   return static_cast<int>(cb);
 }
 
 void AsyncTCPSocket::ProcessInput(char * data, size_t* len) {
   SocketAddress remote_addr(GetRemoteAddress());
 
-  while (true) {
-    if (*len < kPacketLenSize)
-      return;
+  // Deliver every complete packet in place, then move the incomplete one
+  // that may be left to the front of the buffer once.
+  size_t pos = 0;
+  while (*len - pos >= kPacketLenSize) {
+    PacketLength pkt_len = talk_base::GetBE16(data + pos);
+    if (*len - pos < kPacketLenSize + pkt_len)
+      break;
 
-    PacketLength pkt_len = talk_base::GetBE16(data);
-    if (*len < kPacketLenSize + pkt_len)
-      return;
-
-    SignalReadPacket(this, data + kPacketLenSize, pkt_len, remote_addr);
+    SignalReadPacket(this, data + pos + kPacketLenSize, pkt_len, remote_addr);
+    pos += kPacketLenSize + pkt_len;
+  }
 
-    *len -= kPacketLenSize + pkt_len;
-    if (*len > 0) {
-      memmove(data, data + kPacketLenSize + pkt_len, *len);
-    }
+  *len -= pos;
+  if (pos > 0 && *len > 0) {
+    memmove(data, data + pos, *len);
   }
 }
 
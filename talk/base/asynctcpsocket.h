@@ -35,8 +35,10 @@
 namespace talk_base {
 
 // Simulates UDP semantics over TCP.  Send and Recv packet sizes
-// are preserved, and drops packets silently on Send, rather than
-// buffer them in user space.
+// are preserved. Packets are written straight from the caller's buffer;
+// only what the kernel doesn't take is copied into a bounded output ring,
+// and packets that don't fit in it are dropped silently, rather than
+// buffered without limit in user space.
 class AsyncTCPSocketBase : public AsyncPacketSocket {
  public:
   AsyncTCPSocketBase(AsyncSocket* socket, bool listen, size_t max_packet_size);
@@ -67,13 +69,15 @@ class AsyncTCPSocketBase : public AsyncPacketSocket {
                                     const SocketAddress& bind_address,
                                     const SocketAddress& remote_address);
   virtual int SendRaw(const void* pv, size_t cb);
+  // Sends one packet made of the |count| buffers in |iov|. If the output
+  // ring is empty they are written directly and only the unsent remainder
+  // is queued; otherwise the whole packet is queued behind what's pending,
+  // or dropped if it doesn't fit. Returns the packet length, or the socket
+  // error if nothing at all could be written.
+  int SendPacket(const Socket::IoVec* iov, int count);
   int FlushOutBuffer();
-  // Add data to |outbuf_|.
-  void AppendToOutBuffer(const void* pv, size_t cb);
 
-  // Helper methods for |outpos_|.
-  bool IsOutBufferEmpty() const { return outpos_ == 0; }
-  void ClearOutBuffer() { outpos_ = 0; }
+  bool IsOutBufferEmpty() const { return outlen_ == 0; }
 
  private:
   // Called by the underlying socket
@@ -82,10 +86,16 @@ class AsyncTCPSocketBase : public AsyncPacketSocket {
   void OnWriteEvent(AsyncSocket* socket);
   void OnCloseEvent(AsyncSocket* socket, int error);
 
+  // Copies |cb| bytes to the tail of the output ring.
+  void AppendToOutBuffer(const void* pv, size_t cb);
+
   scoped_ptr<AsyncSocket> socket_;
   bool listen_;
   char* inbuf_, * outbuf_;
-  size_t insize_, inpos_, outsize_, outpos_;
+  size_t insize_, inpos_;
+  // |outbuf_| is a ring of |outsize_| bytes holding |outlen_| bytes that
+  // start at |outhead_|.
+  size_t outsize_, outhead_, outlen_;
 
   DISALLOW_EVIL_CONSTRUCTORS(AsyncTCPSocketBase);
 };
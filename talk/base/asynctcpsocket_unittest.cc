@@ -26,11 +26,16 @@
  */
 
 #include <string>
+#include <vector>
 
 #include "talk/base/asynctcpsocket.h"
+#include "talk/base/byteorder.h"
 #include "talk/base/gunit.h"
+#include "talk/base/logging.h"
 #include "talk/base/physicalsocketserver.h"
 #include "talk/base/scoped_ptr.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/base/virtualsocketserver.h"
 
 namespace talk_base {
@@ -67,4 +72,164 @@ TEST_F(AsyncTCPSocketTest, OnWriteEvent) {
   EXPECT_TRUE(ready_to_send_);
 }
 
+// Tests the output queue over real sockets, where the kernel takes partial
+// writes once the connection's buffers fill up.
+class AsyncTCPSocketLoopbackTest
+    : public testing::Test,
+      public sigslot::has_slots<> {
+ public:
+  AsyncTCPSocketLoopbackTest()
+      : scope_(&pss_), received_bytes_(0), last_received_(0),
+        ready_to_send_(false) {}
+
+  virtual void SetUp() {
+    AsyncSocket* listen_socket = pss_.CreateAsyncSocket(SOCK_STREAM);
+    ASSERT_EQ(0, listen_socket->Bind(kLoopback));
+    server_.reset(new AsyncTCPSocket(listen_socket, true));
+    server_->SignalNewConnection.connect(
+        this, &AsyncTCPSocketLoopbackTest::OnNewConnection);
+    client_.reset(AsyncTCPSocket::Create(pss_.CreateAsyncSocket(SOCK_STREAM),
+                                         kLoopback,
+                                         server_->GetLocalAddress()));
+    ASSERT_TRUE(client_.get() != NULL);
+    client_->SignalReadyToSend.connect(
+        this, &AsyncTCPSocketLoopbackTest::OnReadyToSend);
+    EXPECT_TRUE_WAIT(accepted_.get() != NULL &&
+                     client_->GetState() == AsyncPacketSocket::STATE_CONNECTED,
+                     1000);
+  }
+
+  void OnNewConnection(AsyncPacketSocket* server,
+                       AsyncPacketSocket* new_socket) {
+    accepted_.reset(new_socket);
+    accepted_->SignalReadPacket.connect(
+        this, &AsyncTCPSocketLoopbackTest::OnReadPacket);
+  }
+
+  // Packets carry their sequence number followed by a filler derived from
+  // it, so that corruption of the byte stream is caught.
+  static std::string MakePacket(uint32 seq, size_t size) {
+    std::string packet(size, static_cast<char>(seq));
+    SetBE32(&packet[0], seq);
+    return packet;
+  }
+
+  void OnReadPacket(AsyncPacketSocket* socket, const char* data, size_t size,
+                    const SocketAddress& remote_addr) {
+    uint32 seq = GetBE32(data);
+    EXPECT_EQ(MakePacket(seq, size), std::string(data, size));
+    sequence_numbers_.push_back(seq);
+    received_bytes_ += size;
+    last_received_ = Time();
+  }
+
+  void OnReadyToSend(AsyncPacketSocket* socket) {
+    ready_to_send_ = true;
+  }
+
+  // Sends packets |first|, |first| + 1, ... until one is rejected, and
+  // returns the sequence numbers of the ones that were accepted.
+  std::vector<uint32> SendUntilBlocked(uint32 first, size_t size) {
+    std::vector<uint32> sent;
+    for (uint32 seq = first; ; ++seq) {
+      std::string packet = MakePacket(seq, size);
+      int res = client_->Send(packet.data(), packet.size());
+      if (res < 0) {
+        EXPECT_EQ(EWOULDBLOCK, client_->GetError());
+        return sent;
+      }
+      EXPECT_EQ(static_cast<int>(size), res);
+      sent.push_back(seq);
+    }
+  }
+
+ protected:
+  static const SocketAddress kLoopback;
+
+  PhysicalSocketServer pss_;
+  SocketServerScope scope_;
+  scoped_ptr<AsyncTCPSocket> server_;
+  scoped_ptr<AsyncTCPSocket> client_;
+  scoped_ptr<AsyncPacketSocket> accepted_;
+  std::vector<uint32> sequence_numbers_;
+  size_t received_bytes_;
+  uint32 last_received_;
+  bool ready_to_send_;
+};
+
+const SocketAddress AsyncTCPSocketLoopbackTest::kLoopback("127.0.0.1", 0);
+
+// Sends more than the socket buffers hold without running the message loop.
+// What the kernel doesn't take must be queued and delivered intact. A packet
+// that overflows the output ring is rejected with EWOULDBLOCK, never dropped
+// after it was accepted.
+TEST_F(AsyncTCPSocketLoopbackTest, QueuesPartialWrites) {
+  const size_t kPacketSize = 1000;
+  EXPECT_EQ(0, client_->SetOption(Socket::OPT_SNDBUF, 4096));
+  EXPECT_EQ(0, accepted_->SetOption(Socket::OPT_RCVBUF, 4096));
+  std::vector<uint32> sent = SendUntilBlocked(0, kPacketSize);
+  EXPECT_LE(64 * 1024 / kPacketSize, sent.size());
+  EXPECT_EQ_WAIT(sent.size(), sequence_numbers_.size(), 1000);
+  EXPECT_EQ(sent, sequence_numbers_);
+}
+
+// After a packet was rejected, SignalReadyToSend tells when the ring has
+// drained, and sending works again.
+TEST_F(AsyncTCPSocketLoopbackTest, SignalsReadyToSendWhenDrained) {
+  const size_t kPacketSize = 1000;
+  EXPECT_EQ(0, client_->SetOption(Socket::OPT_SNDBUF, 4096));
+  std::vector<uint32> sent = SendUntilBlocked(0, kPacketSize);
+  ready_to_send_ = false;
+  EXPECT_TRUE_WAIT(ready_to_send_, 1000);
+
+  std::string packet = MakePacket(sent.size(), kPacketSize);
+  EXPECT_EQ(static_cast<int>(kPacketSize),
+            client_->Send(packet.data(), packet.size()));
+  sent.push_back(sent.size());
+  EXPECT_EQ_WAIT(sent.size(), sequence_numbers_.size(), 1000);
+  EXPECT_EQ(sent, sequence_numbers_);
+}
+
+// A packet that doesn't fit the output buffer once framed is rejected up
+// front, and the stream stays usable.
+TEST_F(AsyncTCPSocketLoopbackTest, RejectsOversizedPacket) {
+  std::string packet = MakePacket(0, 64 * 1024 + 1);
+  EXPECT_EQ(-1, client_->Send(packet.data(), packet.size()));
+  EXPECT_EQ(EMSGSIZE, client_->GetError());
+
+  packet = MakePacket(1, 1000);
+  EXPECT_EQ(1000, client_->Send(packet.data(), packet.size()));
+  EXPECT_EQ_WAIT(1u, sequence_numbers_.size(), 1000);
+  EXPECT_EQ(1u, sequence_numbers_[0]);
+}
+
+// Measures delivered throughput and loss for a media-like stream, sending a
+// burst of packets between runs of the message loop. The socket buffers are
+// kept small so that the kernel regularly takes partial writes, as it does
+// on a congested path.
+TEST_F(AsyncTCPSocketLoopbackTest, TestThroughputPerf) {
+  const int kNumPackets = 50000;
+  const int kBurst = 100;
+  const size_t kPacketSize = 1200;
+  EXPECT_EQ(0, client_->SetOption(Socket::OPT_SNDBUF, 16 * 1024));
+  uint32 start = Time();
+  for (int i = 0; i < kNumPackets; ++i) {
+    std::string packet = MakePacket(i, kPacketSize);
+    client_->Send(packet.data(), packet.size());
+    if (i % kBurst == kBurst - 1)
+      pss_.Wait(0, true);
+  }
+  uint32 last_count = 0;
+  while (sequence_numbers_.size() != last_count) {
+    last_count = sequence_numbers_.size();
+    pss_.Wait(100, true);
+  }
+  uint32 elapsed = TimeDiff(last_received_, start);
+  EXPECT_FALSE(sequence_numbers_.empty());
+  LOG(LS_INFO) << "Delivered " << sequence_numbers_.size() << " of "
+               << kNumPackets << " packets in " << elapsed << " ms, "
+               << received_bytes_ * 8 / 1000 / (elapsed ? elapsed : 1)
+               << " Mbps";
+}
+
 }  // namespace talk_base
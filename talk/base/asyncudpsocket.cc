@@ -27,11 +27,17 @@
 
 #include "talk/base/asyncudpsocket.h"
 #include "talk/base/logging.h"
+#include "talk/base/thread.h"
 
 namespace talk_base {
 
 static const int BUF_SIZE = 64 * 1024;
 
+
+enum {
+  MSG_FLUSH,
+};
+
 AsyncUDPSocket* AsyncUDPSocket::Create(
     AsyncSocket* socket,
     const SocketAddress& bind_address) {
@@ -53,7 +59,10 @@ AsyncUDPSocket* AsyncUDPSocket::Create(SocketFactory* factory,
 }
 
 AsyncUDPSocket::AsyncUDPSocket(AsyncSocket* socket)
-    : socket_(socket) {
+    : socket_(socket),
+      batching_(false),
+      thread_(NULL),
+      send_count_(0) {
   ASSERT(socket_);
   size_ = BUF_SIZE;
   buf_ = new char[size_];
@@ -64,6 +73,8 @@ AsyncUDPSocket::AsyncUDPSocket(AsyncSocket* socket)
 }
 
 AsyncUDPSocket::~AsyncUDPSocket() {
+  // Send what SendTo() queued, while |socket_| is still around.
+  Flush();
   delete [] buf_;
 }
 
@@ -76,15 +87,32 @@ SocketAddress AsyncUDPSocket::GetRemoteAddress() const {
 }
 
 int AsyncUDPSocket::Send(const void *pv, size_t cb) {
+  // Keep the order of the packets.
+  Flush();
   return socket_->Send(pv, cb);
 }
 
 int AsyncUDPSocket::SendTo(
     const void *pv, size_t cb, const SocketAddress& addr) {
-  return socket_->SendTo(pv, cb, addr);
+  if (!batching_ || cb > kBatchPacketSize) {
+    Flush();
+    return socket_->SendTo(pv, cb, addr);
+  }
+
+  Socket::Datagram* datagram = &send_batch_[send_count_];
+  memcpy(datagram->data, pv, cb);
+  datagram->length = cb;
+  datagram->addr = addr;
+  if (++send_count_ == kBatchSize) {
+    Flush();
+  } else if (send_count_ == 1) {
+    thread_->Post(this, MSG_FLUSH);
+  }
+  return static_cast<int>(cb);
 }
 
 int AsyncUDPSocket::Close() {
+  Flush();
   return socket_->Close();
 }
 
@@ -108,19 +136,107 @@ void AsyncUDPSocket::SetError(int error) {
   return socket_->SetError(error);
 }
 
+void AsyncUDPSocket::EnableBatching() {
+  EnableBatching(Thread::Current());
+}
+
+void AsyncUDPSocket::EnableBatching(Thread* thread) {
+  if (batching_)
+    return;
+  batching_ = true;
+  thread_ = thread;
+  // The receive slots are carved out of |buf_|.
+  ASSERT(kBatchSize * kBatchPacketSize <= size_);
+  recv_batch_.resize(kBatchSize);
+  send_batch_.resize(kBatchSize);
+  send_buf_.reset(new char[kBatchSize * kBatchPacketSize]);
+  for (int i = 0; i < kBatchSize; ++i) {
+    recv_batch_[i].data = buf_ + i * kBatchPacketSize;
+    recv_batch_[i].size = kBatchPacketSize;
+    send_batch_[i].data = send_buf_.get() + i * kBatchPacketSize;
+    send_batch_[i].size = kBatchPacketSize;
+  }
+}
+
+void AsyncUDPSocket::Flush() {
+  if (send_count_ == 0)
+    return;
+  int count = send_count_;
+  send_count_ = 0;
+  thread_->Clear(this, MSG_FLUSH);
+  // A batch send stops at the first packet that fails, so send the rest
+  // again. A packet that fails on its own, e.g. for its address, is dropped
+  // like after a failed SendTo(); once the socket would block, so are all
+  // the packets behind it.
+  int done = 0;
+  int dropped = 0;
+  while (done < count) {
+    int sent = socket_->SendToBatch(&send_batch_[done], count - done);
+    if (sent > 0) {
+      done += sent;
+    } else if (socket_->IsBlocking()) {
+      dropped += count - done;
+      break;
+    } else {
+      ++dropped;
+      ++done;
+    }
+  }
+  if (dropped > 0) {
+    LOG(LS_WARNING) << "AsyncUDPSocket dropped " << dropped << " of "
+                    << count << " packets, error " << socket_->GetError();
+  }
+}
+
+void AsyncUDPSocket::OnMessage(Message* msg) {
+  ASSERT(msg->message_id == MSG_FLUSH);
+  Flush();
+}
+
+void AsyncUDPSocket::ReadBatch() {
+  int received = socket_->RecvFromBatch(&recv_batch_[0], kBatchSize);
+  if (received < 0) {
+    LogReadError();
+    return;
+  }
+
+  for (int i = 0; i < received; ++i) {
+    const Socket::Datagram& datagram = recv_batch_[i];
+    if (datagram.length > datagram.size) {
+      LOG(LS_WARNING) << "AsyncUDPSocket dropped a " << datagram.length
+                      << " byte packet, larger than the batch buffers";
+      continue;
+    }
+    SignalReadPacket(this, datagram.data, datagram.length, datagram.addr);
+  }
+}
+
+void AsyncUDPSocket::LogReadError() {
+  // With an edge-triggered socket server we may be asked to read once more
+  // after the socket has been drained; that is not an error.
+  if (socket_->IsBlocking())
+    return;
+  // An error here typically means we got an ICMP error in response to our
+  // send datagram, indicating the remote address was unreachable.
+  // When doing ICE, this kind of thing will often happen.
+  // TODO: Do something better like forwarding the error to the user.
+  SocketAddress local_addr = socket_->GetLocalAddress();
+  LOG(LS_INFO) << "AsyncUDPSocket[" << local_addr.ToSensitiveString() << "] "
+               << "receive failed with error " << socket_->GetError();
+}
+
 void AsyncUDPSocket::OnReadEvent(AsyncSocket* socket) {
   ASSERT(socket_.get() == socket);
 
+  if (batching_) {
+    ReadBatch();
+    return;
+  }
+
   SocketAddress remote_addr;
   int len = socket_->RecvFrom(buf_, size_, &remote_addr);
   if (len < 0) {
-    // An error here typically means we got an ICMP error in response to our
-    // send datagram, indicating the remote address was unreachable.
-    // When doing ICE, this kind of thing will often happen.
-    // TODO: Do something better like forwarding the error to the user.
-    SocketAddress local_addr = socket_->GetLocalAddress();
-    LOG(LS_INFO) << "AsyncUDPSocket[" << local_addr.ToSensitiveString() << "] "
-                 << "receive failed with error " << socket_->GetError();
+    LogReadError();
     return;
   }
 
@@ -28,16 +28,26 @@
 #ifndef TALK_BASE_ASYNCUDPSOCKET_H_
 #define TALK_BASE_ASYNCUDPSOCKET_H_
 
+#include <vector>
+
 #include "talk/base/asyncpacketsocket.h"
+#include "talk/base/messagehandler.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socketfactory.h"
 
 namespace talk_base {
 
+class Thread;
+
 // Provides the ability to receive packets asynchronously.  Sends are not
 // buffered since it is acceptable to drop packets under high load.
-class AsyncUDPSocket : public AsyncPacketSocket {
+class AsyncUDPSocket : public AsyncPacketSocket, public MessageHandler {
  public:
+  // Number of datagrams read or written at once in batching mode.
+  static const int kBatchSize = 32;
+  // Largest datagram that fits in a batch slot.
+  static const size_t kBatchPacketSize = 2048;
+
   // Binds |socket| and creates AsyncUDPSocket for it. Takes ownership
   // of |socket|. Returns NULL if bind() fails (|socket| is destroyed
   // in that case).
@@ -62,15 +72,41 @@ class AsyncUDPSocket : public AsyncPacketSocket {
   virtual int GetError() const;
   virtual void SetError(int error);
 
+  // Switches to batching mode, for servers that relay many packets. Each read
+  // event then drains up to kBatchSize datagrams with a single call, and
+  // SendTo() queues datagrams which are sent together once control returns
+  // to the current thread's message loop. Received datagrams larger than
+  // kBatchPacketSize are dropped; larger ones are sent right away.
+  void EnableBatching();
+  // As above, but flushes from the message loop of |thread|, which must be
+  // the thread that uses this socket.
+  void EnableBatching(Thread* thread);
+  bool batching() const { return batching_; }
+
+  // Sends the datagrams queued by SendTo() in batching mode.
+  void Flush();
+
+  // MessageHandler:
+  virtual void OnMessage(Message* msg);
+
  private:
   // Called when the underlying socket is ready to be read from.
   void OnReadEvent(AsyncSocket* socket);
   // Called when the underlying socket is ready to send.
   void OnWriteEvent(AsyncSocket* socket);
 
+  void ReadBatch();
+  void LogReadError();
+
   scoped_ptr<AsyncSocket> socket_;
   char* buf_;
   size_t size_;
+  bool batching_;
+  Thread* thread_;
+  std::vector<Socket::Datagram> recv_batch_;
+  std::vector<Socket::Datagram> send_batch_;
+  scoped_array<char> send_buf_;
+  int send_count_;
 };
 
 }  // namespace talk_base
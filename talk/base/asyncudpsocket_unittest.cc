@@ -26,11 +26,13 @@
  */
 
 #include <string>
+#include <vector>
 
 #include "talk/base/asyncudpsocket.h"
 #include "talk/base/gunit.h"
 #include "talk/base/physicalsocketserver.h"
 #include "talk/base/scoped_ptr.h"
+#include "talk/base/thread.h"
 #include "talk/base/virtualsocketserver.h"
 
 namespace talk_base {
@@ -67,4 +69,109 @@ TEST_F(AsyncUdpSocketTest, OnWriteEvent) {
   EXPECT_TRUE(ready_to_send_);
 }
 
+// Tests batching mode over real sockets, so that the batched system calls
+// are exercised where available.
+class AsyncUdpSocketBatchingTest
+    : public testing::Test,
+      public sigslot::has_slots<> {
+ public:
+  AsyncUdpSocketBatchingTest()
+      : scope_(&pss_),
+        sender_(AsyncUDPSocket::Create(&pss_, kLoopback)),
+        receiver_(AsyncUDPSocket::Create(&pss_, kLoopback)) {
+    receiver_->SignalReadPacket.connect(
+        this, &AsyncUdpSocketBatchingTest::OnReadPacket);
+  }
+
+  void OnReadPacket(AsyncPacketSocket* socket, const char* data, size_t size,
+                    const SocketAddress& remote_addr) {
+    packets_.push_back(std::string(data, size));
+  }
+
+ protected:
+  static const SocketAddress kLoopback;
+
+  PhysicalSocketServer pss_;
+  SocketServerScope scope_;
+  scoped_ptr<AsyncUDPSocket> sender_;
+  scoped_ptr<AsyncUDPSocket> receiver_;
+  std::vector<std::string> packets_;
+};
+
+const SocketAddress AsyncUdpSocketBatchingTest::kLoopback("127.0.0.1", 0);
+
+TEST_F(AsyncUdpSocketBatchingTest, ReceivesQueuedPacketsInOrder) {
+  receiver_->EnableBatching();
+  EXPECT_TRUE(receiver_->batching());
+  const int kNumPackets = AsyncUDPSocket::kBatchSize + 5;
+  for (int i = 0; i < kNumPackets; ++i) {
+    std::string packet(i + 1, 'a' + (i % 26));
+    ASSERT_EQ(static_cast<int>(packet.size()),
+              sender_->SendTo(packet.data(), packet.size(),
+                              receiver_->GetLocalAddress()));
+  }
+  EXPECT_EQ_WAIT(static_cast<size_t>(kNumPackets), packets_.size(), 1000);
+  for (int i = 0; i < kNumPackets; ++i) {
+    EXPECT_EQ(std::string(i + 1, 'a' + (i % 26)), packets_[i]);
+  }
+}
+
+TEST_F(AsyncUdpSocketBatchingTest, SendsAreFlushedFromMessageLoop) {
+  sender_->EnableBatching();
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(4, sender_->SendTo("ping", 4, receiver_->GetLocalAddress()));
+  }
+  // Nothing is sent until the message loop runs.
+  EXPECT_TRUE(pss_.Wait(10, true));
+  EXPECT_TRUE(packets_.empty());
+  EXPECT_EQ_WAIT(5U, packets_.size(), 1000);
+}
+
+TEST_F(AsyncUdpSocketBatchingTest, PendingSendsAreFlushedOnDestruction) {
+  sender_->EnableBatching();
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(4, sender_->SendTo("ping", 4, receiver_->GetLocalAddress()));
+  }
+  sender_.reset();
+  EXPECT_EQ_WAIT(5U, packets_.size(), 1000);
+}
+
+TEST_F(AsyncUdpSocketBatchingTest, FullBatchIsSentImmediately) {
+  sender_->EnableBatching();
+  receiver_->EnableBatching();
+  for (int i = 0; i < AsyncUDPSocket::kBatchSize; ++i) {
+    EXPECT_EQ(4, sender_->SendTo("ping", 4, receiver_->GetLocalAddress()));
+  }
+  EXPECT_TRUE(pss_.Wait(100, true));
+  EXPECT_EQ(static_cast<size_t>(AsyncUDPSocket::kBatchSize), packets_.size());
+}
+
+// A packet that fails in the middle of a batch only drops itself, not the
+// packets behind it.
+TEST_F(AsyncUdpSocketBatchingTest, FailedPacketDoesNotDropRestOfBatch) {
+  sender_->EnableBatching();
+  EXPECT_EQ(4, sender_->SendTo("ping", 4, receiver_->GetLocalAddress()));
+  // Port 0 can't be sent to.
+  EXPECT_EQ(4, sender_->SendTo("lost", 4, kLoopback));
+  EXPECT_EQ(4, sender_->SendTo("pong", 4, receiver_->GetLocalAddress()));
+  EXPECT_EQ_WAIT(2U, packets_.size(), 1000);
+  EXPECT_EQ("ping", packets_[0]);
+  EXPECT_EQ("pong", packets_[1]);
+}
+
+TEST_F(AsyncUdpSocketBatchingTest, LargePacketKeepsOrder) {
+  sender_->EnableBatching();
+  receiver_->EnableBatching();
+  std::string large(AsyncUDPSocket::kBatchPacketSize + 1, 'x');
+  EXPECT_EQ(4, sender_->SendTo("ping", 4, receiver_->GetLocalAddress()));
+  EXPECT_EQ(static_cast<int>(large.size()),
+            sender_->SendTo(large.data(), large.size(),
+                            receiver_->GetLocalAddress()));
+  EXPECT_EQ(4, sender_->SendTo("pong", 4, receiver_->GetLocalAddress()));
+  // The large packet can't be received in batching mode and is dropped.
+  EXPECT_EQ_WAIT(2U, packets_.size(), 1000);
+  EXPECT_EQ("ping", packets_[0]);
+  EXPECT_EQ("pong", packets_[1]);
+}
+
 }  // namespace talk_base
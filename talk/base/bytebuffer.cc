@@ -54,6 +54,20 @@ ByteBuffer::ByteBuffer(const char* bytes, size_t len, ByteOrder byte_order) {
   Construct(bytes, len, byte_order);
 }
 
+ByteBuffer::ByteBuffer(const char* bytes, size_t len, ByteOrder byte_order,
+                       Storage storage) {
+  if (storage == STORAGE_VIEW) {
+    version_ = 0;
+    start_ = 0;
+    size_ = end_ = len;
+    byte_order_ = byte_order;
+    bytes_ = const_cast<char*>(bytes);
+    owned_ = false;
+  } else {
+    Construct(bytes, len, byte_order);
+  }
+}
+
 ByteBuffer::ByteBuffer(const char* bytes) {
   Construct(bytes, strlen(bytes), ORDER_NETWORK);
 }
@@ -65,6 +79,7 @@ void ByteBuffer::Construct(const char* bytes, size_t len,
   size_ = len;
   byte_order_ = byte_order;
   bytes_ = new char[size_];
+  owned_ = true;
 
   if (bytes) {
     end_ = len;
@@ -75,7 +90,8 @@ void ByteBuffer::Construct(const char* bytes, size_t len,
 }
 
 ByteBuffer::~ByteBuffer() {
-  delete[] bytes_;
+  if (owned_)
+    delete[] bytes_;
 }
 
 bool ByteBuffer::ReadUInt8(uint8* val) {
@@ -206,16 +222,18 @@ char* ByteBuffer::ReserveWriteBuffer(size_t len) {
 
 void ByteBuffer::Resize(size_t size) {
   size_t len = _min(end_ - start_, size);
-  if (size <= size_) {
+  if (size <= size_ && owned_) {
     // Don't reallocate, just move data backwards
     memmove(bytes_, bytes_ + start_, len);
   } else {
-    // Reallocate a larger buffer.
+    // Reallocate a larger buffer, or copy the data we are viewing.
     size_ = _max(size, 3 * size_ / 2);
     char* new_bytes = new char[size_];
     memcpy(new_bytes, bytes_ + start_, len);
-    delete [] bytes_;
+    if (owned_)
+      delete [] bytes_;
     bytes_ = new_bytes;
+    owned_ = true;
   }
   start_ = 0;
   end_ = len;
@@ -242,6 +260,10 @@ bool ByteBuffer::SetReadPosition(const ReadPosition &position) {
 }
 
 void ByteBuffer::Clear() {
+  if (!owned_) {
+    bytes_ = new char[size_];
+    owned_ = true;
+  }
   memset(bytes_, 0, size_);
   start_ = end_ = 0;
   ++version_;
@@ -43,11 +43,20 @@ class ByteBuffer {
     ORDER_HOST,         // Use the native order of the host.
   };
 
+  enum Storage {
+    STORAGE_COPY = 0,   // Default, the buffer keeps its own copy of the data.
+    STORAGE_VIEW,       // Read the caller's data in place.
+  };
+
   // |byte_order| defines order of bytes in the buffer.
   ByteBuffer();
   explicit ByteBuffer(ByteOrder byte_order);
   ByteBuffer(const char* bytes, size_t len);
   ByteBuffer(const char* bytes, size_t len, ByteOrder byte_order);
+  // With STORAGE_VIEW, |bytes| is not copied and must outlive the buffer,
+  // unless the buffer is written to, which first makes a copy.
+  ByteBuffer(const char* bytes, size_t len, ByteOrder byte_order,
+             Storage storage);
 
   // Initializes buffer from a zero-terminated string.
   explicit ByteBuffer(const char* bytes);
@@ -119,7 +128,10 @@ class ByteBuffer {
  private:
   void Construct(const char* bytes, size_t size, ByteOrder byte_order);
 
+  // Points to the caller's data, rather than to our own, if |owned_| is
+  // false.
   char* bytes_;
+  bool owned_;
   size_t size_;
   size_t start_;
   size_t end_;
@@ -225,4 +225,30 @@ TEST(ByteBufferTest, TestReadWriteBuffer) {
   }
 }
 
+TEST(ByteBufferTest, TestViewStorage) {
+  char data[] = "ABCDEF";
+  ByteBuffer buffer(data, 6, ByteBuffer::ORDER_NETWORK,
+                    ByteBuffer::STORAGE_VIEW);
+  EXPECT_EQ(data, buffer.Data());
+  EXPECT_EQ(6U, buffer.Length());
+  std::string read;
+  EXPECT_TRUE(buffer.ReadString(&read, 2));
+  EXPECT_EQ("AB", read);
+  EXPECT_EQ(data + 2, buffer.Data());
+
+  // Writing copies the data first, and leaves the caller's data alone.
+  buffer.WriteString("GH");
+  EXPECT_NE(data + 2, buffer.Data());
+  EXPECT_EQ("ABCDEF", std::string(data));
+  read.clear();
+  EXPECT_TRUE(buffer.ReadString(&read, 6));
+  EXPECT_EQ("CDEFGH", read);
+
+  ByteBuffer cleared(data, 6, ByteBuffer::ORDER_NETWORK,
+                     ByteBuffer::STORAGE_VIEW);
+  cleared.Clear();
+  EXPECT_EQ(0U, cleared.Length());
+  EXPECT_EQ("ABCDEF", std::string(data));
+}
+
 }  // namespace talk_base
@@ -28,6 +28,26 @@
 #include "talk/base/crc32.h"
 
 #include "talk/base/basicdefs.h"
+#include "talk/base/byteorder.h"
+
+// The carry-less multiplication is compiled for PCLMULQDQ per function, so
+// that the rest of the build doesn't need to target it; it is only used when
+// the CPU has the instructions.
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define HAVE_CRC32_PCLMUL
+#define PCLMUL_TARGET
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_CRC32_PCLMUL
+#define PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#include <cpuid.h>
+#endif
+
+#ifdef HAVE_CRC32_PCLMUL
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
 
 namespace talk_base {
 
@@ -36,12 +56,17 @@ namespace talk_base {
 // CRC32 polynomial, in reversed form.
 // See RFC 1952, or http://en.wikipedia.org/wiki/Cyclic_redundancy_check
 static const uint32 kCrc32Polynomial = 0xEDB88320;
-static uint32 kCrc32Table[256] = { 0 };
+// kCrc32Table[0] is the table of RFC 1952. kCrc32Table[k][i] is the CRC of
+// byte i followed by k zero bytes, which lets the loop look up 8 bytes at
+// once ("slicing-by-8").
+static uint32 kCrc32Table[8][256] = { { 0 } };
+static volatile bool crc32_table_inited = false;
 
 static void EnsureCrc32TableInited() {
-  if (kCrc32Table[ARRAY_SIZE(kCrc32Table) - 1])
+  // Threads racing here all write the same values.
+  if (crc32_table_inited)
     return;  // already inited
-  for (uint32 i = 0; i < ARRAY_SIZE(kCrc32Table); ++i) {
+  for (uint32 i = 0; i < ARRAY_SIZE(kCrc32Table[0]); ++i) {
     uint32 c = i;
     for (size_t j = 0; j < 8; ++j) {
       if (c & 1) {
@@ -50,20 +75,187 @@ static void EnsureCrc32TableInited() {
         c >>= 1;
       }
     }
-    kCrc32Table[i] = c;
+    kCrc32Table[0][i] = c;
   }
+  for (uint32 i = 0; i < ARRAY_SIZE(kCrc32Table[0]); ++i) {
+    for (size_t k = 1; k < ARRAY_SIZE(kCrc32Table); ++k) {
+      uint32 c = kCrc32Table[k - 1][i];
+      kCrc32Table[k][i] = kCrc32Table[0][c & 0xFF] ^ (c >> 8);
+    }
+  }
+  crc32_table_inited = true;
 }
 
-uint32 UpdateCrc32(uint32 start, const void* buf, size_t len) {
-  EnsureCrc32TableInited();
+// The functions below work on the inverted CRC.
 
-  uint32 c = start ^ 0xFFFFFFFF;
-  const uint8* u = static_cast<const uint8*>(buf);
+static uint32 Crc32Bytewise(uint32 c, const uint8* u, size_t len) {
   for (size_t i = 0; i < len; ++i) {
-    c = kCrc32Table[(c ^ u[i]) & 0xFF] ^ (c >> 8);
+    c = kCrc32Table[0][(c ^ u[i]) & 0xFF] ^ (c >> 8);
   }
-  return c ^ 0xFFFFFFFF;
+  return c;
 }
 
-}  // namespace talk_base
+static uint32 Crc32SliceBy8(uint32 c, const uint8* u, size_t len) {
+  // Align the input for the 8-byte loads.
+  while (len > 0 && (reinterpret_cast<uintptr_t>(u) & 7) != 0) {
+    c = kCrc32Table[0][(c ^ *u++) & 0xFF] ^ (c >> 8);
+    --len;
+  }
+  for (; len >= 8; len -= 8, u += 8) {
+    uint32 low = GetLE32(u) ^ c;
+    uint32 high = GetLE32(u + 4);
+    c = kCrc32Table[7][low & 0xFF] ^
+        kCrc32Table[6][(low >> 8) & 0xFF] ^
+        kCrc32Table[5][(low >> 16) & 0xFF] ^
+        kCrc32Table[4][low >> 24] ^
+        kCrc32Table[3][high & 0xFF] ^
+        kCrc32Table[2][(high >> 8) & 0xFF] ^
+        kCrc32Table[1][(high >> 16) & 0xFF] ^
+        kCrc32Table[0][high >> 24];
+  }
+  return Crc32Bytewise(c, u, len);
+}
+
+#ifdef HAVE_CRC32_PCLMUL
+
+// Folds 64 bytes at a time with carry-less multiplication, as described in
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+// (Intel, 2009), and reduces the result with Barrett reduction. The constants
+// are those of the paper for the bit-reflected CRC32 polynomial.
+PCLMUL_TARGET
+static uint32 Crc32Pclmul(uint32 c, const uint8* u, size_t len) {
+  if (len < 64) {
+    return Crc32SliceBy8(c, u, len);
+  }
+  static const uint64 kConstants[8] = {
+    UINT64_C(0x0154442BD4), UINT64_C(0x01C6E41596),  // k1, k2
+    UINT64_C(0x01751997D0), UINT64_C(0x00CCAA009E),  // k3, k4
+    UINT64_C(0x0163CD6124), 0,                       // k5
+    UINT64_C(0x01DB710641), UINT64_C(0x01F7011641),  // P(x)', u'
+  };
+  const __m128i* k = reinterpret_cast<const __m128i*>(kConstants);
+  const __m128i k1k2 = _mm_loadu_si128(k);
+  const __m128i k3k4 = _mm_loadu_si128(k + 1);
+  const __m128i k5 = _mm_loadu_si128(k + 2);
+  const __m128i poly = _mm_loadu_si128(k + 3);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  const __m128i* p = reinterpret_cast<const __m128i*>(u);
+
+  __m128i x1 = _mm_loadu_si128(p);
+  __m128i x2 = _mm_loadu_si128(p + 1);
+  __m128i x3 = _mm_loadu_si128(p + 2);
+  __m128i x4 = _mm_loadu_si128(p + 3);
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(c)));
+  p += 4;
+  len -= 64;
+
+  // Fold four 16-byte lanes in parallel.
+  for (; len >= 64; len -= 64, p += 4) {
+    __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(p));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(p + 1));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(p + 2));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(p + 3));
+  }
+
+  // Fold the lanes into one, then fold in the remaining 16-byte blocks.
+  __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+  for (; len >= 16; len -= 16, ++p) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(p)), x5);
+  }
+
+  // Fold 128 bits to 64, and reduce those to 32.
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  c = static_cast<uint32>(_mm_extract_epi32(x1, 1));
 
+  return Crc32SliceBy8(c, reinterpret_cast<const uint8*>(p), len);
+}
+
+static bool HasPclmul() {
+  // Function 1, ECX bit 1: PCLMULQDQ, ECX bit 19: SSE4.1.
+  const uint32 kPclmulBits = (1 << 1) | (1 << 19);
+#ifdef _MSC_VER
+  int cpu_info[4];
+  __cpuid(cpu_info, 1);
+  uint32 ecx = static_cast<uint32>(cpu_info[2]);
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+#endif
+  return (ecx & kPclmulBits) == kPclmulBits;
+}
+
+#endif  // HAVE_CRC32_PCLMUL
+
+typedef uint32 (*Crc32Function)(uint32 c, const uint8* u, size_t len);
+static Crc32Function crc32_function = NULL;
+
+static Crc32Function GetCrc32Function() {
+  if (!crc32_function) {
+    EnsureCrc32TableInited();
+#ifdef HAVE_CRC32_PCLMUL
+    crc32_function = HasPclmul() ? &Crc32Pclmul : &Crc32SliceBy8;
+#else
+    crc32_function = &Crc32SliceBy8;
+#endif
+  }
+  return crc32_function;
+}
+
+uint32 UpdateCrc32(uint32 start, const void* buf, size_t len) {
+  Crc32Function update = GetCrc32Function();
+  return update(start ^ 0xFFFFFFFF, static_cast<const uint8*>(buf), len) ^
+      0xFFFFFFFF;
+}
+
+bool SetCrc32ImplementationForTest(Crc32Implementation impl) {
+  EnsureCrc32TableInited();
+  switch (impl) {
+    case CRC32_BYTEWISE:
+      crc32_function = &Crc32Bytewise;
+      return true;
+    case CRC32_SLICE_BY_8:
+      crc32_function = &Crc32SliceBy8;
+      return true;
+    case CRC32_PCLMUL:
+#ifdef HAVE_CRC32_PCLMUL
+      if (HasPclmul()) {
+        crc32_function = &Crc32Pclmul;
+        return true;
+      }
+#endif
+      return false;
+  }
+  return false;
+}
+
+}  // namespace talk_base
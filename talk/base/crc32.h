@@ -46,6 +46,19 @@ inline uint32 ComputeCrc32(const std::string& str) {
   return ComputeCrc32(str.c_str(), str.size());
 }
 
+// The implementations UpdateCrc32() chooses from. It uses the fastest one the
+// CPU supports: carry-less multiplication folds 64 bytes at a time, and the
+// table-driven loop handles the rest, 8 bytes at a time.
+enum Crc32Implementation {
+  CRC32_BYTEWISE,
+  CRC32_SLICE_BY_8,
+  CRC32_PCLMUL,
+};
+
+// For testing, makes UpdateCrc32() use |impl|. Returns false, and changes
+// nothing, if the CPU doesn't support it.
+bool SetCrc32ImplementationForTest(Crc32Implementation impl);
+
 }  // namespace talk_base
 
 #endif  // TALK_BASE_CRC32_H_
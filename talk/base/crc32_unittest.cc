@@ -25,6 +25,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "talk/base/basicdefs.h"
 #include "talk/base/crc32.h"
 #include "talk/base/gunit.h"
 
@@ -49,4 +50,39 @@ TEST(Crc32Test, TestMultipleUpdates) {
   EXPECT_EQ(0x171A3F5FU, c);
 }
 
+// Test that every implementation gives the same CRCs, whatever the alignment
+// and length of the input.
+TEST(Crc32Test, TestImplementations) {
+  std::string input;
+  for (int i = 0; i < 600; ++i) {
+    input.push_back(static_cast<char>(i * 31 + (i >> 3)));
+  }
+  Crc32Implementation impls[] = {
+    CRC32_SLICE_BY_8, CRC32_PCLMUL, CRC32_BYTEWISE
+  };
+  for (size_t offset = 0; offset < 8; ++offset) {
+    for (size_t len = 0; len + offset <= input.size(); len += 7) {
+      ASSERT_TRUE(SetCrc32ImplementationForTest(CRC32_BYTEWISE));
+      uint32 expected = ComputeCrc32(&input[offset], len);
+      for (size_t i = 0; i < ARRAY_SIZE(impls); ++i) {
+        if (SetCrc32ImplementationForTest(impls[i])) {
+          EXPECT_EQ(expected, ComputeCrc32(&input[offset], len))
+              << "implementation " << impls[i] << ", offset " << offset
+              << ", length " << len;
+          // Split the input to check the CRC carries over.
+          uint32 c = UpdateCrc32(0, &input[offset], len / 3);
+          EXPECT_EQ(expected,
+                    UpdateCrc32(c, &input[offset + len / 3], len - len / 3));
+        }
+      }
+    }
+  }
+  EXPECT_EQ(0x171A3F5FU,
+      ComputeCrc32("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"));
+  // Leave the fastest implementation in place.
+  if (!SetCrc32ImplementationForTest(CRC32_PCLMUL)) {
+    SetCrc32ImplementationForTest(CRC32_SLICE_BY_8);
+  }
+}
+
 }  // namespace talk_base
@@ -181,6 +181,41 @@ class AtomicOps {
   static int Decrement(int* i) {
     return ::InterlockedDecrement(reinterpret_cast<LONG*>(i));
   }
+  static int Exchange(int* i, int value) {
+    return ::InterlockedExchange(reinterpret_cast<LONG*>(i), value);
+  }
+  static int CompareAndSwap(int* i, int old_value, int new_value) {
+    return ::InterlockedCompareExchange(reinterpret_cast<LONG*>(i), new_value,
+                                        old_value);
+  }
+  static int AcquireLoad(const volatile int* i) {
+    return *i;
+  }
+  static void ReleaseStore(volatile int* i, int value) {
+    *i = value;
+  }
+  template <class T>
+  static T* ExchangePtr(T* volatile* ptr, T* value) {
+    return static_cast<T*>(::InterlockedExchangePointer(
+        reinterpret_cast<PVOID volatile*>(ptr), value));
+  }
+  template <class T>
+  static T* CompareAndSwapPtr(T* volatile* ptr, T* old_value, T* new_value) {
+    return static_cast<T*>(::InterlockedCompareExchangePointer(
+        reinterpret_cast<PVOID volatile*>(ptr), new_value, old_value));
+  }
+  // Volatile accesses have acquire and release semantics with MSVC.
+  template <class T>
+  static T* AcquireLoadPtr(T* volatile* ptr) {
+    return *ptr;
+  }
+  template <class T>
+  static void ReleaseStorePtr(T* volatile* ptr, T* value) {
+    *ptr = value;
+  }
+  static void FullBarrier() {
+    MemoryBarrier();
+  }
 #else
   static int Increment(int* i) {
     return __sync_add_and_fetch(i, 1);
@@ -188,6 +223,80 @@ class AtomicOps {
   static int Decrement(int* i) {
     return __sync_sub_and_fetch(i, 1);
   }
+  // On x86, __sync_lock_test_and_set is a plain exchange, which is a full
+  // barrier. Elsewhere it may only be an acquire barrier, so use a
+  // compare-and-swap loop.
+  static int Exchange(int* i, int value) {
+#if defined(__i386__) || defined(__x86_64__)
+    return __sync_lock_test_and_set(i, value);
+#else
+    int old_value;
+    do {
+      old_value = *i;
+    } while (!__sync_bool_compare_and_swap(i, old_value, value));
+    return old_value;
+#endif
+  }
+  // Sets |*i| to |new_value| if it is |old_value|, and returns the value it
+  // had.
+  static int CompareAndSwap(int* i, int old_value, int new_value) {
+    return __sync_val_compare_and_swap(i, old_value, new_value);
+  }
+  static int AcquireLoad(const volatile int* i) {
+    int value = *i;
+    AcquireReleaseBarrier();
+    return value;
+  }
+  static void ReleaseStore(volatile int* i, int value) {
+    AcquireReleaseBarrier();
+    *i = value;
+  }
+  // Atomically sets |*ptr| to |value|, returning the previous value.
+  template <class T>
+  static T* ExchangePtr(T* volatile* ptr, T* value) {
+#if defined(__i386__) || defined(__x86_64__)
+    return __sync_lock_test_and_set(ptr, value);
+#else
+    T* old_value;
+    do {
+      old_value = *ptr;
+    } while (!__sync_bool_compare_and_swap(ptr, old_value, value));
+    return old_value;
+#endif
+  }
+  // Sets |*ptr| to |new_value| if it is |old_value|. Returns the value that
+  // |*ptr| had, so the swap happened if that is |old_value|.
+  template <class T>
+  static T* CompareAndSwapPtr(T* volatile* ptr, T* old_value, T* new_value) {
+    return __sync_val_compare_and_swap(ptr, old_value, new_value);
+  }
+  template <class T>
+  static T* AcquireLoadPtr(T* volatile* ptr) {
+    T* value = *ptr;
+    AcquireReleaseBarrier();
+    return value;
+  }
+  template <class T>
+  static void ReleaseStorePtr(T* volatile* ptr, T* value) {
+    AcquireReleaseBarrier();
+    *ptr = value;
+  }
+  // Keeps loads and stores from moving across it in either direction, e.g.
+  // to check that data read without a lock did not change meanwhile.
+  static void FullBarrier() {
+    __sync_synchronize();
+  }
+
+ private:
+  // On x86, loads are not reordered with older loads, nor stores with older
+  // loads or stores, so only the compiler needs to be held back.
+  static void AcquireReleaseBarrier() {
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("" : : : "memory");
+#else
+    __sync_synchronize();
+#endif
+  }
 #endif
 };
 
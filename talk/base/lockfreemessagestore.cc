@@ -0,0 +1,562 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/lockfreemessagestore.h"
+
+#include "talk/base/common.h"
+#include "talk/base/criticalsection.h"
+#include "talk/base/timeutils.h"
+
+namespace talk_base {
+
+struct LockFreeMessageStore::Node {
+  enum Location { NOWHERE, READY, DUE, WHEEL };
+
+  Node()
+      : next(NULL), prev(NULL), hnext(NULL), hprev(NULL), trigger(0), num(0),
+        delayed(false), location(NOWHERE), level(0), slot(0) {
+  }
+
+  // Links the node in the incoming queue, the free list, or the list given
+  // by |location|.
+  Node* volatile next;
+  Node* prev;
+  // Links the delayed messages of the same handler.
+  Node* hnext;
+  Node* hprev;
+  Message msg;
+  uint32 trigger;
+  uint32 num;
+  bool delayed;
+  uint8 location;
+  uint8 level;
+  uint8 slot;
+};
+
+// Orders delayed messages by trigger time, then in the order they were
+// posted.
+static bool IsBefore(uint32 trigger1, uint32 num1,
+                     uint32 trigger2, uint32 num2) {
+  int32 diff = TimeDiff(trigger1, trigger2);
+  return diff < 0 || (diff == 0 && static_cast<int32>(num1 - num2) < 0);
+}
+
+LockFreeMessageStore::LockFreeMessageStore(uint32 now)
+    : head_(NULL), free_(NULL), node_count_(0),
+      wakeup_pending_(0), tail_(NULL), stub_(new Node()), freed_(NULL),
+      freed_last_(NULL), freed_count_(0),
+      ready_head_(NULL), ready_tail_(NULL), due_head_(NULL), due_tail_(NULL),
+      ready_count_(0), delayed_count_(0), now_(now), next_num_(0) {
+  head_ = stub_;
+  tail_ = stub_;
+  for (int level = 0; level < kLevels; ++level) {
+    level_count_[level] = 0;
+    for (int slot = 0; slot < kSlots; ++slot) {
+      slots_[level][slot] = NULL;
+    }
+  }
+}
+
+LockFreeMessageStore::~LockFreeMessageStore() {
+  Node* node;
+  while ((node = Pop()) != NULL) {
+    delete node;
+  }
+  delete stub_;
+  for (node = ready_head_; node; ) {
+    Node* next = node->next;
+    delete node;
+    node = next;
+  }
+  for (node = due_head_; node; ) {
+    Node* next = node->next;
+    delete node;
+    node = next;
+  }
+  for (int level = 0; level < kLevels; ++level) {
+    for (int slot = 0; slot < kSlots; ++slot) {
+      for (node = slots_[level][slot]; node; ) {
+        Node* next = node->next;
+        delete node;
+        node = next;
+      }
+    }
+  }
+  ReleaseFreed();
+  for (node = free_; node; ) {
+    Node* next = node->next;
+    delete node;
+    node = next;
+  }
+}
+
+bool LockFreeMessageStore::Post(const Message& msg) {
+  return Push(NewNode(msg));
+}
+
+bool LockFreeMessageStore::PostAt(const Message& msg, uint32 trigger) {
+  Node* node = NewNode(msg);
+  node->delayed = true;
+  node->trigger = trigger;
+  return Push(node);
+}
+
+void LockFreeMessageStore::Update(uint32 now) {
+  TakeIncoming();
+  Advance(now);
+  FlushDue();
+}
+
+bool LockFreeMessageStore::PopReady(Message* msg) {
+  Node* node = ready_head_;
+  if (!node)
+    return false;
+  Unlink(node);
+  --ready_count_;
+  *msg = node->msg;
+  FreeNode(node);
+  return true;
+}
+
+int LockFreeMessageStore::GetDelay(uint32 now) {
+  // Ask for a wakeup on the next post, then look once more, so that a post
+  // that didn't ask for one is not missed.
+  AtomicOps::Exchange(&wakeup_pending_, 0);
+  TakeIncoming();
+  ReleaseFreed();
+  if (ready_head_ || due_head_)
+    return 0;
+  if (delayed_count_ == 0)
+    return kForever;
+
+  // The wheel has to be advanced next when the first occupied level 0 slot
+  // expires, or at the next cascade that moves something, whichever comes
+  // first.
+  uint32 next = 0;
+  bool found = false;
+  if (level_count_[0] > 0) {
+    for (uint32 i = 1; i < static_cast<uint32>(kSlots); ++i) {
+      if (slots_[0][(now_ + i) & (kSlots - 1)]) {
+        next = now_ + i;
+        found = true;
+        break;
+      }
+    }
+  }
+  if (delayed_count_ > level_count_[0]) {
+    int level = 1;
+    uint32 block = (now_ >> kSlotBits) + 1;
+    if (level_count_[0] == 0) {
+      // Skip the cascades of the empty levels, and those of the lowest
+      // occupied level that have nothing to move, up to the next one of the
+      // level above.
+      while (level_count_[level] == 0) {
+        ++level;
+      }
+      block = (now_ >> (level * kSlotBits)) + 1;
+      while ((level + 1 == kLevels || (block & (kSlots - 1)) != 0) &&
+             !slots_[level][block & (kSlots - 1)]) {
+        ++block;
+      }
+    }
+    uint32 cascade = block << (level * kSlotBits);
+    if (!found || TimeDiff(cascade, next) < 0) {
+      next = cascade;
+    }
+  }
+  return talk_base::_max(0, static_cast<int>(TimeDiff(next, now)));
+}
+
+void LockFreeMessageStore::Clear(MessageHandler* handler, uint32 id,
+                                 MessageList* removed) {
+  TakeIncoming();
+
+  Node* node;
+  if (handler) {
+    // The delayed messages are found through the index, only the ready ones
+    // have to be searched.
+    Node** first = handlers_.Find(handler);
+    for (node = first ? *first : NULL; node; ) {
+      Node* next = node->hnext;
+      if (node->msg.Match(handler, id)) {
+        Remove(node, removed);
+      }
+      node = next;
+    }
+  } else {
+    for (node = due_head_; node; ) {
+      Node* next = node->next;
+      if (node->msg.Match(handler, id)) {
+        Remove(node, removed);
+      }
+      node = next;
+    }
+    for (int level = 0; level < kLevels; ++level) {
+      if (level_count_[level] == 0)
+        continue;
+      for (int slot = 0; slot < kSlots; ++slot) {
+        for (node = slots_[level][slot]; node; ) {
+          Node* next = node->next;
+          if (node->msg.Match(handler, id)) {
+            Remove(node, removed);
+          }
+          node = next;
+        }
+      }
+    }
+  }
+  for (node = ready_head_; node; ) {
+    Node* next = node->next;
+    if (node->msg.Match(handler, id)) {
+      Remove(node, removed);
+    }
+    node = next;
+  }
+}
+
+size_t LockFreeMessageStore::size() {
+  TakeIncoming();
+  return ready_count_ + delayed_count_;
+}
+
+LockFreeMessageStore::Node* LockFreeMessageStore::NewNode(const Message& msg) {
+  // Take the whole free list, so that no other producer can pop the node we
+  // are about to take (which would make a compare-and-swap pop subject to
+  // ABA), then put back the rest.
+  Node* node = AtomicOps::ExchangePtr(&free_, static_cast<Node*>(NULL));
+  if (node) {
+    Node* rest = node->next;
+    if (rest && AtomicOps::CompareAndSwapPtr(&free_, static_cast<Node*>(NULL),
+                                             rest) != NULL) {
+      // Nodes were freed in the meantime; put the rest behind them.
+      Node* last = rest;
+      while (last->next) {
+        last = last->next;
+      }
+      Node* head;
+      do {
+        head = free_;
+        last->next = head;
+      } while (AtomicOps::CompareAndSwapPtr(&free_, head, rest) != head);
+    }
+  } else {
+    node = new Node();
+    AtomicOps::Increment(&node_count_);
+  }
+  node->next = NULL;
+  node->msg = msg;
+  node->delayed = false;
+  return node;
+}
+
+void LockFreeMessageStore::FreeNode(Node* node) {
+  if (node_count_ > kMaxPooledNodes) {
+    AtomicOps::Decrement(&node_count_);
+    delete node;
+    return;
+  }
+  node->location = Node::NOWHERE;
+  node->next = freed_;
+  if (!freed_) {
+    freed_last_ = node;
+  }
+  freed_ = node;
+  if (++freed_count_ == kFreeBatchSize) {
+    ReleaseFreed();
+  }
+}
+
+void LockFreeMessageStore::ReleaseFreed() {
+  if (!freed_)
+    return;
+  Node* head;
+  do {
+    head = free_;
+    freed_last_->next = head;
+  } while (AtomicOps::CompareAndSwapPtr(&free_, head, freed_) != head);
+  freed_ = freed_last_ = NULL;
+  freed_count_ = 0;
+}
+
+void LockFreeMessageStore::Enqueue(Node* node) {
+  node->next = NULL;
+  Node* prev = AtomicOps::ExchangePtr(&head_, node);
+  // Between the exchange and this store the queue is cut at |prev|; the
+  // consumer treats that like an empty queue.
+  AtomicOps::ReleaseStorePtr(&prev->next, node);
+}
+
+bool LockFreeMessageStore::Push(Node* node) {
+  Enqueue(node);
+  // While the consumer is busy the flag stays set, and reading it doesn't
+  // take the cache line away from the other producers.
+  if (wakeup_pending_)
+    return false;
+  return AtomicOps::Exchange(&wakeup_pending_, 1) == 0;
+}
+
+LockFreeMessageStore::Node* LockFreeMessageStore::Pop() {
+  Node* tail = tail_;
+  Node* next = AtomicOps::AcquireLoadPtr(&tail->next);
+  if (tail == stub_) {
+    if (!next)
+      return NULL;
+    tail_ = next;
+    tail = next;
+    next = AtomicOps::AcquireLoadPtr(&next->next);
+  }
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+  if (tail != head_)
+    return NULL;  // A push is in progress.
+  // |tail| is the last node; put the stub behind it so it can be taken.
+  Enqueue(stub_);
+  next = AtomicOps::AcquireLoadPtr(&tail->next);
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+  return NULL;
+}
+
+void LockFreeMessageStore::TakeIncoming() {
+  Node* node;
+  while ((node = Pop()) != NULL) {
+    if (node->delayed) {
+      node->num = next_num_++;
+      ++delayed_count_;
+      Index(node);
+      Schedule(node);
+    } else {
+      ++ready_count_;
+      Link(node, Node::READY, 0, 0);
+    }
+  }
+}
+
+void LockFreeMessageStore::Schedule(Node* node) {
+  int32 delta = TimeDiff(node->trigger, now_);
+  if (delta <= 0) {
+    Link(node, Node::DUE, 0, 0);
+    return;
+  }
+  int level = 0;
+  while (level + 1 < kLevels &&
+         static_cast<uint32>(delta) >= (1u << ((level + 1) * kSlotBits))) {
+    ++level;
+  }
+  int slot = (node->trigger >> (level * kSlotBits)) & (kSlots - 1);
+  Link(node, Node::WHEEL, level, slot);
+}
+
+void LockFreeMessageStore::Advance(uint32 now) {
+  while (TimeDiff(now, now_) > 0) {
+    int level = 0;
+    while (level < kLevels && level_count_[level] == 0) {
+      ++level;
+    }
+    if (level == kLevels) {
+      now_ = now;
+      break;
+    }
+    if (level > 0) {
+      // Nothing expires before the next cascade of |level|; the ones of the
+      // levels below have nothing to move.
+      uint32 last = now_ | ((1u << (level * kSlotBits)) - 1);
+      if (TimeDiff(now, last) <= 0) {
+        now_ = now;
+        break;
+      }
+      now_ = last;
+    }
+    ++now_;
+    if ((now_ & (kSlots - 1)) == 0) {
+      Cascade(1);
+    }
+    Node*& slot = slots_[0][now_ & (kSlots - 1)];
+    while (slot) {
+      Node* node = slot;
+      Unlink(node);
+      Link(node, Node::DUE, 0, 0);
+    }
+  }
+}
+
+void LockFreeMessageStore::Cascade(int level) {
+  int index = (now_ >> (level * kSlotBits)) & (kSlots - 1);
+  if (index == 0 && level + 1 < kLevels) {
+    Cascade(level + 1);
+  }
+  Node*& slot = slots_[level][index];
+  while (slot) {
+    Node* node = slot;
+    Unlink(node);
+    Schedule(node);
+  }
+}
+
+void LockFreeMessageStore::FlushDue() {
+  while (due_head_) {
+    Node* node = due_head_;
+    Unlink(node);
+    Unindex(node);
+    --delayed_count_;
+    ++ready_count_;
+    Link(node, Node::READY, 0, 0);
+  }
+}
+
+void LockFreeMessageStore::Index(Node* node) {
+  MessageHandler* handler = node->msg.phandler;
+  Node** first = handlers_.Find(handler);
+  node->hprev = NULL;
+  node->hnext = first ? *first : NULL;
+  if (node->hnext) {
+    node->hnext->hprev = node;
+  }
+  handlers_.Insert(handler, node);
+}
+
+void LockFreeMessageStore::Unindex(Node* node) {
+  if (node->hprev) {
+    node->hprev->hnext = node->hnext;
+  } else if (node->hnext) {
+    handlers_.Insert(node->msg.phandler, node->hnext);
+  } else {
+    handlers_.Erase(node->msg.phandler);
+  }
+  if (node->hnext) {
+    node->hnext->hprev = node->hprev;
+  }
+  node->hnext = node->hprev = NULL;
+}
+
+void LockFreeMessageStore::Link(Node* node, int location, int level,
+                                int slot) {
+  node->location = static_cast<uint8>(location);
+  node->level = static_cast<uint8>(level);
+  node->slot = static_cast<uint8>(slot);
+  if (location == Node::READY) {
+    node->prev = ready_tail_;
+    node->next = NULL;
+    if (ready_tail_) {
+      ready_tail_->next = node;
+    } else {
+      ready_head_ = node;
+    }
+    ready_tail_ = node;
+  } else if (location == Node::DUE) {
+    // Messages mostly become due in order, so search from the back.
+    Node* prev = due_tail_;
+    while (prev && IsBefore(node->trigger, node->num,
+                            prev->trigger, prev->num)) {
+      prev = prev->prev;
+    }
+    Node* next = prev ? prev->next : due_head_;
+    node->prev = prev;
+    node->next = next;
+    if (prev) {
+      prev->next = node;
+    } else {
+      due_head_ = node;
+    }
+    if (next) {
+      next->prev = node;
+    } else {
+      due_tail_ = node;
+    }
+  } else {
+    Node*& first = slots_[level][slot];
+    node->prev = NULL;
+    node->next = first;
+    if (first) {
+      first->prev = node;
+    }
+    first = node;
+    ++level_count_[level];
+  }
+}
+
+void LockFreeMessageStore::Unlink(Node* node) {
+  Node* prev = node->prev;
+  Node* next = node->next;
+  if (node->location == Node::READY) {
+    if (prev) {
+      prev->next = next;
+    } else {
+      ready_head_ = next;
+    }
+    if (next) {
+      next->prev = prev;
+    } else {
+      ready_tail_ = prev;
+    }
+  } else if (node->location == Node::DUE) {
+    if (prev) {
+      prev->next = next;
+    } else {
+      due_head_ = next;
+    }
+    if (next) {
+      next->prev = prev;
+    } else {
+      due_tail_ = prev;
+    }
+  } else if (node->location == Node::WHEEL) {
+    if (prev) {
+      prev->next = next;
+    } else {
+      slots_[node->level][node->slot] = next;
+    }
+    if (next) {
+      next->prev = prev;
+    }
+    --level_count_[node->level];
+  }
+  node->location = Node::NOWHERE;
+  node->next = node->prev = NULL;
+}
+
+void LockFreeMessageStore::Remove(Node* node, MessageList* removed) {
+  if (node->location == Node::READY) {
+    --ready_count_;
+  } else {
+    Unindex(node);
+    --delayed_count_;
+  }
+  Unlink(node);
+  if (removed) {
+    removed->push_back(node->msg);
+  } else {
+    delete node->msg.pdata;
+  }
+  FreeNode(node);
+}
+
+}  // namespace talk_base
@@ -0,0 +1,144 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_LOCKFREEMESSAGESTORE_H_
+#define TALK_BASE_LOCKFREEMESSAGESTORE_H_
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/messagequeue.h"
+#include "talk/base/openhashmap.h"
+
+namespace talk_base {
+
+// Holds the messages of a MessageQueue in MODE_LOCKFREE.
+//
+// Messages are posted, from any thread and without locking, to an intrusive
+// multi-producer, single-consumer queue whose nodes come from a per-store
+// pool. The consumer moves them out of that queue into a ready list, or for
+// delayed messages into a hierarchical timer wheel, from which they move to
+// the ready list once due. Delayed messages are also indexed by handler, so
+// that clearing the messages of one handler does not walk all of them.
+//
+// The consumer methods may be called from any thread, but not concurrently;
+// MessageQueue calls them under its lock.
+class LockFreeMessageStore {
+ public:
+  explicit LockFreeMessageStore(uint32 now);
+  // Deletes the remaining messages, but not their data.
+  ~LockFreeMessageStore();
+
+  // Producer methods. These return true if the consumer has to be woken up,
+  // i.e. if this is the first message since the consumer last called
+  // GetDelay().
+  bool Post(const Message& msg);
+  bool PostAt(const Message& msg, uint32 trigger);
+
+  // Consumer methods.
+  // Takes in posted messages, and makes the delayed messages that are due at
+  // |now| ready.
+  void Update(uint32 now);
+  // Gets the oldest ready message.
+  bool PopReady(Message* msg);
+  // Returns the number of milliseconds from |now| until Update() needs to be
+  // called again; this is 0 if there are ready messages. It may be less than
+  // the time until the next delayed message is due. To be called before the
+  // consumer waits, as the next post will wake it up.
+  int GetDelay(uint32 now);
+  // Removes the matching messages, see MessageQueue::Clear.
+  void Clear(MessageHandler* handler, uint32 id, MessageList* removed);
+  // Takes in posted messages and counts all messages.
+  size_t size();
+
+ private:
+  struct Node;
+  struct PointerHash {
+    size_t operator()(const MessageHandler* p) const {
+      return reinterpret_cast<size_t>(p);
+    }
+  };
+  // Maps each handler to the first of its delayed messages.
+  typedef OpenHashMap<MessageHandler*, Node*, PointerHash> HandlerMap;
+
+  static const int kLevels = 4;
+  static const int kSlotBits = 8;
+  static const int kSlots = 1 << kSlotBits;
+  static const int kMaxPooledNodes = 1024;
+  static const int kFreeBatchSize = 32;
+
+  Node* NewNode(const Message& msg);
+  // Freed nodes are given back to the pool in batches, so that the consumer
+  // and the producers don't contend for the pool on every message.
+  void FreeNode(Node* node);
+  void ReleaseFreed();
+  void Enqueue(Node* node);
+  bool Push(Node* node);
+  Node* Pop();
+
+  void TakeIncoming();
+  void Schedule(Node* node);
+  void Advance(uint32 now);
+  void Cascade(int level);
+  void FlushDue();
+  void Index(Node* node);
+  void Unindex(Node* node);
+  void Link(Node* node, int location, int level, int slot);
+  void Unlink(Node* node);
+  void Remove(Node* node, MessageList* removed);
+
+  // Shared with the producers: the incoming queue and the node pool.
+  Node* volatile head_;
+  Node* volatile free_;
+  int node_count_;
+  int wakeup_pending_;
+
+  // Consumer side. The ready and due lists are in delivery order; due
+  // messages are delayed messages that are ready, kept apart until they are
+  // sorted by trigger time.
+  Node* tail_;
+  Node* stub_;
+  Node* freed_;
+  Node* freed_last_;
+  int freed_count_;
+  Node* ready_head_;
+  Node* ready_tail_;
+  Node* due_head_;
+  Node* due_tail_;
+  Node* slots_[kLevels][kSlots];
+  size_t ready_count_;
+  size_t delayed_count_;
+  size_t level_count_[kLevels];
+  uint32 now_;
+  uint32 next_num_;
+  HandlerMap handlers_;
+
+  DISALLOW_COPY_AND_ASSIGN(LockFreeMessageStore);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_LOCKFREEMESSAGESTORE_H_
@@ -0,0 +1,199 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <vector>
+
+#include "talk/base/gunit.h"
+#include "talk/base/lockfreemessagestore.h"
+
+using talk_base::LockFreeMessageStore;
+using talk_base::Message;
+using talk_base::MessageHandler;
+using talk_base::MessageList;
+using talk_base::kForever;
+
+class StoreTestHandler : public MessageHandler {
+ public:
+  virtual void OnMessage(Message* msg) {}
+};
+
+static Message MakeMessage(MessageHandler* handler, uint32 id) {
+  Message msg;
+  msg.phandler = handler;
+  msg.message_id = id;
+  return msg;
+}
+
+TEST(LockFreeMessageStoreTest, PostsAreReadyInOrder) {
+  StoreTestHandler handler;
+  LockFreeMessageStore store(1000);
+  EXPECT_TRUE(store.Post(MakeMessage(&handler, 0)));
+  // Only the first post since the last update asks for a wakeup.
+  EXPECT_FALSE(store.Post(MakeMessage(&handler, 1)));
+  EXPECT_FALSE(store.PostAt(MakeMessage(&handler, 2), 1000));
+  EXPECT_EQ(3u, store.size());
+  EXPECT_EQ(0, store.GetDelay(1000));
+
+  store.Update(1000);
+  Message msg;
+  for (uint32 i = 0; i < 3; ++i) {
+    ASSERT_TRUE(store.PopReady(&msg));
+    EXPECT_EQ(i, msg.message_id);
+  }
+  EXPECT_FALSE(store.PopReady(&msg));
+  EXPECT_EQ(0u, store.size());
+  EXPECT_EQ(kForever, store.GetDelay(1000));
+  EXPECT_TRUE(store.Post(MakeMessage(&handler, 3)));
+}
+
+// Posts messages with delays that end up on every level of the wheel, and
+// checks that each one becomes ready when it is due and not before, when
+// time advances as indicated by GetDelay.
+static void TestDelayedPosts(uint32 start) {
+  static const uint32 kDelays[] = {
+    1, 5, 255, 256, 257, 300, 65535, 65536, 70000, 1 << 20, (1 << 24) + 3,
+    0x40000000,
+  };
+  static const size_t kNumDelays = sizeof(kDelays) / sizeof(kDelays[0]);
+  StoreTestHandler handler;
+  LockFreeMessageStore store(start);
+  for (size_t i = 0; i < kNumDelays; ++i) {
+    store.PostAt(MakeMessage(&handler, static_cast<uint32>(i)),
+                 start + kDelays[i]);
+  }
+  // An overdue one becomes ready right away.
+  store.PostAt(MakeMessage(&handler, 100), start - 10);
+
+  uint32 now = start;
+  store.Update(now);
+  Message msg;
+  ASSERT_TRUE(store.PopReady(&msg));
+  EXPECT_EQ(100u, msg.message_id);
+
+  size_t next = 0;
+  int updates = 0;
+  while (next < kNumDelays) {
+    int delay = store.GetDelay(now);
+    ASSERT_NE(kForever, delay);
+    ASSERT_GT(delay, 0);
+    // Lag behind a bit at times, as a busy thread would.
+    now += delay + (updates % 3 == 0 ? 1 : 0);
+    store.Update(now);
+    ++updates;
+    while (store.PopReady(&msg)) {
+      ASSERT_EQ(next, msg.message_id);
+      EXPECT_LE(kDelays[next], now - start);
+      // It shouldn't be later than we made it.
+      EXPECT_GE(kDelays[next] + 1, now - start);
+      ++next;
+    }
+  }
+  EXPECT_EQ(kForever, store.GetDelay(now));
+  // Getting there should not take a wakeup per millisecond.
+  EXPECT_GT(5000, updates);
+}
+
+TEST(LockFreeMessageStoreTest, DelayedPostsAreReadyWhenDue) {
+  TestDelayedPosts(1000);
+  TestDelayedPosts(123456789);
+}
+
+TEST(LockFreeMessageStoreTest, DelayedPostsAreReadyWhenDueAcrossWrap) {
+  TestDelayedPosts(0xFFFFFF00);
+  TestDelayedPosts(0xFFFFFFFF);
+}
+
+TEST(LockFreeMessageStoreTest, DelayedPostsWithIdenticalTimesAreFifo) {
+  StoreTestHandler handler;
+  LockFreeMessageStore store(1000);
+  store.PostAt(MakeMessage(&handler, 3), 1010);
+  store.PostAt(MakeMessage(&handler, 0), 1002);
+  store.Update(1001);
+  store.PostAt(MakeMessage(&handler, 1), 1005);
+  store.PostAt(MakeMessage(&handler, 4), 1010);
+  store.PostAt(MakeMessage(&handler, 2), 1005);
+  store.Update(1020);
+  Message msg;
+  for (uint32 i = 0; i < 5; ++i) {
+    ASSERT_TRUE(store.PopReady(&msg));
+    EXPECT_EQ(i, msg.message_id);
+  }
+  EXPECT_FALSE(store.PopReady(&msg));
+}
+
+TEST(LockFreeMessageStoreTest, ClearByHandler) {
+  StoreTestHandler handler1, handler2;
+  LockFreeMessageStore store(1000);
+  for (uint32 i = 0; i < 10; ++i) {
+    store.Post(MakeMessage(&handler1, i));
+    store.Post(MakeMessage(&handler2, i));
+    store.PostAt(MakeMessage(&handler1, i), 1000 + i * 1000);
+    store.PostAt(MakeMessage(&handler2, i), 1000 + i * 1000);
+  }
+  store.Update(1000);
+  EXPECT_EQ(40u, store.size());
+
+  MessageList removed;
+  store.Clear(&handler1, 3, &removed);
+  EXPECT_EQ(2u, removed.size());
+  EXPECT_EQ(38u, store.size());
+  removed.clear();
+  store.Clear(&handler1, talk_base::MQID_ANY, &removed);
+  EXPECT_EQ(18u, removed.size());
+  for (MessageList::iterator it = removed.begin(); it != removed.end(); ++it) {
+    EXPECT_EQ(&handler1, it->phandler);
+  }
+  EXPECT_EQ(20u, store.size());
+
+  // Clearing all handlers by id also finds the delayed messages.
+  removed.clear();
+  store.Clear(NULL, 9, &removed);
+  EXPECT_EQ(2u, removed.size());
+
+  store.Update(20000);
+  Message msg;
+  size_t count = 0;
+  while (store.PopReady(&msg)) {
+    EXPECT_EQ(&handler2, msg.phandler);
+    EXPECT_NE(9u, msg.message_id);
+    ++count;
+  }
+  EXPECT_EQ(18u, count);
+  EXPECT_EQ(0u, store.size());
+}
+
+TEST(LockFreeMessageStoreTest, ClearTakesInPosts) {
+  StoreTestHandler handler;
+  LockFreeMessageStore store(1000);
+  store.Post(MakeMessage(&handler, 1));
+  store.PostAt(MakeMessage(&handler, 2), 5000);
+  MessageList removed;
+  store.Clear(&handler, talk_base::MQID_ANY, &removed);
+  EXPECT_EQ(2u, removed.size());
+  EXPECT_EQ(0u, store.size());
+  EXPECT_EQ(kForever, store.GetDelay(1000));
+}
@@ -51,6 +51,7 @@ static const int kMaxLogLineSize = 1024 - 60;
 #include <vector>
 
 #include "talk/base/logging.h"
+#include "talk/base/asynclogger.h"
 #include "talk/base/stream.h"
 #include "talk/base/stringencode.h"
 #include "talk/base/stringutils.h"
@@ -113,6 +114,10 @@ int LogMessage::ctx_sev_ = LS_WARNING;
 // cleanup by setting to NULL, or let it leak (safe at program exit).
 LogMessage::StreamList LogMessage::streams_;
 
+CriticalSection LogMessage::async_crit_;
+AsyncLogger* volatile LogMessage::async_logger_ = NULL;
+int LogMessage::async_ = 0;
+
 // Boolean options default to false (0)
 bool LogMessage::thread_, LogMessage::timestamp_;
 
@@ -201,14 +206,13 @@ LogMessage::~LogMessage() {
     OutputToDebug(str, severity_);
   }
 
-  uint32 before = Time();
-  // Must lock streams_ before accessing
-  CritScope cs(&crit_);
-  for (StreamList::iterator it = streams_.begin(); it != streams_.end(); ++it) {
-    if (severity_ >= it->second) {
-      OutputToStream(it->first, str);
-    }
+  if (AtomicOps::AcquireLoad(&async_)) {
+    AtomicOps::AcquireLoadPtr(&async_logger_)->Log(severity_, str);
+    return;
   }
+
+  uint32 before = Time();
+  OutputToStreams(str, severity_);
   uint32 delay = TimeSince(before);
   if (delay >= warn_slow_logs_delay_) {
     LogMessage slow_log_warning =
@@ -290,6 +294,44 @@ void LogMessage::RemoveLogToStream(StreamInterface* stream) {
   UpdateMinLogSeverity();
 }
 
+void LogMessage::SetAsyncLogging(bool on) {
+  // Not crit_, which the writer thread takes while it is being stopped.
+  CritScope cs(&async_crit_);
+  if (on == (async_ != 0)) {
+    return;
+  }
+  if (on) {
+    if (!async_logger_) {
+      // Published before async_, which is what the logging threads check.
+      AtomicOps::ReleaseStorePtr(
+          &async_logger_, new AsyncLogger(AsyncLogger::kDefaultRingSize));
+    }
+    async_logger_->Start();
+    AtomicOps::ReleaseStore(&async_, 1);
+  } else {
+    // Messages that other threads are logging right now may still end up in
+    // the rings, to be written out if async logging is turned on again.
+    AtomicOps::ReleaseStore(&async_, 0);
+    async_logger_->Stop();
+  }
+}
+
+bool LogMessage::IsAsyncLogging() {
+  return AtomicOps::AcquireLoad(&async_) != 0;
+}
+
+void LogMessage::FlushAsyncLogging() {
+  AsyncLogger* logger = AtomicOps::AcquireLoadPtr(&async_logger_);
+  if (logger) {
+    logger->Flush();
+  }
+}
+
+int LogMessage::GetDroppedLogCount() {
+  AsyncLogger* logger = AtomicOps::AcquireLoadPtr(&async_logger_);
+  return logger ? logger->dropped_count() : 0;
+}
+
 void LogMessage::ConfigureLogging(const char* params, const char* filename) {
   int current_level = LS_VERBOSE;
   int debug_level = GetLogToDebug();
@@ -503,6 +545,17 @@ void LogMessage::OutputToDebug(const std::string& str,
   }
 }
 
+void LogMessage::OutputToStreams(const std::string& str,
+                                 LoggingSeverity severity) {
+  // Must lock streams_ before accessing
+  CritScope cs(&crit_);
+  for (StreamList::iterator it = streams_.begin(); it != streams_.end(); ++it) {
+    if (severity >= it->second) {
+      OutputToStream(it->first, str);
+    }
+  }
+}
+
 void LogMessage::OutputToStream(StreamInterface* stream,
                                 const std::string& str) {
   // If write isn't fully successful, what are we going to do, log it? :)
@@ -74,6 +74,7 @@
 
 namespace talk_base {
 
+class AsyncLogger;
 class StreamInterface;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -178,6 +179,16 @@ class LogMessage {
   static void AddLogToStream(StreamInterface* stream, int min_sev);
   static void RemoveLogToStream(StreamInterface* stream);
 
+  //  Async: Messages for the streams are queued and written out by a
+  //   background thread, see AsyncLogger. Threads that log then don't wait for
+  //   each other or for the streams, but may drop messages if the streams
+  //   can't keep up. Debug output is still written synchronously.
+  //   FlushAsyncLogging writes out the queued messages before it returns.
+  static void SetAsyncLogging(bool on);
+  static bool IsAsyncLogging();
+  static void FlushAsyncLogging();
+  static int GetDroppedLogCount();
+
   // Testing against MinLogSeverity allows code to avoid potentially expensive
   // logging operations by pre-checking the logging level.
   static int GetMinLogSeverity() { return min_sev_; }
@@ -206,6 +217,8 @@ class LogMessage {
   // These write out the actual log messages.
   static void OutputToDebug(const std::string& msg, LoggingSeverity severity_);
   static void OutputToStream(StreamInterface* stream, const std::string& msg);
+  // Writes to all the streams that take messages of |severity|.
+  static void OutputToStreams(const std::string& msg, LoggingSeverity severity);
 
   // The ostream that buffers the formatted message before output
   std::ostringstream print_stream_;
@@ -234,12 +247,22 @@ class LogMessage {
   // The output streams and their associated severities
   static StreamList streams_;
 
+  // Writes to the streams when async logging is on. It is created the first
+  // time async logging is turned on, and never deleted, as other threads may
+  // still be logging through it.
+  // Both are written under async_crit_ and read without it, with AtomicOps.
+  static CriticalSection async_crit_;
+  static AsyncLogger* volatile async_logger_;
+  static int async_;
+
   // Flags for formatting options
   static bool thread_, timestamp_;
 
   // are we in diagnostic mode (as defined by the app)?
   static bool is_diagnostic_mode_;
 
+  friend class AsyncLogger;
+
   DISALLOW_EVIL_CONSTRUCTORS(LogMessage);
 };
 
@@ -31,6 +31,7 @@
 #include "talk/base/pathutils.h"
 #include "talk/base/stream.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 
 namespace talk_base {
 
@@ -115,6 +116,65 @@ TEST(LogTest, MultipleThreads) {
 }
 
 
+// Logs numbered messages, to check that they arrive in order.
+class CountingLogThread : public Thread {
+ public:
+  CountingLogThread(int id, int count) : id_(id), count_(count) {}
+  virtual ~CountingLogThread() { Stop(); }
+
+  virtual void Run() {
+    for (int i = 0; i < count_; ++i) {
+      LOG(LS_INFO) << "thread " << id_ << " message " << i << ".";
+    }
+  }
+
+ private:
+  int id_;
+  int count_;
+};
+
+TEST(LogTest, AsyncStreams) {
+  int sev = LogMessage::GetLogToStream(NULL);
+
+  std::string str;
+  StringStream stream(str);
+  LogMessage::AddLogToStream(&stream, LS_INFO);
+  LogMessage::SetAsyncLogging(true);
+  EXPECT_TRUE(LogMessage::IsAsyncLogging());
+
+  const int kThreads = 3;
+  const int kMessages = 100;
+  {
+    CountingLogThread thread1(1, kMessages), thread2(2, kMessages),
+        thread3(3, kMessages);
+    thread1.Start();
+    thread2.Start();
+    thread3.Start();
+  }
+  LOG(LS_VERBOSE) << "VERBOSE";
+  LogMessage::FlushAsyncLogging();
+
+  for (int id = 1; id <= kThreads; ++id) {
+    size_t pos = 0;
+    for (int i = 0; i < kMessages; ++i) {
+      std::ostringstream message;
+      message << "thread " << id << " message " << i << ".";
+      pos = str.find(message.str(), pos);
+      ASSERT_NE(std::string::npos, pos) << message.str();
+    }
+  }
+  EXPECT_EQ(std::string::npos, str.find("VERBOSE"));
+  EXPECT_EQ(0, LogMessage::GetDroppedLogCount());
+
+  LogMessage::SetAsyncLogging(false);
+  EXPECT_FALSE(LogMessage::IsAsyncLogging());
+  LOG(LS_INFO) << "SYNC";
+  EXPECT_NE(std::string::npos, str.find("SYNC"));
+  LogMessage::RemoveLogToStream(&stream);
+
+  EXPECT_EQ(sev, LogMessage::GetLogToStream(NULL));
+}
+
 TEST(LogTest, WallClockStartTime) {
   uint32 time = LogMessage::WallClockStartTime();
   // Expect the time to be in a sensible range, e.g. > 2012-01-01.
@@ -146,4 +206,69 @@ TEST(LogTest, Perf) {
   LOG(LS_INFO) << "Average log time: " << TimeDiff(finish, start) << " us";
 }
 
+// Logs 80-character messages and measures how long each LOG takes.
+class TimedLogThread : public Thread {
+ public:
+  explicit TimedLogThread(int count) : count_(count), elapsed_(0) {}
+  virtual ~TimedLogThread() { Stop(); }
+
+  virtual void Run() {
+    std::string message(80, 'X');
+    uint64 start = TimeNanos();
+    for (int i = 0; i < count_; ++i) {
+      LOG(LS_SENSITIVE) << message;
+    }
+    elapsed_ = TimeNanos() - start;
+  }
+
+  uint64 elapsed() const { return elapsed_; }
+
+ private:
+  int count_;
+  uint64 elapsed_;
+};
+
+// Compare the time a LOG takes when four threads log to an unbuffered file,
+// with the file written synchronously and asynchronously. The bursts fit into
+// the ring buffers, so that no messages are dropped even if the writer thread
+// doesn't get to run.
+TEST(LogTest, MultipleThreadsPerf) {
+  const int kThreads = 4;
+  const int kMessages = 250;
+  Pathname path;
+  EXPECT_TRUE(Filesystem::GetTemporaryFolder(path, true, NULL));
+  path.SetPathname(Filesystem::TempFilename(path, "ut"));
+
+  FileStream stream;
+  EXPECT_TRUE(stream.Open(path.pathname(), "wb", NULL));
+  stream.DisableBuffering();
+  LogMessage::AddLogToStream(&stream, LS_SENSITIVE);
+
+  uint64 elapsed[2] = { 0, 0 };
+  for (int async = 0; async < 2; ++async) {
+    LogMessage::SetAsyncLogging(async != 0);
+    TimedLogThread* threads[kThreads];
+    for (int i = 0; i < kThreads; ++i) {
+      threads[i] = new TimedLogThread(kMessages);
+      threads[i]->Start();
+    }
+    for (int i = 0; i < kThreads; ++i) {
+      threads[i]->Stop();
+      elapsed[async] += threads[i]->elapsed();
+      delete threads[i];
+    }
+    LogMessage::SetAsyncLogging(false);
+  }
+  int dropped = LogMessage::GetDroppedLogCount();
+
+  LogMessage::RemoveLogToStream(&stream);
+  stream.Close();
+  Filesystem::DeleteFile(path);
+
+  LOG(LS_INFO) << "Average log time with " << kThreads << " threads: "
+               << elapsed[0] / (kThreads * kMessages) << " ns, "
+               << elapsed[1] / (kThreads * kMessages) << " ns async, "
+               << dropped << " messages dropped";
+}
+
 }  // namespace talk_base
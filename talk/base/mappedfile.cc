@@ -0,0 +1,159 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/mappedfile.h"
+
+#ifdef POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN32
+#include "talk/base/win32.h"
+#endif
+
+#include "talk/base/logging.h"
+
+namespace talk_base {
+
+#ifdef WIN32
+
+MappedFile::MappedFile()
+    : open_(false), data_(NULL), size_(0), file_(NULL), mapping_(NULL) {
+}
+
+bool MappedFile::Open(const std::string& filename) {
+  Close();
+  HANDLE file = ::CreateFile(ToUtf16(filename).c_str(), GENERIC_READ,
+                             FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    LOG_ERR(LS_ERROR) << "CreateFile(" << filename << ") failed";
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(file, &size) ||
+      static_cast<uint64>(size.QuadPart) > static_cast<size_t>(-1)) {
+    LOG_ERR(LS_ERROR) << "Can't map " << filename;
+    ::CloseHandle(file);
+    return false;
+  }
+  file_ = file;
+  size_ = static_cast<size_t>(size.QuadPart);
+  open_ = true;
+  if (size_ == 0) {
+    // Empty files can't be mapped.
+    return true;
+  }
+  mapping_ = ::CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_) {
+    data_ = static_cast<const char*>(
+        ::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (!data_) {
+    LOG_ERR(LS_ERROR) << "Can't map " << filename;
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) {
+    ::UnmapViewOfFile(data_);
+  }
+  if (mapping_) {
+    ::CloseHandle(mapping_);
+  }
+  if (file_) {
+    ::CloseHandle(file_);
+  }
+  open_ = false;
+  data_ = NULL;
+  size_ = 0;
+  file_ = NULL;
+  mapping_ = NULL;
+}
+
+#else  // !WIN32
+
+MappedFile::MappedFile() : open_(false), data_(NULL), size_(0) {
+}
+
+bool MappedFile::Open(const std::string& filename) {
+  Close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG_ERR(LS_ERROR) << "open(" << filename << ") failed";
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<uint64>(st.st_size) > static_cast<size_t>(-1)) {
+    LOG_ERR(LS_ERROR) << "Can't map " << filename;
+    ::close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* data = NULL;
+  if (size > 0) {
+    data = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      LOG_ERR(LS_ERROR) << "mmap(" << filename << ") failed";
+      ::close(fd);
+      return false;
+    }
+    // The file is read front to back; let the kernel read ahead.
+    ::madvise(data, size, MADV_SEQUENTIAL);
+  }
+  // The mapping stays valid after the descriptor is closed.
+  ::close(fd);
+  data_ = static_cast<const char*>(data);
+  size_ = size;
+  open_ = true;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+  open_ = false;
+  data_ = NULL;
+  size_ = 0;
+}
+
+#endif  // !WIN32
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+}  // namespace talk_base
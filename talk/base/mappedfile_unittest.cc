@@ -0,0 +1,90 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string>
+
+#include "talk/base/fileutils.h"
+#include "talk/base/gunit.h"
+#include "talk/base/mappedfile.h"
+#include "talk/base/pathutils.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/stream.h"
+
+namespace talk_base {
+
+static bool WriteMappedFileTestData(const Pathname& path,
+                                    const std::string& data) {
+  scoped_ptr<FileStream> stream(Filesystem::OpenFile(path, "wb"));
+  return stream.get() != NULL &&
+      stream->WriteAll(data.data(), data.size(), NULL, NULL) == SR_SUCCESS;
+}
+
+TEST(MappedFileTest, MapFile) {
+  Pathname path;
+  ASSERT_TRUE(Filesystem::GetTemporaryFolder(path, true, NULL));
+  path.SetPathname(Filesystem::TempFilename(path, "mappedfile-test-"));
+  const std::string data = "mapped file contents";
+  ASSERT_TRUE(WriteMappedFileTestData(path, data));
+
+  MappedFile file;
+  EXPECT_FALSE(file.is_open());
+  ASSERT_TRUE(file.Open(path.pathname()));
+  EXPECT_TRUE(file.is_open());
+  ASSERT_EQ(data.size(), file.size());
+  EXPECT_EQ(data, std::string(file.data(), file.size()));
+  file.Close();
+  EXPECT_FALSE(file.is_open());
+  EXPECT_TRUE(file.data() == NULL);
+  EXPECT_EQ(0U, file.size());
+
+  // The mapping stays valid after the file is deleted, where that is allowed.
+  ASSERT_TRUE(file.Open(path.pathname()));
+  Filesystem::DeleteFile(path);
+  EXPECT_EQ(data, std::string(file.data(), file.size()));
+}
+
+TEST(MappedFileTest, MapEmptyFile) {
+  Pathname path;
+  ASSERT_TRUE(Filesystem::GetTemporaryFolder(path, true, NULL));
+  path.SetPathname(Filesystem::TempFilename(path, "mappedfile-test-"));
+  ASSERT_TRUE(WriteMappedFileTestData(path, ""));
+
+  MappedFile file;
+  EXPECT_TRUE(file.Open(path.pathname()));
+  EXPECT_TRUE(file.is_open());
+  EXPECT_EQ(0U, file.size());
+  file.Close();
+  EXPECT_TRUE(Filesystem::DeleteFile(path));
+}
+
+TEST(MappedFileTest, MapMissingFile) {
+  MappedFile file;
+  EXPECT_FALSE(file.Open("/this/file/does/not/exist"));
+  EXPECT_FALSE(file.is_open());
+}
+
+}  // namespace talk_base
@@ -54,6 +54,10 @@ class Md5Digest : public MessageDigest {
     MD5Init(&ctx_);  // Reset for next use.
     return kSize;
   }
+  virtual bool CopyFrom(const MessageDigest& other) {
+    ctx_ = static_cast<const Md5Digest&>(other).ctx_;
+    return true;
+  }
  private:
   MD5_CTX ctx_;
 };
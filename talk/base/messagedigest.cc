@@ -181,4 +181,66 @@ std::string ComputeHmac(const std::string& alg, const std::string& key,
   return output;
 }
 
+HmacContext* HmacContext::Create(const std::string& alg,
+                                 const void* key, size_t key_len) {
+  scoped_ptr<MessageDigest> inner(MessageDigestFactory::Create(alg));
+  scoped_ptr<MessageDigest> outer(MessageDigestFactory::Create(alg));
+  scoped_ptr<MessageDigest> digest(MessageDigestFactory::Create(alg));
+  // As in ComputeHmac(), we only handle algorithms with a 64-byte blocksize.
+  if (!inner || !outer || !digest || digest->Size() > 32 ||
+      !digest->CopyFrom(*inner)) {
+    return NULL;
+  }
+  uint8 new_key[kBlockSize];
+  if (key_len > kBlockSize) {
+    ComputeDigest(digest.get(), key, key_len, new_key, kBlockSize);
+    memset(new_key + digest->Size(), 0, kBlockSize - digest->Size());
+  } else {
+    memcpy(new_key, key, key_len);
+    memset(new_key + key_len, 0, kBlockSize - key_len);
+  }
+  uint8 o_pad[kBlockSize], i_pad[kBlockSize];
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    o_pad[i] = 0x5c ^ new_key[i];
+    i_pad[i] = 0x36 ^ new_key[i];
+  }
+  inner->Update(i_pad, kBlockSize);
+  outer->Update(o_pad, kBlockSize);
+  digest->CopyFrom(*inner);
+  return new HmacContext(inner.release(), outer.release(), digest.release());
+}
+
+HmacContext::HmacContext(MessageDigest* inner, MessageDigest* outer,
+                         MessageDigest* digest)
+    : inner_(inner), outer_(outer), digest_(digest) {
+}
+
+size_t HmacContext::Size() const {
+  return digest_->Size();
+}
+
+void HmacContext::Update(const void* buf, size_t len) {
+  digest_->Update(buf, len);
+}
+
+size_t HmacContext::Finish(void* output, size_t out_len) {
+  if (out_len < Size()) {
+    digest_->CopyFrom(*inner_);
+    return 0;
+  }
+  uint8 inner_hash[MessageDigest::kMaxSize];
+  digest_->Finish(inner_hash, sizeof(inner_hash));
+  digest_->CopyFrom(*outer_);
+  digest_->Update(inner_hash, Size());
+  size_t ret = digest_->Finish(output, out_len);
+  digest_->CopyFrom(*inner_);
+  return ret;
+}
+
+size_t HmacContext::Compute(const void* input, size_t in_len,
+                            void* output, size_t out_len) {
+  Update(input, in_len);
+  return Finish(output, out_len);
+}
+
 }  // namespace talk_base
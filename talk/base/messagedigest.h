@@ -30,6 +30,9 @@
 
 #include <string>
 
+#include "talk/base/constructormagic.h"
+#include "talk/base/scoped_ptr.h"
+
 namespace talk_base {
 
 // Definitions for the digest algorithms.
@@ -52,6 +55,10 @@ class MessageDigest {
   // Outputs the digest value to |buf| with length |len|.
   // Returns the number of bytes written, i.e., Size().
   virtual size_t Finish(void* buf, size_t len) = 0;
+  // Sets the state of this digest to that of |other|, which must be of the
+  // same class and algorithm, as if it had been given the same input.
+  // Returns false if the implementation can't copy its state.
+  virtual bool CopyFrom(const MessageDigest& other) { return false; }
 };
 
 // A factory class for creating digest objects.
@@ -118,6 +125,39 @@ std::string ComputeHmac(const std::string& alg, const std::string& key,
 bool ComputeHmac(const std::string& alg, const std::string& key,
                  const std::string& input, std::string* output);
 
+// Computes RFC 2104 HMACs under one key. The padded key is hashed into the
+// inner and outer digest states once, and each HMAC starts from copies of
+// them, rather than hashing the padded key twice for every input.
+class HmacContext {
+ public:
+  // Returns NULL if there is no digest with the name |alg|, or if its
+  // implementation can't copy its state.
+  static HmacContext* Create(const std::string& alg,
+                             const void* key, size_t key_len);
+
+  // Returns the HMAC size, i.e. the digest size.
+  size_t Size() const;
+  // Adds |len| bytes from |buf| to the input of the current HMAC.
+  void Update(const void* buf, size_t len);
+  // Outputs the HMAC of the input so far to |output|, which is |out_len|
+  // bytes long, and starts a new HMAC. Returns the number of bytes written,
+  // or 0 if |out_len| was too small.
+  size_t Finish(void* output, size_t out_len);
+  // Computes the HMAC of |in_len| bytes of |input|, like ComputeHmac().
+  size_t Compute(const void* input, size_t in_len,
+                 void* output, size_t out_len);
+
+ private:
+  HmacContext(MessageDigest* inner, MessageDigest* outer,
+              MessageDigest* digest);
+
+  scoped_ptr<MessageDigest> inner_;
+  scoped_ptr<MessageDigest> outer_;
+  scoped_ptr<MessageDigest> digest_;
+
+  DISALLOW_COPY_AND_ASSIGN(HmacContext);
+};
+
 }  // namespace talk_base
 
 #endif  // TALK_BASE_MESSAGEDIGEST_H_
@@ -25,6 +25,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "talk/base/basicdefs.h"
 #include "talk/base/gunit.h"
 #include "talk/base/messagedigest.h"
 #include "talk/base/stringencode.h"
@@ -159,6 +160,42 @@ TEST(MessageDigestTest, TestSha1Hmac) {
           input.c_str(), input.size(), output, sizeof(output) - 1));
 }
 
+// Test that HmacContext computes the same HMACs as ComputeHmac, repeatedly.
+TEST(MessageDigestTest, TestHmacContext) {
+  const char* algs[] = { DIGEST_MD5, DIGEST_SHA_1 };
+  const std::string keys[] = { "Jefe", std::string(20, '\x0b'),
+                               std::string(80, '\xaa') };
+  const std::string input("Test Using Larger Than Block-Size Key and Larger "
+                          "Than One Block-Size Data");
+  for (size_t i = 0; i < ARRAY_SIZE(algs); ++i) {
+    for (size_t j = 0; j < ARRAY_SIZE(keys); ++j) {
+      scoped_ptr<HmacContext> context(
+          HmacContext::Create(algs[i], keys[j].data(), keys[j].size()));
+      ASSERT_TRUE(context.get() != NULL);
+      std::string expected = ComputeHmac(algs[i], keys[j], input);
+      char output[MessageDigest::kMaxSize];
+      ASSERT_EQ(expected.size() / 2, context->Size());
+      for (int k = 0; k < 2; ++k) {
+        EXPECT_EQ(context->Size(), context->Compute(
+            input.data(), input.size(), output, sizeof(output)));
+        EXPECT_EQ(expected, hex_encode(output, context->Size()));
+      }
+      // Give the input in pieces.
+      context->Update(input.data(), 10);
+      context->Update(input.data() + 10, input.size() - 10);
+      EXPECT_EQ(context->Size(), context->Finish(output, sizeof(output)));
+      EXPECT_EQ(expected, hex_encode(output, context->Size()));
+      // Check the output buffer size; this also starts a new HMAC.
+      context->Update(input.data(), input.size());
+      EXPECT_EQ(0U, context->Finish(output, context->Size() - 1));
+      EXPECT_EQ(context->Size(), context->Compute(
+          input.data(), input.size(), output, sizeof(output)));
+      EXPECT_EQ(expected, hex_encode(output, context->Size()));
+    }
+  }
+  EXPECT_TRUE(HmacContext::Create("sha-9000", "key", 3) == NULL);
+}
+
 TEST(MessageDigestTest, TestBadHmac) {
   std::string output;
   EXPECT_FALSE(ComputeHmac("sha-9000", "key", "abc", &output));
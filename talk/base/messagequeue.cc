@@ -30,9 +30,11 @@
 #endif
 
 #include "talk/base/common.h"
+#include "talk/base/lockfreemessagestore.h"
 #include "talk/base/logging.h"
 #include "talk/base/messagequeue.h"
 #include "talk/base/physicalsocketserver.h"
+#include "talk/base/trace.h"
 
 
 namespace talk_base {
@@ -101,9 +103,9 @@ void MessageQueueManager::Clear(MessageHandler *handler) {
 //------------------------------------------------------------------
 // MessageQueue
 
-MessageQueue::MessageQueue(SocketServer* ss)
+MessageQueue::MessageQueue(SocketServer* ss, Mode mode)
     : ss_(ss), fStop_(false), fPeekKeep_(false), active_(false),
-      dmsgq_next_num_(0) {
+      msgq_size_(0), dmsgq_next_num_(0), stats_enabled_(0) {
   if (!ss_) {
     // Currently, MessageQueue holds a socket server, and is the base class for
     // Thread.  It seems like it makes more sense for Thread to hold the socket
@@ -114,6 +116,12 @@ MessageQueue::MessageQueue(SocketServer* ss)
     ss_ = default_ss_.get();
   }
   ss_->SetMessageQueue(this);
+  if (mode == MODE_LOCKFREE) {
+    store_.reset(new LockFreeMessageStore(Time()));
+    // Posts don't take the lock, so register with the manager now.
+    CritScope cs(&crit_);
+    EnsureActive();
+  }
 }
 
 MessageQueue::~MessageQueue() {
@@ -183,34 +191,58 @@ bool MessageQueue::Get(Message *pmsg, int cmsWait, bool process_io) {
     // Check for posted events
     int cmsDelayNext = kForever;
     bool first_pass = true;
+    size_t depth = 0;
     while (true) {
       // All queue operations need to be locked, but nothing else in this loop
       // (specifically handling disposed message) can happen inside the crit.
       // Otherwise, disposed MessageHandlers will cause deadlocks.
       {
         CritScope cs(&crit_);
-        // On the first pass, check for delayed messages that have been
-        // triggered and calculate the next trigger time.
-        if (first_pass) {
-          first_pass = false;
-          while (!dmsgq_.empty()) {
-            if (TimeIsLater(msCurrent, dmsgq_.top().msTrigger_)) {
-              cmsDelayNext = TimeDiff(dmsgq_.top().msTrigger_, msCurrent);
-              break;
-            }
-            msgq_.push_back(dmsgq_.top().msg_);
-            dmsgq_.pop();
+        if (store_) {
+          // Take in the messages posted since the last pass, and the delayed
+          // messages that have been triggered.
+          store_->Update(msCurrent);
+          if (!store_->PopReady(pmsg)) {
+            cmsDelayNext = store_->GetDelay(msCurrent);
+            break;
+          }
+          if (stats_enabled()) {
+            depth = store_->size() + 1;
           }
-        }
-        // Pull a message off the message queue, if available.
-        if (msgq_.empty()) {
-          break;
         } else {
-          *pmsg = msgq_.front();
-          msgq_.pop_front();
+          // On the first pass, check for delayed messages that have been
+          // triggered and calculate the next trigger time.
+          if (first_pass) {
+            first_pass = false;
+            while (!dmsgq_.empty()) {
+              if (TimeIsLater(msCurrent, dmsgq_.top().msTrigger_)) {
+                cmsDelayNext = TimeDiff(dmsgq_.top().msTrigger_, msCurrent);
+                break;
+              }
+              msgq_.push_back(dmsgq_.top().msg_);
+              ++msgq_size_;
+              dmsgq_.pop();
+            }
+          }
+          // Pull a message off the message queue, if available.
+          if (msgq_.empty()) {
+            break;
+          } else {
+            if (stats_enabled()) {
+              depth = msgq_size_ + dmsgq_.size();
+            }
+            *pmsg = msgq_.front();
+            msgq_.pop_front();
+            --msgq_size_;
+          }
         }
       }  // crit_ is released here.
 
+      if (depth != 0) {
+        RecordDepth(depth);
+        depth = 0;
+      }
+
       // Log a warning for time-sensitive messages that we're late to deliver.
       if (pmsg->ts_sensitive) {
         int32 delay = TimeDiff(msCurrent, pmsg->ts_sensitive);
@@ -271,8 +303,6 @@ void MessageQueue::Post(MessageHandler *phandler, uint32 id,
   // Add the message to the end of the queue
   // Signal for the multiplexer to return
 
-  CritScope cs(&crit_);
-  EnsureActive();
   Message msg;
   msg.phandler = phandler;
   msg.message_id = id;
@@ -280,7 +310,20 @@ void MessageQueue::Post(MessageHandler *phandler, uint32 id,
   if (time_sensitive) {
     msg.ts_sensitive = Time() + kMaxMsgLatency;
   }
+  if (stats_enabled()) {
+    msg.ts_posted_ns = TimeNanos();
+  }
+  if (store_) {
+    // Only the first post since the queue was last looked at needs to wake
+    // it up.
+    if (store_->Post(msg))
+      ss_->WakeUp();
+    return;
+  }
+  CritScope cs(&crit_);
+  EnsureActive();
   msgq_.push_back(msg);
+  ++msgq_size_;
   ss_->WakeUp();
 }
 
@@ -293,12 +336,21 @@ void MessageQueue::DoDelayPost(int cmsDelay, uint32 tstamp,
   // Add to the priority queue. Gets sorted soonest first.
   // Signal for the multiplexer to return.
 
-  CritScope cs(&crit_);
-  EnsureActive();
   Message msg;
   msg.phandler = phandler;
   msg.message_id = id;
   msg.pdata = pdata;
+  if (stats_enabled()) {
+    msg.ts_posted_ns = TimeNanos() +
+        static_cast<uint64>(_max(cmsDelay, 0)) * kNumNanosecsPerMillisec;
+  }
+  if (store_) {
+    if (store_->PostAt(msg, tstamp))
+      ss_->WakeUp();
+    return;
+  }
+  CritScope cs(&crit_);
+  EnsureActive();
   DelayedMessage dmsg(cmsDelay, tstamp, dmsgq_next_num_, msg);
   dmsgq_.push(dmsg);
   // If this message queue processes 1 message every millisecond for 50 days,
@@ -311,6 +363,12 @@ void MessageQueue::DoDelayPost(int cmsDelay, uint32 tstamp,
 int MessageQueue::GetDelay() {
   CritScope cs(&crit_);
 
+  if (store_) {
+    uint32 now = Time();
+    store_->Update(now);
+    return store_->GetDelay(now);
+  }
+
   if (!msgq_.empty())
     return 0;
 
@@ -339,6 +397,11 @@ void MessageQueue::Clear(MessageHandler *phandler, uint32 id,
     fPeekKeep_ = false;
   }
 
+  if (store_) {
+    store_->Clear(phandler, id, removed);
+    return;
+  }
+
   // Remove from ordered message queue
 
   for (MessageList::iterator it = msgq_.begin(); it != msgq_.end();) {
@@ -349,6 +412,7 @@ void MessageQueue::Clear(MessageHandler *phandler, uint32 id,
         delete it->pdata;
       }
       it = msgq_.erase(it);
+      --msgq_size_;
     } else {
       ++it;
     }
@@ -373,8 +437,80 @@ void MessageQueue::Clear(MessageHandler *phandler, uint32 id,
   dmsgq_.reheap();
 }
 
+size_t MessageQueue::size() const {
+  CritScope cs(&crit_);
+  size_t count = store_ ? store_->size() : msgq_size_ + dmsgq_.size();
+  return count + (fPeekKeep_ ? 1u : 0u);
+}
+
 void MessageQueue::Dispatch(Message *pmsg) {
+  LJ_TRACE_EVENT1(LJ_TRACE_CATEGORY_BASE, "MessageQueue::Dispatch",
+                  pmsg->message_id);
+  if (!stats_enabled()) {
+    pmsg->phandler->OnMessage(pmsg);
+    return;
+  }
+  // The handler may change the message.
+  Message msg = *pmsg;
+  uint64 start_ns = TimeNanos();
   pmsg->phandler->OnMessage(pmsg);
+  RecordHandled(msg, false, start_ns, TimeNanos());
+}
+
+void MessageQueue::EnableStats(bool enable) {
+  CritScope cs(&stats_crit_);
+  if (enable && !stats_) {
+    stats_.reset(new MessageQueueStats());
+  }
+  AtomicOps::ReleaseStore(&stats_enabled_, enable ? 1 : 0);
+}
+
+bool MessageQueue::GetStats(MessageQueueStats* stats) const {
+  CritScope cs(&stats_crit_);
+  if (!stats_) {
+    return false;
+  }
+  *stats = *stats_;
+  return true;
+}
+
+void MessageQueue::ResetStats() {
+  CritScope cs(&stats_crit_);
+  if (stats_) {
+    stats_->Reset();
+  }
+}
+
+void MessageQueue::RecordHandled(const Message& msg, bool sent,
+                                 uint64 start_ns, uint64 end_ns) {
+  CritScope cs(&stats_crit_);
+  if (!stats_) {
+    return;
+  }
+  // Messages posted before stats were enabled have no time stamp.
+  if (msg.ts_posted_ns != 0) {
+    uint64 wait_ns =
+        start_ns > msg.ts_posted_ns ? start_ns - msg.ts_posted_ns : 0;
+    LatencyHistogram& latency =
+        sent ? stats_->send_latency : stats_->queue_latency;
+    latency.Add(wait_ns / kNumNanosecsPerMicrosec);
+  }
+  uint64 handler_us = (end_ns - start_ns) / kNumNanosecsPerMicrosec;
+  stats_->handler_time.Add(handler_us);
+  MessageQueueStats::HandlerStats& handler = stats_->handlers[
+      MessageQueueStats::HandlerKey(msg.phandler, msg.message_id)];
+  ++handler.count;
+  handler.total_us += handler_us;
+  handler.max_us = _max(handler.max_us, handler_us);
+}
+
+void MessageQueue::RecordDepth(size_t depth) {
+  CritScope cs(&stats_crit_);
+  if (!stats_) {
+    return;
+  }
+  stats_->max_depth = _max(stats_->max_depth, depth);
+  stats_->total_depth += depth;
 }
 
 void MessageQueue::EnsureActive() {
@@ -38,6 +38,7 @@
 #include "talk/base/constructormagic.h"
 #include "talk/base/criticalsection.h"
 #include "talk/base/messagehandler.h"
+#include "talk/base/messagequeuestats.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/sigslot.h"
@@ -146,6 +147,9 @@ struct Message {
   uint32 message_id;
   MessageData *pdata;
   uint32 ts_sensitive;
+  // When the message was posted, or became due if delayed. Only set while
+  // the receiving queue collects stats.
+  uint64 ts_posted_ns;
 };
 
 typedef std::list<Message> MessageList;
@@ -169,9 +173,19 @@ class DelayedMessage {
   Message msg_;
 };
 
+class LockFreeMessageStore;
+
 class MessageQueue {
  public:
-  explicit MessageQueue(SocketServer* ss = NULL);
+  enum Mode {
+    // Posts are serialized by a lock, delayed posts kept in a priority queue.
+    MODE_DEFAULT,
+    // Posts are lock-free and delayed posts kept in a timer wheel; for queues
+    // that many threads post to at high rates. See LockFreeMessageStore.
+    MODE_LOCKFREE,
+  };
+
+  explicit MessageQueue(SocketServer* ss = NULL, Mode mode = MODE_DEFAULT);
   virtual ~MessageQueue();
 
   SocketServer* socketserver() { return ss_; }
@@ -213,10 +227,18 @@ class MessageQueue {
   virtual int GetDelay();
 
   bool empty() const { return size() == 0u; }
-  size_t size() const {
-    CritScope cs(&crit_);  // msgq_.size() is not thread safe.
-    return msgq_.size() + dmsgq_.size() + (fPeekKeep_ ? 1u : 0u);
+  size_t size() const;
+
+  // Starts or stops collecting MessageQueueStats. Stats are off by default;
+  // until they are turned on, they cost a flag check per message.
+  void EnableStats(bool enable);
+  bool stats_enabled() const {
+    return AtomicOps::AcquireLoad(&stats_enabled_) != 0;
   }
+  // Copies out the stats collected so far. Returns false if stats have never
+  // been enabled. May be called from any thread.
+  bool GetStats(MessageQueueStats* stats) const;
+  void ResetStats();
 
   // Internally posts a message which causes the doomed object to be deleted
   template<class T> void Dispose(T* doomed) {
@@ -237,6 +259,10 @@ class MessageQueue {
   };
 
   void EnsureActive();
+  // Adds a message that was handled between |start_ns| and |end_ns| to the
+  // stats. |sent| tells messages from Thread::Send() from posted ones.
+  void RecordHandled(const Message& msg, bool sent, uint64 start_ns,
+                     uint64 end_ns);
   void DoDelayPost(int cmsDelay, uint32 tstamp, MessageHandler *phandler,
                    uint32 id, MessageData* pdata);
 
@@ -251,11 +277,21 @@ class MessageQueue {
   // This also corresponds to being in MessageQueueManager's global list.
   bool active_;
   MessageList msgq_;
+  // The length of |msgq_|, which std::list::size() may have to count.
+  size_t msgq_size_;
   PriorityQueue dmsgq_;
   uint32 dmsgq_next_num_;
+  // Holds the messages instead of msgq_ and dmsgq_ in MODE_LOCKFREE.
+  scoped_ptr<LockFreeMessageStore> store_;
   mutable CriticalSection crit_;
+  int stats_enabled_;
+  // Created when stats are first enabled, and guarded by |stats_crit_|.
+  scoped_ptr<MessageQueueStats> stats_;
+  mutable CriticalSection stats_crit_;
 
  private:
+  void RecordDepth(size_t depth);
+
   DISALLOW_COPY_AND_ASSIGN(MessageQueue);
 };
 
@@ -27,7 +27,10 @@
 
 #include "talk/base/messagequeue.h"
 
+#include <vector>
+
 #include "talk/base/bind.h"
+#include "talk/base/event.h"
 #include "talk/base/gunit.h"
 #include "talk/base/logging.h"
 #include "talk/base/thread.h"
@@ -130,3 +133,210 @@ TEST_F(MessageQueueTest, DiposeHandlerWithPostedMessagePending) {
   EXPECT_TRUE(deleted);
 }
 
+
+TEST_F(MessageQueueTest,
+       DelayedPostsWithIdenticalTimesAreProcessedInFifoOrderLockFree) {
+  MessageQueue q(NULL, MessageQueue::MODE_LOCKFREE);
+  DelayedPostsWithIdenticalTimesAreProcessedInFifoOrder(&q);
+  NullSocketServer nullss;
+  MessageQueue q_nullss(&nullss, MessageQueue::MODE_LOCKFREE);
+  DelayedPostsWithIdenticalTimesAreProcessedInFifoOrder(&q_nullss);
+}
+
+TEST_F(MessageQueueTest, Size) {
+  MessageQueue q;
+  bool deleted1 = false, deleted2 = false;
+  DeletedMessageHandler handler1(&deleted1), handler2(&deleted2);
+  EXPECT_TRUE(q.empty());
+  q.Post(&handler1, 1);
+  q.Post(&handler2, 2);
+  q.PostDelayed(0, &handler1, 3);
+  q.PostDelayed(100000, &handler2, 4);
+  EXPECT_EQ(4u, q.size());
+  Message msg;
+  EXPECT_TRUE(q.Get(&msg, 0));
+  EXPECT_EQ(3u, q.size());
+  q.Clear(&handler1);
+  EXPECT_EQ(2u, q.size());
+  EXPECT_TRUE(q.Get(&msg, 0));
+  EXPECT_EQ(2u, msg.message_id);
+  EXPECT_EQ(1u, q.size());
+  q.Clear(NULL);
+  EXPECT_TRUE(q.empty());
+}
+
+TEST_F(MessageQueueTest, ClearLockFree) {
+  MessageQueue q(NULL, MessageQueue::MODE_LOCKFREE);
+  bool deleted1 = false, deleted2 = false;
+  DeletedMessageHandler handler1(&deleted1), handler2(&deleted2);
+  q.Post(&handler1, 1);
+  q.Post(&handler2, 2);
+  q.PostDelayed(10, &handler1, 3);
+  q.PostDelayed(100000, &handler1, 4);
+  EXPECT_EQ(4u, q.size());
+  Message msg;
+  EXPECT_TRUE(q.Peek(&msg));
+  EXPECT_EQ(1u, msg.message_id);
+  q.Clear(&handler1);
+  EXPECT_EQ(1u, q.size());
+  EXPECT_TRUE(q.Get(&msg, 100));
+  EXPECT_EQ(2u, msg.message_id);
+  EXPECT_FALSE(q.Get(&msg, 50));
+  EXPECT_TRUE(q.empty());
+}
+
+class SlowMessageHandler : public MessageHandler {
+ public:
+  virtual void OnMessage(Message* msg) {
+    Thread::SleepMs(2);
+  }
+};
+
+static void CollectsStats(MessageQueue* q) {
+  MessageQueueStats stats;
+  EXPECT_FALSE(q->GetStats(&stats));
+  SlowMessageHandler handler;
+  // Not counted, since it is posted before stats are enabled.
+  q->Post(&handler, 1);
+  q->EnableStats(true);
+  q->Post(&handler, 1);
+  q->Post(&handler, 2);
+  q->PostDelayed(0, &handler, 2);
+  Message msg;
+  while (q->Get(&msg, 0)) {
+    q->Dispatch(&msg);
+  }
+
+  ASSERT_TRUE(q->GetStats(&stats));
+  EXPECT_EQ(3, stats.queue_latency.count());
+  EXPECT_EQ(0, stats.send_latency.count());
+  // The last message waited for the ones before it.
+  EXPECT_GE(stats.queue_latency.max_us(), 4000u);
+  EXPECT_EQ(4, stats.handler_time.count());
+  EXPECT_GE(stats.handler_time.max_us(), 2000u);
+  EXPECT_EQ(4u, stats.max_depth);
+  EXPECT_EQ(4u + 3u + 2u + 1u, stats.total_depth);
+  ASSERT_EQ(2u, stats.handlers.size());
+  EXPECT_EQ(2, stats.handlers[
+      MessageQueueStats::HandlerKey(&handler, 1)].count);
+  EXPECT_EQ(2, stats.handlers[
+      MessageQueueStats::HandlerKey(&handler, 2)].count);
+
+  // Stopping keeps what was collected.
+  q->EnableStats(false);
+  q->Post(&handler, 1);
+  EXPECT_TRUE(q->Get(&msg, 0));
+  q->Dispatch(&msg);
+  ASSERT_TRUE(q->GetStats(&stats));
+  EXPECT_EQ(4, stats.handler_time.count());
+
+  q->ResetStats();
+  ASSERT_TRUE(q->GetStats(&stats));
+  EXPECT_EQ(0, stats.handler_time.count());
+  EXPECT_TRUE(stats.handlers.empty());
+}
+
+TEST_F(MessageQueueTest, CollectsStats) {
+  MessageQueue q;
+  CollectsStats(&q);
+  MessageQueue q_lockfree(NULL, MessageQueue::MODE_LOCKFREE);
+  CollectsStats(&q_lockfree);
+}
+
+// Records the messages posted by each sender, which are numbered by the low
+// bits of the message id, and the sender in the high bits.
+class PostOrderChecker : public MessageHandler {
+ public:
+  PostOrderChecker(int num_senders, int num_messages, Event* done)
+      : next_(num_senders, 0), num_messages_(num_messages), count_(0),
+        in_order_(true), done_(done) {
+  }
+  virtual void OnMessage(Message* msg) {
+    uint32 sender = msg->message_id >> 24;
+    uint32 seq = msg->message_id & 0xFFFFFF;
+    if (next_[sender]++ != seq)
+      in_order_ = false;
+    if (++count_ == num_messages_)
+      done_->Set();
+  }
+  int count() const { return count_; }
+  bool in_order() const { return in_order_; }
+
+ private:
+  std::vector<uint32> next_;
+  int num_messages_;
+  int count_;
+  bool in_order_;
+  Event* done_;
+};
+
+class QueuePoster : public Runnable {
+ public:
+  QueuePoster(MessageQueue* queue, MessageHandler* handler, uint32 index,
+         int count)
+      : queue_(queue), handler_(handler), index_(index), count_(count) {
+  }
+  virtual void Run(Thread* thread) {
+    for (int i = 0; i < count_; ++i) {
+      queue_->Post(handler_, (index_ << 24) | i);
+    }
+  }
+
+ private:
+  MessageQueue* queue_;
+  MessageHandler* handler_;
+  uint32 index_;
+  int count_;
+};
+
+// Posts |per_sender| messages from each of |num_senders| threads to a thread
+// in |mode|, and returns the time it took for all of them to be dispatched.
+static uint32 PostFromThreads(MessageQueue::Mode mode, int num_senders,
+                              int per_sender) {
+  Event done(false, false);
+  PostOrderChecker checker(num_senders, num_senders * per_sender, &done);
+  Thread receiver(NULL, mode);
+  receiver.Start();
+  std::vector<Thread*> threads;
+  std::vector<QueuePoster*> posters;
+  for (int i = 0; i < num_senders; ++i) {
+    threads.push_back(new Thread());
+    posters.push_back(new QueuePoster(&receiver, &checker, i, per_sender));
+  }
+  uint32 start = Time();
+  for (int i = 0; i < num_senders; ++i) {
+    threads[i]->Start(posters[i]);
+  }
+  EXPECT_TRUE(done.Wait(60000));
+  uint32 elapsed = TimeSince(start);
+  receiver.Stop();
+  for (int i = 0; i < num_senders; ++i) {
+    delete threads[i];
+    delete posters[i];
+  }
+  EXPECT_EQ(num_senders * per_sender, checker.count());
+  EXPECT_TRUE(checker.in_order());
+  return elapsed;
+}
+
+TEST_F(MessageQueueTest, PostsFromThreadsAreDeliveredInOrderLockFree) {
+  PostFromThreads(MODE_LOCKFREE, 4, 10000);
+}
+
+// Compares the posts/sec that a thread takes in from contending senders.
+TEST_F(MessageQueueTest, ContendedPostPerf) {
+  const int kNumMessages = 400000;
+  const int kSenderCounts[] = { 1, 4, 16 };
+  for (size_t i = 0; i < ARRAY_SIZE(kSenderCounts); ++i) {
+    int num_senders = kSenderCounts[i];
+    uint32 locked = PostFromThreads(MODE_DEFAULT, num_senders,
+                                    kNumMessages / num_senders);
+    uint32 lockfree = PostFromThreads(MODE_LOCKFREE, num_senders,
+                                      kNumMessages / num_senders);
+    LOG(LS_INFO) << num_senders << " senders: "
+                 << kNumMessages / _max<uint32>(locked, 1) << "k posts/sec"
+                 << " with locking, "
+                 << kNumMessages / _max<uint32>(lockfree, 1) << "k posts/sec"
+                 << " lock-free";
+  }
+}
@@ -0,0 +1,76 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/messagequeuestats.h"
+
+#include <algorithm>
+
+namespace talk_base {
+
+const int LatencyHistogram::kBuckets;
+
+void LatencyHistogram::Add(uint64 us) {
+  int bucket = 0;
+  while (bucket < kBuckets - 1 && (us >> bucket) != 0) {
+    ++bucket;
+  }
+  ++buckets_[bucket];
+  ++count_;
+  total_us_ += us;
+  max_us_ = std::max(max_us_, us);
+}
+
+void LatencyHistogram::Reset() {
+  std::fill(buckets_, buckets_ + kBuckets, 0);
+  count_ = 0;
+  total_us_ = 0;
+  max_us_ = 0;
+}
+
+uint64 LatencyHistogram::Percentile(int percentile) const {
+  // The number of samples at or below the percentile, rounded up.
+  int64 needed = (static_cast<int64>(count_) * percentile + 99) / 100;
+  int64 seen = 0;
+  for (int i = 0; i < kBuckets - 1; ++i) {
+    seen += buckets_[i];
+    if (seen >= needed) {
+      return std::min(max_us_, (static_cast<uint64>(1) << i) - 1);
+    }
+  }
+  return max_us_;
+}
+
+void MessageQueueStats::Reset() {
+  queue_latency.Reset();
+  send_latency.Reset();
+  handler_time.Reset();
+  handlers.clear();
+  max_depth = 0;
+  total_depth = 0;
+}
+
+}  // namespace talk_base
@@ -0,0 +1,104 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_MESSAGEQUEUESTATS_H_
+#define TALK_BASE_MESSAGEQUEUESTATS_H_
+
+#include <map>
+#include <utility>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/messagehandler.h"
+
+namespace talk_base {
+
+// Counts durations in buckets that double in size. Bucket 0 holds durations
+// under 1 us, bucket i holds durations from 2^(i-1) us to 2^i - 1 us, and the
+// last bucket also holds everything longer.
+class LatencyHistogram {
+ public:
+  static const int kBuckets = 24;
+
+  LatencyHistogram() { Reset(); }
+
+  void Add(uint64 us);
+  void Reset();
+
+  int count() const { return count_; }
+  int bucket_count(int bucket) const { return buckets_[bucket]; }
+  uint64 total_us() const { return total_us_; }
+  uint64 max_us() const { return max_us_; }
+  uint64 average_us() const { return count_ ? total_us_ / count_ : 0; }
+  // Returns the upper bound of the bucket that the |percentile|th percentile
+  // falls into, or the longest duration if that is smaller.
+  uint64 Percentile(int percentile) const;
+
+ private:
+  int buckets_[kBuckets];
+  int count_;
+  uint64 total_us_;
+  uint64 max_us_;
+};
+
+// What a MessageQueue has been up to since it started collecting stats. See
+// MessageQueue::EnableStats().
+struct MessageQueueStats {
+  struct HandlerStats {
+    HandlerStats() : count(0), total_us(0), max_us(0) {}
+    int count;
+    uint64 total_us;
+    uint64 max_us;
+  };
+  // Handlers are told apart by address, which a new handler may reuse after
+  // the old one is gone.
+  typedef std::pair<const MessageHandler*, uint32> HandlerKey;
+  typedef std::map<HandlerKey, HandlerStats> HandlerStatsMap;
+
+  MessageQueueStats() : max_depth(0), total_depth(0) {}
+
+  void Reset();
+
+  // How long posted messages waited from Post(), or from when a delayed
+  // message became due, until they were dispatched.
+  LatencyHistogram queue_latency;
+  // How long messages sent with Thread::Send() (and so Invoke()) waited for
+  // the thread to get to them. The sending thread is blocked meanwhile.
+  LatencyHistogram send_latency;
+  // How long OnMessage() took, for posted and sent messages.
+  LatencyHistogram handler_time;
+  // OnMessage() times by handler and message id.
+  HandlerStatsMap handlers;
+  // The number of messages in the queue, delayed ones included, whenever a
+  // posted message was taken out of it. The average is
+  // total_depth / queue_latency.count().
+  size_t max_depth;
+  uint64 total_depth;
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_MESSAGEQUEUESTATS_H_
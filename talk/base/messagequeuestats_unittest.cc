@@ -0,0 +1,56 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/gunit.h"
+#include "talk/base/messagequeuestats.h"
+
+namespace talk_base {
+
+TEST(LatencyHistogramTest, Percentile) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0u, histogram.Percentile(50));
+  for (int i = 0; i < 90; ++i) {
+    histogram.Add(3);
+  }
+  for (int i = 0; i < 10; ++i) {
+    histogram.Add(1000);
+  }
+  EXPECT_EQ(100, histogram.count());
+  EXPECT_EQ(90, histogram.bucket_count(2));
+  EXPECT_EQ(10, histogram.bucket_count(10));
+  EXPECT_EQ(3u, histogram.Percentile(50));
+  EXPECT_EQ(3u, histogram.Percentile(90));
+  EXPECT_EQ(1000u, histogram.Percentile(99));
+  EXPECT_EQ(102u, histogram.average_us());
+
+  // Long durations go into the last bucket.
+  histogram.Add(UINT64_C(1) << 40);
+  EXPECT_EQ(1, histogram.bucket_count(LatencyHistogram::kBuckets - 1));
+  EXPECT_EQ(UINT64_C(1) << 40, histogram.Percentile(100));
+}
+
+}  // namespace talk_base
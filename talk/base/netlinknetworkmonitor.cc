@@ -0,0 +1,242 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if defined(LINUX) || defined(ANDROID)
+#include "talk/base/netlinknetworkmonitor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <cstring>
+
+#include "talk/base/logging.h"
+
+namespace talk_base {
+
+namespace {
+
+// Big enough for a burst of address and link messages; a single RTM_NEWLINK
+// can be well over 1KB with all its attributes.
+const size_t kReceiveBufferSize = 8192;
+
+bool IsLinkUp(unsigned int flags) {
+  return (flags & IFF_UP) && (flags & IFF_RUNNING);
+}
+
+}  // namespace
+
+NetlinkNetworkMonitor::NetlinkNetworkMonitor(PhysicalSocketServer* ss)
+    : ss_(ss),
+      fd_(-1) {
+}
+
+NetlinkNetworkMonitor::~NetlinkNetworkMonitor() {
+  Stop();
+}
+
+bool NetlinkNetworkMonitor::Start() {
+  if (fd_ >= 0)
+    return true;
+
+  int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+  if (fd < 0) {
+    LOG_ERR(LS_WARNING) << "socket(NETLINK_ROUTE)";
+    return false;
+  }
+
+  struct sockaddr_nl addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+    LOG_ERR(LS_WARNING) << "bind(NETLINK_ROUTE)";
+    close(fd);
+    return false;
+  }
+
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    LOG_ERR(LS_WARNING) << "fcntl(O_NONBLOCK)";
+    close(fd);
+    return false;
+  }
+
+  fd_ = fd;
+  ss_->Add(this);
+  return true;
+}
+
+void NetlinkNetworkMonitor::Stop() {
+  if (fd_ < 0)
+    return;
+
+  ss_->Remove(this);
+  close(fd_);
+  fd_ = -1;
+  link_states_.clear();
+}
+
+uint32 NetlinkNetworkMonitor::GetRequestedEvents() {
+  return DE_READ;
+}
+
+void NetlinkNetworkMonitor::OnPreEvent(uint32 ff) {
+  // Nothing to do.
+}
+
+void NetlinkNetworkMonitor::OnEvent(uint32 ff, int err) {
+  // Drain the socket; with the epoll backend we won't be woken up again for
+  // data that is already queued.
+  char buffer[kReceiveBufferSize];
+  while (fd_ >= 0) {
+    ssize_t len = recv(fd_, buffer, sizeof(buffer), 0);
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == ENOBUFS) {
+        // The kernel dropped messages because we fell behind. There is no
+        // way to know what we missed, so forget the link states and let the
+        // listeners rescan.
+        LOG(LS_WARNING) << "Netlink receive buffer overrun";
+        link_states_.clear();
+        SignalOverrun();
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        LOG_ERR(LS_WARNING) << "recv(NETLINK_ROUTE)";
+      break;
+    }
+    if (len == 0)
+      break;
+    ParseMessages(buffer, static_cast<size_t>(len));
+  }
+}
+
+int NetlinkNetworkMonitor::GetDescriptor() {
+  return fd_;
+}
+
+bool NetlinkNetworkMonitor::IsDescriptorClosed() {
+  return false;
+}
+
+void NetlinkNetworkMonitor::ParseMessages(const char* data, size_t len) {
+  // NLMSG_OK and NLMSG_NEXT want a mutable int length and header.
+  int remaining = static_cast<int>(len);
+  struct nlmsghdr* header =
+      reinterpret_cast<struct nlmsghdr*>(const_cast<char*>(data));
+  for (; NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+    switch (header->nlmsg_type) {
+      case RTM_NEWADDR:
+      case RTM_DELADDR:
+        OnAddressMessage(header);
+        break;
+      case RTM_NEWLINK:
+      case RTM_DELLINK:
+        OnLinkMessage(header);
+        break;
+      case NLMSG_DONE:
+        return;
+      default:
+        break;
+    }
+  }
+}
+
+void NetlinkNetworkMonitor::OnAddressMessage(const struct nlmsghdr* header) {
+  if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg)))
+    return;
+  const struct ifaddrmsg* msg =
+      static_cast<const struct ifaddrmsg*>(NLMSG_DATA(header));
+
+  // IFA_LOCAL is the interface's own address on point-to-point links, where
+  // IFA_ADDRESS is the peer's. Otherwise they're the same.
+  IPAddress address;
+  IPAddress local;
+  int attr_len = static_cast<int>(IFA_PAYLOAD(header));
+  const struct rtattr* attr = IFA_RTA(msg);
+  for (; RTA_OK(attr, attr_len); attr = RTA_NEXT(attr, attr_len)) {
+    if (attr->rta_type != IFA_ADDRESS && attr->rta_type != IFA_LOCAL)
+      continue;
+    IPAddress ip;
+    if (msg->ifa_family == AF_INET &&
+        RTA_PAYLOAD(attr) >= sizeof(struct in_addr)) {
+      ip = IPAddress(*static_cast<const struct in_addr*>(RTA_DATA(attr)));
+    } else if (msg->ifa_family == AF_INET6 &&
+               RTA_PAYLOAD(attr) >= sizeof(struct in6_addr)) {
+      ip = IPAddress(*static_cast<const struct in6_addr*>(RTA_DATA(attr)));
+    } else {
+      continue;
+    }
+    if (attr->rta_type == IFA_LOCAL) {
+      local = ip;
+    } else {
+      address = ip;
+    }
+  }
+  if (!IPIsUnspec(local))
+    address = local;
+  if (IPIsUnspec(address))
+    return;
+
+  SignalAddressChanged(static_cast<int>(msg->ifa_index), address,
+                       msg->ifa_prefixlen, header->nlmsg_type == RTM_NEWADDR);
+}
+
+void NetlinkNetworkMonitor::OnLinkMessage(const struct nlmsghdr* header) {
+  if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+    return;
+  const struct ifinfomsg* msg =
+      static_cast<const struct ifinfomsg*>(NLMSG_DATA(header));
+  int index = msg->ifi_index;
+
+  if (header->nlmsg_type == RTM_DELLINK) {
+    link_states_.erase(index);
+    SignalLinkChanged(index, false);
+    return;
+  }
+
+  // The kernel sends RTM_NEWLINK for all sorts of attribute updates (MTU,
+  // statistics, promiscuous mode...). Only report transitions of the state
+  // we care about.
+  bool up = IsLinkUp(msg->ifi_flags);
+  LinkStateMap::iterator it = link_states_.find(index);
+  if (it != link_states_.end() && it->second == up)
+    return;
+  link_states_[index] = up;
+  SignalLinkChanged(index, up);
+}
+
+}  // namespace talk_base
+
+#endif  // defined(LINUX) || defined(ANDROID)
@@ -0,0 +1,101 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_NETLINKNETWORKMONITOR_H_
+#define TALK_BASE_NETLINKNETWORKMONITOR_H_
+
+#if defined(LINUX) || defined(ANDROID)
+
+#include <map>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/ipaddress.h"
+#include "talk/base/physicalsocketserver.h"
+#include "talk/base/sigslot.h"
+
+struct nlmsghdr;
+
+namespace talk_base {
+
+// Listens on an rtnetlink socket for interface address and link state
+// changes, so that network managers can react to them as they happen instead
+// of periodically polling getifaddrs(). The monitor registers itself with the
+// PhysicalSocketServer it is given and therefore raises its signals on the
+// thread that runs that socket server.
+class NetlinkNetworkMonitor : public Dispatcher {
+ public:
+  explicit NetlinkNetworkMonitor(PhysicalSocketServer* ss);
+  virtual ~NetlinkNetworkMonitor();
+
+  // Opens the netlink socket and starts dispatching events. Returns false if
+  // the kernel doesn't give us a routing socket, in which case callers should
+  // fall back to polling.
+  bool Start();
+  void Stop();
+  bool started() const { return fd_ >= 0; }
+
+  // Emitted when an address is added to (|added| true) or removed from an
+  // interface. Arguments are the interface index, the address and its prefix
+  // length.
+  sigslot::signal4<int, const IPAddress&, int, bool> SignalAddressChanged;
+  // Emitted when an interface goes up or down, or disappears. Flag-only
+  // updates that don't affect IFF_UP or IFF_RUNNING are filtered out.
+  sigslot::signal2<int, bool> SignalLinkChanged;
+  // Emitted when the kernel had to drop events because the socket buffer
+  // was full. Listeners should treat all of their state as stale.
+  sigslot::signal0<> SignalOverrun;
+
+  // Parses a buffer of netlink messages as read from the socket and raises
+  // the signals above. Separated from OnEvent for tests.
+  void ParseMessages(const char* data, size_t len);
+
+  // Dispatcher interface.
+  virtual uint32 GetRequestedEvents();
+  virtual void OnPreEvent(uint32 ff);
+  virtual void OnEvent(uint32 ff, int err);
+  virtual int GetDescriptor();
+  virtual bool IsDescriptorClosed();
+
+ private:
+  typedef std::map<int, bool> LinkStateMap;
+
+  void OnAddressMessage(const struct nlmsghdr* header);
+  void OnLinkMessage(const struct nlmsghdr* header);
+
+  PhysicalSocketServer* ss_;
+  int fd_;
+  // Last IFF_UP && IFF_RUNNING state seen for each interface index.
+  LinkStateMap link_states_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(NetlinkNetworkMonitor);
+};
+
+}  // namespace talk_base
+
+#endif  // defined(LINUX) || defined(ANDROID)
+
+#endif  // TALK_BASE_NETLINKNETWORKMONITOR_H_
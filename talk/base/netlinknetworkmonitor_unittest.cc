@@ -0,0 +1,252 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <cstring>
+#include <vector>
+
+#include "talk/base/gunit.h"
+#include "talk/base/netlinknetworkmonitor.h"
+#include "talk/base/thread.h"
+
+namespace talk_base {
+
+class NetlinkNetworkMonitorTest : public testing::Test,
+                                  public sigslot::has_slots<> {
+ public:
+  NetlinkNetworkMonitorTest()
+      : monitor_(static_cast<PhysicalSocketServer*>(
+            Thread::Current()->socketserver())),
+        address_events_(0), link_events_(0),
+        last_index_(0), last_prefix_length_(0),
+        last_added_(false), last_up_(false) {
+    monitor_.SignalAddressChanged.connect(
+        this, &NetlinkNetworkMonitorTest::OnAddressChanged);
+    monitor_.SignalLinkChanged.connect(
+        this, &NetlinkNetworkMonitorTest::OnLinkChanged);
+  }
+
+  void OnAddressChanged(int index, const IPAddress& ip, int prefix_length,
+                        bool added) {
+    ++address_events_;
+    last_index_ = index;
+    last_ip_ = ip;
+    last_prefix_length_ = prefix_length;
+    last_added_ = added;
+  }
+
+  void OnLinkChanged(int index, bool up) {
+    ++link_events_;
+    last_index_ = index;
+    last_up_ = up;
+  }
+
+ protected:
+  // Appends an address message for |ip| to |buffer|. If |local| is set it is
+  // sent as IFA_LOCAL, as the kernel does for point-to-point links.
+  static void AppendAddressMessage(std::vector<char>* buffer, uint16 type,
+                                   int index, const IPAddress& ip,
+                                   int prefix_length, const IPAddress& local) {
+    size_t addr_size = (ip.family() == AF_INET) ? sizeof(in_addr)
+                                                : sizeof(in6_addr);
+    size_t attrs_size = RTA_SPACE(addr_size);
+    if (!IPIsUnspec(local))
+      attrs_size += RTA_SPACE(addr_size);
+    size_t msg_size = NLMSG_SPACE(sizeof(ifaddrmsg) + attrs_size);
+    size_t offset = buffer->size();
+    buffer->resize(offset + msg_size, 0);
+
+    nlmsghdr* header = reinterpret_cast<nlmsghdr*>(&(*buffer)[offset]);
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(ifaddrmsg) + attrs_size);
+    header->nlmsg_type = type;
+    ifaddrmsg* msg = static_cast<ifaddrmsg*>(NLMSG_DATA(header));
+    msg->ifa_family = ip.family();
+    msg->ifa_prefixlen = prefix_length;
+    msg->ifa_index = index;
+    rtattr* attr = IFA_RTA(msg);
+    AppendAddressAttribute(attr, IFA_ADDRESS, ip);
+    if (!IPIsUnspec(local)) {
+      attr = reinterpret_cast<rtattr*>(
+          reinterpret_cast<char*>(attr) + RTA_SPACE(addr_size));
+      AppendAddressAttribute(attr, IFA_LOCAL, local);
+    }
+  }
+
+  static void AppendAddressAttribute(rtattr* attr, uint16 type,
+                                     const IPAddress& ip) {
+    attr->rta_type = type;
+    if (ip.family() == AF_INET) {
+      in_addr addr = ip.ipv4_address();
+      attr->rta_len = RTA_LENGTH(sizeof(addr));
+      memcpy(RTA_DATA(attr), &addr, sizeof(addr));
+    } else {
+      in6_addr addr = ip.ipv6_address();
+      attr->rta_len = RTA_LENGTH(sizeof(addr));
+      memcpy(RTA_DATA(attr), &addr, sizeof(addr));
+    }
+  }
+
+  static void AppendLinkMessage(std::vector<char>* buffer, uint16 type,
+                                int index, unsigned int flags) {
+    size_t offset = buffer->size();
+    buffer->resize(offset + NLMSG_SPACE(sizeof(ifinfomsg)), 0);
+    nlmsghdr* header = reinterpret_cast<nlmsghdr*>(&(*buffer)[offset]);
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(ifinfomsg));
+    header->nlmsg_type = type;
+    ifinfomsg* msg = static_cast<ifinfomsg*>(NLMSG_DATA(header));
+    msg->ifi_family = AF_UNSPEC;
+    msg->ifi_index = index;
+    msg->ifi_flags = flags;
+  }
+
+  void Parse(const std::vector<char>& buffer) {
+    monitor_.ParseMessages(&buffer[0], buffer.size());
+  }
+
+  NetlinkNetworkMonitor monitor_;
+  int address_events_;
+  int link_events_;
+  int last_index_;
+  IPAddress last_ip_;
+  int last_prefix_length_;
+  bool last_added_;
+  bool last_up_;
+};
+
+TEST_F(NetlinkNetworkMonitorTest, TestParseIPv4Address) {
+  IPAddress ip;
+  EXPECT_TRUE(IPFromString("192.168.1.7", &ip));
+  std::vector<char> buffer;
+  AppendAddressMessage(&buffer, RTM_NEWADDR, 3, ip, 24, IPAddress());
+  Parse(buffer);
+  EXPECT_EQ(1, address_events_);
+  EXPECT_EQ(3, last_index_);
+  EXPECT_EQ(ip, last_ip_);
+  EXPECT_EQ(24, last_prefix_length_);
+  EXPECT_TRUE(last_added_);
+
+  buffer.clear();
+  AppendAddressMessage(&buffer, RTM_DELADDR, 3, ip, 24, IPAddress());
+  Parse(buffer);
+  EXPECT_EQ(2, address_events_);
+  EXPECT_FALSE(last_added_);
+}
+
+TEST_F(NetlinkNetworkMonitorTest, TestParseIPv6Address) {
+  IPAddress ip;
+  EXPECT_TRUE(IPFromString("2001:db8::1", &ip));
+  std::vector<char> buffer;
+  AppendAddressMessage(&buffer, RTM_NEWADDR, 5, ip, 64, IPAddress());
+  Parse(buffer);
+  EXPECT_EQ(1, address_events_);
+  EXPECT_EQ(5, last_index_);
+  EXPECT_EQ(ip, last_ip_);
+  EXPECT_EQ(64, last_prefix_length_);
+}
+
+// On point-to-point links IFA_ADDRESS is the peer; our address is IFA_LOCAL.
+TEST_F(NetlinkNetworkMonitorTest, TestParsePointToPointAddress) {
+  IPAddress peer, local;
+  EXPECT_TRUE(IPFromString("10.0.0.1", &peer));
+  EXPECT_TRUE(IPFromString("10.0.0.2", &local));
+  std::vector<char> buffer;
+  AppendAddressMessage(&buffer, RTM_NEWADDR, 7, peer, 32, local);
+  Parse(buffer);
+  EXPECT_EQ(1, address_events_);
+  EXPECT_EQ(local, last_ip_);
+}
+
+TEST_F(NetlinkNetworkMonitorTest, TestParseMultipleMessages) {
+  IPAddress ip4, ip6;
+  EXPECT_TRUE(IPFromString("192.168.1.7", &ip4));
+  EXPECT_TRUE(IPFromString("2001:db8::1", &ip6));
+  std::vector<char> buffer;
+  AppendLinkMessage(&buffer, RTM_NEWLINK, 2, IFF_UP | IFF_RUNNING);
+  AppendAddressMessage(&buffer, RTM_NEWADDR, 2, ip4, 24, IPAddress());
+  AppendAddressMessage(&buffer, RTM_NEWADDR, 2, ip6, 64, IPAddress());
+  Parse(buffer);
+  EXPECT_EQ(1, link_events_);
+  EXPECT_EQ(2, address_events_);
+  EXPECT_EQ(ip6, last_ip_);
+}
+
+TEST_F(NetlinkNetworkMonitorTest, TestLinkStateChangesOnly) {
+  std::vector<char> buffer;
+  AppendLinkMessage(&buffer, RTM_NEWLINK, 4, IFF_UP | IFF_RUNNING);
+  Parse(buffer);
+  EXPECT_EQ(1, link_events_);
+  EXPECT_TRUE(last_up_);
+
+  // Same state with an unrelated flag flipped; should be filtered out.
+  buffer.clear();
+  AppendLinkMessage(&buffer, RTM_NEWLINK, 4,
+                    IFF_UP | IFF_RUNNING | IFF_PROMISC);
+  Parse(buffer);
+  EXPECT_EQ(1, link_events_);
+
+  // Carrier lost.
+  buffer.clear();
+  AppendLinkMessage(&buffer, RTM_NEWLINK, 4, IFF_UP);
+  Parse(buffer);
+  EXPECT_EQ(2, link_events_);
+  EXPECT_FALSE(last_up_);
+
+  buffer.clear();
+  AppendLinkMessage(&buffer, RTM_DELLINK, 4, 0);
+  Parse(buffer);
+  EXPECT_EQ(3, link_events_);
+  EXPECT_EQ(4, last_index_);
+  EXPECT_FALSE(last_up_);
+}
+
+TEST_F(NetlinkNetworkMonitorTest, TestIgnoresTruncatedMessages) {
+  IPAddress ip;
+  EXPECT_TRUE(IPFromString("192.168.1.7", &ip));
+  std::vector<char> buffer;
+  AppendAddressMessage(&buffer, RTM_NEWADDR, 3, ip, 24, IPAddress());
+  monitor_.ParseMessages(&buffer[0], NLMSG_HDRLEN);
+  EXPECT_EQ(0, address_events_);
+}
+
+TEST_F(NetlinkNetworkMonitorTest, TestStartStop) {
+  // Netlink may be unavailable in sandboxed environments.
+  if (!monitor_.Start()) {
+    LOG(LS_WARNING) << "Netlink socket unavailable; skipping";
+    return;
+  }
+  EXPECT_TRUE(monitor_.started());
+  EXPECT_GE(monitor_.GetDescriptor(), 0);
+  // Nothing should be pending, and draining must not block.
+  monitor_.OnEvent(DE_READ, 0);
+  monitor_.Stop();
+  EXPECT_FALSE(monitor_.started());
+}
+
+}  // namespace talk_base
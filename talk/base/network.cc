@@ -55,6 +55,9 @@
 
 #include "talk/base/host.h"
 #include "talk/base/logging.h"
+#if defined(LINUX) || defined(ANDROID)
+#include "talk/base/netlinknetworkmonitor.h"
+#endif
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socket.h"  // includes something that makes windows happy
 #include "talk/base/stream.h"
@@ -67,7 +70,8 @@ namespace {
 const uint32 kUpdateNetworksMessage = 1;
 const uint32 kSignalNetworksMessage = 2;
 
-// Fetch list of networks every two seconds.
+// Fetch list of networks every two seconds, unless the network monitor tells
+// us when something changes.
 const int kNetworksUpdateIntervalMs = 2000;
 
 
@@ -175,10 +179,14 @@ void NetworkManagerBase::MergeNetworkList(const NetworkList& new_networks,
 
 BasicNetworkManager::BasicNetworkManager()
     : thread_(NULL),
-      start_count_(0) {
+      start_count_(0),
+      network_monitor_ss_(NULL),
+      update_pending_(false),
+      network_monitor_(NULL) {
 }
 
 BasicNetworkManager::~BasicNetworkManager() {
+  StopNetworkMonitor();
 }
 
 #if defined(POSIX)
@@ -433,6 +441,8 @@ void BasicNetworkManager::StartUpdating() {
     if (sent_first_update_)
       thread_->Post(this, kSignalNetworksMessage);
   } else {
+    if (network_monitor_ss_)
+      StartNetworkMonitor();
     thread_->Post(this, kUpdateNetworksMessage);
   }
   ++start_count_;
@@ -445,9 +455,69 @@ void BasicNetworkManager::StopUpdating() {
 
   --start_count_;
   if (!start_count_) {
+    StopNetworkMonitor();
     thread_->Clear(this);
     sent_first_update_ = false;
+    update_pending_ = false;
+  }
+}
+
+void BasicNetworkManager::StartNetworkMonitor() {
+#if defined(LINUX) || defined(ANDROID)
+  // The monitor is a Dispatcher, so it only works on the socket server that
+  // the updating thread actually waits on.
+  if (thread_->socketserver() != network_monitor_ss_) {
+    LOG(LS_WARNING) << "Network monitor needs the updating thread's "
+                    << "PhysicalSocketServer, polling for changes";
+    return;
   }
+  network_monitor_ = new NetlinkNetworkMonitor(network_monitor_ss_);
+  if (!network_monitor_->Start()) {
+    LOG(LS_WARNING) << "Network monitor unavailable, polling for changes";
+    StopNetworkMonitor();
+    return;
+  }
+  network_monitor_->SignalAddressChanged.connect(
+      this, &BasicNetworkManager::OnNetworkMonitorAddressChanged);
+  network_monitor_->SignalLinkChanged.connect(
+      this, &BasicNetworkManager::OnNetworkMonitorLinkChanged);
+  network_monitor_->SignalOverrun.connect(
+      this, &BasicNetworkManager::OnNetworkMonitorOverrun);
+#endif
+}
+
+void BasicNetworkManager::StopNetworkMonitor() {
+#if defined(LINUX) || defined(ANDROID)
+  delete network_monitor_;
+  network_monitor_ = NULL;
+#endif
+}
+
+void BasicNetworkManager::OnNetworkMonitorAddressChanged(
+    int index, const IPAddress& ip, int prefix_length, bool added) {
+  LOG(LS_VERBOSE) << "Address " << (added ? "added to" : "removed from")
+                  << " interface " << index << ": " << ip.ToString()
+                  << "/" << prefix_length;
+  ScheduleUpdate();
+}
+
+void BasicNetworkManager::OnNetworkMonitorLinkChanged(int index, bool up) {
+  LOG(LS_VERBOSE) << "Interface " << index << " is " << (up ? "up" : "down");
+  ScheduleUpdate();
+}
+
+void BasicNetworkManager::OnNetworkMonitorOverrun() {
+  ScheduleUpdate();
+}
+
+void BasicNetworkManager::ScheduleUpdate() {
+  // A single interface change usually arrives as several link and address
+  // events. Collapse them into one rescan, which runs once the socket server
+  // is done dispatching.
+  if (update_pending_ || !start_count_)
+    return;
+  update_pending_ = true;
+  thread_->Post(this, kUpdateNetworksMessage);
 }
 
 void BasicNetworkManager::OnMessage(Message* msg) {
@@ -466,6 +536,7 @@ void BasicNetworkManager::OnMessage(Message* msg) {
 }
 
 void BasicNetworkManager::DoUpdateNetworks() {
+  update_pending_ = false;
   if (!start_count_)
     return;
 
@@ -483,7 +554,11 @@ void BasicNetworkManager::DoUpdateNetworks() {
     }
   }
 
-  thread_->PostDelayed(kNetworksUpdateIntervalMs, this, kUpdateNetworksMessage);
+  // With the monitor running there's nothing to do until the kernel tells
+  // us about a change.
+  if (!network_monitor_)
+    thread_->PostDelayed(kNetworksUpdateIntervalMs, this,
+                         kUpdateNetworksMessage);
 }
 
 void BasicNetworkManager::DumpNetworks(bool include_ignored) {
@@ -44,8 +44,10 @@ struct ifaddrs;
 
 namespace talk_base {
 
+class NetlinkNetworkMonitor;
 class Network;
 class NetworkSession;
+class PhysicalSocketServer;
 class Thread;
 
 // Generic network manager interface. It provides list of local
@@ -112,7 +114,8 @@ class NetworkManagerBase : public NetworkManager {
 // Basic implementation of the NetworkManager interface that gets list
 // of networks using OS APIs.
 class BasicNetworkManager : public NetworkManagerBase,
-                            public MessageHandler {
+                            public MessageHandler,
+                            public sigslot::has_slots<> {
  public:
   BasicNetworkManager();
   virtual ~BasicNetworkManager();
@@ -127,6 +130,15 @@ class BasicNetworkManager : public NetworkManagerBase,
   virtual void OnMessage(Message* msg);
   bool started() { return start_count_ > 0; }
 
+  // When set, interface changes are picked up from rtnetlink events on Linux
+  // instead of by polling every couple of seconds. |ss| must be the socket
+  // server run by the thread that calls StartUpdating(); if it isn't, or if
+  // the netlink socket can't be opened, polling is used as before. NULL (the
+  // default) disables the monitor. Must be set before StartUpdating().
+  void set_network_monitor_socket_server(PhysicalSocketServer* ss) {
+    network_monitor_ss_ = ss;
+  }
+
  protected:
 #if defined(POSIX)
   // Separated from CreateNetworks for tests.
@@ -145,10 +157,23 @@ class BasicNetworkManager : public NetworkManagerBase,
   friend class NetworkTest;
 
   void DoUpdateNetworks();
+  void StartNetworkMonitor();
+  void StopNetworkMonitor();
+  void OnNetworkMonitorAddressChanged(int index, const IPAddress& ip,
+                                      int prefix_length, bool added);
+  void OnNetworkMonitorLinkChanged(int index, bool up);
+  void OnNetworkMonitorOverrun();
+  void ScheduleUpdate();
 
   Thread* thread_;
   bool sent_first_update_;
   int start_count_;
+  PhysicalSocketServer* network_monitor_ss_;
+  // True while a kUpdateNetworksMessage triggered by the monitor is queued,
+  // so that a burst of events only causes one rescan.
+  bool update_pending_;
+  // Only created on Linux, while updating with the monitor enabled.
+  NetlinkNetworkMonitor* network_monitor_;
 };
 
 // Represents a Unix-type network interface, with a name and single address.
@@ -37,6 +37,8 @@
 #endif
 #endif
 #include "talk/base/gunit.h"
+#include "talk/base/physicalsocketserver.h"
+#include "talk/base/thread.h"
 
 namespace talk_base {
 
@@ -75,6 +77,19 @@ class NetworkTest : public testing::Test, public sigslot::has_slots<>  {
   }
 #endif  // defined(POSIX)
 
+  static void SimulateLinkChanged(BasicNetworkManager& network_manager,
+                                  int index, bool up) {
+    network_manager.OnNetworkMonitorLinkChanged(index, up);
+  }
+
+  static bool IsUpdatePending(const BasicNetworkManager& network_manager) {
+    return network_manager.update_pending_;
+  }
+
+  static bool HasNetworkMonitor(const BasicNetworkManager& network_manager) {
+    return network_manager.network_monitor_ != NULL;
+  }
+
  protected:
   bool callback_called_;
 };
@@ -161,6 +176,46 @@ TEST_F(NetworkTest, TestUpdateNetworks) {
   EXPECT_TRUE(callback_called_);
 }
 
+#if defined(LINUX) || defined(ANDROID)
+// Verify that the first update still goes out with the network monitor
+// enabled, and that a monitor event triggers exactly one rescan.
+TEST_F(NetworkTest, TestUpdateNetworksWithMonitor) {
+  PhysicalSocketServer ss;
+  SocketServerScope scope(&ss);
+  BasicNetworkManager manager;
+  manager.set_network_monitor_socket_server(&ss);
+  manager.SignalNetworksChanged.connect(
+      static_cast<NetworkTest*>(this), &NetworkTest::OnNetworksChanged);
+  manager.StartUpdating();
+  Thread::Current()->ProcessMessages(0);
+  EXPECT_TRUE(callback_called_);
+
+  SimulateLinkChanged(manager, 1, true);
+  SimulateLinkChanged(manager, 1, false);
+  EXPECT_TRUE(IsUpdatePending(manager));
+  Thread::Current()->ProcessMessages(0);
+  EXPECT_FALSE(IsUpdatePending(manager));
+
+  manager.StopUpdating();
+  EXPECT_FALSE(HasNetworkMonitor(manager));
+}
+
+// Verify that the monitor isn't started on a socket server that the updating
+// thread doesn't run, and that networks are still polled in that case.
+TEST_F(NetworkTest, TestNetworkMonitorNeedsThreadSocketServer) {
+  PhysicalSocketServer other_ss;
+  BasicNetworkManager manager;
+  manager.set_network_monitor_socket_server(&other_ss);
+  manager.SignalNetworksChanged.connect(
+      static_cast<NetworkTest*>(this), &NetworkTest::OnNetworksChanged);
+  manager.StartUpdating();
+  EXPECT_FALSE(HasNetworkMonitor(manager));
+  Thread::Current()->ProcessMessages(0);
+  EXPECT_TRUE(callback_called_);
+  manager.StopUpdating();
+}
+#endif
+
 // Verify that MergeNetworkList() merges network lists properly.
 TEST_F(NetworkTest, TestBasicMergeNetworkList) {
   Network ipv4_network1("test_eth0", "Test Network Adapter 1",
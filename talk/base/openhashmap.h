@@ -0,0 +1,200 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_OPENHASHMAP_H_
+#define TALK_BASE_OPENHASHMAP_H_
+
+#include <vector>
+
+#include "talk/base/common.h"
+
+namespace talk_base {
+
+// OpenHashMap is a hash map with open addressing and linear probing, for
+// lookups on per-packet paths where the pointer chasing of std::map shows.
+// The entries live in a single array, so a lookup usually touches one or two
+// cache lines.
+//
+// K and V must be default-constructible and copyable, and K must have
+// operator==. HashFn is a functor returning a size_t for a K; its result is
+// mixed before use, so weak hashes like HashIP() are fine.
+// Inserting or erasing invalidates pointers returned by Find().
+template<typename K, typename V, typename HashFn>
+class OpenHashMap {
+ public:
+  OpenHashMap() : size_(0) {
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // Returns the value stored for |key|, or NULL if there is none.
+  V* Find(const K& key) {
+    size_t index;
+    return Lookup(key, Mix(hash_(key)), &index) ? &slots_[index].value : NULL;
+  }
+  const V* Find(const K& key) const {
+    size_t index;
+    return Lookup(key, Mix(hash_(key)), &index) ? &slots_[index].value : NULL;
+  }
+
+  // Stores |value| for |key|. Returns false if |key| was already present, in
+  // which case its value is replaced.
+  bool Insert(const K& key, const V& value) {
+    size_t hash = Mix(hash_(key));
+    size_t index;
+    if (Lookup(key, hash, &index)) {
+      slots_[index].value = value;
+      return false;
+    }
+    // Keep the load factor at or below one half, so probe runs stay short.
+    if ((size_ + 1) * 2 > slots_.size()) {
+      Grow();
+      Lookup(key, hash, &index);
+    }
+    Slot& slot = slots_[index];
+    slot.used = true;
+    slot.hash = hash;
+    slot.key = key;
+    slot.value = value;
+    ++size_;
+    return true;
+  }
+
+  // Removes |key|. Returns false if it was not present.
+  bool Erase(const K& key) {
+    size_t index;
+    if (!Lookup(key, Mix(hash_(key)), &index)) {
+      return false;
+    }
+    // Shift later entries of the probe run back into the hole, so that no
+    // tombstones are needed.
+    size_t mask = slots_.size() - 1;
+    size_t hole = index;
+    for (size_t i = (hole + 1) & mask; slots_[i].used; i = (i + 1) & mask) {
+      size_t home = slots_[i].hash & mask;
+      // Moving entry |i| to |hole| is allowed if its home slot is not in the
+      // cyclic range (hole, i].
+      bool in_range = (hole <= i) ? (hole < home && home <= i)
+                                  : (hole < home || home <= i);
+      if (!in_range) {
+        slots_[hole] = slots_[i];
+        hole = i;
+      }
+    }
+    slots_[hole] = Slot();
+    --size_;
+    return true;
+  }
+
+  void Clear() {
+    slots_.clear();
+    size_ = 0;
+  }
+
+  // Appends all the values to |values|, in no particular order.
+  void GetValues(std::vector<V>* values) const {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      if (slots_[i].used) {
+        values->push_back(slots_[i].value);
+      }
+    }
+  }
+
+ private:
+  struct Slot {
+    Slot() : used(false), hash(0) {}
+    bool used;
+    size_t hash;
+    K key;
+    V value;
+  };
+
+  static const size_t kMinCapacity = 8;
+
+  // Spreads the bits of |hash| (the 32-bit MurmurHash3 finalizer), since the
+  // table index is taken from the low bits.
+  static size_t Mix(size_t hash) {
+    uint32 h = static_cast<uint32>(hash ^ (hash >> 31 >> 1));
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+  }
+
+  // Finds the slot holding |key|, or else the empty slot where it would be
+  // inserted, and returns whether |key| was found.
+  bool Lookup(const K& key, size_t hash, size_t* index) const {
+    if (slots_.empty()) {
+      *index = 0;
+      return false;
+    }
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+      const Slot& slot = slots_[i];
+      if (!slot.used) {
+        *index = i;
+        return false;
+      }
+      if (slot.hash == hash && slot.key == key) {
+        *index = i;
+        return true;
+      }
+    }
+  }
+
+  void Grow() {
+    std::vector<Slot> old_slots;
+    old_slots.swap(slots_);
+    slots_.resize(old_slots.empty() ? kMinCapacity : old_slots.size() * 2);
+    size_t mask = slots_.size() - 1;
+    for (size_t i = 0; i < old_slots.size(); ++i) {
+      if (old_slots[i].used) {
+        size_t j = old_slots[i].hash & mask;
+        while (slots_[j].used) {
+          j = (j + 1) & mask;
+        }
+        slots_[j] = old_slots[i];
+      }
+    }
+  }
+
+  HashFn hash_;
+  std::vector<Slot> slots_;
+  size_t size_;
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_OPENHASHMAP_H_
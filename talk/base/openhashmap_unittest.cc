@@ -0,0 +1,148 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+
+#include <map>
+#include <vector>
+
+#include "talk/base/gunit.h"
+#include "talk/base/openhashmap.h"
+#include "talk/base/socketaddress.h"
+
+namespace talk_base {
+
+namespace {
+
+// Puts every key in the same probe run, to exercise collisions.
+struct ConstantHash {
+  size_t operator()(int key) const { return 0; }
+};
+
+struct IntHash {
+  size_t operator()(int key) const { return key; }
+};
+
+struct SocketAddressHash {
+  size_t operator()(const SocketAddress& addr) const { return addr.Hash(); }
+};
+
+}  // namespace
+
+TEST(OpenHashMapTest, Empty) {
+  OpenHashMap<int, int, IntHash> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(0U, map.size());
+  EXPECT_TRUE(map.Find(1) == NULL);
+  EXPECT_FALSE(map.Erase(1));
+}
+
+TEST(OpenHashMapTest, InsertFindErase) {
+  OpenHashMap<int, int, IntHash> map;
+  EXPECT_TRUE(map.Insert(1, 10));
+  EXPECT_TRUE(map.Insert(2, 20));
+  EXPECT_FALSE(map.Insert(1, 11));
+  EXPECT_EQ(2U, map.size());
+  ASSERT_TRUE(map.Find(1) != NULL);
+  EXPECT_EQ(11, *map.Find(1));
+  ASSERT_TRUE(map.Find(2) != NULL);
+  EXPECT_EQ(20, *map.Find(2));
+  EXPECT_TRUE(map.Find(3) == NULL);
+
+  EXPECT_TRUE(map.Erase(1));
+  EXPECT_FALSE(map.Erase(1));
+  EXPECT_TRUE(map.Find(1) == NULL);
+  EXPECT_EQ(1U, map.size());
+
+  map.Clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.Find(2) == NULL);
+}
+
+// Tests that erasing from the middle of a probe run keeps the entries after
+// it reachable.
+TEST(OpenHashMapTest, EraseWithCollisions) {
+  OpenHashMap<int, int, ConstantHash> map;
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_TRUE(map.Insert(i, i * 10));
+  }
+  for (int i = 0; i < 20; i += 3) {
+    EXPECT_TRUE(map.Erase(i));
+  }
+  for (int i = 0; i < 20; ++i) {
+    if (i % 3 == 0) {
+      EXPECT_TRUE(map.Find(i) == NULL);
+    } else {
+      ASSERT_TRUE(map.Find(i) != NULL);
+      EXPECT_EQ(i * 10, *map.Find(i));
+    }
+  }
+}
+
+// Compares against std::map under a mix of inserts and erases that makes the
+// table grow and wrap around.
+TEST(OpenHashMapTest, MatchesStdMap) {
+  OpenHashMap<int, int, IntHash> map;
+  std::map<int, int> expected;
+  srand(1234);
+  for (int i = 0; i < 20000; ++i) {
+    int key = rand() % 2000;
+    if (rand() % 3 == 0) {
+      EXPECT_EQ(expected.erase(key) == 1, map.Erase(key));
+    } else {
+      EXPECT_EQ(expected.find(key) == expected.end(), map.Insert(key, i));
+      expected[key] = i;
+    }
+  }
+  EXPECT_EQ(expected.size(), map.size());
+  for (int key = 0; key < 2000; ++key) {
+    std::map<int, int>::const_iterator it = expected.find(key);
+    const int* value = map.Find(key);
+    if (it == expected.end()) {
+      EXPECT_TRUE(value == NULL);
+    } else {
+      ASSERT_TRUE(value != NULL);
+      EXPECT_EQ(it->second, *value);
+    }
+  }
+
+  std::vector<int> values;
+  map.GetValues(&values);
+  EXPECT_EQ(expected.size(), values.size());
+}
+
+TEST(OpenHashMapTest, SocketAddressKeys) {
+  OpenHashMap<SocketAddress, int, SocketAddressHash> map;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(map.Insert(SocketAddress("10.0.0.1", 1000 + i), i));
+  }
+  ASSERT_TRUE(map.Find(SocketAddress("10.0.0.1", 1050)) != NULL);
+  EXPECT_EQ(50, *map.Find(SocketAddress("10.0.0.1", 1050)));
+  EXPECT_TRUE(map.Find(SocketAddress("10.0.0.2", 1050)) == NULL);
+}
+
+}  // namespace talk_base
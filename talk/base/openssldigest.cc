@@ -71,6 +71,14 @@ size_t OpenSSLDigest::Finish(void* buf, size_t len) {
   return md_len;
 }
 
+bool OpenSSLDigest::CopyFrom(const MessageDigest& other) {
+  const OpenSSLDigest& digest = static_cast<const OpenSSLDigest&>(other);
+  if (!md_ || md_ != digest.md_) {
+    return false;
+  }
+  return EVP_MD_CTX_copy_ex(&ctx_, &digest.ctx_) == 1;
+}
+
 bool OpenSSLDigest::GetDigestEVP(const std::string& algorithm,
                                  const EVP_MD** mdp) {
   const EVP_MD* md;
@@ -46,6 +46,8 @@ class OpenSSLDigest : public MessageDigest {
   virtual void Update(const void* buf, size_t len);
   // Outputs the digest value to |buf| with length |len|.
   virtual size_t Finish(void* buf, size_t len);
+  // Copies the state of |other|, which must be an OpenSSLDigest.
+  virtual bool CopyFrom(const MessageDigest& other);
 
   // Helper function to look up a digest.
   static bool GetDigestEVP(const std::string &algorithm,
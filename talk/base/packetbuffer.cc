@@ -0,0 +1,149 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/packetbuffer.h"
+
+#include <cstring>
+
+#include "talk/base/common.h"
+
+namespace talk_base {
+
+const size_t PacketBuffer::kCapacity;
+const size_t PacketBuffer::kDefaultHeadroom;
+
+PacketBuffer::PacketBuffer(PacketBufferPool* pool)
+    : pool_(pool), ref_count_(0), offset_(kDefaultHeadroom), length_(0),
+      next_(NULL) {
+}
+
+PacketBuffer::~PacketBuffer() {
+  // Only a queue deletes a buffer that is still referenced; give back the
+  // reference to the pool that came with it.
+  if (ref_count_ > 0) {
+    pool_->Release();
+  }
+}
+
+int PacketBuffer::AddRef() {
+  return AtomicOps::Increment(&ref_count_);
+}
+
+int PacketBuffer::Release() {
+  int count = AtomicOps::Decrement(&ref_count_);
+  if (!count) {
+    PacketBufferPool* pool = pool_;
+    pool->Put(this);
+    pool->Release();
+  }
+  return count;
+}
+
+bool PacketBuffer::SetData(const void* data, size_t length) {
+  if (length > kCapacity - kDefaultHeadroom)
+    return false;
+  offset_ = kDefaultHeadroom;
+  length_ = length;
+  memcpy(storage_ + offset_, data, length);
+  return true;
+}
+
+bool PacketBuffer::SetLength(size_t length) {
+  if (length > kCapacity - offset_)
+    return false;
+  length_ = length;
+  return true;
+}
+
+char* PacketBuffer::Prepend(size_t length) {
+  if (length > offset_)
+    return NULL;
+  offset_ -= length;
+  length_ += length;
+  return data();
+}
+
+bool PacketBuffer::Consume(size_t length) {
+  if (length > length_)
+    return false;
+  offset_ += length;
+  length_ -= length;
+  return true;
+}
+
+PacketBufferPool::PacketBufferPool(size_t max_free)
+    : free_(NULL), free_count_(0), max_free_(max_free) {
+}
+
+PacketBufferPool::~PacketBufferPool() {
+  while (free_) {
+    PacketBuffer* buffer = free_;
+    free_ = buffer->next_;
+    delete buffer;
+  }
+}
+
+PacketBuffer* PacketBufferPool::Get() {
+  PacketBuffer* buffer = NULL;
+  {
+    CritScope cs(&crit_);
+    if (free_) {
+      buffer = free_;
+      free_ = buffer->next_;
+      --free_count_;
+    }
+  }
+  if (!buffer) {
+    buffer = new PacketBuffer(this);
+  }
+  buffer->next_ = NULL;
+  buffer->offset_ = PacketBuffer::kDefaultHeadroom;
+  buffer->length_ = 0;
+  buffer->AddRef();
+  AddRef();
+  return buffer;
+}
+
+size_t PacketBufferPool::free_count() const {
+  CritScope cs(&crit_);
+  return free_count_;
+}
+
+void PacketBufferPool::Put(PacketBuffer* buffer) {
+  {
+    CritScope cs(&crit_);
+    if (free_count_ < max_free_) {
+      buffer->next_ = free_;
+      free_ = buffer;
+      ++free_count_;
+      return;
+    }
+  }
+  delete buffer;
+}
+
+}  // namespace talk_base
@@ -0,0 +1,124 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_PACKETBUFFER_H_
+#define TALK_BASE_PACKETBUFFER_H_
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/criticalsection.h"
+#include "talk/base/messagequeue.h"
+#include "talk/base/refcount.h"
+
+namespace talk_base {
+
+class PacketBufferPool;
+
+// A packet with room in front of it and behind it, so that headers (e.g. TURN
+// ChannelData framing) can be prepended and trailers (e.g. SRTP auth tags)
+// appended in place. Buffers are reference counted, and go back to the pool
+// they came from when the last reference is released.
+//
+// A buffer can be posted as message data, passing on the reference. If the
+// queue deletes it instead, e.g. when it is cleared, it is freed rather than
+// going back to the pool.
+class PacketBuffer : public MessageData {
+ public:
+  // Room for a packet of up to 2048 bytes with the default headroom, plus
+  // trailers.
+  static const size_t kCapacity = 2304;
+  static const size_t kDefaultHeadroom = 64;
+
+  int AddRef();
+  int Release();
+
+  const char* data() const { return storage_ + offset_; }
+  char* data() { return storage_ + offset_; }
+  size_t length() const { return length_; }
+  size_t headroom() const { return offset_; }
+  size_t tailroom() const { return kCapacity - offset_ - length_; }
+
+  // Replaces the contents, which start after the default headroom. Returns
+  // false if they don't fit.
+  bool SetData(const void* data, size_t length);
+  // Changes the length in place, e.g. after a trailer has been written.
+  // Returns false if there is not enough tailroom.
+  bool SetLength(size_t length);
+  // Extends the packet at the front by |length| bytes and returns the new
+  // start, or NULL if there is not enough headroom.
+  char* Prepend(size_t length);
+  // Removes |length| bytes from the front.
+  bool Consume(size_t length);
+
+ private:
+  friend class PacketBufferPool;
+
+  explicit PacketBuffer(PacketBufferPool* pool);
+  virtual ~PacketBuffer();
+
+  PacketBufferPool* pool_;
+  int ref_count_;
+  size_t offset_;
+  size_t length_;
+  // Links the free buffers of the pool.
+  PacketBuffer* next_;
+  char storage_[kCapacity];
+
+  DISALLOW_COPY_AND_ASSIGN(PacketBuffer);
+};
+
+// A thread-safe pool of PacketBuffers, which keeps up to |max_free| buffers
+// around for reuse. Create it as a RefCountedObject; buffers that are in use
+// hold a reference to it.
+class PacketBufferPool : public RefCountInterface {
+ public:
+  explicit PacketBufferPool(size_t max_free);
+
+  // Returns an empty buffer with one reference.
+  PacketBuffer* Get();
+  // Returns the number of buffers that are waiting for reuse.
+  size_t free_count() const;
+
+ protected:
+  virtual ~PacketBufferPool();
+
+ private:
+  friend class PacketBuffer;
+
+  void Put(PacketBuffer* buffer);
+
+  mutable CriticalSection crit_;
+  PacketBuffer* free_;
+  size_t free_count_;
+  size_t max_free_;
+
+  DISALLOW_COPY_AND_ASSIGN(PacketBufferPool);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_PACKETBUFFER_H_
@@ -0,0 +1,166 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+
+#include "talk/base/gunit.h"
+#include "talk/base/messagequeue.h"
+#include "talk/base/packetbuffer.h"
+#include "talk/base/scoped_ref_ptr.h"
+
+namespace talk_base {
+
+namespace {
+
+PacketBufferPool* CreatePool(size_t max_free) {
+  return new RefCountedObject<PacketBufferPool>(max_free);
+}
+
+// Returns the number of references held on |pool|.
+int PoolRefCount(PacketBufferPool* pool) {
+  int count = pool->AddRef() - 1;
+  pool->Release();
+  return count;
+}
+
+}  // namespace
+
+TEST(PacketBufferTest, SetData) {
+  scoped_refptr<PacketBufferPool> pool(CreatePool(1));
+  PacketBuffer* buffer = pool->Get();
+  EXPECT_EQ(0U, buffer->length());
+  EXPECT_EQ(PacketBuffer::kDefaultHeadroom, buffer->headroom());
+  EXPECT_EQ(PacketBuffer::kCapacity - PacketBuffer::kDefaultHeadroom,
+            buffer->tailroom());
+
+  EXPECT_TRUE(buffer->SetData("abcd", 4));
+  EXPECT_EQ(4U, buffer->length());
+  EXPECT_EQ(0, memcmp("abcd", buffer->data(), 4));
+  EXPECT_EQ(PacketBuffer::kCapacity - PacketBuffer::kDefaultHeadroom - 4,
+            buffer->tailroom());
+
+  char big[PacketBuffer::kCapacity] = {0};
+  EXPECT_FALSE(buffer->SetData(big, sizeof(big)));
+  EXPECT_EQ(4U, buffer->length());
+  EXPECT_TRUE(buffer->SetData(big, sizeof(big) -
+                              PacketBuffer::kDefaultHeadroom));
+  EXPECT_EQ(0U, buffer->tailroom());
+  buffer->Release();
+}
+
+TEST(PacketBufferTest, SetLength) {
+  scoped_refptr<PacketBufferPool> pool(CreatePool(1));
+  PacketBuffer* buffer = pool->Get();
+  EXPECT_TRUE(buffer->SetData("abcd", 4));
+  memcpy(buffer->data() + 4, "ef", 2);
+  EXPECT_TRUE(buffer->SetLength(6));
+  EXPECT_EQ(0, memcmp("abcdef", buffer->data(), 6));
+  EXPECT_TRUE(buffer->SetLength(2));
+  EXPECT_EQ(2U, buffer->length());
+  EXPECT_FALSE(buffer->SetLength(
+      PacketBuffer::kCapacity - PacketBuffer::kDefaultHeadroom + 1));
+  EXPECT_EQ(2U, buffer->length());
+  buffer->Release();
+}
+
+TEST(PacketBufferTest, PrependAndConsume) {
+  scoped_refptr<PacketBufferPool> pool(CreatePool(1));
+  PacketBuffer* buffer = pool->Get();
+  EXPECT_TRUE(buffer->SetData("data", 4));
+
+  char* header = buffer->Prepend(4);
+  ASSERT_TRUE(header != NULL);
+  memcpy(header, "head", 4);
+  EXPECT_EQ(8U, buffer->length());
+  EXPECT_EQ(PacketBuffer::kDefaultHeadroom - 4, buffer->headroom());
+  EXPECT_EQ(0, memcmp("headdata", buffer->data(), 8));
+  EXPECT_TRUE(buffer->Prepend(PacketBuffer::kDefaultHeadroom) == NULL);
+
+  EXPECT_TRUE(buffer->Consume(4));
+  EXPECT_EQ(4U, buffer->length());
+  EXPECT_EQ(0, memcmp("data", buffer->data(), 4));
+  EXPECT_FALSE(buffer->Consume(5));
+  EXPECT_TRUE(buffer->Consume(4));
+  EXPECT_EQ(0U, buffer->length());
+  buffer->Release();
+}
+
+TEST(PacketBufferTest, BuffersAreReused) {
+  scoped_refptr<PacketBufferPool> pool(CreatePool(1));
+  PacketBuffer* buffer = pool->Get();
+  EXPECT_TRUE(buffer->SetData("abcd", 4));
+  ASSERT_TRUE(buffer->Prepend(2) != NULL);
+  buffer->AddRef();
+  EXPECT_EQ(1, buffer->Release());
+  EXPECT_EQ(0U, pool->free_count());
+  EXPECT_EQ(0, buffer->Release());
+  EXPECT_EQ(1U, pool->free_count());
+
+  // The recycled buffer comes back empty.
+  PacketBuffer* reused = pool->Get();
+  EXPECT_EQ(buffer, reused);
+  EXPECT_EQ(0U, pool->free_count());
+  EXPECT_EQ(0U, reused->length());
+  EXPECT_EQ(PacketBuffer::kDefaultHeadroom, reused->headroom());
+  reused->Release();
+}
+
+TEST(PacketBufferTest, PoolKeepsAtMostMaxFree) {
+  scoped_refptr<PacketBufferPool> pool(CreatePool(2));
+  PacketBuffer* buffers[4];
+  for (int i = 0; i < 4; ++i) {
+    buffers[i] = pool->Get();
+  }
+  for (int i = 0; i < 4; ++i) {
+    buffers[i]->Release();
+  }
+  EXPECT_EQ(2U, pool->free_count());
+}
+
+TEST(PacketBufferTest, BuffersKeepThePoolAlive) {
+  PacketBufferPool* pool = CreatePool(1);
+  pool->AddRef();
+  PacketBuffer* buffer = pool->Get();
+  EXPECT_EQ(2, PoolRefCount(pool));
+  EXPECT_EQ(1, pool->Release());
+  // The buffer is the last user of the pool; releasing it deletes both.
+  EXPECT_TRUE(buffer->SetData("abcd", 4));
+  buffer->Release();
+}
+
+TEST(PacketBufferTest, ClearingAQueueReleasesThePool) {
+  scoped_refptr<PacketBufferPool> pool(CreatePool(1));
+  MessageQueue queue;
+  PacketBuffer* buffer = pool->Get();
+  queue.Post(NULL, 0, buffer);
+  EXPECT_EQ(2, PoolRefCount(pool));
+  queue.Clear(NULL);
+  EXPECT_EQ(1, PoolRefCount(pool));
+  EXPECT_EQ(0U, pool->free_count());
+}
+
+}  // namespace talk_base
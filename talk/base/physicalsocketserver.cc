@@ -40,6 +40,10 @@
 #include <signal.h>
 #endif
 
+#ifdef LINUX
+#include <sys/epoll.h>
+#endif
+
 #ifdef WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -105,6 +109,14 @@ static const int IP_HEADER_SIZE = 20u;
 static const int IPV6_HEADER_SIZE = 40u;
 static const int ICMP_HEADER_SIZE = 8u;
 static const int ICMP_PING_TIMEOUT_MILLIS = 10000u;
+#ifdef LINUX
+// Maximum number of datagrams handled by one recvmmsg()/sendmmsg() call.
+static const int kMaxBatchSize = 64;
+#endif
+#ifdef POSIX
+// Maximum number of buffers gathered by one sendmsg() call.
+static const int kMaxIoVecs = 16;
+#endif
 
 class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
  public:
@@ -229,7 +241,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
       return SOCKET_ERROR;
     }
 
-    enabled_events_ |= DE_READ | DE_WRITE;
+    EnableEvents(DE_READ | DE_WRITE);
     return 0;
   }
 
@@ -291,11 +303,46 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     // We have seen minidumps where this may be false.
     ASSERT(sent <= static_cast<int>(cb));
     if ((sent < 0) && IsBlockingError(error_)) {
-      enabled_events_ |= DE_WRITE;
+      OnWouldBlock(DE_WRITE);
+      EnableEvents(DE_WRITE);
     }
     return sent;
   }
 
+#ifdef POSIX
+  // Gathers the buffers with a single sendmsg() call.
+  int SendV(const IoVec* iov, int count) {
+    count = _min(count, kMaxIoVecs);
+    iovec iovs[kMaxIoVecs];
+    size_t total = 0;
+    for (int i = 0; i < count; ++i) {
+      iovs[i].iov_base = const_cast<void*>(iov[i].data);
+      iovs[i].iov_len = iov[i].length;
+      total += iov[i].length;
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = count;
+    int sent = static_cast<int>(::sendmsg(s_, &msg,
+#ifdef LINUX
+        // Suppress SIGPIPE. See Send() for explanation.
+        MSG_NOSIGNAL
+#else
+        0
+#endif
+        ));
+    UpdateLastError();
+    MaybeRemapSendError();
+    ASSERT(sent <= static_cast<int>(total));
+    if ((sent < 0) && IsBlockingError(error_)) {
+      OnWouldBlock(DE_WRITE);
+      EnableEvents(DE_WRITE);
+    }
+    return sent;
+  }
+#endif
+
   int SendTo(const void* buffer, size_t length, const SocketAddress& addr) {
     sockaddr_storage saddr;
     size_t len = addr.ToSockAddrStorage(&saddr);
@@ -313,7 +360,8 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     // We have seen minidumps where this may be false.
     ASSERT(sent <= static_cast<int>(length));
     if ((sent < 0) && IsBlockingError(error_)) {
-      enabled_events_ |= DE_WRITE;
+      OnWouldBlock(DE_WRITE);
+      EnableEvents(DE_WRITE);
     }
     return sent;
   }
@@ -333,9 +381,12 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
       return SOCKET_ERROR;
     }
     UpdateLastError();
+    if ((received < 0) && IsBlockingError(error_)) {
+      OnWouldBlock(DE_READ);
+    }
     bool success = (received >= 0) || IsBlockingError(error_);
     if (udp_ || success) {
-      enabled_events_ |= DE_READ;
+      EnableEvents(DE_READ);
     }
     if (!success) {
       LOG_F(LS_VERBOSE) << "Error = " << error_;
@@ -352,9 +403,12 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     UpdateLastError();
     if ((received >= 0) && (out_addr != NULL))
       SocketAddressFromSockAddrStorage(addr_storage, out_addr);
+    if ((received < 0) && IsBlockingError(error_)) {
+      OnWouldBlock(DE_READ);
+    }
     bool success = (received >= 0) || IsBlockingError(error_);
     if (udp_ || success) {
-      enabled_events_ |= DE_READ;
+      EnableEvents(DE_READ);
     }
     if (!success) {
       LOG_F(LS_VERBOSE) << "Error = " << error_;
@@ -362,12 +416,77 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     return received;
   }
 
+#ifdef LINUX
+  // Receives the batch with a single recvmmsg() call.
+  int RecvFromBatch(Datagram* datagrams, int count) {
+    count = _min(count, kMaxBatchSize);
+    mmsghdr msgs[kMaxBatchSize];
+    iovec iovs[kMaxBatchSize];
+    sockaddr_storage addrs[kMaxBatchSize];
+    for (int i = 0; i < count; ++i) {
+      iovs[i].iov_base = datagrams[i].data;
+      iovs[i].iov_len = datagrams[i].size;
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    // MSG_TRUNC makes msg_len report the real size of truncated datagrams.
+    int received = ::recvmmsg(s_, msgs, count, MSG_TRUNC, NULL);
+    UpdateLastError();
+    for (int i = 0; i < received; ++i) {
+      datagrams[i].length = msgs[i].msg_len;
+      SocketAddressFromSockAddrStorage(addrs[i], &datagrams[i].addr);
+    }
+    // A short batch means the receive queue has been drained.
+    if (((received < 0) && IsBlockingError(error_)) ||
+        ((received >= 0) && (received < count))) {
+      OnWouldBlock(DE_READ);
+    }
+    bool success = (received >= 0) || IsBlockingError(error_);
+    if (udp_ || success) {
+      EnableEvents(DE_READ);
+    }
+    if (!success) {
+      LOG_F(LS_VERBOSE) << "Error = " << error_;
+    }
+    return received;
+  }
+
+  // Sends the batch with a single sendmmsg() call.
+  int SendToBatch(const Datagram* datagrams, int count) {
+    count = _min(count, kMaxBatchSize);
+    mmsghdr msgs[kMaxBatchSize];
+    iovec iovs[kMaxBatchSize];
+    sockaddr_storage addrs[kMaxBatchSize];
+    for (int i = 0; i < count; ++i) {
+      iovs[i].iov_base = datagrams[i].data;
+      iovs[i].iov_len = datagrams[i].length;
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen =
+          datagrams[i].addr.ToSockAddrStorage(&addrs[i]);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    // Suppress SIGPIPE. See Send() for explanation.
+    int sent = ::sendmmsg(s_, msgs, count, MSG_NOSIGNAL);
+    UpdateLastError();
+    if ((sent < 0) && IsBlockingError(error_)) {
+      OnWouldBlock(DE_WRITE);
+      EnableEvents(DE_WRITE);
+    }
+    return sent;
+  }
+#endif
+
   int Listen(int backlog) {
     int err = ::listen(s_, backlog);
     UpdateLastError();
     if (err == 0) {
       state_ = CS_CONNECTING;
-      enabled_events_ |= DE_ACCEPT;
+      EnableEvents(DE_ACCEPT);
 #ifdef _DEBUG
       dbg_addr_ = "Listening @ ";
       dbg_addr_.append(GetLocalAddress().ToString());
@@ -382,9 +501,12 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     sockaddr* addr = reinterpret_cast<sockaddr*>(&addr_storage);
     SOCKET s = ::accept(s_, addr, &addr_len);
     UpdateLastError();
-    if (s == INVALID_SOCKET)
+    if (s == INVALID_SOCKET) {
+      if (IsBlockingError(error_))
+        OnWouldBlock(DE_ACCEPT);
       return NULL;
-    enabled_events_ |= DE_ACCEPT;
+    }
+    EnableEvents(DE_ACCEPT);
     if (out_addr != NULL)
       SocketAddressFromSockAddrStorage(addr_storage, out_addr);
     return ss_->WrapSocket(s);
@@ -490,6 +612,18 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     error_ = LAST_SYSTEM_ERROR;
   }
 
+  void EnableEvents(uint8 events) {
+    uint8 old_events = enabled_events_;
+    enabled_events_ |= events;
+    if (enabled_events_ != old_events)
+      OnEventsEnabled();
+  }
+
+  // Hooks for SocketDispatcher, which passes them on to the socket server so
+  // that an edge-triggered backend knows when to deliver events again.
+  virtual void OnEventsEnabled() {}
+  virtual void OnWouldBlock(uint8 events) {}
+
   void MaybeRemapSendError() {
 #if defined(OSX)
     // https://developer.apple.com/library/mac/documentation/Darwin/
@@ -530,6 +664,15 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
         *slevel = IPPROTO_TCP;
         *sopt = TCP_NODELAY;
         break;
+      case OPT_REUSEPORT:
+#ifdef SO_REUSEPORT
+        *slevel = SOL_SOCKET;
+        *sopt = SO_REUSEPORT;
+        break;
+#else
+        LOG(LS_WARNING) << "Socket::OPT_REUSEPORT not supported.";
+        return -1;
+#endif
       default:
         ASSERT(false);
         return -1;
@@ -740,8 +883,9 @@ class PosixSignalDispatcher : public Dispatcher {
   }
 
   virtual void OnPreEvent(uint32 ff) {
-    // Events might get grouped if signals come very fast, so we read out up to
-    // 16 bytes to make sure we keep the pipe empty.
+    // Events might get grouped if signals come very fast, so we read until the
+    // pipe is empty. The edge-triggered backend would not report it again
+    // otherwise.
     uint8 b[16];
     ssize_t ret = read(GetDescriptor(), b, sizeof(b));
     if (ret < 0) {
@@ -749,6 +893,9 @@ class PosixSignalDispatcher : public Dispatcher {
     } else if (ret == 0) {
       LOG(LS_WARNING) << "Should have read at least one byte";
     }
+    while (ret == sizeof(b)) {
+      ret = read(GetDescriptor(), b, sizeof(b));
+    }
   }
 
   virtual void OnEvent(uint32 ff, int err) {
@@ -810,8 +957,8 @@ class SocketDispatcher : public Dispatcher, public PhysicalSocket {
   }
 
   bool Initialize() {
-    ss_->Add(this);
     fcntl(s_, F_SETFL, fcntl(s_, F_GETFL, 0) | O_NONBLOCK);
+    ss_->AddTracked(this);
     return true;
   }
 
@@ -850,6 +997,11 @@ class SocketDispatcher : public Dispatcher, public PhysicalSocket {
         // Returned during ungraceful peer shutdown.
         case ECONNRESET:
           return true;
+        // The edge-triggered backend delivers readiness until a read runs
+        // into EWOULDBLOCK, so this is expected once the socket is drained.
+        case EWOULDBLOCK:
+          OnWouldBlock(DE_READ);
+          return false;
         default:
           // Assume that all other errors are just blocking errors, meaning the
           // connection is still good but we just can't read from it right now.
@@ -910,11 +1062,21 @@ class SocketDispatcher : public Dispatcher, public PhysicalSocket {
     ss_->Remove(this);
     return PhysicalSocket::Close();
   }
+
+ protected:
+  virtual void OnEventsEnabled() {
+    ss_->Update(this);
+  }
+
+  virtual void OnWouldBlock(uint8 events) {
+    ss_->ClearReady(this, events);
+  }
 };
 
 class FileDispatcher: public Dispatcher, public AsyncFile {
  public:
-  FileDispatcher(int fd, PhysicalSocketServer *ss) : ss_(ss), fd_(fd) {
+  FileDispatcher(int fd, PhysicalSocketServer *ss)
+      : ss_(ss), fd_(fd), flags_(0) {
     set_readable(true);
 
     ss_->Add(this);
@@ -958,6 +1120,7 @@ class FileDispatcher: public Dispatcher, public AsyncFile {
 
   virtual void set_readable(bool value) {
     flags_ = value ? (flags_ | DE_READ) : (flags_ & ~DE_READ);
+    ss_->Update(this);
   }
 
   virtual bool writable() {
@@ -966,6 +1129,7 @@ class FileDispatcher: public Dispatcher, public AsyncFile {
 
   virtual void set_writable(bool value) {
     flags_ = value ? (flags_ | DE_WRITE) : (flags_ & ~DE_WRITE);
+    ss_->Update(this);
   }
 
  private:
@@ -1186,10 +1350,64 @@ class Signaler : public EventDispatcher {
   bool *pf_;
 };
 
+#ifdef LINUX
+// Readiness of a descriptor as last reported by epoll_wait().
+static const uint32 kEpollReadable = 0x01;
+static const uint32 kEpollWritable = 0x02;
+// Maximum number of events collected per call to epoll_wait().
+static const int kMaxEpollEvents = 128;
+
+struct PhysicalSocketServer::EpollEntry {
+  EpollEntry(Dispatcher* d, bool t)
+      : dispatcher(d), ready(0), tracked(t), queued(false), level(false) {
+  }
+  // NULL once the dispatcher has been removed.
+  Dispatcher* dispatcher;
+  uint32 ready;
+  // Whether the dispatcher was added with AddTracked().
+  bool tracked;
+  // Whether the entry is in |epoll_ready_|.
+  bool queued;
+  // Whether the descriptor can't be polled (e.g. a regular file) and is
+  // therefore always considered ready, as select() does.
+  bool level;
+};
+#endif
+
 PhysicalSocketServer::PhysicalSocketServer()
-    : fWait_(false),
-      last_tick_tracked_(0),
-      last_tick_dispatch_count_(0) {
+    : backend_(BACKEND_DEFAULT) {
+  Initialize();
+}
+
+PhysicalSocketServer::PhysicalSocketServer(Backend backend)
+    : backend_(backend) {
+  Initialize();
+}
+
+void PhysicalSocketServer::Initialize() {
+  fWait_ = false;
+  last_tick_tracked_ = 0;
+  last_tick_dispatch_count_ = 0;
+#ifdef LINUX
+  epoll_fd_ = -1;
+  dispatching_ = NULL;
+  waiting_ = false;
+  if (backend_ == BACKEND_EPOLL) {
+    epoll_fd_ = epoll_create(FD_SETSIZE);
+    if (epoll_fd_ < 0) {
+      LOG_ERR(LS_WARNING) << "epoll_create failed, falling back to select";
+      backend_ = BACKEND_DEFAULT;
+    } else {
+      fcntl(epoll_fd_, F_SETFD, FD_CLOEXEC);
+    }
+  }
+#else
+  if (backend_ == BACKEND_EPOLL) {
+    LOG(LS_WARNING) << "epoll is not available, using the default backend";
+    backend_ = BACKEND_DEFAULT;
+  }
+#endif
+  // The wakeup signaler registers itself, so the backend must be set up first.
   signal_wakeup_ = new Signaler(this, &fWait_);
 #ifdef WIN32
   socket_ev_ = WSACreateEvent();
@@ -1205,6 +1423,20 @@ PhysicalSocketServer::~PhysicalSocketServer() {
 #endif
   delete signal_wakeup_;
   ASSERT(dispatchers_.empty());
+#ifdef LINUX
+  ASSERT(epoll_entries_.empty());
+  for (EpollEntryMap::iterator it = epoll_entries_.begin();
+       it != epoll_entries_.end(); ++it) {
+    delete it->second;
+  }
+  for (EpollEntryList::iterator it = epoll_dead_.begin();
+       it != epoll_dead_.end(); ++it) {
+    delete *it;
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+#endif
 }
 
 void PhysicalSocketServer::WakeUp() {
@@ -1250,6 +1482,12 @@ AsyncSocket* PhysicalSocketServer::WrapSocket(SOCKET s) {
 }
 
 void PhysicalSocketServer::Add(Dispatcher *pdispatcher) {
+#ifdef LINUX
+  if (backend_ == BACKEND_EPOLL) {
+    AddInternal(pdispatcher, false);
+    return;
+  }
+#endif
   CritScope cs(&crit_);
   // Prevent duplicates. This can cause dead dispatchers to stick around.
   DispatcherList::iterator pos = std::find(dispatchers_.begin(),
@@ -1260,8 +1498,37 @@ void PhysicalSocketServer::Add(Dispatcher *pdispatcher) {
   dispatchers_.push_back(pdispatcher);
 }
 
+void PhysicalSocketServer::AddTracked(Dispatcher *pdispatcher) {
+#ifdef LINUX
+  if (backend_ == BACKEND_EPOLL) {
+    AddInternal(pdispatcher, true);
+    return;
+  }
+#endif
+  Add(pdispatcher);
+}
+
 void PhysicalSocketServer::Remove(Dispatcher *pdispatcher) {
   CritScope cs(&crit_);
+#ifdef LINUX
+  if (backend_ == BACKEND_EPOLL) {
+    EpollEntryMap::iterator it = epoll_entries_.find(pdispatcher);
+    ASSERT(it != epoll_entries_.end());
+    if (it == epoll_entries_.end())
+      return;
+    EpollEntry* entry = it->second;
+    epoll_entries_.erase(it);
+    if (!entry->level) {
+      epoll_event event = epoll_event();
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, pdispatcher->GetDescriptor(), &event);
+    }
+    // The entry may still be referenced by events that another thread has
+    // just collected, so it is deleted from inside WaitEpoll().
+    entry->dispatcher = NULL;
+    epoll_dead_.push_back(entry);
+    return;
+  }
+#endif
   DispatcherList::iterator pos = std::find(dispatchers_.begin(),
                                            dispatchers_.end(),
                                            pdispatcher);
@@ -1276,8 +1543,150 @@ void PhysicalSocketServer::Remove(Dispatcher *pdispatcher) {
   }
 }
 
+void PhysicalSocketServer::Update(Dispatcher *pdispatcher) {
+#ifdef LINUX
+  if (backend_ != BACKEND_EPOLL)
+    return;
+  CritScope cs(&crit_);
+  // Events requested while being dispatched are picked up afterwards.
+  if (pdispatcher == dispatching_)
+    return;
+  EpollEntryMap::iterator it = epoll_entries_.find(pdispatcher);
+  if (it == epoll_entries_.end())
+    return;
+  if (QueueIfDeliverable(it->second) && waiting_) {
+    // Another thread is blocked in epoll_wait() and won't see the entry.
+    signal_wakeup_->Signal();
+  }
+#endif
+}
+
+void PhysicalSocketServer::ClearReady(Dispatcher *pdispatcher, uint32 ff) {
+#ifdef LINUX
+  if (backend_ != BACKEND_EPOLL)
+    return;
+  CritScope cs(&crit_);
+  EpollEntryMap::iterator it = epoll_entries_.find(pdispatcher);
+  if (it == epoll_entries_.end() || it->second->level)
+    return;
+  EpollEntry* entry = it->second;
+  if (ff & (DE_READ | DE_ACCEPT))
+    entry->ready &= ~kEpollReadable;
+  if (ff & (DE_WRITE | DE_CONNECT))
+    entry->ready &= ~kEpollWritable;
+  if (pdispatcher != dispatching_) {
+    // Outside of OnEvent() the descriptor may have become ready again, and that
+    // edge may already have been collected by a concurrent WaitEpoll(). Rearming
+    // makes epoll report the descriptor again if it is ready by now.
+    epoll_event event = epoll_event();
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = entry;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, pdispatcher->GetDescriptor(), &event);
+  }
+#endif
+}
+
+#ifdef LINUX
+void PhysicalSocketServer::AddInternal(Dispatcher *pdispatcher, bool tracked) {
+  CritScope cs(&crit_);
+  if (epoll_entries_.find(pdispatcher) != epoll_entries_.end())
+    return;
+  EpollEntry* entry = new EpollEntry(pdispatcher, tracked);
+  epoll_event event = epoll_event();
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.ptr = entry;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pdispatcher->GetDescriptor(),
+                &event) != 0) {
+    if (errno != EPERM) {
+      LOG_ERR(LS_ERROR) << "epoll_ctl failed for fd "
+                        << pdispatcher->GetDescriptor();
+      delete entry;
+      return;
+    }
+    // Regular files can't be polled; select() reports them as always ready.
+    entry->level = true;
+    entry->ready = kEpollReadable | kEpollWritable;
+  }
+  epoll_entries_[pdispatcher] = entry;
+  QueueIfDeliverable(entry);
+}
+
+bool PhysicalSocketServer::IsDeliverable(EpollEntry* entry, bool process_io) {
+  if (!entry->dispatcher || entry->ready == 0)
+    return false;
+  if (!process_io && (entry->dispatcher != signal_wakeup_))
+    return false;
+  uint32 ff = entry->dispatcher->GetRequestedEvents();
+  return ((entry->ready & kEpollReadable) && (ff & (DE_READ | DE_ACCEPT))) ||
+      ((entry->ready & kEpollWritable) && (ff & (DE_WRITE | DE_CONNECT)));
+}
+
+bool PhysicalSocketServer::QueueIfDeliverable(EpollEntry* entry) {
+  if (entry->queued || !IsDeliverable(entry, true))
+    return false;
+  entry->queued = true;
+  epoll_ready_.push_back(entry);
+  return true;
+}
+#endif
+
 #ifdef POSIX
+// Turns the raw readiness of |pdispatcher|'s descriptor into DispatcherEvents,
+// according to what the dispatcher is waiting for, and delivers them.
+static void ProcessEvents(Dispatcher* pdispatcher, bool readable,
+                          bool writable) {
+  int fd = pdispatcher->GetDescriptor();
+  uint32 ff = 0;
+  int errcode = 0;
+
+  // Reap any error code, which can be signaled through reads or writes.
+  // TODO: Should we set errcode if getsockopt fails?
+  if (readable || writable) {
+    socklen_t len = sizeof(errcode);
+    ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &errcode, &len);
+  }
+
+  // Check readable descriptors. If we're waiting on an accept, signal
+  // that. Otherwise we're waiting for data, check to see if we're
+  // readable or really closed.
+  // TODO: Only peek at TCP descriptors.
+  if (readable) {
+    if (pdispatcher->GetRequestedEvents() & DE_ACCEPT) {
+      ff |= DE_ACCEPT;
+    } else if (errcode || pdispatcher->IsDescriptorClosed()) {
+      ff |= DE_CLOSE;
+    } else {
+      ff |= DE_READ;
+    }
+  }
+
+  // Check writable descriptors. If we're waiting on a connect, detect
+  // success versus failure by the reaped error code.
+  if (writable) {
+    if (pdispatcher->GetRequestedEvents() & DE_CONNECT) {
+      if (!errcode) {
+        ff |= DE_CONNECT;
+      } else {
+        ff |= DE_CLOSE;
+      }
+    } else {
+      ff |= DE_WRITE;
+    }
+  }
+
+  // Tell the descriptor about the event.
+  if (ff != 0) {
+    pdispatcher->OnPreEvent(ff);
+    pdispatcher->OnEvent(ff, errcode);
+  }
+}
+
 bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
+#ifdef LINUX
+  if (backend_ == BACKEND_EPOLL)
+    return WaitEpoll(cmsWait, process_io);
+#endif
+
   // Calculate timing information
 
   struct timeval *ptvWait = NULL;
@@ -1356,51 +1765,11 @@ bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
       for (size_t i = 0; i < dispatchers_.size(); ++i) {
         Dispatcher *pdispatcher = dispatchers_[i];
         int fd = pdispatcher->GetDescriptor();
-        uint32 ff = 0;
-        int errcode = 0;
-
-        // Reap any error code, which can be signaled through reads or writes.
-        // TODO: Should we set errcode if getsockopt fails?
-        if (FD_ISSET(fd, &fdsRead) || FD_ISSET(fd, &fdsWrite)) {
-          socklen_t len = sizeof(errcode);
-          ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &errcode, &len);
-        }
-
-        // Check readable descriptors. If we're waiting on an accept, signal
-        // that. Otherwise we're waiting for data, check to see if we're
-        // readable or really closed.
-        // TODO: Only peek at TCP descriptors.
-        if (FD_ISSET(fd, &fdsRead)) {
-          FD_CLR(fd, &fdsRead);
-          if (pdispatcher->GetRequestedEvents() & DE_ACCEPT) {
-            ff |= DE_ACCEPT;
-          } else if (errcode || pdispatcher->IsDescriptorClosed()) {
-            ff |= DE_CLOSE;
-          } else {
-            ff |= DE_READ;
-          }
-        }
-
-        // Check writable descriptors. If we're waiting on a connect, detect
-        // success versus failure by the reaped error code.
-        if (FD_ISSET(fd, &fdsWrite)) {
-          FD_CLR(fd, &fdsWrite);
-          if (pdispatcher->GetRequestedEvents() & DE_CONNECT) {
-            if (!errcode) {
-              ff |= DE_CONNECT;
-            } else {
-              ff |= DE_CLOSE;
-            }
-          } else {
-            ff |= DE_WRITE;
-          }
-        }
-
-        // Tell the descriptor about the event.
-        if (ff != 0) {
-          pdispatcher->OnPreEvent(ff);
-          pdispatcher->OnEvent(ff, errcode);
-        }
+        bool readable = FD_ISSET(fd, &fdsRead) != 0;
+        bool writable = FD_ISSET(fd, &fdsWrite) != 0;
+        FD_CLR(fd, &fdsRead);
+        FD_CLR(fd, &fdsWrite);
+        ProcessEvents(pdispatcher, readable, writable);
       }
     }
 
@@ -1428,6 +1797,138 @@ bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
   return true;
 }
 
+#ifdef LINUX
+bool PhysicalSocketServer::WaitEpoll(int cmsWait, bool process_io) {
+  uint32 msStop = 0;
+  if (cmsWait != kForever)
+    msStop = TimeAfter(cmsWait);
+
+  epoll_event events[kMaxEpollEvents];
+  fWait_ = true;
+
+  while (fWait_) {
+    int cmsNext = kForever;
+    {
+      CritScope cr(&crit_);
+      // Delete removed entries here, where no collected event can refer to
+      // them anymore.
+      EpollEntryList queued;
+      for (EpollEntryList::iterator it = epoll_dead_.begin();
+           it != epoll_dead_.end(); ++it) {
+        if ((*it)->queued) {
+          queued.push_back(*it);
+        } else {
+          delete *it;
+        }
+      }
+      epoll_dead_.swap(queued);
+
+      if (HasDeliverable(process_io)) {
+        // Some dispatchers still have readiness they asked for, e.g. sockets
+        // that haven't read until EWOULDBLOCK yet. Don't block.
+        cmsNext = 0;
+      } else if (cmsWait != kForever) {
+        cmsNext = _max(TimeUntil(msStop), 0);
+      }
+      waiting_ = true;
+    }
+
+    // Only the descriptors that changed state since the last call are
+    // returned, so this is independent of the number of dispatchers.
+    int n = epoll_wait(epoll_fd_, events, kMaxEpollEvents, cmsNext);
+
+    CritScope cr(&crit_);
+    waiting_ = false;
+    if (n < 0) {
+      if (errno != EINTR) {
+        LOG_E(LS_ERROR, EN, errno) << "epoll_wait";
+        return false;
+      }
+      // Else ignore the error and keep going. See the comment in Wait().
+      continue;
+    }
+
+    for (int i = 0; i < n; ++i) {
+      EpollEntry* entry = static_cast<EpollEntry*>(events[i].data.ptr);
+      if (!entry->dispatcher)
+        continue;
+      if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+        entry->ready |= kEpollReadable;
+      if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+        entry->ready |= kEpollWritable;
+      QueueIfDeliverable(entry);
+    }
+
+    bool delivered = DispatchReady(process_io);
+
+    // If timeout, return success
+    if (n == 0 && !delivered && cmsWait != kForever &&
+        TimeUntil(msStop) <= 0) {
+      return true;
+    }
+  }
+
+  return true;
+}
+
+bool PhysicalSocketServer::HasDeliverable(bool process_io) {
+  if (process_io)
+    return !epoll_ready_.empty();
+  for (EpollEntryList::iterator it = epoll_ready_.begin();
+       it != epoll_ready_.end(); ++it) {
+    if (IsDeliverable(*it, false))
+      return true;
+  }
+  return false;
+}
+
+bool PhysicalSocketServer::DispatchReady(bool process_io) {
+  bool delivered = false;
+  // Handlers may add, update or remove dispatchers, so work on a copy. Entries
+  // in it stay marked as queued until visited, which keeps them from being
+  // queued twice or deleted underneath us.
+  EpollEntryList entries;
+  entries.swap(epoll_ready_);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EpollEntry* entry = entries[i];
+    entry->queued = false;
+    if (!entry->dispatcher) {
+      // Removed while queued; deleted from WaitEpoll().
+      continue;
+    }
+    if (!IsDeliverable(entry, process_io)) {
+      QueueIfDeliverable(entry);
+      continue;
+    }
+
+    Dispatcher* pdispatcher = entry->dispatcher;
+    uint32 requested = pdispatcher->GetRequestedEvents();
+    bool readable = (entry->ready & kEpollReadable) &&
+        (requested & (DE_READ | DE_ACCEPT));
+    bool writable = (entry->ready & kEpollWritable) &&
+        (requested & (DE_WRITE | DE_CONNECT));
+    if (!entry->tracked && !entry->level) {
+      // We won't hear whether the dispatcher consumed everything, so this
+      // readiness is used up.
+      if (readable)
+        entry->ready &= ~kEpollReadable;
+      if (writable)
+        entry->ready &= ~kEpollWritable;
+    }
+
+    dispatching_ = pdispatcher;
+    ProcessEvents(pdispatcher, readable, writable);
+    dispatching_ = NULL;
+    delivered = true;
+
+    // Tracked dispatchers that still want events and haven't run into
+    // EWOULDBLOCK get another turn on the next iteration.
+    QueueIfDeliverable(entry);
+  }
+  return delivered;
+}
+#endif  // LINUX
+
 static void GlobalSignalHandler(int signum) {
   PosixSignalHandler::Instance()->OnPosixSignalReceived(signum);
 }
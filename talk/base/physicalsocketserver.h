@@ -28,6 +28,7 @@
 #ifndef TALK_BASE_PHYSICALSOCKETSERVER_H__
 #define TALK_BASE_PHYSICALSOCKETSERVER_H__
 
+#include <map>
 #include <vector>
 
 #include "talk/base/asyncfile.h"
@@ -74,9 +75,25 @@ class Dispatcher {
 // A socket server that provides the real sockets of the underlying OS.
 class PhysicalSocketServer : public SocketServer {
  public:
+  // The mechanism Wait() uses to find out which dispatchers are ready.
+  enum Backend {
+    // select(2) on POSIX, WSAWaitForMultipleEvents on Windows. The wait set is
+    // rebuilt from every dispatcher on each iteration, so the cost of a wakeup
+    // grows with the number of sockets, and on POSIX descriptors beyond
+    // FD_SETSIZE cannot be waited on.
+    BACKEND_DEFAULT,
+    // Edge-triggered epoll(7). Descriptors are registered once and only the
+    // ones that became ready are visited. Linux only; other platforms fall
+    // back to their default backend.
+    BACKEND_EPOLL,
+  };
+
   PhysicalSocketServer();
+  explicit PhysicalSocketServer(Backend backend);
   virtual ~PhysicalSocketServer();
 
+  Backend backend() const { return backend_; }
+
   // SocketFactory:
   virtual Socket* CreateSocket(int type);
   virtual Socket* CreateSocket(int family, int type);
@@ -94,6 +111,17 @@ class PhysicalSocketServer : public SocketServer {
   void Add(Dispatcher* dispatcher);
   void Remove(Dispatcher* dispatcher);
 
+  // With BACKEND_EPOLL a descriptor is reported only when it becomes ready.
+  // By default the readiness is forgotten once it has been delivered, so a
+  // dispatcher added with Add() must consume all of it in OnEvent().
+  // Dispatchers added with AddTracked() instead keep their readiness until
+  // they report through ClearReady() that an operation returned EWOULDBLOCK,
+  // and call Update() when GetRequestedEvents() grows outside of OnEvent().
+  // With BACKEND_DEFAULT these are equivalent to Add() and no-ops.
+  void AddTracked(Dispatcher* dispatcher);
+  void Update(Dispatcher* dispatcher);
+  void ClearReady(Dispatcher* dispatcher, uint32 ff);
+
 #ifdef POSIX
   AsyncFile* CreateFile(int fd);
 
@@ -117,11 +145,38 @@ class PhysicalSocketServer : public SocketServer {
   typedef std::vector<Dispatcher*> DispatcherList;
   typedef std::vector<size_t*> IteratorList;
 
+  void Initialize();
+
 #ifdef POSIX
   static bool InstallSignal(int signum, void (*handler)(int));
 
   scoped_ptr<PosixSignalDispatcher> signal_dispatcher_;
 #endif
+#ifdef LINUX
+  struct EpollEntry;
+  typedef std::map<Dispatcher*, EpollEntry*> EpollEntryMap;
+  typedef std::vector<EpollEntry*> EpollEntryList;
+
+  void AddInternal(Dispatcher* dispatcher, bool tracked);
+  bool WaitEpoll(int cms, bool process_io);
+  bool IsDeliverable(EpollEntry* entry, bool process_io);
+  bool QueueIfDeliverable(EpollEntry* entry);
+  bool HasDeliverable(bool process_io);
+  bool DispatchReady(bool process_io);
+
+  int epoll_fd_;
+  EpollEntryMap epoll_entries_;
+  // Entries that had readiness the dispatcher asked for the last time we
+  // looked. Only these are visited on each iteration of WaitEpoll().
+  EpollEntryList epoll_ready_;
+  // Entries of removed dispatchers, waiting to be deleted.
+  EpollEntryList epoll_dead_;
+  // The dispatcher whose OnEvent() is running, if any.
+  Dispatcher* dispatching_;
+  // Whether WaitEpoll() is blocked in epoll_wait().
+  bool waiting_;
+#endif
+  Backend backend_;
   DispatcherList dispatchers_;
   IteratorList iterators_;
   Signaler* signal_wakeup_;
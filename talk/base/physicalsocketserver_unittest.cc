@@ -34,6 +34,7 @@
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socket_unittest.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 
 namespace talk_base {
 
@@ -172,6 +173,188 @@ TEST_F(PhysicalSocketTest, TestGetSetOptionsIPv6) {
   SocketTest::TestGetSetOptionsIPv6();
 }
 
+#ifdef LINUX
+
+// Runs the generic socket tests against the edge-triggered epoll backend.
+class PhysicalSocketEpollTest : public SocketTest {
+ protected:
+  PhysicalSocketEpollTest()
+      : epoll_ss_(PhysicalSocketServer::BACKEND_EPOLL),
+        scope_(&epoll_ss_) {
+  }
+
+  PhysicalSocketServer epoll_ss_;
+  SocketServerScope scope_;
+};
+
+TEST_F(PhysicalSocketEpollTest, TestBackend) {
+  EXPECT_EQ(PhysicalSocketServer::BACKEND_EPOLL, epoll_ss_.backend());
+}
+
+TEST_F(PhysicalSocketEpollTest, TestConnectIPv4) {
+  SocketTest::TestConnectIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestConnectIPv6) {
+  SocketTest::TestConnectIPv6();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestConnectFailIPv4) {
+  SocketTest::TestConnectFailIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestConnectWithClosedSocketIPv4) {
+  SocketTest::TestConnectWithClosedSocketIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestConnectWhileNotClosedIPv4) {
+  SocketTest::TestConnectWhileNotClosedIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestServerCloseDuringConnectIPv4) {
+  SocketTest::TestServerCloseDuringConnectIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestClientCloseDuringConnectIPv4) {
+  SocketTest::TestClientCloseDuringConnectIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestServerCloseIPv4) {
+  SocketTest::TestServerCloseIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestCloseInClosedCallbackIPv4) {
+  SocketTest::TestCloseInClosedCallbackIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestSocketServerWaitIPv4) {
+  SocketTest::TestSocketServerWaitIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestTcpIPv4) {
+  SocketTest::TestTcpIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestTcpIPv6) {
+  SocketTest::TestTcpIPv6();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestUdpIPv4) {
+  SocketTest::TestUdpIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestUdpIPv6) {
+  SocketTest::TestUdpIPv6();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestUdpReadyToSendIPv4) {
+  SocketTest::TestUdpReadyToSendIPv4();
+}
+
+TEST_F(PhysicalSocketEpollTest, TestGetSetOptionsIPv4) {
+  SocketTest::TestGetSetOptionsIPv4();
+}
+
+// Counts the packets read from a socket, one Recv() per read event like
+// AsyncUDPSocket does.
+class PacketCounter : public sigslot::has_slots<> {
+ public:
+  explicit PacketCounter(SocketServer* ss) : ss_(ss), count_(0), target_(0) {}
+
+  void set_target(int target) { target_ = target; }
+  int count() const { return count_; }
+
+  void OnReadEvent(AsyncSocket* socket) {
+    char buf[64];
+    if (socket->Recv(buf, sizeof(buf)) > 0) {
+      ++count_;
+      if (count_ == target_)
+        ss_->WakeUp();
+    }
+  }
+
+ private:
+  SocketServer* ss_;
+  int count_;
+  int target_;
+};
+
+// With an edge-triggered backend, packets that are already queued when the
+// socket becomes readable must all be delivered, even though the consumer
+// reads only one of them per event.
+TEST_F(PhysicalSocketEpollTest, TestUdpDeliversQueuedPackets) {
+  const int kNumPackets = 50;
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  scoped_ptr<AsyncSocket> receiver(
+      epoll_ss_.CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+  scoped_ptr<AsyncSocket> sender(
+      epoll_ss_.CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+  ASSERT_EQ(0, receiver->Bind(loopback));
+  ASSERT_EQ(0, sender->Bind(loopback));
+
+  PacketCounter counter(&epoll_ss_);
+  counter.set_target(kNumPackets);
+  receiver->SignalReadEvent.connect(&counter, &PacketCounter::OnReadEvent);
+  for (int i = 0; i < kNumPackets; ++i) {
+    ASSERT_EQ(4, sender->SendTo("ping", 4, receiver->GetLocalAddress()));
+  }
+  EXPECT_TRUE(epoll_ss_.Wait(5000, true));
+  EXPECT_EQ(kNumPackets, counter.count());
+}
+
+// Measures the cost of a wakeup for one active socket while |num_sockets|
+// others are registered and idle.
+static void MeasureWakeupCost(PhysicalSocketServer::Backend backend,
+                              int num_sockets) {
+  const int kNumWakeups = 1000;
+  PhysicalSocketServer ss(backend);
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  std::vector<AsyncSocket*> idle;
+  for (int i = 0; i < num_sockets; ++i) {
+    AsyncSocket* socket = ss.CreateAsyncSocket(AF_INET, SOCK_DGRAM);
+    if (!socket)
+      break;
+    idle.push_back(socket);
+    socket->Bind(loopback);
+  }
+  scoped_ptr<AsyncSocket> receiver(ss.CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+  scoped_ptr<AsyncSocket> sender(ss.CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+  ASSERT_EQ(0, receiver->Bind(loopback));
+  ASSERT_EQ(0, sender->Bind(loopback));
+  PacketCounter counter(&ss);
+  receiver->SignalReadEvent.connect(&counter, &PacketCounter::OnReadEvent);
+
+  uint32 start = Time();
+  for (int i = 1; i <= kNumWakeups; ++i) {
+    counter.set_target(i);
+    sender->SendTo("ping", 4, receiver->GetLocalAddress());
+    ss.Wait(1000, true);
+  }
+  uint32 elapsed = TimeSince(start);
+  EXPECT_EQ(kNumWakeups, counter.count());
+
+  LOG(LS_INFO) << (backend == PhysicalSocketServer::BACKEND_EPOLL ?
+                   "epoll" : "select") << " with " << idle.size()
+               << " idle sockets: " << elapsed * 1000 / kNumWakeups
+               << " us per wakeup";
+  for (size_t i = 0; i < idle.size(); ++i) {
+    delete idle[i];
+  }
+}
+
+// Shows how the wakeup cost of each backend scales with the socket count.
+// select() is bounded by FD_SETSIZE, so it stops at 1000 sockets.
+TEST(PhysicalSocketServerTest, WakeupPerf) {
+  const int kSocketCounts[] = { 10, 100, 1000 };
+  for (size_t i = 0; i < ARRAY_SIZE(kSocketCounts); ++i) {
+    MeasureWakeupCost(PhysicalSocketServer::BACKEND_DEFAULT, kSocketCounts[i]);
+    MeasureWakeupCost(PhysicalSocketServer::BACKEND_EPOLL, kSocketCounts[i]);
+  }
+  MeasureWakeupCost(PhysicalSocketServer::BACKEND_EPOLL, 5000);
+}
+
+#endif  // LINUX
+
 #ifdef POSIX
 
 class PosixSignalDeliveryTest : public testing::Test {
@@ -250,6 +433,28 @@ TEST_F(PosixSignalDeliveryTest, InsanelyManySignals) {
   EXPECT_TRUE(ExpectNone());
 }
 
+#ifdef LINUX
+// Same as above with the epoll backend, whose signal pipe must be drained
+// completely or it won't be reported again.
+TEST_F(PosixSignalDeliveryTest, InsanelyManySignalsEpoll) {
+  ss_.reset(new PhysicalSocketServer(PhysicalSocketServer::BACKEND_EPOLL));
+  ss_->SetPosixSignalHandler(SIGTERM, &RecordSignal);
+  ss_->SetPosixSignalHandler(SIGINT, &RecordSignal);
+  for (int i = 0; i < 10000; ++i) {
+    raise(SIGTERM);
+  }
+  raise(SIGINT);
+  EXPECT_TRUE(ss_->Wait(0, true));
+  EXPECT_TRUE(ExpectSignal(SIGINT));
+  EXPECT_TRUE(ExpectSignal(SIGTERM));
+  EXPECT_TRUE(ExpectNone());
+  raise(SIGTERM);
+  EXPECT_TRUE(ss_->Wait(0, true));
+  EXPECT_TRUE(ExpectSignal(SIGTERM));
+  EXPECT_TRUE(ExpectNone());
+}
+#endif
+
 // Test that a signal during a Wait() call is detected.
 TEST_F(PosixSignalDeliveryTest, SignalDuringWait) {
   ss_->SetPosixSignalHandler(SIGALRM, &RecordSignal);
@@ -54,6 +54,10 @@ class Sha1Digest : public MessageDigest {
     SHA1Init(&ctx_);  // Reset for next use.
     return kSize;
   }
+  virtual bool CopyFrom(const MessageDigest& other) {
+    ctx_ = static_cast<const Sha1Digest&>(other).ctx_;
+    return true;
+  }
 
  private:
   SHA1_CTX ctx_;
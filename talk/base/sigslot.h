@@ -90,6 +90,7 @@
 #include <list>
 #include <set>
 #include <stdlib.h>
+#include <string.h>
 
 // On our copy of sigslot.h, we set single threading as default.
 #define SIGSLOT_DEFAULT_MT_POLICY single_threaded
@@ -2845,6 +2846,540 @@ namespace sigslot {
 		}
 	};
 
+	// Libjingle specific: fast_signalN.
+	//
+	// Same connect/disconnect/emit interface as signalN, and works with any
+	// has_slots, but meant for signals that fire for every packet. Slots are
+	// kept by value in a small inline array instead of a std::list of heap
+	// allocated _connection objects, and emitting is a direct call through a
+	// per-slot function pointer: no lock, no virtual calls and no allocation.
+	// There is no mt_policy; like single_threaded, connect, disconnect and
+	// emit must not run concurrently.
+	//
+	// Slots may disconnect themselves or others, connect new slots, or delete
+	// the signal from within a callback. Removed slots are only marked dead
+	// while an emit is in progress and the array is compacted when the
+	// outermost emit returns. Slots connected during an emit are not called
+	// until the next one.
+	struct _fast_slot
+	{
+		has_slots_interface* dest;
+		// Pointer to member function of the destination class, type-erased.
+		// Its size depends on the class and the compiler; connect() checks
+		// that it fits.
+		unsigned char method[4 * sizeof(void*)];
+	};
+
+	template<bool fits>
+	struct _fast_method_fits;
+
+	template<>
+	struct _fast_method_fits<true>
+	{
+		static void check() {}
+	};
+
+	template<class emitter_type>
+	struct _fast_connection : public _fast_slot
+	{
+		emitter_type emitter;
+	};
+
+	template<class emitter_type>
+	class _fast_signal_base : public _signal_base_interface
+	{
+	public:
+		typedef _fast_connection<emitter_type> connection;
+
+		_fast_signal_base()
+			: m_slots(m_inline), m_size(0), m_capacity(kInlineSlots),
+			  m_emit_depth(0), m_dirty(false), m_destroyed(NULL)
+		{
+			;
+		}
+
+		_fast_signal_base(const _fast_signal_base<emitter_type>& s)
+			: _signal_base_interface(s), m_slots(m_inline), m_size(0),
+			  m_capacity(kInlineSlots), m_emit_depth(0), m_dirty(false),
+			  m_destroyed(NULL)
+		{
+			for(size_t i = 0; i < s.m_size; ++i)
+			{
+				if(s.m_slots[i].dest)
+				{
+					s.m_slots[i].dest->signal_connect(this);
+					append(s.m_slots[i]);
+				}
+			}
+		}
+
+		virtual ~_fast_signal_base()
+		{
+			disconnect_all();
+			// Let an emit further up the stack know it must not touch us.
+			if(m_destroyed)
+				*m_destroyed = true;
+			if(m_slots != m_inline)
+				delete [] m_slots;
+		}
+
+		void slot_duplicate(const has_slots_interface* oldtarget, has_slots_interface* newtarget)
+		{
+			size_t size = m_size;
+			for(size_t i = 0; i < size; ++i)
+			{
+				if(m_slots[i].dest == oldtarget)
+				{
+					connection conn = m_slots[i];
+					conn.dest = newtarget;
+					append(conn);
+				}
+			}
+		}
+
+		bool is_empty()
+		{
+			for(size_t i = 0; i < m_size; ++i)
+			{
+				if(m_slots[i].dest)
+					return false;
+			}
+			return true;
+		}
+
+		void disconnect_all()
+		{
+			for(size_t i = 0; i < m_size; ++i)
+			{
+				if(m_slots[i].dest)
+				{
+					m_slots[i].dest->signal_disconnect(this);
+					m_slots[i].dest = NULL;
+				}
+			}
+			if(m_emit_depth)
+				m_dirty = true;
+			else
+				m_size = 0;
+		}
+
+#ifdef _DEBUG
+		bool connected(has_slots_interface* pclass)
+		{
+			for(size_t i = 0; i < m_size; ++i)
+			{
+				if(m_slots[i].dest == pclass)
+					return true;
+			}
+			return false;
+		}
+#endif
+
+		void disconnect(has_slots_interface* pclass)
+		{
+			for(size_t i = 0; i < m_size; ++i)
+			{
+				if(m_slots[i].dest == pclass)
+				{
+					remove(i);
+					pclass->signal_disconnect(this);
+					return;
+				}
+			}
+		}
+
+		void slot_disconnect(has_slots_interface* pslot)
+		{
+			for(size_t i = m_size; i > 0; --i)
+			{
+				if(m_slots[i - 1].dest == pslot)
+					remove(i - 1);
+			}
+		}
+
+	protected:
+		enum { kInlineSlots = 2 };
+
+		template<class desttype, class pmemfun_type>
+		void connect_slot(desttype* pclass, pmemfun_type pmemfun, emitter_type emitter)
+		{
+			connection conn;
+			// Fails to compile if the member function pointer doesn't fit.
+			_fast_method_fits<sizeof(pmemfun) <= sizeof(conn.method)>::check();
+			conn.dest = pclass;
+			memset(conn.method, 0, sizeof(conn.method));
+			memcpy(conn.method, &pmemfun, sizeof(pmemfun));
+			conn.emitter = emitter;
+			append(conn);
+			pclass->signal_connect(this);
+		}
+
+		// Brackets the slot calls of an emit. |destroyed| is set to true if
+		// the signal is deleted from within a slot; after that the emit must
+		// return without touching any members.
+		void begin_emit(bool* destroyed, bool** outer)
+		{
+			*outer = m_destroyed;
+			m_destroyed = destroyed;
+			++m_emit_depth;
+		}
+
+		void end_emit(bool destroyed, bool* outer)
+		{
+			if(destroyed)
+			{
+				if(outer)
+					*outer = true;
+				return;
+			}
+			m_destroyed = outer;
+			if(--m_emit_depth == 0 && m_dirty)
+				compact();
+		}
+
+		connection* m_slots;
+		size_t m_size;
+
+	private:
+		void append(const connection& conn)
+		{
+			if(m_size == m_capacity)
+			{
+				connection* slots = new connection[m_capacity * 2];
+				for(size_t i = 0; i < m_size; ++i)
+					slots[i] = m_slots[i];
+				if(m_slots != m_inline)
+					delete [] m_slots;
+				m_slots = slots;
+				m_capacity *= 2;
+			}
+			m_slots[m_size++] = conn;
+		}
+
+		void remove(size_t i)
+		{
+			if(m_emit_depth)
+			{
+				m_slots[i].dest = NULL;
+				m_dirty = true;
+				return;
+			}
+			for(size_t j = i + 1; j < m_size; ++j)
+				m_slots[j - 1] = m_slots[j];
+			--m_size;
+		}
+
+		void compact()
+		{
+			size_t size = 0;
+			for(size_t i = 0; i < m_size; ++i)
+			{
+				if(m_slots[i].dest)
+					m_slots[size++] = m_slots[i];
+			}
+			m_size = size;
+			m_dirty = false;
+		}
+
+		// Not assignable; copy construct instead.
+		_fast_signal_base& operator=(const _fast_signal_base&);
+
+		connection m_inline[kInlineSlots];
+		size_t m_capacity;
+		int m_emit_depth;
+		bool m_dirty;
+		bool* m_destroyed;
+	};
+
+	class fast_signal0 : public _fast_signal_base<void (*)(const _fast_slot&)>
+	{
+	public:
+		typedef _fast_signal_base<void (*)(const _fast_slot&)> base;
+		typedef base::connection connection;
+		using base::m_slots;
+		using base::m_size;
+
+		template<class desttype>
+			void connect(desttype* pclass, void (desttype::*pmemfun)())
+		{
+			base::connect_slot(pclass, pmemfun, &call<desttype>);
+		}
+
+		void emit()
+		{
+			// Nothing is touched after the call, so a lone slot needs none of
+			// the bookkeeping below even if it disconnects or deletes us.
+			if(m_size == 1 && m_slots[0].dest)
+			{
+				const connection& c = m_slots[0];
+				c.emitter(c);
+				return;
+			}
+
+			// Slots connected from within a callback wait for the next emit.
+			size_t size = m_size;
+			bool destroyed = false;
+			bool* outer;
+			base::begin_emit(&destroyed, &outer);
+			for(size_t i = 0; i < size; ++i)
+			{
+				const connection& c = m_slots[i];
+				if(!c.dest)
+					continue;
+				c.emitter(c);
+				if(destroyed)
+					break;
+			}
+			base::end_emit(destroyed, outer);
+		}
+
+		void operator()()
+		{
+			emit();
+		}
+
+	private:
+		template<class desttype>
+		static void call(const _fast_slot& slot)
+		{
+			void (desttype::*pmemfun)();
+			memcpy(&pmemfun, slot.method, sizeof(pmemfun));
+			(static_cast<desttype*>(slot.dest)->*pmemfun)();
+		}
+	};
+
+	template<class arg1_type>
+	class fast_signal1 : public _fast_signal_base<void (*)(const _fast_slot&, arg1_type)>
+	{
+	public:
+		typedef _fast_signal_base<void (*)(const _fast_slot&, arg1_type)> base;
+		typedef typename base::connection connection;
+		using base::m_slots;
+		using base::m_size;
+
+		template<class desttype>
+			void connect(desttype* pclass, void (desttype::*pmemfun)(arg1_type))
+		{
+			base::connect_slot(pclass, pmemfun, &call<desttype>);
+		}
+
+		void emit(arg1_type a1)
+		{
+			// Nothing is touched after the call, so a lone slot needs none of
+			// the bookkeeping below even if it disconnects or deletes us.
+			if(m_size == 1 && m_slots[0].dest)
+			{
+				const connection& c = m_slots[0];
+				c.emitter(c, a1);
+				return;
+			}
+
+			// Slots connected from within a callback wait for the next emit.
+			size_t size = m_size;
+			bool destroyed = false;
+			bool* outer;
+			base::begin_emit(&destroyed, &outer);
+			for(size_t i = 0; i < size; ++i)
+			{
+				const connection& c = m_slots[i];
+				if(!c.dest)
+					continue;
+				c.emitter(c, a1);
+				if(destroyed)
+					break;
+			}
+			base::end_emit(destroyed, outer);
+		}
+
+		void operator()(arg1_type a1)
+		{
+			emit(a1);
+		}
+
+	private:
+		template<class desttype>
+		static void call(const _fast_slot& slot, arg1_type a1)
+		{
+			void (desttype::*pmemfun)(arg1_type);
+			memcpy(&pmemfun, slot.method, sizeof(pmemfun));
+			(static_cast<desttype*>(slot.dest)->*pmemfun)(a1);
+		}
+	};
+
+	template<class arg1_type, class arg2_type>
+	class fast_signal2 : public _fast_signal_base<void (*)(const _fast_slot&, arg1_type, arg2_type)>
+	{
+	public:
+		typedef _fast_signal_base<void (*)(const _fast_slot&, arg1_type, arg2_type)> base;
+		typedef typename base::connection connection;
+		using base::m_slots;
+		using base::m_size;
+
+		template<class desttype>
+			void connect(desttype* pclass, void (desttype::*pmemfun)(arg1_type, arg2_type))
+		{
+			base::connect_slot(pclass, pmemfun, &call<desttype>);
+		}
+
+		void emit(arg1_type a1, arg2_type a2)
+		{
+			// Nothing is touched after the call, so a lone slot needs none of
+			// the bookkeeping below even if it disconnects or deletes us.
+			if(m_size == 1 && m_slots[0].dest)
+			{
+				const connection& c = m_slots[0];
+				c.emitter(c, a1, a2);
+				return;
+			}
+
+			// Slots connected from within a callback wait for the next emit.
+			size_t size = m_size;
+			bool destroyed = false;
+			bool* outer;
+			base::begin_emit(&destroyed, &outer);
+			for(size_t i = 0; i < size; ++i)
+			{
+				const connection& c = m_slots[i];
+				if(!c.dest)
+					continue;
+				c.emitter(c, a1, a2);
+				if(destroyed)
+					break;
+			}
+			base::end_emit(destroyed, outer);
+		}
+
+		void operator()(arg1_type a1, arg2_type a2)
+		{
+			emit(a1, a2);
+		}
+
+	private:
+		template<class desttype>
+		static void call(const _fast_slot& slot, arg1_type a1, arg2_type a2)
+		{
+			void (desttype::*pmemfun)(arg1_type, arg2_type);
+			memcpy(&pmemfun, slot.method, sizeof(pmemfun));
+			(static_cast<desttype*>(slot.dest)->*pmemfun)(a1, a2);
+		}
+	};
+
+	template<class arg1_type, class arg2_type, class arg3_type>
+	class fast_signal3 : public _fast_signal_base<void (*)(const _fast_slot&, arg1_type, arg2_type, arg3_type)>
+	{
+	public:
+		typedef _fast_signal_base<void (*)(const _fast_slot&, arg1_type, arg2_type, arg3_type)> base;
+		typedef typename base::connection connection;
+		using base::m_slots;
+		using base::m_size;
+
+		template<class desttype>
+			void connect(desttype* pclass, void (desttype::*pmemfun)(arg1_type, arg2_type, arg3_type))
+		{
+			base::connect_slot(pclass, pmemfun, &call<desttype>);
+		}
+
+		void emit(arg1_type a1, arg2_type a2, arg3_type a3)
+		{
+			// Nothing is touched after the call, so a lone slot needs none of
+			// the bookkeeping below even if it disconnects or deletes us.
+			if(m_size == 1 && m_slots[0].dest)
+			{
+				const connection& c = m_slots[0];
+				c.emitter(c, a1, a2, a3);
+				return;
+			}
+
+			// Slots connected from within a callback wait for the next emit.
+			size_t size = m_size;
+			bool destroyed = false;
+			bool* outer;
+			base::begin_emit(&destroyed, &outer);
+			for(size_t i = 0; i < size; ++i)
+			{
+				const connection& c = m_slots[i];
+				if(!c.dest)
+					continue;
+				c.emitter(c, a1, a2, a3);
+				if(destroyed)
+					break;
+			}
+			base::end_emit(destroyed, outer);
+		}
+
+		void operator()(arg1_type a1, arg2_type a2, arg3_type a3)
+		{
+			emit(a1, a2, a3);
+		}
+
+	private:
+		template<class desttype>
+		static void call(const _fast_slot& slot, arg1_type a1, arg2_type a2, arg3_type a3)
+		{
+			void (desttype::*pmemfun)(arg1_type, arg2_type, arg3_type);
+			memcpy(&pmemfun, slot.method, sizeof(pmemfun));
+			(static_cast<desttype*>(slot.dest)->*pmemfun)(a1, a2, a3);
+		}
+	};
+
+	template<class arg1_type, class arg2_type, class arg3_type, class arg4_type>
+	class fast_signal4 : public _fast_signal_base<void (*)(const _fast_slot&, arg1_type, arg2_type, arg3_type, arg4_type)>
+	{
+	public:
+		typedef _fast_signal_base<void (*)(const _fast_slot&, arg1_type, arg2_type, arg3_type, arg4_type)> base;
+		typedef typename base::connection connection;
+		using base::m_slots;
+		using base::m_size;
+
+		template<class desttype>
+			void connect(desttype* pclass, void (desttype::*pmemfun)(arg1_type, arg2_type, arg3_type, arg4_type))
+		{
+			base::connect_slot(pclass, pmemfun, &call<desttype>);
+		}
+
+		void emit(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4)
+		{
+			// Nothing is touched after the call, so a lone slot needs none of
+			// the bookkeeping below even if it disconnects or deletes us.
+			if(m_size == 1 && m_slots[0].dest)
+			{
+				const connection& c = m_slots[0];
+				c.emitter(c, a1, a2, a3, a4);
+				return;
+			}
+
+			// Slots connected from within a callback wait for the next emit.
+			size_t size = m_size;
+			bool destroyed = false;
+			bool* outer;
+			base::begin_emit(&destroyed, &outer);
+			for(size_t i = 0; i < size; ++i)
+			{
+				const connection& c = m_slots[i];
+				if(!c.dest)
+					continue;
+				c.emitter(c, a1, a2, a3, a4);
+				if(destroyed)
+					break;
+			}
+			base::end_emit(destroyed, outer);
+		}
+
+		void operator()(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4)
+		{
+			emit(a1, a2, a3, a4);
+		}
+
+	private:
+		template<class desttype>
+		static void call(const _fast_slot& slot, arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4)
+		{
+			void (desttype::*pmemfun)(arg1_type, arg2_type, arg3_type, arg4_type);
+			memcpy(&pmemfun, slot.method, sizeof(pmemfun));
+			(static_cast<desttype*>(slot.dest)->*pmemfun)(a1, a2, a3, a4);
+		}
+	};
+
 }; // namespace sigslot
 
 #endif // TALK_BASE_SIGSLOT_H__
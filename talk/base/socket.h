@@ -184,11 +184,80 @@ class Socket {
     OPT_RCVBUF,      // receive buffer size
     OPT_SNDBUF,      // send buffer size
     OPT_NODELAY,     // whether Nagle algorithm is enabled
-    OPT_IPV6_V6ONLY  // Whether the socket is IPv6 only.
+    OPT_IPV6_V6ONLY, // Whether the socket is IPv6 only.
+    OPT_REUSEPORT    // whether other sockets may bind to the same port;
+                     // must be set before Bind
   };
   virtual int GetOption(Option opt, int* value) = 0;
   virtual int SetOption(Option opt, int value) = 0;
 
+  // A datagram for RecvFromBatch() and SendToBatch().
+  struct Datagram {
+    Datagram() : data(NULL), size(0), length(0) {}
+    char* data;
+    // Size of |data|; only used when receiving.
+    size_t size;
+    // Length of the datagram. When receiving, a value larger than |size| means
+    // that the datagram was truncated.
+    size_t length;
+    SocketAddress addr;
+  };
+
+  // Receives up to |count| datagrams. Returns the number received, or -1 if
+  // none could be (see GetError()). The default implementation simply calls
+  // RecvFrom() repeatedly; sockets that can receive several datagrams in one
+  // system call override it.
+  virtual int RecvFromBatch(Datagram* datagrams, int count) {
+    int received = 0;
+    while (received < count) {
+      Datagram* datagram = &datagrams[received];
+      int len = RecvFrom(datagram->data, datagram->size, &datagram->addr);
+      if (len < 0)
+        break;
+      datagram->length = len;
+      ++received;
+    }
+    return (received > 0) ? received : -1;
+  }
+
+  // Sends up to |count| datagrams. Returns the number sent, or -1 if none
+  // could be (see GetError()). As with RecvFromBatch(), the default
+  // implementation calls SendTo() repeatedly.
+  virtual int SendToBatch(const Datagram* datagrams, int count) {
+    int sent = 0;
+    while (sent < count) {
+      const Datagram* datagram = &datagrams[sent];
+      if (SendTo(datagram->data, datagram->length, datagram->addr) < 0)
+        break;
+      ++sent;
+    }
+    return (sent > 0) ? sent : -1;
+  }
+
+  // A piece of a stream write for SendV().
+  struct IoVec {
+    const void* data;
+    size_t length;
+  };
+
+  // Sends the |count| buffers in order, as if they had been concatenated.
+  // Returns the number of bytes sent, which may stop short anywhere, or the
+  // result of Send() if nothing could be sent. The default implementation
+  // calls Send() for each buffer until one is not taken completely; sockets
+  // that can gather in one system call override it.
+  virtual int SendV(const IoVec* iov, int count) {
+    int sent = 0;
+    for (int i = 0; i < count; ++i) {
+      int res = Send(iov[i].data, iov[i].length);
+      if (res < 0)
+        return (sent > 0) ? sent : res;
+      sent += res;
+      if (static_cast<size_t>(res) < iov[i].length)
+        break;
+    }
+    return sent;
+  }
+
  protected:
   Socket() {}
 
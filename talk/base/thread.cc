@@ -142,8 +142,8 @@ struct ThreadInit {
   Runnable* runnable;
 };
 
-Thread::Thread(SocketServer* ss)
-    : MessageQueue(ss),
+Thread::Thread(SocketServer* ss, Mode mode)
+    : MessageQueue(ss, mode),
       priority_(PRIORITY_NORMAL),
       started_(false),
       has_sends_(false),
@@ -391,6 +391,9 @@ void Thread::Send(MessageHandler *phandler, uint32 id, MessageData *pdata) {
     phandler->OnMessage(&msg);
     return;
   }
+  if (stats_enabled()) {
+    msg.ts_posted_ns = TimeNanos();
+  }
 
   AutoThread thread;
   Thread *current_thread = Thread::Current();
@@ -451,7 +454,15 @@ void Thread::ReceiveSends() {
     _SendMessage smsg = sendlist_.front();
     sendlist_.pop_front();
     crit_.Leave();
-    smsg.msg.phandler->OnMessage(&smsg.msg);
+    if (stats_enabled()) {
+      // The handler may change the message.
+      Message msg = smsg.msg;
+      uint64 start_ns = TimeNanos();
+      smsg.msg.phandler->OnMessage(&smsg.msg);
+      RecordHandled(msg, true, start_ns, TimeNanos());
+    } else {
+      smsg.msg.phandler->OnMessage(&smsg.msg);
+    }
     crit_.Enter();
     *smsg.ready = true;
     smsg.thread->socketserver()->WakeUp();
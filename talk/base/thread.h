@@ -113,7 +113,7 @@ class Runnable {
 
 class Thread : public MessageQueue {
  public:
-  explicit Thread(SocketServer* ss = NULL);
+  explicit Thread(SocketServer* ss = NULL, Mode mode = MODE_DEFAULT);
   virtual ~Thread();
 
   static Thread* Current();
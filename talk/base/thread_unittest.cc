@@ -302,6 +302,20 @@ TEST(ThreadTest, Invoke) {
   thread.Invoke<void>(&LocalFuncs::Func2);
 }
 
+TEST(ThreadTest, SendStats) {
+  Thread thread;
+  thread.EnableStats(true);
+  thread.Start();
+  EXPECT_EQ(42, thread.Invoke<int>(Functor1()));
+  thread.Stop();
+
+  MessageQueueStats stats;
+  ASSERT_TRUE(thread.GetStats(&stats));
+  EXPECT_EQ(1, stats.send_latency.count());
+  EXPECT_EQ(1, stats.handler_time.count());
+  EXPECT_EQ(1u, stats.handlers.size());
+}
+
 #ifdef WIN32
 class ComThreadTest : public testing::Test, public MessageHandler {
  public:
@@ -0,0 +1,317 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/trace.h"
+
+#if defined(POSIX)
+#include <pthread.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "talk/base/common.h"
+#include "talk/base/thread.h"
+
+namespace talk_base {
+
+const int Trace::kRingEvents;
+const int Trace::kMaxRings;
+int Trace::enabled_ = 0;
+
+namespace {
+
+struct TraceEvent {
+  const TraceEventType* type;
+  uint64 start_ns;
+  uint32 duration_ns;
+  uint32 arg;
+  // The value of the clear generation when the event was recorded.
+  int generation;
+};
+
+// An event and a sequence number, which is odd while the owning thread
+// writes the event, so that readers on other threads can skip it.
+struct TraceRecord {
+  TraceRecord() : seq(0) {}
+
+  int seq;
+  TraceEvent event;
+};
+
+// The events of one thread. Only the owning thread writes to the ring; the
+// oldest event is overwritten when it is full.
+struct TraceRing {
+  TraceRing(int id, int generation)
+      : next(0), wrapped(0), generation(generation), in_use(1), id(id),
+        next_ring(NULL) {
+    thread_name[0] = '\0';
+  }
+
+  TraceRecord records[Trace::kRingEvents];
+  // Where the owning thread puts the next record, and whether it got around
+  // the ring yet.
+  volatile int next;
+  volatile int wrapped;
+  // The clear generation the records belong to. Only the owning thread uses
+  // it, to start over after Trace::Clear().
+  int generation;
+  // Whether a thread owns the ring.
+  int in_use;
+  // Used as the thread id in the trace.
+  int id;
+  char thread_name[32];
+  // Rings are never freed.
+  TraceRing* next_ring;
+};
+
+class TraceRecorder {
+ public:
+  TraceRecorder() : rings_(NULL), ring_count_(0), generation_(0) {
+#if defined(WIN32)
+    // Unlike TLS, FLS calls back when a thread exits, so the ring can be
+    // handed to another thread.
+    key_ = FlsAlloc(&TraceRecorder::ReleaseRing);
+#elif defined(POSIX)
+    pthread_key_create(&key_, &TraceRecorder::ReleaseRing);
+#endif
+  }
+
+  void Add(const TraceEventType* type, uint64 start_ns, uint64 duration_ns,
+           uint32 arg) {
+    TraceRing* ring = GetRing();
+    if (!ring) {
+      return;
+    }
+    int generation = this->generation();
+    if (ring->generation != generation) {
+      ring->generation = generation;
+      AtomicOps::ReleaseStore(&ring->wrapped, 0);
+      AtomicOps::ReleaseStore(&ring->next, 0);
+    }
+    int pos = ring->next;
+    TraceRecord& record = ring->records[pos];
+    // Increment() is a full barrier, so the odd sequence number is visible
+    // before any of the event is.
+    int seq = AtomicOps::Increment(&record.seq);
+    record.event.type = type;
+    record.event.start_ns = start_ns;
+    record.event.duration_ns = static_cast<uint32>(
+        std::min<uint64>(duration_ns, 0xFFFFFFFF));
+    record.event.arg = arg;
+    record.event.generation = generation;
+    AtomicOps::ReleaseStore(&record.seq, seq + 1);
+    pos = (pos + 1) % Trace::kRingEvents;
+    if (pos == 0) {
+      AtomicOps::ReleaseStore(&ring->wrapped, 1);
+    }
+    AtomicOps::ReleaseStore(&ring->next, pos);
+  }
+
+  // Copies the event of |record| to |event|. Returns false if the event is
+  // being written, or was recorded before the last Clear().
+  bool Read(const TraceRecord& record, TraceEvent* event) {
+    int seq = AtomicOps::AcquireLoad(&record.seq);
+    if (seq == 0 || (seq & 1) != 0) {
+      return false;
+    }
+    *event = record.event;
+    AtomicOps::FullBarrier();
+    return AtomicOps::AcquireLoad(&record.seq) == seq &&
+        event->generation == generation();
+  }
+
+  // Makes every thread drop its events before it records the next one.
+  void Clear() { AtomicOps::Increment(&generation_); }
+
+  TraceRing* rings() { return AtomicOps::AcquireLoadPtr(&rings_); }
+  int generation() { return AtomicOps::AcquireLoad(&generation_); }
+
+ private:
+  TraceRing* GetRing() {
+#if defined(WIN32)
+    TraceRing* ring = static_cast<TraceRing*>(FlsGetValue(key_));
+#elif defined(POSIX)
+    TraceRing* ring = static_cast<TraceRing*>(pthread_getspecific(key_));
+#endif
+    if (ring) {
+      return ring;
+    }
+
+    // Take over the ring of a thread that has exited, and with it the id.
+    for (ring = rings(); ring; ring = ring->next_ring) {
+      if (AtomicOps::CompareAndSwap(&ring->in_use, 0, 1) == 0) {
+        ring->generation = generation();
+        AtomicOps::ReleaseStore(&ring->wrapped, 0);
+        AtomicOps::ReleaseStore(&ring->next, 0);
+        break;
+      }
+    }
+    if (!ring) {
+      int id = AtomicOps::Increment(&ring_count_);
+      if (id > Trace::kMaxRings) {
+        AtomicOps::Decrement(&ring_count_);
+        return NULL;
+      }
+      ring = new TraceRing(id, generation());
+      TraceRing* head;
+      do {
+        head = rings();
+        ring->next_ring = head;
+      } while (AtomicOps::CompareAndSwapPtr(&rings_, head, ring) != head);
+    }
+    Thread* thread = Thread::Current();
+    std::string name = thread ? thread->name() : std::string();
+    strncpy(ring->thread_name, name.c_str(), sizeof(ring->thread_name) - 1);
+    ring->thread_name[sizeof(ring->thread_name) - 1] = '\0';
+#if defined(WIN32)
+    FlsSetValue(key_, ring);
+#elif defined(POSIX)
+    pthread_setspecific(key_, ring);
+#endif
+    return ring;
+  }
+
+#if defined(WIN32)
+  static void WINAPI ReleaseRing(void* ring) {
+#elif defined(POSIX)
+  static void ReleaseRing(void* ring) {
+#endif
+    if (ring) {
+      AtomicOps::ReleaseStore(&static_cast<TraceRing*>(ring)->in_use, 0);
+    }
+  }
+
+  TraceRing* volatile rings_;
+  int ring_count_;
+  // Incremented by Trace::Clear().
+  int generation_;
+#if defined(WIN32)
+  DWORD key_;
+#elif defined(POSIX)
+  pthread_key_t key_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(TraceRecorder);
+};
+
+TraceRecorder* Recorder() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(TraceRecorder, recorder, ());
+  return &recorder;
+}
+
+const char* CategoryName(int category) {
+  switch (category) {
+    case LJ_TRACE_CATEGORY_BASE: return "base";
+    case LJ_TRACE_CATEGORY_P2P: return "p2p";
+    case LJ_TRACE_CATEGORY_MEDIA: return "media";
+    default: return "other";
+  }
+}
+
+void WriteString(std::ostream& os, const char* str) {
+  os << '"';
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      os << '\\' << *str;
+    } else if (static_cast<unsigned char>(*str) >= 0x20) {
+      os << *str;
+    }
+  }
+  os << '"';
+}
+
+// Timestamps are in microseconds.
+void WriteMicros(std::ostream& os, uint64 ns) {
+  os << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000
+     << std::setfill(' ');
+}
+
+void WriteEvent(std::ostream& os, int tid, const TraceEvent& event) {
+  os << ",\n{\"name\":";
+  WriteString(os, event.type->name);
+  os << ",\"cat\":\"" << CategoryName(event.type->category) << "\"";
+  if (event.type->instant) {
+    os << ",\"ph\":\"i\",\"s\":\"t\"";
+  } else {
+    os << ",\"ph\":\"X\",\"dur\":";
+    WriteMicros(os, event.duration_ns);
+  }
+  os << ",\"ts\":";
+  WriteMicros(os, event.start_ns);
+  os << ",\"pid\":1,\"tid\":" << tid
+     << ",\"args\":{\"arg\":" << event.arg << "}}";
+}
+
+}  // namespace
+
+void Trace::Enable(bool enable) {
+  AtomicOps::ReleaseStore(&enabled_, enable ? 1 : 0);
+}
+
+void Trace::Add(const TraceEventType* type, uint64 start_ns,
+                uint64 duration_ns, uint32 arg) {
+  Recorder()->Add(type, start_ns, duration_ns, arg);
+}
+
+std::string Trace::ToJson() {
+  TraceRecorder* recorder = Recorder();
+  std::ostringstream os;
+  os << "{\"traceEvents\":[\n"
+     << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+     << "\"args\":{\"name\":\"libjingle\"}}";
+  TraceEvent event;
+  for (TraceRing* ring = recorder->rings(); ring; ring = ring->next_ring) {
+    os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+       << ring->id << ",\"args\":{\"name\":";
+    WriteString(os, ring->thread_name);
+    os << "}}";
+    int next = AtomicOps::AcquireLoad(&ring->next);
+    if (AtomicOps::AcquireLoad(&ring->wrapped)) {
+      for (int i = next; i < kRingEvents; ++i) {
+        if (recorder->Read(ring->records[i], &event)) {
+          WriteEvent(os, ring->id, event);
+        }
+      }
+    }
+    for (int i = 0; i < next; ++i) {
+      if (recorder->Read(ring->records[i], &event)) {
+        WriteEvent(os, ring->id, event);
+      }
+    }
+  }
+  os << "\n]}\n";
+  return os.str();
+}
+
+void Trace::Clear() {
+  Recorder()->Clear();
+}
+
+}  // namespace talk_base
@@ -0,0 +1,177 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Binary trace events for following a packet or a task through the threads
+// of the media pipeline. Example:
+//   void BaseChannel::HandlePacket(bool rtcp, Buffer* packet) {
+//     LJ_TRACE_EVENT1(LJ_TRACE_CATEGORY_MEDIA, "BaseChannel::HandlePacket",
+//                     rtcp);
+//     // Do something
+//   }
+//   ...
+//   talk_base::Trace::Enable(true);
+//   // Run the call.
+//   std::string json = talk_base::Trace::ToJson();
+// The JSON loads into chrome://tracing.
+//
+// Each event has a static type, so recording one stores a pointer, two
+// timestamps and an argument into a ring buffer of the calling thread, without
+// locking or formatting. The rings keep the most recent events of each thread;
+// older ones are overwritten. While tracing is disabled an event costs a
+// load and a branch. Categories that are not in LJ_TRACE_CATEGORIES are
+// compiled out entirely, e.g. build with
+//   -DLJ_TRACE_CATEGORIES="(LJ_TRACE_CATEGORY_P2P|LJ_TRACE_CATEGORY_MEDIA)"
+// to leave the MessageQueue events out, or with -DLJ_TRACE_CATEGORIES=0 to
+// leave out all of them.
+// The macros carry an LJ_ prefix so that they can be used next to the
+// TRACE_EVENT macros of webrtc and Chromium.
+
+#ifndef TALK_BASE_TRACE_H_
+#define TALK_BASE_TRACE_H_
+
+#include <string>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/criticalsection.h"
+#include "talk/base/timeutils.h"
+
+#define LJ_TRACE_CATEGORY_BASE 0x1
+#define LJ_TRACE_CATEGORY_P2P 0x2
+#define LJ_TRACE_CATEGORY_MEDIA 0x4
+
+#ifndef LJ_TRACE_CATEGORIES
+#define LJ_TRACE_CATEGORIES \
+  (LJ_TRACE_CATEGORY_BASE | LJ_TRACE_CATEGORY_P2P | LJ_TRACE_CATEGORY_MEDIA)
+#endif
+
+#define LJ_TRACE_CATEGORY_ENABLED(category) \
+  (((category) & (LJ_TRACE_CATEGORIES)) != 0)
+
+#define LJ_TRACE_UV_HELPER2(x, line) _trace_ ## x ## line
+#define LJ_TRACE_UV_HELPER(x, line) LJ_TRACE_UV_HELPER2(x, line)
+#define LJ_TRACE_UNIQUE_VAR(x) LJ_TRACE_UV_HELPER(x, __LINE__)
+
+// Traces the current scope, with |arg| as an argument of the event.
+#define LJ_TRACE_EVENT1(category, name, arg) \
+  static const talk_base::TraceEventType LJ_TRACE_UNIQUE_VAR(type) = \
+      { name, category, false }; \
+  talk_base::TraceScope<LJ_TRACE_CATEGORY_ENABLED(category)> \
+      LJ_TRACE_UNIQUE_VAR(scope)(&LJ_TRACE_UNIQUE_VAR(type), \
+                                 static_cast<uint32>(arg))
+// Traces the current scope.
+#define LJ_TRACE_EVENT(category, name) LJ_TRACE_EVENT1(category, name, 0)
+// Records a point in time, with |arg| as an argument of the event.
+#define LJ_TRACE_INSTANT1(category, name, arg) \
+  do { \
+    static const talk_base::TraceEventType LJ_TRACE_UNIQUE_VAR(type) = \
+        { name, category, true }; \
+    if (LJ_TRACE_CATEGORY_ENABLED(category) && \
+        talk_base::Trace::IsEnabled()) { \
+      talk_base::Trace::Add(&LJ_TRACE_UNIQUE_VAR(type), \
+                            talk_base::TimeNanos(), 0, \
+                            static_cast<uint32>(arg)); \
+    } \
+  } while (0)
+// Records a point in time.
+#define LJ_TRACE_INSTANT(category, name) LJ_TRACE_INSTANT1(category, name, 0)
+
+namespace talk_base {
+
+// The static part of an event. The address identifies the event type.
+struct TraceEventType {
+  const char* name;
+  int category;
+  bool instant;
+};
+
+class Trace {
+ public:
+  // The number of events kept per thread.
+  static const int kRingEvents = 4096;
+  // The number of threads that can record at the same time. Events of further
+  // threads are dropped.
+  static const int kMaxRings = 64;
+
+  static void Enable(bool enable);
+  static bool IsEnabled() { return AtomicOps::AcquireLoad(&enabled_) != 0; }
+
+  // Records an event of the calling thread.
+  static void Add(const TraceEventType* type, uint64 start_ns,
+                  uint64 duration_ns, uint32 arg);
+
+  // Returns the recorded events in the Trace Event Format of Chrome. Events
+  // that are being recorded while this runs are left out, so disable tracing
+  // first for a complete snapshot.
+  static std::string ToJson();
+  // Forgets the recorded events. Each thread drops its events when it records
+  // the next one; until then ToJson() leaves them out.
+  static void Clear();
+
+ private:
+  static int enabled_;
+};
+
+// Records the time spent in a scope. Scopes of categories that are compiled
+// out use the empty specialization below.
+template <bool kEnabled>
+class TraceScope {
+ public:
+  TraceScope(const TraceEventType* type, uint32 arg)
+      : type_(NULL), arg_(arg), start_ns_(0) {
+    if (Trace::IsEnabled()) {
+      type_ = type;
+      start_ns_ = TimeNanos();
+    }
+  }
+  ~TraceScope() {
+    if (type_) {
+      Trace::Add(type_, start_ns_, TimeNanos() - start_ns_, arg_);
+    }
+  }
+
+ private:
+  const TraceEventType* type_;
+  uint32 arg_;
+  uint64 start_ns_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceScope);
+};
+
+template <>
+class TraceScope<false> {
+ public:
+  TraceScope(const TraceEventType* type, uint32 arg) {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TraceScope);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_TRACE_H_
@@ -0,0 +1,206 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string>
+
+#include "talk/base/gunit.h"
+#include "talk/base/logging.h"
+#include "talk/base/stringencode.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+#include "talk/base/trace.h"
+
+namespace talk_base {
+
+// A category that is not compiled in.
+#define LJ_TRACE_CATEGORY_TEST 0x40000000
+
+static void TracedFunction(int arg) {
+  LJ_TRACE_EVENT1(LJ_TRACE_CATEGORY_BASE, "TracedFunction", arg);
+}
+
+static bool Contains(const std::string& str, const std::string& part) {
+  return str.find(part) != std::string::npos;
+}
+
+class TraceTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    Trace::Enable(false);
+    Trace::Clear();
+  }
+  virtual void TearDown() {
+    Trace::Enable(false);
+    Trace::Clear();
+  }
+};
+
+TEST_F(TraceTest, RecordsEvents) {
+  Trace::Enable(true);
+  TracedFunction(42);
+  LJ_TRACE_INSTANT1(LJ_TRACE_CATEGORY_MEDIA, "Instant", 7);
+  {
+    LJ_TRACE_EVENT(LJ_TRACE_CATEGORY_TEST, "CompiledOut");
+  }
+  Trace::Enable(false);
+  TracedFunction(43);
+
+  std::string json = Trace::ToJson();
+  EXPECT_EQ(0U, json.find("{\"traceEvents\":["));
+  EXPECT_TRUE(Contains(json, "{\"name\":\"TracedFunction\",\"cat\":\"base\","
+                             "\"ph\":\"X\",\"dur\":"));
+  EXPECT_TRUE(Contains(json, "\"args\":{\"arg\":42}}"));
+  EXPECT_TRUE(Contains(json, "{\"name\":\"Instant\",\"cat\":\"media\","
+                             "\"ph\":\"i\",\"s\":\"t\",\"ts\":"));
+  EXPECT_TRUE(Contains(json, "\"args\":{\"arg\":7}}"));
+  EXPECT_FALSE(Contains(json, "CompiledOut"));
+  EXPECT_FALSE(Contains(json, "\"arg\":43"));
+
+  Trace::Clear();
+  EXPECT_FALSE(Contains(Trace::ToJson(), "TracedFunction"));
+}
+
+TEST_F(TraceTest, KeepsMostRecentEvents) {
+  Trace::Enable(true);
+  for (int i = 0; i < Trace::kRingEvents + 10; ++i) {
+    TracedFunction(i);
+  }
+  Trace::Enable(false);
+
+  std::string json = Trace::ToJson();
+  EXPECT_FALSE(Contains(json, "\"arg\":9}"));
+  EXPECT_TRUE(Contains(json, "\"arg\":10}"));
+  EXPECT_TRUE(Contains(json, "\"arg\":" +
+                       ToString(Trace::kRingEvents + 9) + "}"));
+  // Oldest first.
+  EXPECT_LT(json.find("\"arg\":10}"), json.find("\"arg\":11}"));
+}
+
+class PostedHandler : public MessageHandler {
+ public:
+  virtual void OnMessage(Message* msg) {
+    LJ_TRACE_INSTANT(LJ_TRACE_CATEGORY_BASE, "PostedHandler");
+  }
+};
+
+TEST_F(TraceTest, NamesThreads) {
+  Trace::Enable(true);
+  Thread thread;
+  thread.SetName("TraceTestThread", NULL);
+  thread.Start();
+  PostedHandler handler;
+  thread.Send(&handler, 12345);
+  thread.Stop();
+  Trace::Enable(false);
+
+  std::string json = Trace::ToJson();
+  EXPECT_TRUE(Contains(json, "\"args\":{\"name\":\"TraceTestThread\"}"));
+  EXPECT_TRUE(Contains(json, "{\"name\":\"PostedHandler\""));
+}
+
+class TracingHandler : public MessageHandler {
+ public:
+  virtual void OnMessage(Message* msg) {
+    TracedFunction(msg->message_id);
+  }
+};
+
+TEST_F(TraceTest, ClearsEventsOfOtherThreads) {
+  Trace::Enable(true);
+  Thread thread;
+  thread.Start();
+  TracingHandler handler;
+  thread.Send(&handler, 111);
+  EXPECT_TRUE(Contains(Trace::ToJson(), "\"arg\":111}"));
+
+  // The thread drops its events the next time it records one, and until
+  // then they are left out.
+  Trace::Clear();
+  EXPECT_FALSE(Contains(Trace::ToJson(), "\"arg\":111}"));
+  thread.Send(&handler, 222);
+  thread.Stop();
+  Trace::Enable(false);
+
+  std::string json = Trace::ToJson();
+  EXPECT_FALSE(Contains(json, "\"arg\":111}"));
+  EXPECT_TRUE(Contains(json, "\"arg\":222}"));
+}
+
+// Readers skip the records that are being written, so every event that is
+// returned while another thread records is complete.
+TEST_F(TraceTest, ReadsWhileRecording) {
+  Trace::Enable(true);
+  Thread thread;
+  thread.Start();
+  TracingHandler handler;
+  const uint32 kEvents = 100000;
+  for (uint32 i = 1; i <= kEvents; ++i) {
+    thread.Post(&handler, i);
+  }
+  for (int i = 0; i < 100; ++i) {
+    std::string json = Trace::ToJson();
+    size_t pos = 0;
+    while ((pos = json.find("{\"name\":\"TracedFunction\"", pos)) !=
+           std::string::npos) {
+      size_t arg = json.find("\"args\":{\"arg\":", pos);
+      ASSERT_NE(std::string::npos, arg);
+      uint32 value = 0;
+      ASSERT_TRUE(FromString(json.substr(arg + 14,
+                                         json.find('}', arg) - arg - 14),
+                             &value));
+      EXPECT_GE(kEvents, value);
+      EXPECT_LT(0U, value);
+      pos = arg;
+    }
+    if (i % 10 == 0) {
+      Trace::Clear();
+    }
+  }
+  thread.Stop();
+  Trace::Enable(false);
+}
+
+TEST_F(TraceTest, Perf) {
+  const int kEvents = 1000000;
+  uint64 start = TimeNanos();
+  for (int i = 0; i < kEvents; ++i) {
+    TracedFunction(i);
+  }
+  uint64 disabled_ns = TimeNanos() - start;
+
+  Trace::Enable(true);
+  start = TimeNanos();
+  for (int i = 0; i < kEvents; ++i) {
+    TracedFunction(i);
+  }
+  uint64 enabled_ns = TimeNanos() - start;
+
+  LOG(LS_INFO) << "Per event: " << disabled_ns / kEvents
+               << " ns disabled, " << enabled_ns / kEvents << " ns enabled";
+}
+
+}  // namespace talk_base
@@ -252,6 +252,8 @@
         'base/asyncfile.h',
         'base/asynchttprequest.cc',
         'base/asynchttprequest.h',
+        'base/asynclogger.cc',
+        'base/asynclogger.h',
         'base/asyncpacketsocket.h',
         'base/asyncsocket.cc',
         'base/asyncsocket.h',
@@ -321,10 +323,14 @@
         'base/json.h',
         'base/linked_ptr.h',
         'base/linuxfdwalk.h',
+        'base/lockfreemessagestore.cc',
+        'base/lockfreemessagestore.h',
         'base/logging.cc',
         'base/logging.h',
         'base/maccocoathreadhelper.h',
         'base/maccocoathreadhelper.mm',
+        'base/mappedfile.cc',
+        'base/mappedfile.h',
         'base/mathutils.h',
         'base/md5.cc',
         'base/md5.h',
@@ -335,6 +341,8 @@
         'base/messagehandler.h',
         'base/messagequeue.cc',
         'base/messagequeue.h',
+        'base/messagequeuestats.cc',
+        'base/messagequeuestats.h',
         'base/multipart.cc',
         'base/multipart.h',
         'base/natserver.cc',
@@ -352,8 +360,11 @@
         'base/nssstreamadapter.cc',
         'base/nssstreamadapter.h',
         'base/nullsocketserver.h',
+        'base/openhashmap.h',
         'base/optionsfile.cc',
         'base/optionsfile.h',
+        'base/packetbuffer.cc',
+        'base/packetbuffer.h',
         'base/pathutils.cc',
         'base/pathutils.h',
         'base/physicalsocketserver.cc',
@@ -435,6 +446,8 @@
         'base/timeutils.h',
         'base/timing.cc',
         'base/timing.h',
+        'base/trace.cc',
+        'base/trace.h',
         'base/transformadapter.cc',
         'base/transformadapter.h',
         'base/urlencode.cc',
@@ -557,6 +570,8 @@
           'sources': [
             'base/linux.cc',
             'base/linux.h',
+            'base/netlinknetworkmonitor.cc',
+            'base/netlinknetworkmonitor.h',
           ],
         }],
         ['OS=="linux"', {
@@ -1000,6 +1015,8 @@
         'p2p/base/portproxy.h',
         'p2p/base/pseudotcp.cc',
         'p2p/base/pseudotcp.h',
+        'p2p/base/pseudotcpcongestion.cc',
+        'p2p/base/pseudotcpcongestion.h',
         'p2p/base/rawtransport.cc',
         'p2p/base/rawtransport.h',
         'p2p/base/rawtransportchannel.cc',
@@ -1086,6 +1103,8 @@
         'session/media/rtcpmuxfilter.h',
         'session/media/soundclip.cc',
         'session/media/soundclip.h',
+        'session/media/srtpaesni.cc',
+        'session/media/srtpaesni.h',
         'session/media/srtpfilter.cc',
         'session/media/srtpfilter.h',
         'session/media/ssrcmuxfilter.cc',
@@ -106,6 +106,7 @@
       ],
       'sources': [
         'base/asynchttprequest_unittest.cc',
+        'base/asynclogger_unittest.cc',
         'base/atomicops_unittest.cc',
         'base/autodetectproxy_unittest.cc',
         'base/bandwidthsmoother_unittest.cc',
@@ -126,15 +127,20 @@
         'base/httpcommon_unittest.cc',
         'base/httpserver_unittest.cc',
         'base/ipaddress_unittest.cc',
+        'base/lockfreemessagestore_unittest.cc',
         'base/logging_unittest.cc',
+        'base/mappedfile_unittest.cc',
         'base/md5digest_unittest.cc',
         'base/messagedigest_unittest.cc',
         'base/messagequeue_unittest.cc',
+        'base/messagequeuestats_unittest.cc',
         'base/multipart_unittest.cc',
         'base/nat_unittest.cc',
         'base/network_unittest.cc',
         'base/nullsocketserver_unittest.cc',
+        'base/openhashmap_unittest.cc',
         'base/optionsfile_unittest.cc',
+        'base/packetbuffer_unittest.cc',
         'base/pathutils_unittest.cc',
         'base/physicalsocketserver_unittest.cc',
         'base/profiler_unittest.cc',
@@ -160,6 +166,7 @@
         'base/testclient_unittest.cc',
         'base/thread_unittest.cc',
         'base/timeutils_unittest.cc',
+        'base/trace_unittest.cc',
         'base/urlencode_unittest.cc',
         'base/versionparsing_unittest.cc',
         'base/virtualsocket_unittest.cc',
@@ -194,6 +201,7 @@
             # TODO(ronghuawu): Reenable this test.
             # 'base/linux_unittest.cc',
             'base/linuxfdwalk_unittest.cc',
+            'base/netlinknetworkmonitor_unittest.cc',
           ],
         }],
         ['OS=="win"', {
@@ -326,6 +334,7 @@
         'p2p/base/port_unittest.cc',
         'p2p/base/portallocatorsessionproxy_unittest.cc',
         'p2p/base/pseudotcp_unittest.cc',
+        'p2p/base/pseudotcpcongestion_unittest.cc',
         'p2p/base/relayport_unittest.cc',
         'p2p/base/relayserver_unittest.cc',
         'p2p/base/session_unittest.cc',
@@ -338,6 +347,7 @@
         'p2p/base/testturnserver.h',
         'p2p/base/transport_unittest.cc',
         'p2p/base/transportdescriptionfactory_unittest.cc',
+        'p2p/base/turnserver_unittest.cc',
         'p2p/client/connectivitychecker_unittest.cc',
         'p2p/client/fakeportallocator.h',
         'p2p/client/portallocator_unittest.cc',
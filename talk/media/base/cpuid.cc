@@ -85,4 +85,16 @@ bool IsCoreIOrBetter() {
   return false;
 }
 
+bool HasAesNi() {
+#if !defined(DISABLE_YUV) && (defined(__i386__) || defined(__x86_64__) || \
+    defined(_M_IX86) || defined(_M_X64))
+  int cpu_info[4];
+  libyuv::CpuId(cpu_info, 1);  // Function 1: Feature flags
+  const int kAesBit = 1 << 25;  // ECX bit 25: AES
+  return (cpu_info[2] & kAesBit) != 0;
+#else
+  return false;
+#endif
+}
+
 }  // namespace cricket
@@ -71,6 +71,9 @@ class CpuInfo {
 // Detect an Intel Core I5 or better such as 4th generation Macbook Air.
 bool IsCoreIOrBetter();
 
+// Detect the AES-NI instructions.
+bool HasAesNi();
+
 }  // namespace cricket
 
 #endif  // TALK_MEDIA_BASE_CPUID_H_
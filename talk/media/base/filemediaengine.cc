@@ -38,6 +38,24 @@
 
 namespace cricket {
 
+// Opens the input RTP dump |filename|, and sets either |reader| to a looping
+// reader that maps it, or else |stream| to the file stream. Returns false if
+// the file can't be opened.
+static bool OpenInputDump(const std::string& filename,
+                          RtpDumpMappedReader** reader,
+                          talk_base::FileStream** stream) {
+  talk_base::scoped_ptr<RtpDumpMappedReader> mapped_reader(
+      new RtpDumpMappedReader());
+  if (mapped_reader->Open(filename)) {
+    mapped_reader->set_loop(true);
+    *reader = mapped_reader.release();
+    return true;
+  }
+  *stream = talk_base::Filesystem::OpenFile(talk_base::Pathname(filename),
+                                            "rb");
+  return *stream != NULL;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Implementation of FileMediaEngine.
 ///////////////////////////////////////////////////////////////////////////
@@ -59,60 +77,64 @@ int FileMediaEngine::GetCapabilities() {
 }
 
 VoiceMediaChannel* FileMediaEngine::CreateChannel() {
+  RtpDumpMappedReader* input_reader = NULL;
   talk_base::FileStream* input_file_stream = NULL;
   talk_base::FileStream* output_file_stream = NULL;
 
   if (voice_input_filename_.empty() && voice_output_filename_.empty())
     return NULL;
-  if (!voice_input_filename_.empty()) {
-    input_file_stream = talk_base::Filesystem::OpenFile(
-        talk_base::Pathname(voice_input_filename_), "rb");
-    if (!input_file_stream) {
-      LOG(LS_ERROR) << "Not able to open the input audio stream file.";
-      return NULL;
-    }
+  if (!voice_input_filename_.empty() &&
+      !OpenInputDump(voice_input_filename_, &input_reader, &input_file_stream)) {
+    LOG(LS_ERROR) << "Not able to open the input audio stream file.";
+    return NULL;
   }
 
   if (!voice_output_filename_.empty()) {
     output_file_stream = talk_base::Filesystem::OpenFile(
         talk_base::Pathname(voice_output_filename_), "wb");
     if (!output_file_stream) {
+      delete input_reader;
       delete input_file_stream;
       LOG(LS_ERROR) << "Not able to open the output audio stream file.";
       return NULL;
     }
   }
 
+  if (input_reader) {
+    return new FileVoiceChannel(input_reader, output_file_stream);
+  }
   return new FileVoiceChannel(input_file_stream, output_file_stream);
 }
 
 VideoMediaChannel* FileMediaEngine::CreateVideoChannel(
     VoiceMediaChannel* voice_ch) {
+  RtpDumpMappedReader* input_reader = NULL;
   talk_base::FileStream* input_file_stream = NULL;
   talk_base::FileStream* output_file_stream = NULL;
 
   if (video_input_filename_.empty() && video_output_filename_.empty())
       return NULL;
 
-  if (!video_input_filename_.empty()) {
-    input_file_stream = talk_base::Filesystem::OpenFile(
-        talk_base::Pathname(video_input_filename_), "rb");
-    if (!input_file_stream) {
-      LOG(LS_ERROR) << "Not able to open the input video stream file.";
-      return NULL;
-    }
+  if (!video_input_filename_.empty() &&
+      !OpenInputDump(video_input_filename_, &input_reader, &input_file_stream)) {
+    LOG(LS_ERROR) << "Not able to open the input video stream file.";
+    return NULL;
   }
 
   if (!video_output_filename_.empty()) {
     output_file_stream = talk_base::Filesystem::OpenFile(
         talk_base::Pathname(video_output_filename_), "wb");
     if (!output_file_stream) {
+      delete input_reader;
       delete input_file_stream;
       LOG(LS_ERROR) << "Not able to open the output video stream file.";
       return NULL;
     }
   }
 
+  if (input_reader) {
+    return new FileVideoChannel(input_reader, output_file_stream);
+  }
   return new FileVideoChannel(input_file_stream, output_file_stream);
 }
 
@@ -125,6 +147,9 @@ class RtpSenderReceiver
   RtpSenderReceiver(MediaChannel* channel,
                     talk_base::StreamInterface* input_file_stream,
                     talk_base::StreamInterface* output_file_stream);
+  RtpSenderReceiver(MediaChannel* channel,
+                    RtpDumpReader* input_reader,
+                    talk_base::StreamInterface* output_file_stream);
 
   // Called by media channel. Context: media channel thread.
   bool SetSend(bool send);
@@ -135,6 +160,9 @@ class RtpSenderReceiver
   virtual void OnMessage(talk_base::Message* pmsg);
 
  private:
+  // Start the sender thread if there is an input, and create a rtp dump writer
+  // for the output.
+  void Init(talk_base::StreamInterface* output_file_stream);
   // Read the next RTP dump packet, whose RTP SSRC is the same as first_ssrc_.
   // Return true if successful.
   bool ReadNextPacket(RtpDumpPacket* packet);
@@ -146,10 +174,12 @@ class RtpSenderReceiver
   MediaChannel* media_channel_;
   talk_base::scoped_ptr<talk_base::StreamInterface> input_stream_;
   talk_base::scoped_ptr<talk_base::StreamInterface> output_stream_;
-  talk_base::scoped_ptr<RtpDumpLoopReader> rtp_dump_reader_;
+  talk_base::scoped_ptr<RtpDumpReader> rtp_dump_reader_;
   talk_base::scoped_ptr<RtpDumpWriter> rtp_dump_writer_;
   // RTP dump packet read from the input stream.
   RtpDumpPacket rtp_dump_packet_;
+  // Reused for every packet sent.
+  talk_base::Buffer send_buffer_;
   uint32 start_send_time_;
   bool sending_;
   bool first_packet_;
@@ -166,11 +196,30 @@ RtpSenderReceiver::RtpSenderReceiver(
     talk_base::StreamInterface* input_file_stream,
     talk_base::StreamInterface* output_file_stream)
     : media_channel_(channel),
+      send_buffer_(NULL, 0, kMaxRtpPacketLen),
       sending_(false),
       first_packet_(true) {
   input_stream_.reset(input_file_stream);
   if (input_stream_) {
     rtp_dump_reader_.reset(new RtpDumpLoopReader(input_stream_.get()));
+  }
+  Init(output_file_stream);
+}
+
+RtpSenderReceiver::RtpSenderReceiver(
+    MediaChannel* channel,
+    RtpDumpReader* input_reader,
+    talk_base::StreamInterface* output_file_stream)
+    : media_channel_(channel),
+      rtp_dump_reader_(input_reader),
+      send_buffer_(NULL, 0, kMaxRtpPacketLen),
+      sending_(false),
+      first_packet_(true) {
+  Init(output_file_stream);
+}
+
+void RtpSenderReceiver::Init(talk_base::StreamInterface* output_file_stream) {
+  if (rtp_dump_reader_) {
     // Start the sender thread, which reads rtp dump records, waits based on
     // the record timestamps, and sends the RTP packets to the network.
     Thread::Start();
@@ -249,8 +298,8 @@ bool RtpSenderReceiver::SendRtpPacket(const void* data, size_t len) {
     return false;
   }
 
-  talk_base::Buffer packet(data, len, kMaxRtpPacketLen);
-  return media_channel_->network_interface()->SendPacket(&packet);
+  send_buffer_.SetData(data, len);
+  return media_channel_->network_interface()->SendPacket(&send_buffer_);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -263,6 +312,13 @@ FileVoiceChannel::FileVoiceChannel(
       rtp_sender_receiver_(new RtpSenderReceiver(this, input_file_stream,
                                                  output_file_stream)) {}
 
+FileVoiceChannel::FileVoiceChannel(
+    RtpDumpReader* input_reader,
+    talk_base::StreamInterface* output_file_stream)
+    : send_ssrc_(0),
+      rtp_sender_receiver_(new RtpSenderReceiver(this, input_reader,
+                                                 output_file_stream)) {}
+
 FileVoiceChannel::~FileVoiceChannel() {}
 
 bool FileVoiceChannel::SetSendCodecs(const std::vector<AudioCodec>& codecs) {
@@ -306,6 +362,13 @@ FileVideoChannel::FileVideoChannel(
       rtp_sender_receiver_(new RtpSenderReceiver(this, input_file_stream,
                                                  output_file_stream)) {}
 
+FileVideoChannel::FileVideoChannel(
+    RtpDumpReader* input_reader,
+    talk_base::StreamInterface* output_file_stream)
+    : send_ssrc_(0),
+      rtp_sender_receiver_(new RtpSenderReceiver(this, input_reader,
+                                                 output_file_stream)) {}
+
 FileVideoChannel::~FileVideoChannel() {}
 
 bool FileVideoChannel::SetSendCodecs(const std::vector<VideoCodec>& codecs) {
@@ -48,6 +48,8 @@ namespace cricket {
 // stream. Depending on the parameters of the constructor, FileMediaEngine can
 // act as file voice engine, file video engine, or both. Currently, we use
 // only the RTP dump packets. TODO(whyuan): Enable RTCP packets.
+// The input RTP dumps are memory-mapped if possible, so that large captures
+// can be replayed at line rate; they are read through a stream otherwise.
 class FileMediaEngine : public MediaEngineInterface {
  public:
   FileMediaEngine() {}
@@ -170,12 +172,16 @@ class FileMediaEngine : public MediaEngineInterface {
   DISALLOW_COPY_AND_ASSIGN(FileMediaEngine);
 };
 
+class RtpDumpReader;
 class RtpSenderReceiver;  // Forward declaration. Defined in the .cc file.
 
 class FileVoiceChannel : public VoiceMediaChannel {
  public:
   FileVoiceChannel(talk_base::StreamInterface* input_file_stream,
       talk_base::StreamInterface* output_file_stream);
+  // Sends the packets read by |input_reader|, which it takes ownership of.
+  FileVoiceChannel(RtpDumpReader* input_reader,
+      talk_base::StreamInterface* output_file_stream);
   virtual ~FileVoiceChannel();
 
   // Implement pure virtual methods of VoiceMediaChannel.
@@ -249,6 +255,9 @@ class FileVideoChannel : public VideoMediaChannel {
  public:
   FileVideoChannel(talk_base::StreamInterface* input_file_stream,
       talk_base::StreamInterface* output_file_stream);
+  // Sends the packets read by |input_reader|, which it takes ownership of.
+  FileVideoChannel(RtpDumpReader* input_reader,
+      talk_base::StreamInterface* output_file_stream);
   virtual ~FileVideoChannel();
 
   // Implement pure virtual methods of VideoMediaChannel.
@@ -29,6 +29,7 @@
 
 #include <ctype.h>
 
+#include <algorithm>
 #include <string>
 
 #include "talk/base/byteorder.h"
@@ -314,6 +315,193 @@ void RtpDumpLoopReader::UpdateDumpPacket(RtpDumpPacket* packet) {
   }
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Implementation of RtpDumpMappedReader.
+///////////////////////////////////////////////////////////////////////////
+RtpDumpMappedReader::RtpDumpMappedReader()
+    : RtpDumpReader(NULL),
+      data_(NULL),
+      size_(0),
+      start_time_ms_(0),
+      next_(0),
+      loop_(false),
+      loop_count_(0),
+      elapsed_time_increase_(0),
+      rtp_seq_num_increase_(0),
+      rtp_timestamp_increase_(0) {
+}
+
+bool RtpDumpMappedReader::Open(const std::string& filename) {
+  if (!file_.Open(filename)) {
+    return false;
+  }
+  if (!Attach(file_.data(), file_.size())) {
+    file_.Close();
+    return false;
+  }
+  return true;
+}
+
+bool RtpDumpMappedReader::Attach(const void* data, size_t len) {
+  data_ = static_cast<const char*>(data);
+  size_ = len;
+  next_ = 0;
+  loop_count_ = 0;
+  if (!BuildIndex()) {
+    LOG(LS_WARNING) << "Not a valid RTP dump";
+    index_.clear();
+    data_ = NULL;
+    size_ = 0;
+    return false;
+  }
+  return true;
+}
+
+bool RtpDumpMappedReader::BuildIndex() {
+  index_.clear();
+  // Check the first line and read the start time from the file header.
+  const char* end_of_line = static_cast<const char*>(
+      memchr(data_, '\n', size_));
+  if (!end_of_line ||
+      !CheckFirstLine(std::string(data_, end_of_line - data_))) {
+    return false;
+  }
+  size_t offset = end_of_line + 1 - data_;
+  if (size_ - offset < RtpDumpFileHeader::kHeaderLength) {
+    return false;
+  }
+  uint32 start_sec = talk_base::GetBE32(data_ + offset);
+  uint32 start_usec = talk_base::GetBE32(data_ + offset + 4);
+  start_time_ms_ = start_sec * 1000 + start_usec / 1000;
+  offset += RtpDumpFileHeader::kHeaderLength;
+
+  // Index the dump packets, and gather the statistics that
+  // RtpDumpLoopReader gathers during its first loop.
+  uint32 seek_time = 0;
+  uint32 frame_count = 0;
+  uint32 first_elapsed_time = 0;
+  uint32 last_elapsed_time = 0;
+  int first_rtp_seq_num = 0;
+  int last_rtp_seq_num = 0;
+  uint32 first_rtp_timestamp = 0;
+  uint32 last_rtp_timestamp = 0;
+  while (size_ - offset >= RtpDumpPacket::kHeaderLength) {
+    const char* header = data_ + offset;
+    uint16 dump_packet_len = talk_base::GetBE16(header);
+    uint16 original_data_len = talk_base::GetBE16(header + 2);
+    uint32 elapsed_time = talk_base::GetBE32(header + 4);
+    if (dump_packet_len < RtpDumpPacket::kHeaderLength ||
+        dump_packet_len > size_ - offset) {
+      LOG(LS_WARNING) << "Ignoring truncated RTP dump packet at " << offset;
+      break;
+    }
+
+    const char* packet = header + RtpDumpPacket::kHeaderLength;
+    size_t len = dump_packet_len - RtpDumpPacket::kHeaderLength;
+    int rtp_seq_num = 0;
+    uint32 rtp_timestamp = 0;
+    if (original_data_len >= len && len >= kMinRtpPacketLen) {
+      GetRtpSeqNum(packet, len, &rtp_seq_num);
+      GetRtpTimestamp(packet, len, &rtp_timestamp);
+    }
+    if (index_.empty()) {
+      first_elapsed_time = elapsed_time;
+      first_rtp_seq_num = rtp_seq_num;
+      first_rtp_timestamp = rtp_timestamp;
+      ++frame_count;
+    } else if (rtp_timestamp != last_rtp_timestamp) {
+      ++frame_count;
+    }
+    last_elapsed_time = elapsed_time;
+    last_rtp_seq_num = rtp_seq_num;
+    last_rtp_timestamp = rtp_timestamp;
+
+    seek_time = talk_base::_max(seek_time, elapsed_time);
+    IndexEntry entry = { offset, seek_time };
+    index_.push_back(entry);
+    offset += dump_packet_len;
+  }
+
+  uint32 packet_count = static_cast<uint32>(index_.size());
+  rtp_seq_num_increase_ = last_rtp_seq_num - first_rtp_seq_num + 1;
+  elapsed_time_increase_ = packet_count <= 1 ? kDefaultTimeIncrease :
+      (last_elapsed_time - first_elapsed_time) * packet_count /
+      (packet_count - 1);
+  rtp_timestamp_increase_ = frame_count <= 1 ? kDefaultTimeIncrease :
+      (last_rtp_timestamp - first_rtp_timestamp) * frame_count /
+      (frame_count - 1);
+  return true;
+}
+
+bool RtpDumpMappedReader::SeekToTime(uint32 elapsed_ms) {
+  loop_count_ = 0;
+  if (loop_ && elapsed_time_increase_ > 0 && !index_.empty()) {
+    // Find the loop that |elapsed_ms| falls in, then seek in the first one.
+    uint32 loop_start = index_.front().seek_time;
+    if (elapsed_ms > loop_start) {
+      loop_count_ = (elapsed_ms - loop_start) / elapsed_time_increase_;
+      elapsed_ms -= loop_count_ * elapsed_time_increase_;
+    }
+  }
+  next_ = std::lower_bound(index_.begin(), index_.end(), elapsed_ms) -
+      index_.begin();
+  return next_ < index_.size() || (loop_ && !index_.empty());
+}
+
+bool RtpDumpMappedReader::SeekToPacket(size_t index) {
+  if (index > index_.size()) {
+    return false;
+  }
+  loop_count_ = 0;
+  next_ = index;
+  return true;
+}
+
+talk_base::StreamResult RtpDumpMappedReader::ReadPacket(
+    RtpDumpPacket* packet) {
+  if (!packet || !data_) return talk_base::SR_ERROR;
+
+  if (next_ >= index_.size()) {
+    if (!loop_ || index_.empty()) {
+      return talk_base::SR_EOS;
+    }
+    ++loop_count_;
+    next_ = 0;
+  }
+
+  const char* header = data_ + index_[next_++].offset;
+  uint16 dump_packet_len = talk_base::GetBE16(header);
+  packet->original_data_len = talk_base::GetBE16(header + 2);
+  packet->elapsed_time = talk_base::GetBE32(header + 4);
+  // Unlike resize() and memcpy(), assign() does not value-initialize the
+  // bytes it then overwrites.
+  const uint8* begin =
+      reinterpret_cast<const uint8*>(header + RtpDumpPacket::kHeaderLength);
+  packet->data.assign(begin, begin + dump_packet_len -
+                      RtpDumpPacket::kHeaderLength);
+
+  if (loop_count_ > 0) {
+    UpdateDumpPacket(packet);
+  }
+  if (packet->IsValidRtpPacket() && ssrc_override() != 0) {
+    talk_base::SetBE32(&packet->data[kRtpSsrcOffset], ssrc_override());
+  }
+  return talk_base::SR_SUCCESS;
+}
+
+void RtpDumpMappedReader::UpdateDumpPacket(RtpDumpPacket* packet) {
+  packet->elapsed_time += loop_count_ * elapsed_time_increase_;
+
+  int sequence = 0;
+  uint32 timestamp = 0;
+  if (packet->GetRtpSeqNum(&sequence) && packet->GetRtpTimestamp(&timestamp)) {
+    sequence += loop_count_ * rtp_seq_num_increase_;
+    timestamp += loop_count_ * rtp_timestamp_increase_;
+    talk_base::SetBE16(&packet->data[2], static_cast<uint16>(sequence));
+    talk_base::SetBE32(&packet->data[4], timestamp);
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Implementation of RtpDumpWriter.
 ///////////////////////////////////////////////////////////////////////////
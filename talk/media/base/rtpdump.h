@@ -34,6 +34,7 @@
 
 #include "talk/base/basictypes.h"
 #include "talk/base/bytebuffer.h"
+#include "talk/base/mappedfile.h"
 #include "talk/base/stream.h"
 
 namespace cricket {
@@ -121,11 +122,11 @@ class RtpDumpReader {
   bool RewindToFirstDumpPacket() {
     return stream_->SetPosition(first_line_and_file_header_len_);
   }
-
- private:
   // Check if its matches "#!rtpplay1.0 address/port\n".
   bool CheckFirstLine(const std::string& first_line);
+  uint32 ssrc_override() const { return ssrc_override_; }
 
+ private:
   talk_base::StreamInterface* stream_;
   bool file_header_read_;
   size_t first_line_and_file_header_len_;
@@ -183,6 +184,74 @@ class RtpDumpLoopReader : public RtpDumpReader {
   DISALLOW_COPY_AND_ASSIGN(RtpDumpLoopReader);
 };
 
+// RtpDumpMappedReader reads a RTP dump file through a read-only memory
+// mapping, for replaying large captures. When the dump is opened, it indexes
+// the offset and elapsed time of every dump packet, so that it can seek by
+// time in O(log n). When looping, it adjusts the packets of later loops like
+// RtpDumpLoopReader does, from statistics gathered while indexing.
+// ReadPacket() copies into the existing buffer of |packet|, so reading into
+// the same packet does not allocate once it has held the largest packet.
+class RtpDumpMappedReader : public RtpDumpReader {
+ public:
+  RtpDumpMappedReader();
+
+  // Maps and indexes the dump file |filename|. Returns false if the file
+  // can't be mapped or does not start with a valid file header. A truncated
+  // last packet is ignored.
+  bool Open(const std::string& filename);
+  // Indexes a dump held in memory, which must outlive the reader.
+  bool Attach(const void* data, size_t len);
+
+  // Whether to rewind to the first packet at the end of the dump.
+  void set_loop(bool loop) { loop_ = loop; }
+
+  size_t packet_count() const { return index_.size(); }
+  uint32 start_time_ms() const { return start_time_ms_; }
+  // The index of the packet that ReadPacket() returns next.
+  size_t position() const { return next_; }
+
+  // Moves to the first packet whose elapsed time, and that of every packet
+  // before it, is at least |elapsed_ms| (the elapsed times in a dump may go
+  // back slightly). When looping, |elapsed_ms| may fall in a later loop.
+  // Returns false, and moves to the end, if there is no such packet.
+  bool SeekToTime(uint32 elapsed_ms);
+  // Moves to the packet with index |index| in the first loop.
+  bool SeekToPacket(size_t index);
+
+  virtual talk_base::StreamResult ReadPacket(RtpDumpPacket* packet);
+
+ private:
+  struct IndexEntry {
+    size_t offset;
+    // The largest elapsed time of this and the preceding packets, which
+    // unlike the elapsed time itself never decreases.
+    uint32 seek_time;
+    bool operator<(uint32 time) const { return seek_time < time; }
+  };
+
+  // Checks the file header, and indexes the dump packets and gathers the
+  // loop statistics in one pass.
+  bool BuildIndex();
+  // Adjusts |packet| for the current loop, as RtpDumpLoopReader does.
+  void UpdateDumpPacket(RtpDumpPacket* packet);
+
+  talk_base::MappedFile file_;
+  const char* data_;
+  size_t size_;
+  uint32 start_time_ms_;
+  std::vector<IndexEntry> index_;
+  size_t next_;
+  bool loop_;
+  int loop_count_;
+  // What RtpDumpLoopReader calculates in its first loop, from the packet
+  // and frame counts and the first and last packets of the dump.
+  uint32 elapsed_time_increase_;
+  int rtp_seq_num_increase_;
+  uint32 rtp_timestamp_increase_;
+
+  DISALLOW_COPY_AND_ASSIGN(RtpDumpMappedReader);
+};
+
 class RtpDumpWriter {
  public:
   explicit RtpDumpWriter(talk_base::StreamInterface* stream);
@@ -28,8 +28,11 @@
 #include <string>
 
 #include "talk/base/bytebuffer.h"
+#include "talk/base/fileutils.h"
 #include "talk/base/gunit.h"
+#include "talk/base/pathutils.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/media/base/rtpdump.h"
 #include "talk/media/base/rtputils.h"
 #include "talk/media/base/testutils.h"
@@ -38,6 +41,38 @@ namespace cricket {
 
 static const uint32 kTestSsrc = 1;
 
+// Checks that RtpDumpMappedReader reads the same |count| packets from the
+// dump in |stream| as RtpDumpLoopReader, or as RtpDumpReader if not |loop|.
+static void ExpectMappedReadSameAsStream(talk_base::MemoryStream* stream,
+                                         size_t count, bool loop,
+                                         uint32 ssrc) {
+  size_t len = 0;
+  ASSERT_TRUE(stream->GetSize(&len));
+  RtpDumpMappedReader mapped_reader;
+  ASSERT_TRUE(mapped_reader.Attach(stream->GetBuffer(), len));
+  mapped_reader.set_loop(loop);
+  mapped_reader.SetSsrc(ssrc);
+
+  stream->Rewind();
+  talk_base::scoped_ptr<RtpDumpReader> reader(
+      loop ? new RtpDumpLoopReader(stream) : new RtpDumpReader(stream));
+  reader->SetSsrc(ssrc);
+
+  RtpDumpPacket expected;
+  RtpDumpPacket packet;
+  for (size_t i = 0; i < count; ++i) {
+    ASSERT_EQ(talk_base::SR_SUCCESS, reader->ReadPacket(&expected));
+    ASSERT_EQ(talk_base::SR_SUCCESS, mapped_reader.ReadPacket(&packet));
+    EXPECT_EQ(expected.elapsed_time, packet.elapsed_time);
+    EXPECT_EQ(expected.original_data_len, packet.original_data_len);
+    EXPECT_TRUE(expected.data == packet.data);
+  }
+  if (!loop) {
+    EXPECT_EQ(talk_base::SR_EOS, reader->ReadPacket(&expected));
+    EXPECT_EQ(talk_base::SR_EOS, mapped_reader.ReadPacket(&packet));
+  }
+}
+
 // Test that we read the correct header fields from the RTP/RTCP packet.
 TEST(RtpDumpTest, ReadRtpDumpPacket) {
   talk_base::ByteBuffer rtp_buf;
@@ -294,4 +329,207 @@ TEST(RtpDumpTest, LoopReadSingleRtcp) {
   EXPECT_EQ(talk_base::SR_SUCCESS, loop_reader.ReadPacket(&packet));
 }
 
+// Test that RtpDumpMappedReader reads what RtpDumpReader reads.
+TEST(RtpDumpTest, MappedReadSameRtpAndRtcp) {
+  talk_base::MemoryStream stream;
+  RtpDumpWriter writer(&stream);
+  ASSERT_TRUE(RtpTestUtility::WriteTestPackets(
+      RtpTestUtility::GetTestPacketCount(), false, kTestSsrc, &writer));
+  ASSERT_TRUE(RtpTestUtility::WriteTestPackets(
+      RtpTestUtility::GetTestPacketCount(), true, kTestSsrc, &writer));
+  ExpectMappedReadSameAsStream(
+      &stream, 2 * RtpTestUtility::GetTestPacketCount(), false, 0);
+  ExpectMappedReadSameAsStream(
+      &stream, 2 * RtpTestUtility::GetTestPacketCount(), false, kTestSsrc + 1);
+}
+
+// Test that RtpDumpMappedReader loops like RtpDumpLoopReader.
+TEST(RtpDumpTest, MappedLoopReadRtp) {
+  talk_base::MemoryStream stream;
+  RtpDumpWriter writer(&stream);
+  ASSERT_TRUE(RtpTestUtility::WriteTestPackets(
+      RtpTestUtility::GetTestPacketCount(), false, kTestSsrc, &writer));
+  ExpectMappedReadSameAsStream(
+      &stream, 3 * RtpTestUtility::GetTestPacketCount(), true, kTestSsrc + 1);
+}
+
+TEST(RtpDumpTest, MappedLoopReadRtcp) {
+  talk_base::MemoryStream stream;
+  RtpDumpWriter writer(&stream);
+  ASSERT_TRUE(RtpTestUtility::WriteTestPackets(
+      RtpTestUtility::GetTestPacketCount(), true, kTestSsrc, &writer));
+  ExpectMappedReadSameAsStream(
+      &stream, 3 * RtpTestUtility::GetTestPacketCount(), true, 0);
+}
+
+TEST(RtpDumpTest, MappedLoopReadSingleRtp) {
+  talk_base::MemoryStream stream;
+  RtpDumpWriter writer(&stream);
+  ASSERT_TRUE(RtpTestUtility::WriteTestPackets(1, false, kTestSsrc, &writer));
+  ExpectMappedReadSameAsStream(&stream, 3, true, 0);
+}
+
+// Test that RtpDumpMappedReader rejects an invalid first line, and ignores a
+// truncated last packet.
+TEST(RtpDumpTest, MappedReadInvalidDump) {
+  talk_base::MemoryStream stream;
+  RtpDumpWriter writer(&stream);
+  ASSERT_TRUE(RtpTestUtility::WriteTestPackets(2, false, kTestSsrc, &writer));
+  size_t len = 0;
+  ASSERT_TRUE(stream.GetSize(&len));
+
+  RtpDumpMappedReader reader;
+  RtpDumpPacket packet;
+  EXPECT_TRUE(reader.Attach(stream.GetBuffer(), len));
+  EXPECT_EQ(2U, reader.packet_count());
+  EXPECT_TRUE(reader.Attach(stream.GetBuffer(), len - 1));
+  EXPECT_EQ(1U, reader.packet_count());
+  EXPECT_EQ(talk_base::SR_SUCCESS, reader.ReadPacket(&packet));
+  EXPECT_EQ(talk_base::SR_EOS, reader.ReadPacket(&packet));
+
+  const char bad_line[] = "#!rtpplaz1.0 0.0.0.0/0\n";
+  memcpy(stream.GetBuffer(), bad_line, strlen(bad_line));
+  EXPECT_FALSE(reader.Attach(stream.GetBuffer(), len));
+  EXPECT_EQ(0U, reader.packet_count());
+  EXPECT_EQ(talk_base::SR_ERROR, reader.ReadPacket(&packet));
+  EXPECT_FALSE(reader.Attach(stream.GetBuffer(), 0));
+}
+
+// Test seeking by time and by packet, with and without looping.
+TEST(RtpDumpTest, MappedReadSeek) {
+  talk_base::MemoryStream stream;
+  RtpDumpWriter writer(&stream);
+  const size_t count = RtpTestUtility::GetTestPacketCount();
+  const uint32 interval = RtpTestUtility::kElapsedTimeInterval;
+  ASSERT_TRUE(RtpTestUtility::WriteTestPackets(count, false, kTestSsrc,
+                                               &writer));
+  size_t len = 0;
+  ASSERT_TRUE(stream.GetSize(&len));
+  RtpDumpMappedReader reader;
+  ASSERT_TRUE(reader.Attach(stream.GetBuffer(), len));
+  ASSERT_EQ(count, reader.packet_count());
+
+  RtpDumpPacket packet;
+  int seq_num = 0;
+  // Exactly on a packet, and between two packets.
+  EXPECT_TRUE(reader.SeekToTime(2 * interval));
+  EXPECT_EQ(2U, reader.position());
+  EXPECT_TRUE(reader.SeekToTime(2 * interval + 1));
+  EXPECT_EQ(3U, reader.position());
+  EXPECT_EQ(talk_base::SR_SUCCESS, reader.ReadPacket(&packet));
+  EXPECT_EQ(3 * interval, packet.elapsed_time);
+  EXPECT_TRUE(packet.GetRtpSeqNum(&seq_num));
+  EXPECT_EQ(RtpTestUtility::kTestRawRtpPackets[3].sequence_number, seq_num);
+  // Past the end.
+  EXPECT_FALSE(reader.SeekToTime((count - 1) * interval + 1));
+  EXPECT_EQ(count, reader.position());
+  EXPECT_EQ(talk_base::SR_EOS, reader.ReadPacket(&packet));
+  EXPECT_TRUE(reader.SeekToPacket(1));
+  EXPECT_EQ(talk_base::SR_SUCCESS, reader.ReadPacket(&packet));
+  EXPECT_EQ(interval, packet.elapsed_time);
+  EXPECT_FALSE(reader.SeekToPacket(count + 1));
+
+  // When looping, seeking to a later loop reads the packet that the loop
+  // reader would read there.
+  reader.set_loop(true);
+  EXPECT_TRUE(reader.SeekToTime((2 * count + 1) * interval));
+  EXPECT_EQ(1U, reader.position());
+  EXPECT_EQ(talk_base::SR_SUCCESS, reader.ReadPacket(&packet));
+  EXPECT_EQ((2 * count + 1) * interval, packet.elapsed_time);
+  EXPECT_TRUE(packet.GetRtpSeqNum(&seq_num));
+  EXPECT_EQ(static_cast<int>(
+      RtpTestUtility::kTestRawRtpPackets[1].sequence_number + 2 * count),
+      seq_num);
+}
+
+// Test that RtpDumpMappedReader maps a dump file, and fails on a missing one.
+TEST(RtpDumpTest, MappedReadFile) {
+  talk_base::Pathname path;
+  ASSERT_TRUE(talk_base::Filesystem::GetTemporaryFolder(path, true, NULL));
+  path.SetPathname(talk_base::Filesystem::TempFilename(path, "rtpdump-test-"));
+  talk_base::scoped_ptr<talk_base::FileStream> stream(
+      talk_base::Filesystem::OpenFile(path, "wb"));
+  ASSERT_TRUE(stream.get() != NULL);
+  RtpDumpWriter writer(stream.get());
+  ASSERT_TRUE(RtpTestUtility::WriteTestPackets(
+      RtpTestUtility::GetTestPacketCount(), false, kTestSsrc, &writer));
+  stream.reset();
+
+  RtpDumpMappedReader reader;
+  EXPECT_TRUE(reader.Open(path.pathname()));
+  EXPECT_EQ(RtpTestUtility::GetTestPacketCount(), reader.packet_count());
+  RtpDumpPacket packet;
+  for (size_t i = 0; i < RtpTestUtility::GetTestPacketCount(); ++i) {
+    ASSERT_EQ(talk_base::SR_SUCCESS, reader.ReadPacket(&packet));
+    EXPECT_TRUE(RtpTestUtility::VerifyPacket(
+        &packet, &RtpTestUtility::kTestRawRtpPackets[i], false));
+  }
+  EXPECT_EQ(talk_base::SR_EOS, reader.ReadPacket(&packet));
+  EXPECT_TRUE(talk_base::Filesystem::DeleteFile(path));
+  EXPECT_FALSE(reader.Open(path.pathname()));
+}
+
+// Compares reading a large dump file through a file stream and through a
+// mapping, and measures seeking by time.
+TEST(RtpDumpTest, MappedReadLargeFilePerf) {
+  const int kPackets = 200000;
+  const int kPayloadSize = 200;
+  const int kSeeks = 100000;
+  talk_base::Pathname path;
+  ASSERT_TRUE(talk_base::Filesystem::GetTemporaryFolder(path, true, NULL));
+  path.SetPathname(talk_base::Filesystem::TempFilename(path, "rtpdump-perf-"));
+  talk_base::scoped_ptr<talk_base::FileStream> stream(
+      talk_base::Filesystem::OpenFile(path, "wb"));
+  ASSERT_TRUE(stream.get() != NULL);
+  {
+    RtpDumpWriter writer(stream.get());
+    talk_base::ByteBuffer buf;
+    RtpTestUtility::kTestRawRtpPackets[0].WriteToByteBuffer(kTestSsrc, &buf);
+    std::string payload(kPayloadSize, 'x');
+    buf.WriteString(payload);
+    RtpDumpPacket dump_packet(buf.Data(), buf.Length(), 0, false);
+    for (int i = 0; i < kPackets; ++i) {
+      dump_packet.elapsed_time = i * 20;
+      ASSERT_EQ(talk_base::SR_SUCCESS, writer.WritePacket(dump_packet));
+    }
+  }
+  stream.reset();
+
+  RtpDumpPacket packet;
+  uint32 start = talk_base::Time();
+  stream.reset(talk_base::Filesystem::OpenFile(path, "rb"));
+  ASSERT_TRUE(stream.get() != NULL);
+  RtpDumpReader stream_reader(stream.get());
+  int stream_packets = 0;
+  while (stream_reader.ReadPacket(&packet) == talk_base::SR_SUCCESS) {
+    ++stream_packets;
+  }
+  uint32 stream_time = talk_base::TimeSince(start);
+
+  start = talk_base::Time();
+  RtpDumpMappedReader mapped_reader;
+  ASSERT_TRUE(mapped_reader.Open(path.pathname()));
+  uint32 index_time = talk_base::TimeSince(start);
+  int mapped_packets = 0;
+  while (mapped_reader.ReadPacket(&packet) == talk_base::SR_SUCCESS) {
+    ++mapped_packets;
+  }
+  uint32 mapped_time = talk_base::TimeSince(start);
+  EXPECT_EQ(kPackets, stream_packets);
+  EXPECT_EQ(kPackets, mapped_packets);
+
+  start = talk_base::Time();
+  for (int i = 0; i < kSeeks; ++i) {
+    uint32 time = static_cast<uint32>((i * 7919) % kPackets) * 20;
+    EXPECT_TRUE(mapped_reader.SeekToTime(time));
+  }
+  uint32 seek_time = talk_base::TimeSince(start);
+
+  LOG(LS_INFO) << "Read " << kPackets << " packets: stream " << stream_time
+               << " ms, mapped " << mapped_time << " ms (indexing "
+               << index_time << " ms); " << kSeeks << " seeks " << seek_time
+               << " ms";
+  EXPECT_TRUE(talk_base::Filesystem::DeleteFile(path));
+}
+
 }  // namespace cricket
@@ -246,6 +246,15 @@ bool VideoAdapter::AdaptFrame(const VideoFrame* in_frame,
                                              .5f);
   }
 
+  // A frame that already has the output size, e.g. because the capturer
+  // scaled it while converting it, is passed on instead of copied.
+  if (!black_output_ &&
+      in_frame->GetWidth() == static_cast<size_t>(output_format_.width) &&
+      in_frame->GetHeight() == static_cast<size_t>(output_format_.height)) {
+    *out_frame = in_frame;
+    return true;
+  }
+
   if (!StretchToOutputFrame(in_frame)) {
     return false;
   }
@@ -60,7 +60,8 @@ class VideoAdapter {
   // Adapt the input frame from the input format to the output format. Return
   // true and set the output frame to NULL if the input frame is dropped. Return
   // true and set the out frame to output_frame_ if the input frame is adapted
-  // successfully. Return false otherwise.
+  // successfully, or to the input frame itself if it needs no scaling. Return
+  // false otherwise.
   // output_frame_ is owned by the VideoAdapter that has the best knowledge on
   // the output frame.
   bool AdaptFrame(const VideoFrame* in_frame, const VideoFrame** out_frame);
@@ -29,9 +29,6 @@
 
 #include <algorithm>
 
-#if !defined(DISABLE_YUV)
-#include "libyuv/scale_argb.h"
-#endif
 #include "talk/base/common.h"
 #include "talk/base/logging.h"
 #include "talk/base/systeminfo.h"
@@ -320,9 +317,11 @@ void VideoCapturer::OnFrameCaptured(VideoCapturer*,
 #define VIDEO_FRAME_NAME WebRtcVideoFrame
 #endif
 #if defined(VIDEO_FRAME_NAME)
-#if !defined(DISABLE_YUV)
+  // Size to scale the captured frame to. Screencasts are scaled down as they
+  // are converted, rather than in a separate pass over the captured frame.
+  int scaled_width = 0;
+  int scaled_height = 0;
   if (IsScreencast()) {
-    int scaled_width, scaled_height;
     int desired_screencast_fps = capture_format_.get() ?
         VideoFormat::IntervalToFps(capture_format_->interval) :
         kDefaultScreencastFps;
@@ -337,27 +336,7 @@ void VideoCapturer::OnFrameCaptured(VideoCapturer*,
       scaled_width_ = scaled_width;
       scaled_height_ = scaled_height;
     }
-    if (FOURCC_ARGB == captured_frame->fourcc &&
-        (scaled_width != captured_frame->height ||
-         scaled_height != captured_frame->height)) {
-      CapturedFrame* scaled_frame = const_cast<CapturedFrame*>(captured_frame);
-      // Compute new width such that width * height is less than maximum but
-      // maintains original captured frame aspect ratio.
-      // Round down width to multiple of 4 so odd width won't round up beyond
-      // maximum, and so chroma channel is even width to simplify spatial
-      // resampling.
-      libyuv::ARGBScale(reinterpret_cast<const uint8*>(captured_frame->data),
-                        captured_frame->width * 4, captured_frame->width,
-                        captured_frame->height,
-                        reinterpret_cast<uint8*>(scaled_frame->data),
-                        scaled_width * 4, scaled_width, scaled_height,
-                        libyuv::kFilterBilinear);
-      scaled_frame->width = scaled_width;
-      scaled_frame->height = scaled_height;
-      scaled_frame->data_size = scaled_width * 4 * scaled_height;
-    }
   }
-#endif  // !DISABLE_YUV
         // Size to crop captured frame to.  This adjusts the captured frames
         // aspect ratio to match the final view aspect ratio, considering pixel
   // aspect ratio and rotation.  The final size may be scaled down by video
@@ -389,7 +368,11 @@ void VideoCapturer::OnFrameCaptured(VideoCapturer*,
   }
 
   VIDEO_FRAME_NAME i420_frame;
-  if (!i420_frame.Init(captured_frame, desired_width, desired_height)) {
+  bool converted = scaled_width > 0 ?
+      i420_frame.InitScaled(captured_frame, desired_width, desired_height,
+                            scaled_width, scaled_height) :
+      i420_frame.Init(captured_frame, desired_width, desired_height);
+  if (!converted) {
     // TODO(fbarchard): LOG more information about captured frame attributes.
     LOG(LS_ERROR) << "Couldn't convert to I420! "
                   << "From " << ToString(captured_frame) << " To "
@@ -27,9 +27,12 @@
 
 #include "talk/media/webrtc/webrtcvideoframe.h"
 
+#include <algorithm>
+
 #include "libyuv/convert.h"
 #include "libyuv/convert_from.h"
 #include "libyuv/planar_functions.h"
+#include "libyuv/scale.h"
 #include "talk/base/logging.h"
 #include "talk/media/base/videocapturer.h"
 #include "talk/media/base/videocommon.h"
@@ -42,14 +45,149 @@ static const int kWatermarkOffsetFromLeft = 8;
 static const int kWatermarkOffsetFromBottom = 8;
 static const unsigned char kWatermarkMaxYValue = 64;
 
-FrameBuffer::FrameBuffer() : length_(0) {}
+// Enough for a few frames in flight between the capturer, the adapter and
+// the encoder, even at 1080p.
+static const size_t kDefaultMaxFreeBuffersPerSize = 4;
+static const size_t kDefaultMaxFreeBytes = 32 * 1024 * 1024;
+
+FrameBufferPool::FrameBufferPool(size_t max_free_per_size,
+                                 size_t max_free_bytes)
+    : max_free_per_size_(max_free_per_size),
+      max_free_bytes_(max_free_bytes),
+      free_count_(0),
+      free_bytes_(0),
+      allocation_count_(0),
+      reuse_count_(0),
+      use_count_(0) {
+}
+
+FrameBufferPool::~FrameBufferPool() {
+  Clear();
+}
+
+FrameBufferPool* FrameBufferPool::Default() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(FrameBufferPool, pool,
+      (kDefaultMaxFreeBuffersPerSize, kDefaultMaxFreeBytes));
+  return &pool;
+}
+
+char* FrameBufferPool::Get(size_t length) {
+  {
+    talk_base::CritScope cs(&crit_);
+    FreeBufferMap::iterator it = free_buffers_.find(length);
+    if (it != free_buffers_.end()) {
+      it->second.last_used = ++use_count_;
+    }
+    if (it != free_buffers_.end() && !it->second.buffers.empty()) {
+      char* data = it->second.buffers.back();
+      it->second.buffers.pop_back();
+      --free_count_;
+      free_bytes_ -= length;
+      ++reuse_count_;
+      return data;
+    }
+    ++allocation_count_;
+  }
+  return new char[length];
+}
+
+void FrameBufferPool::Put(char* data, size_t length) {
+  {
+    talk_base::CritScope cs(&crit_);
+    if (free_bytes_ + length > max_free_bytes_) {
+      EvictOtherSizes(length);
+    }
+    FreeBuffers& free = free_buffers_[length];
+    free.last_used = ++use_count_;
+    std::vector<char*>& buffers = free.buffers;
+    if (buffers.size() < max_free_per_size_ &&
+        free_bytes_ + length <= max_free_bytes_) {
+      buffers.push_back(data);
+      ++free_count_;
+      free_bytes_ += length;
+      return;
+    }
+  }
+  delete [] data;
+}
+
+void FrameBufferPool::Clear() {
+  talk_base::CritScope cs(&crit_);
+  for (FreeBufferMap::iterator it = free_buffers_.begin();
+       it != free_buffers_.end(); ++it) {
+    for (size_t i = 0; i < it->second.buffers.size(); ++i) {
+      delete [] it->second.buffers[i];
+    }
+  }
+  free_buffers_.clear();
+  free_count_ = 0;
+  free_bytes_ = 0;
+}
+
+size_t FrameBufferPool::allocation_count() const {
+  talk_base::CritScope cs(&crit_);
+  return allocation_count_;
+}
 
-FrameBuffer::FrameBuffer(size_t length) : length_(0) {
+size_t FrameBufferPool::reuse_count() const {
+  talk_base::CritScope cs(&crit_);
+  return reuse_count_;
+}
+
+size_t FrameBufferPool::free_count() const {
+  talk_base::CritScope cs(&crit_);
+  return free_count_;
+}
+
+size_t FrameBufferPool::free_bytes() const {
+  talk_base::CritScope cs(&crit_);
+  return free_bytes_;
+}
+
+void FrameBufferPool::EvictOtherSizes(size_t length) {
+  // There are only ever a few sizes, so a scan for the oldest one is cheap.
+  while (free_bytes_ + length > max_free_bytes_) {
+    FreeBufferMap::iterator oldest = free_buffers_.end();
+    for (FreeBufferMap::iterator it = free_buffers_.begin();
+         it != free_buffers_.end(); ++it) {
+      if (it->first != length && !it->second.buffers.empty() &&
+          (oldest == free_buffers_.end() ||
+           it->second.last_used < oldest->second.last_used)) {
+        oldest = it;
+      }
+    }
+    if (oldest == free_buffers_.end())
+      return;
+    std::vector<char*>& buffers = oldest->second.buffers;
+    while (!buffers.empty() && free_bytes_ + length > max_free_bytes_) {
+      delete [] buffers.back();
+      buffers.pop_back();
+      --free_count_;
+      free_bytes_ -= oldest->first;
+    }
+    if (buffers.empty()) {
+      free_buffers_.erase(oldest);
+    }
+  }
+}
+
+FrameBuffer::FrameBuffer() : length_(0), pool_(NULL) {}
+
+FrameBuffer::FrameBuffer(size_t length) : length_(0), pool_(NULL) {
   char* buffer = new char[length];
   SetData(buffer, length);
 }
 
+FrameBuffer::FrameBuffer(size_t length, FrameBufferPool* pool)
+    : length_(0), pool_(NULL) {
+  SetData(pool->Get(length), length);
+  pool_ = pool;
+}
+
 FrameBuffer::~FrameBuffer() {
+  if (pool_) {
+    pool_->Put(data_.release(), length_);
+  }
   // Make sure that the video_frame_ doesn't delete the buffer as it may be
   // shared between multiple WebRtcVideoFrame.
   uint8_t* new_memory = NULL;
@@ -59,6 +197,10 @@ FrameBuffer::~FrameBuffer() {
 }
 
 void FrameBuffer::SetData(char* data, size_t length) {
+  if (pool_) {
+    pool_->Put(data_.release(), length_);
+    pool_ = NULL;
+  }
   data_.reset(data);
   length_ = length;
   uint8_t* new_memory = reinterpret_cast<uint8_t*>(data);
@@ -74,6 +216,8 @@ void FrameBuffer::ReturnData(char** data, size_t* length) {
   video_frame_.Swap(old_memory, old_length, old_size);
   data_.release();
   length_ = 0;
+  // The caller owns the buffer now.
+  pool_ = NULL;
   *length = old_length;
   *data = reinterpret_cast<char*>(old_memory);
 }
@@ -106,6 +250,69 @@ bool WebRtcVideoFrame::Init(const CapturedFrame* frame, int dw, int dh) {
                frame->time_stamp, frame->rotation);
 }
 
+bool WebRtcVideoFrame::InitScaled(const CapturedFrame* frame, int dw, int dh,
+                                  int sw, int sh) {
+  if (sw <= 0 || sh <= 0) {
+    return false;
+  }
+  uint32 format = CanonicalFourCC(frame->fourcc);
+  int w = frame->width;
+  int h = frame->height;
+  uint8* sample = static_cast<uint8*>(frame->data);
+  // Same rounding as in Reset().
+  dw = (dw > 4) ? (dw & ~3) : dw;
+  dh = (dh > 4) ? (dh & ~3) : dh;
+  sw = (sw > 4) ? (sw & ~3) : sw;
+  sh = (sh > 4) ? (sh & ~3) : sh;
+  bool rotated = frame->rotation == 90 || frame->rotation == 270;
+  if ((!rotated && sw == dw && sh == dh) ||
+      (rotated && sw == dh && sh == dw)) {
+    return Init(frame, dw, dh);
+  }
+
+  if ((format != FOURCC_I420 && format != FOURCC_YV12) ||
+      frame->rotation != 0 || h < 0) {
+    // libyuv can't scale packed formats, so convert first.
+    WebRtcVideoFrame converted;
+    if (!converted.Init(frame, dw, dh)) {
+      return false;
+    }
+    InitToEmptyBuffer(sw, sh, frame->pixel_width, frame->pixel_height,
+                      frame->elapsed_time, frame->time_stamp);
+    converted.StretchToPlanes(GetYPlane(), GetUPlane(), GetVPlane(),
+                              GetYPitch(), GetUPitch(), GetVPitch(),
+                              sw, sh, true, false);
+    return true;
+  }
+
+  if (!Validate(format, w, h, sample, frame->data_size)) {
+    return false;
+  }
+  InitToEmptyBuffer(sw, sh, frame->pixel_width, frame->pixel_height,
+                    frame->elapsed_time, frame->time_stamp);
+  int uv_stride = (w + 1) / 2;
+  const uint8* src_y = sample;
+  const uint8* src_u = src_y + w * h;
+  const uint8* src_v = src_u + uv_stride * ((h + 1) / 2);
+  if (format == FOURCC_YV12) {
+    std::swap(src_u, src_v);
+  }
+  int horiz_crop = ((w - dw) / 2) & ~1;
+  int vert_crop = ((h - dh) / 2) & ~1;
+  src_y += vert_crop * w + horiz_crop;
+  src_u += vert_crop / 2 * uv_stride + horiz_crop / 2;
+  src_v += vert_crop / 2 * uv_stride + horiz_crop / 2;
+  int r = libyuv::Scale(src_y, src_u, src_v, w, uv_stride, uv_stride,
+                        dw, dh, GetYPlane(), GetUPlane(), GetVPlane(),
+                        GetYPitch(), GetUPitch(), GetVPitch(), sw, sh, true);
+  if (r) {
+    LOG(LS_ERROR) << "Error scaling " << GetFourccName(format)
+                  << " return code : " << r;
+    return false;
+  }
+  return true;
+}
+
 bool WebRtcVideoFrame::InitToBlack(int w, int h, size_t pixel_width,
                                    size_t pixel_height, int64 elapsed_time,
                                    int64 time_stamp) {
@@ -193,7 +400,8 @@ VideoFrame* WebRtcVideoFrame::Copy() const {
 
 bool WebRtcVideoFrame::MakeExclusive() {
   const int length = static_cast<int>(video_buffer_->length());
-  RefCountedBuffer* exclusive_buffer = new RefCountedBuffer(length);
+  RefCountedBuffer* exclusive_buffer =
+      new RefCountedBuffer(length, FrameBufferPool::Default());
   memcpy(exclusive_buffer->data(), video_buffer_->data(), length);
   Attach(exclusive_buffer, length, frame()->Width(), frame()->Height(),
          pixel_width_, pixel_height_, elapsed_time_, time_stamp_, rotation_);
@@ -306,7 +514,7 @@ bool WebRtcVideoFrame::Reset(
 
   size_t desired_size = SizeOf(new_width, new_height);
   talk_base::scoped_refptr<RefCountedBuffer> video_buffer(
-      new RefCountedBuffer(desired_size));
+      new RefCountedBuffer(desired_size, FrameBufferPool::Default()));
   // Since the libyuv::ConvertToI420 will handle the rotation, so the
   // new frame's rotation should always be 0.
   Attach(video_buffer.get(), desired_size, new_width, new_height, pixel_width,
@@ -350,7 +558,7 @@ void WebRtcVideoFrame::InitToEmptyBuffer(int w, int h, size_t pixel_width,
                                          int64 elapsed_time, int64 time_stamp) {
   size_t buffer_size = VideoFrame::SizeOf(w, h);
   talk_base::scoped_refptr<RefCountedBuffer> video_buffer(
-      new RefCountedBuffer(buffer_size));
+      new RefCountedBuffer(buffer_size, FrameBufferPool::Default()));
   Attach(video_buffer.get(), buffer_size, w, h, pixel_width, pixel_height,
          elapsed_time, time_stamp, 0);
 }
@@ -28,7 +28,12 @@
 #ifndef TALK_MEDIA_WEBRTCVIDEOFRAME_H_
 #define TALK_MEDIA_WEBRTCVIDEOFRAME_H_
 
+#include <map>
+#include <vector>
+
 #include "talk/base/buffer.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/criticalsection.h"
 #include "talk/base/refcount.h"
 #include "talk/base/scoped_ref_ptr.h"
 #include "talk/media/base/videoframe.h"
@@ -39,11 +44,71 @@ namespace cricket {
 
 struct CapturedFrame;
 
+// A thread-safe pool of frame buffers, bucketed by size. All frames of a
+// stream have the same size, so once the pipeline is primed every new frame
+// picks up a buffer that an earlier frame released instead of allocating a
+// new one. Up to |max_free_per_size| buffers of each size, and no more than
+// |max_free_bytes| in total, are kept around; buffers of other sizes, e.g.
+// left behind by a resolution change, are dropped first to make room, the
+// size that was used least recently first.
+class FrameBufferPool {
+ public:
+  FrameBufferPool(size_t max_free_per_size, size_t max_free_bytes);
+  ~FrameBufferPool();
+
+  // The pool that WebRtcVideoFrame allocates from. It is never deleted.
+  static FrameBufferPool* Default();
+
+  // Returns a buffer of |length| bytes, allocated with new[].
+  char* Get(size_t length);
+  // Takes back a buffer that was returned by Get().
+  void Put(char* data, size_t length);
+  // Frees all the buffers that are waiting for reuse.
+  void Clear();
+
+  // The number of Get() calls that had to allocate a new buffer.
+  size_t allocation_count() const;
+  // The number of Get() calls that reused a buffer.
+  size_t reuse_count() const;
+  // The number of buffers that are waiting for reuse, and their total size.
+  size_t free_count() const;
+  size_t free_bytes() const;
+
+ private:
+  struct FreeBuffers {
+    FreeBuffers() : last_used(0) {}
+    std::vector<char*> buffers;
+    // The value of |use_count_| when a buffer of this size was last handed
+    // out or taken back.
+    uint64 last_used;
+  };
+  typedef std::map<size_t, FreeBuffers> FreeBufferMap;
+
+  // Frees buffers that are not |length| bytes long, of the least recently
+  // used size first, until |length| more bytes fit under |max_free_bytes_|.
+  void EvictOtherSizes(size_t length);
+
+  mutable talk_base::CriticalSection crit_;
+  FreeBufferMap free_buffers_;
+  size_t max_free_per_size_;
+  size_t max_free_bytes_;
+  size_t free_count_;
+  size_t free_bytes_;
+  size_t allocation_count_;
+  size_t reuse_count_;
+  // Incremented on every Get() and Put(), to order the sizes by last use.
+  uint64 use_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameBufferPool);
+};
+
 // Class that takes ownership of the frame passed to it.
 class FrameBuffer {
  public:
   FrameBuffer();
   explicit FrameBuffer(size_t length);
+  // Takes a buffer from |pool|, and gives it back when destroyed.
+  FrameBuffer(size_t length, FrameBufferPool* pool);
   ~FrameBuffer();
 
   void SetData(char* data, size_t length);
@@ -57,6 +122,8 @@ class FrameBuffer {
  private:
   talk_base::scoped_array<char> data_;
   size_t length_;
+  // The pool |data_| came from, if any.
+  FrameBufferPool* pool_;
   webrtc::VideoFrame video_frame_;
 };
 
@@ -77,6 +144,14 @@ class WebRtcVideoFrame : public VideoFrame {
 
   bool Init(const CapturedFrame* frame, int dw, int dh);
 
+  // Crops "frame" to "dw" x "dh" like Init() does, and scales the result to
+  // "sw" x "sh" as it is converted to I420, so that the frame leaves the
+  // capturer at its final size. I420 and YV12 samples are scaled straight
+  // from the capture buffer in one pass; other formats are converted into a
+  // pooled buffer first. "sw" x "sh" is the size after rotation, and like
+  // the crop size it is rounded down to a multiple of 4.
+  bool InitScaled(const CapturedFrame* frame, int dw, int dh, int sw, int sh);
+
   bool InitToBlack(int w, int h, size_t pixel_width, size_t pixel_height,
                    int64 elapsed_time, int64 time_stamp);
 
@@ -26,6 +26,8 @@
  */
 
 #include "talk/base/flags.h"
+#include "talk/base/logging.h"
+#include "talk/base/timeutils.h"
 #include "talk/media/base/videoframe_unittest.h"
 #include "talk/media/webrtc/webrtcvideoframe.h"
 
@@ -71,6 +73,60 @@ class WebRtcVideoFrameTest : public VideoFrameTest<cricket::WebRtcVideoFrame> {
     EXPECT_EQ(static_cast<size_t>(cropped_width & ~3), frame.GetWidth());
     EXPECT_EQ(static_cast<size_t>(cropped_height & ~3), frame.GetHeight());
   }
+
+  // Creates a test image in one of the formats that capturers deliver.
+  talk_base::MemoryStream* CreateCapturedSample(uint32 fourcc, uint32 width,
+                                                uint32 height) {
+    switch (fourcc) {
+      case cricket::FOURCC_I420:
+      case cricket::FOURCC_YV12:
+        return CreateYuvSample(width, height, 12);
+      case cricket::FOURCC_YUY2:
+      case cricket::FOURCC_UYVY:
+        return CreateYuv422Sample(fourcc, width, height);
+      default:
+        return CreateRgbSample(fourcc, width, height);
+    }
+  }
+
+  void InitCapturedFrame(talk_base::MemoryStream* ms, uint32 fourcc,
+                         int width, int height,
+                         cricket::CapturedFrame* captured_frame) {
+    captured_frame->fourcc = fourcc;
+    captured_frame->pixel_width = 1;
+    captured_frame->pixel_height = 1;
+    captured_frame->elapsed_time = 1234;
+    captured_frame->time_stamp = 5678;
+    captured_frame->width = width;
+    captured_frame->height = height;
+    size_t data_size = 0;
+    ms->GetSize(&data_size);
+    captured_frame->data_size = static_cast<uint32>(data_size);
+    captured_frame->data = ms->GetBuffer();
+  }
+
+  // Checks that cropping, converting and scaling a captured frame in one go
+  // gives the same picture as doing it in separate passes.
+  void TestInitScaled(uint32 fourcc) {
+    const int kCaptureWidth = 1280;
+    const int kCaptureHeight = 720;
+    talk_base::scoped_ptr<talk_base::MemoryStream> ms(
+        CreateCapturedSample(fourcc, kCaptureWidth, kCaptureHeight));
+    ASSERT_TRUE(ms.get() != NULL);
+    cricket::CapturedFrame captured_frame;
+    InitCapturedFrame(ms.get(), fourcc, kCaptureWidth, kCaptureHeight,
+                      &captured_frame);
+
+    cricket::WebRtcVideoFrame cropped;
+    ASSERT_TRUE(cropped.Init(&captured_frame, 960, 720));
+    talk_base::scoped_ptr<cricket::VideoFrame> expected(
+        cropped.Stretch(480, 360, true, false));
+    ASSERT_TRUE(expected.get() != NULL);
+
+    cricket::WebRtcVideoFrame frame;
+    ASSERT_TRUE(frame.InitScaled(&captured_frame, 960, 720, 480, 360));
+    EXPECT_TRUE(IsEqual(frame, *expected, 0));
+  }
 };
 
 #define TEST_WEBRTCVIDEOFRAME(X) TEST_F(WebRtcVideoFrameTest, X) { \
@@ -311,3 +367,220 @@ TEST_F(WebRtcVideoFrameTest, InitOddHeight) {
 TEST_F(WebRtcVideoFrameTest, InitOddWidthHeight) {
   TestInit(355, 1021);
 }
+
+TEST(FrameBufferPoolTest, ReusesBuffersOfTheSameSize) {
+  cricket::FrameBufferPool pool(2, 1024);
+  char* buffer1 = pool.Get(100);
+  char* buffer2 = pool.Get(100);
+  EXPECT_EQ(2u, pool.allocation_count());
+  pool.Put(buffer1, 100);
+  pool.Put(buffer2, 100);
+  EXPECT_EQ(2u, pool.free_count());
+  EXPECT_EQ(200u, pool.free_bytes());
+
+  // A buffer of another size is allocated, not taken from the pool.
+  char* buffer3 = pool.Get(200);
+  EXPECT_EQ(3u, pool.allocation_count());
+  EXPECT_EQ(0u, pool.reuse_count());
+  EXPECT_EQ(buffer2, pool.Get(100));
+  EXPECT_EQ(buffer1, pool.Get(100));
+  EXPECT_EQ(2u, pool.reuse_count());
+  EXPECT_EQ(0u, pool.free_count());
+
+  // Only two buffers per size are kept.
+  char* buffer4 = pool.Get(100);
+  pool.Put(buffer1, 100);
+  pool.Put(buffer2, 100);
+  pool.Put(buffer4, 100);
+  EXPECT_EQ(2u, pool.free_count());
+  pool.Put(buffer3, 200);
+  EXPECT_EQ(3u, pool.free_count());
+  EXPECT_EQ(400u, pool.free_bytes());
+  pool.Clear();
+  EXPECT_EQ(0u, pool.free_count());
+  EXPECT_EQ(0u, pool.free_bytes());
+}
+
+TEST(FrameBufferPoolTest, EvictsOtherSizesWhenFull) {
+  cricket::FrameBufferPool pool(4, 1000);
+  char* small1 = pool.Get(300);
+  char* small2 = pool.Get(300);
+  char* large1 = pool.Get(600);
+  char* large2 = pool.Get(600);
+  pool.Put(small1, 300);
+  pool.Put(small2, 300);
+  EXPECT_EQ(600u, pool.free_bytes());
+  // A buffer of the old size makes room for the new one.
+  pool.Put(large1, 600);
+  EXPECT_EQ(2u, pool.free_count());
+  EXPECT_EQ(900u, pool.free_bytes());
+  // The old size goes first, and if that is not enough, the buffer of the
+  // new size is dropped.
+  pool.Put(large2, 600);
+  EXPECT_EQ(1u, pool.free_count());
+  EXPECT_EQ(600u, pool.free_bytes());
+  EXPECT_EQ(large1, pool.Get(600));
+  delete [] large1;
+}
+
+TEST(FrameBufferPoolTest, EvictsLeastRecentlyUsedSizeFirst) {
+  cricket::FrameBufferPool pool(4, 900);
+  char* small = pool.Get(100);
+  char* medium = pool.Get(200);
+  char* large = pool.Get(700);
+  // The smaller of the two old sizes is used last, so the larger one is
+  // evicted, even though it comes later in size order.
+  pool.Put(small, 100);
+  pool.Put(medium, 200);
+  char* reused = pool.Get(100);
+  EXPECT_EQ(small, reused);
+  pool.Put(reused, 100);
+  pool.Put(large, 700);
+  EXPECT_EQ(2u, pool.free_count());
+  EXPECT_EQ(800u, pool.free_bytes());
+  EXPECT_EQ(small, pool.Get(100));
+  EXPECT_EQ(large, pool.Get(700));
+  delete [] small;
+  delete [] large;
+}
+
+// Frames that are released go back to the pool, unless they are detached.
+TEST_F(WebRtcVideoFrameTest, ReturnsBuffersToPool) {
+  cricket::FrameBufferPool* pool = cricket::FrameBufferPool::Default();
+  pool->Clear();
+  {
+    cricket::WebRtcVideoFrame frame;
+    ASSERT_TRUE(frame.InitToBlack(kWidth, kHeight, 1, 1, 0, 0));
+    talk_base::scoped_ptr<cricket::VideoFrame> copy(frame.Copy());
+    EXPECT_EQ(0u, pool->free_count());
+  }
+  EXPECT_EQ(1u, pool->free_count());
+
+  cricket::WebRtcVideoFrame frame;
+  ASSERT_TRUE(frame.InitToBlack(kWidth, kHeight, 1, 1, 0, 0));
+  EXPECT_EQ(0u, pool->free_count());
+  uint8* buffer;
+  size_t size;
+  frame.Detach(&buffer, &size);
+  EXPECT_EQ(0u, pool->free_count());
+  delete [] buffer;
+}
+
+// Captures and scales frames the way VideoCapturer does, and checks that no
+// frame buffers are allocated once the pool has been primed.
+TEST_F(WebRtcVideoFrameTest, SteadyStateCapturePerf) {
+  const int kFrameWidth = 1280;
+  const int kFrameHeight = 720;
+  const int kNumFrames = 100;
+  cricket::CapturedFrame captured_frame;
+  captured_frame.fourcc = cricket::FOURCC_I420;
+  captured_frame.pixel_width = 1;
+  captured_frame.pixel_height = 1;
+  captured_frame.width = kFrameWidth;
+  captured_frame.height = kFrameHeight;
+  captured_frame.data_size = cricket::VideoFrame::SizeOf(kFrameWidth,
+                                                         kFrameHeight);
+  talk_base::scoped_array<uint8> captured_frame_buffer(
+      new uint8[captured_frame.data_size]);
+  memset(captured_frame_buffer.get(), 0x80, captured_frame.data_size);
+  captured_frame.data = captured_frame_buffer.get();
+
+  cricket::FrameBufferPool* pool = cricket::FrameBufferPool::Default();
+  size_t allocations = 0;
+  uint64 start = 0;
+  for (int i = 0; i <= kNumFrames; ++i) {
+    if (i == 1) {
+      // The first frame primes the pool.
+      allocations = pool->allocation_count();
+      start = talk_base::TimeNanos();
+    }
+    cricket::WebRtcVideoFrame frame;
+    ASSERT_TRUE(frame.Init(&captured_frame, kFrameWidth, kFrameHeight));
+    talk_base::scoped_ptr<cricket::VideoFrame> scaled(
+        frame.Stretch(kFrameWidth / 2, kFrameHeight / 2, true, true));
+    ASSERT_TRUE(scaled.get() != NULL);
+  }
+  uint64 elapsed = talk_base::TimeNanos() - start;
+  EXPECT_EQ(allocations, pool->allocation_count());
+  LOG(LS_INFO) << "Captured and scaled " << kNumFrames << " frames in "
+               << elapsed / 1000 << " us, "
+               << pool->allocation_count() - allocations
+               << " frame buffers allocated";
+}
+
+TEST_F(WebRtcVideoFrameTest, InitScaledI420) {
+  TestInitScaled(cricket::FOURCC_I420);
+}
+
+TEST_F(WebRtcVideoFrameTest, InitScaledYV12) {
+  TestInitScaled(cricket::FOURCC_YV12);
+}
+
+TEST_F(WebRtcVideoFrameTest, InitScaledYUY2) {
+  TestInitScaled(cricket::FOURCC_YUY2);
+}
+
+TEST_F(WebRtcVideoFrameTest, InitScaledARGB) {
+  TestInitScaled(cricket::FOURCC_ARGB);
+}
+
+// Without scaling, InitScaled() is the same as Init().
+TEST_F(WebRtcVideoFrameTest, InitScaledToCropSize) {
+  talk_base::scoped_ptr<talk_base::MemoryStream> ms(
+      CreateCapturedSample(cricket::FOURCC_I420, kWidth, kHeight));
+  cricket::CapturedFrame captured_frame;
+  InitCapturedFrame(ms.get(), cricket::FOURCC_I420, kWidth, kHeight,
+                    &captured_frame);
+  cricket::WebRtcVideoFrame frame1, frame2;
+  ASSERT_TRUE(frame1.Init(&captured_frame, kWidth, kHeight));
+  ASSERT_TRUE(frame2.InitScaled(&captured_frame, kWidth, kHeight,
+                                kWidth, kHeight));
+  EXPECT_TRUE(IsEqual(frame1, frame2, 0));
+  EXPECT_FALSE(frame2.InitScaled(&captured_frame, kWidth, kHeight, 0, 0));
+}
+
+// Compares converting and scaling 720p captures to 360p in one stage with
+// converting them and scaling the converted frame, for each capture format.
+TEST_F(WebRtcVideoFrameTest, InitScaledPerf) {
+  const int kCaptureWidth = 1280;
+  const int kCaptureHeight = 720;
+  const int kNumFrames = 50;
+  const uint32 kFourccs[] = {
+    cricket::FOURCC_I420, cricket::FOURCC_YV12, cricket::FOURCC_YUY2,
+    cricket::FOURCC_UYVY, cricket::FOURCC_ARGB
+  };
+  for (int i = 0; i < ARRAY_SIZE(kFourccs); ++i) {
+    talk_base::scoped_ptr<talk_base::MemoryStream> ms(
+        CreateCapturedSample(kFourccs[i], kCaptureWidth, kCaptureHeight));
+    ASSERT_TRUE(ms.get() != NULL);
+    cricket::CapturedFrame captured_frame;
+    InitCapturedFrame(ms.get(), kFourccs[i], kCaptureWidth, kCaptureHeight,
+                      &captured_frame);
+
+    uint64 start = talk_base::TimeNanos();
+    for (int j = 0; j < kNumFrames; ++j) {
+      cricket::WebRtcVideoFrame frame;
+      ASSERT_TRUE(frame.Init(&captured_frame, kCaptureWidth, kCaptureHeight));
+      talk_base::scoped_ptr<cricket::VideoFrame> scaled(
+          frame.Stretch(kCaptureWidth / 2, kCaptureHeight / 2, true, false));
+    }
+    uint64 two_pass = talk_base::TimeNanos() - start;
+
+    start = talk_base::TimeNanos();
+    for (int j = 0; j < kNumFrames; ++j) {
+      cricket::WebRtcVideoFrame frame;
+      ASSERT_TRUE(frame.InitScaled(&captured_frame, kCaptureWidth,
+                                   kCaptureHeight, kCaptureWidth / 2,
+                                   kCaptureHeight / 2));
+    }
+    uint64 one_pass = talk_base::TimeNanos() - start;
+
+    // Bytes of captured frames per microsecond is megabytes per second.
+    uint64 bytes = static_cast<uint64>(captured_frame.data_size) * kNumFrames;
+    LOG(LS_INFO) << cricket::GetFourccName(kFourccs[i]) << ": "
+                 << bytes * 1000 / two_pass
+                 << " MB/s converting then scaling, "
+                 << bytes * 1000 / one_pass
+                 << " MB/s in one stage";
+  }
+}
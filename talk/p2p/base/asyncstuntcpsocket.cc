@@ -71,10 +71,6 @@ int AsyncStunTCPSocket::Send(const void *pv, size_t cb) {
     return -1;
   }
 
-  // If we are blocking on send, then silently drop this packet
-  if (!IsOutBufferEmpty())
-    return static_cast<int>(cb);
-
   int pad_bytes;
   size_t expected_pkt_len = GetExpectedLength(pv, cb, &pad_bytes);
 
@@ -82,20 +78,15 @@ int AsyncStunTCPSocket::Send(const void *pv, size_t cb) {
   if (cb != expected_pkt_len)
     return -1;
 
-  AppendToOutBuffer(pv, cb);
-
   ASSERT(pad_bytes < 4);
-  char padding[4] = {0};
-  AppendToOutBuffer(padding, pad_bytes);
-
-  int res = FlushOutBuffer();
+  static const char kPadding[4] = {0};
+  talk_base::Socket::IoVec iov[2] = {
+    { pv, cb }, { kPadding, static_cast<size_t>(pad_bytes) }
+  };
+  int res = SendPacket(iov, pad_bytes ? 2 : 1);
   if (res <= 0) {
-    // drop packet if we made no progress
-    ClearOutBuffer();
     return res;
   }
-
-  // We claim to have sent the whole thing, even if we only sent partial
   return static_cast<int>(cb);
 }
 
@@ -111,25 +102,26 @@ void AsyncStunTCPSocket::ProcessInput(char* data, size_t* len) {
   // |         Channel Number        |            Length             |
   // +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 
-  while (true) {
-    // We need at least 4 bytes to read the STUN or ChannelData packet length.
-    if (*len < kPacketLenOffset + kPacketLenSize)
-      return;
-
+  // Deliver every complete packet in place, then move the incomplete one
+  // that may be left to the front of the buffer once.
+  size_t pos = 0;
+  // We need at least 4 bytes to read the STUN or ChannelData packet length.
+  while (*len - pos >= kPacketLenOffset + kPacketLenSize) {
     int pad_bytes;
-    size_t expected_pkt_len = GetExpectedLength(data, *len, &pad_bytes);
+    size_t expected_pkt_len =
+        GetExpectedLength(data + pos, *len - pos, &pad_bytes);
     size_t actual_length = expected_pkt_len + pad_bytes;
 
-    if (*len < actual_length) {
-      return;
-    }
+    if (*len - pos < actual_length)
+      break;
 
-    SignalReadPacket(this, data, expected_pkt_len, remote_addr);
+    SignalReadPacket(this, data + pos, expected_pkt_len, remote_addr);
+    pos += actual_length;
+  }
 
-    *len -= actual_length;
-    if (*len > 0) {
-      memmove(data, data + actual_length, *len);
-    }
+  *len -= pos;
+  if (pos > 0 && *len > 0) {
+    memmove(data, data + pos, *len);
   }
 }
 
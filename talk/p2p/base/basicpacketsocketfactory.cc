@@ -58,6 +58,20 @@ BasicPacketSocketFactory::~BasicPacketSocketFactory() {
 
 AsyncPacketSocket* BasicPacketSocketFactory::CreateUdpSocket(
     const SocketAddress& address, int min_port, int max_port) {
+  return CreateAsyncUdpSocket(address, min_port, max_port);
+}
+
+AsyncPacketSocket* BasicPacketSocketFactory::CreateBatchedUdpSocket(
+    const SocketAddress& address, int min_port, int max_port) {
+  AsyncUDPSocket* socket = CreateAsyncUdpSocket(address, min_port, max_port);
+  if (socket) {
+    socket->EnableBatching();
+  }
+  return socket;
+}
+
+AsyncUDPSocket* BasicPacketSocketFactory::CreateAsyncUdpSocket(
+    const SocketAddress& address, int min_port, int max_port) {
   // UDP sockets are simple.
   talk_base::AsyncSocket* socket =
       socket_factory()->CreateAsyncSocket(
@@ -33,6 +33,7 @@
 namespace talk_base {
 
 class AsyncSocket;
+class AsyncUDPSocket;
 class SocketFactory;
 class Thread;
 
@@ -45,6 +46,8 @@ class BasicPacketSocketFactory : public PacketSocketFactory {
 
   virtual AsyncPacketSocket* CreateUdpSocket(
       const SocketAddress& local_address, int min_port, int max_port);
+  virtual AsyncPacketSocket* CreateBatchedUdpSocket(
+      const SocketAddress& local_address, int min_port, int max_port);
   virtual AsyncPacketSocket* CreateServerTcpSocket(
       const SocketAddress& local_address, int min_port, int max_port, int opts);
   virtual AsyncPacketSocket* CreateClientTcpSocket(
@@ -52,6 +55,8 @@ class BasicPacketSocketFactory : public PacketSocketFactory {
       const ProxyInfo& proxy_info, const std::string& user_agent, int opts);
 
  private:
+  AsyncUDPSocket* CreateAsyncUdpSocket(const SocketAddress& local_address,
+                                       int min_port, int max_port);
   int BindSocket(AsyncSocket* socket, const SocketAddress& local_address,
                  int min_port, int max_port);
 
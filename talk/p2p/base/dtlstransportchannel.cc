@@ -57,10 +57,18 @@ talk_base::StreamResult StreamInterfaceChannel::Read(void* buffer,
                                                      int* error) {
   if (state_ == talk_base::SS_CLOSED)
     return talk_base::SR_EOS;
-  if (state_ == talk_base::SS_OPENING)
+  if (state_ == talk_base::SS_OPENING || !packet_)
     return talk_base::SR_BLOCK;
 
-  return fifo_.Read(buffer, buffer_len, read, error);
+  // Like a datagram socket, this truncates packets that don't fit.
+  size_t size = talk_base::_min(buffer_len, packet_size_);
+  memcpy(buffer, packet_, size);
+  packet_ = NULL;
+  packet_size_ = 0;
+  if (read) {
+    *read = size;
+  }
+  return talk_base::SR_SUCCESS;
 }
 
 talk_base::StreamResult StreamInterfaceChannel::Write(const void* data,
@@ -77,21 +85,18 @@ talk_base::StreamResult StreamInterfaceChannel::Write(const void* data,
 }
 
 bool StreamInterfaceChannel::OnPacketReceived(const char* data, size_t size) {
-  // We force a read event here to ensure that we don't overflow our FIFO.
-  // Under high packet rate this can occur if we wait for the FIFO to post its
-  // own SE_READ.
-  bool ret = (fifo_.WriteAll(data, size, NULL, NULL) == talk_base::SR_SUCCESS);
-  if (ret) {
-    SignalEvent(this, talk_base::SE_READ, 0);
-  }
+  // The DTLS stack reads the packet from within the event, so it can be
+  // handed over in place rather than queued in a FIFO.
+  ASSERT(packet_ == NULL);
+  packet_ = data;
+  packet_size_ = size;
+  SignalEvent(this, talk_base::SE_READ, 0);
+  bool ret = (packet_ == NULL);
+  packet_ = NULL;
+  packet_size_ = 0;
   return ret;
 }
 
-void StreamInterfaceChannel::OnEvent(talk_base::StreamInterface* stream,
-                                     int sig, int err) {
-  SignalEvent(this, sig, err);
-}
-
 DtlsTransportChannelWrapper::DtlsTransportChannelWrapper(
                                            Transport* transport,
                                            TransportChannelImpl* channel)
@@ -213,8 +218,7 @@ bool DtlsTransportChannelWrapper::SetRemoteFingerprint(const std::string&
 }
 
 bool DtlsTransportChannelWrapper::SetupDtls() {
-  StreamInterfaceChannel* downward =
-      new StreamInterfaceChannel(worker_thread_, channel_);
+  StreamInterfaceChannel* downward = new StreamInterfaceChannel(channel_);
 
   dtls_.reset(talk_base::SSLStreamAdapter::Create(downward));
   if (!dtls_) {
@@ -471,9 +475,11 @@ void DtlsTransportChannelWrapper::OnDtlsEvent(talk_base::StreamInterface* dtls,
     }
   }
   if (sig & talk_base::SE_READ) {
+    // A packet may carry several records; read until the stream blocks.
     char buf[kMaxDtlsPacketLen];
     size_t read;
-    if (dtls_->Read(buf, sizeof(buf), &read, NULL) == talk_base::SR_SUCCESS) {
+    while (dtls_->Read(buf, sizeof(buf), &read, NULL) ==
+           talk_base::SR_SUCCESS) {
       SignalReadPacket(this, buf, read, 0);
     }
   }
@@ -42,17 +42,20 @@ namespace cricket {
 
 // A bridge between a packet-oriented/channel-type interface on
 // the bottom and a StreamInterface on the top.
-class StreamInterfaceChannel : public talk_base::StreamInterface,
-                               public sigslot::has_slots<> {
+// The stream is datagram-oriented: each Read() returns exactly one packet.
+// Received packets are not buffered; the SSL stream reads them in place,
+// from within the SE_READ event that OnPacketReceived() raises.
+class StreamInterfaceChannel : public talk_base::StreamInterface {
  public:
-  StreamInterfaceChannel(talk_base::Thread* owner, TransportChannel* channel)
+  explicit StreamInterfaceChannel(TransportChannel* channel)
       : channel_(channel),
         state_(talk_base::SS_OPEN),
-        fifo_(kFifoSize, owner) {
-    fifo_.SignalEvent.connect(this, &StreamInterfaceChannel::OnEvent);
+        packet_(NULL),
+        packet_size_(0) {
   }
 
-  // Push in a packet; this gets pulled out from Read().
+  // Push in a packet; this gets pulled out from Read(). Returns false if the
+  // packet was not read, in which case it is dropped.
   bool OnPacketReceived(const char* data, size_t size);
 
   // Implementations of StreamInterface
@@ -64,14 +67,11 @@ class StreamInterfaceChannel : public talk_base::StreamInterface,
                                         size_t* written, int* error);
 
  private:
-  static const size_t kFifoSize = 8192;
-
-  // Forward events
-  virtual void OnEvent(talk_base::StreamInterface* stream, int sig, int err);
-
   TransportChannel* channel_;  // owned by DtlsTransportChannelWrapper
   talk_base::StreamState state_;
-  talk_base::FifoBuffer fifo_;
+  // The packet being received, until it is read. Not owned.
+  const char* packet_;
+  size_t packet_size_;
 
   DISALLOW_COPY_AND_ASSIGN(StreamInterfaceChannel);
 };
@@ -95,7 +95,8 @@ class StreamInterfaceChannel : public talk_base::StreamInterface,
 //     or not, and if it is, is passed to DtlsTransportChannelWrapper::
 //     HandleDtlsPacket, which pushes it into to downward_.
 //     dtls_ is listening for events on downward_, so it immediately calls
-//     downward_->Read().
+//     downward_->Read(), which copies the packet straight into the DTLS
+//     stack.
 //
 //   - Data written to DtlsTransportChannelWrapper is passed either to
 //      downward_ or directly to channel_, depending on whether DTLS is
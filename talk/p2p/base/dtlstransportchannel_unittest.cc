@@ -34,6 +34,7 @@
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/stringutils.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/p2p/base/fakesession.h"
 #include "talk/base/ssladapter.h"
 #include "talk/base/sslidentity.h"
@@ -563,3 +564,21 @@ TEST_F(DtlsTransportChannelTest, TestTransferDtlsSrtpDemux) {
   TestTransfer(0, 1000, 100, false);
   TestTransfer(0, 1000, 100, true);
 }
+
+// Connect with DTLS, and measure the throughput of a bulk transfer with
+// packets the size of SCTP data channel packets.
+TEST_F(DtlsTransportChannelTest, TestTransferDtlsBulkPerf) {
+  MAYBE_SKIP_TEST(HaveDtls);
+  const size_t kPacketSize = 1200;
+  const size_t kNumPackets = 20000;
+  PrepareDtls(true, true);
+  ASSERT_TRUE(Connect());
+  uint32 start = talk_base::Time();
+  TestTransfer(0, kPacketSize, kNumPackets, false);
+  int elapsed = talk_base::TimeSince(start);
+  LOG(LS_INFO) << "Transferred " << kNumPackets << " packets of "
+               << kPacketSize << " bytes over DTLS in " << elapsed << " ms, "
+               << (kPacketSize * kNumPackets * 8) / (elapsed ? elapsed : 1) /
+                  1000
+               << " Mbps";
+}
@@ -27,11 +27,13 @@
 
 #include "talk/p2p/base/p2ptransportchannel.h"
 
-#include <set>
+#include <algorithm>
+#include <map>
 #include "talk/base/common.h"
 #include "talk/base/crc32.h"
 #include "talk/base/logging.h"
 #include "talk/base/stringencode.h"
+#include "talk/base/trace.h"
 #include "talk/p2p/base/common.h"
 #include "talk/p2p/base/relayport.h"  // For RELAY_PORT_TYPE.
 #include "talk/p2p/base/stunport.h"  // For STUN_PORT_TYPE.
@@ -60,6 +62,10 @@ static const uint32 MAX_CURRENT_WRITABLE_DELAY = 900;  // 2*WRITABLE_DELAY - bit
 // The minimum improvement in RTT that justifies a switch.
 static const double kMinImprovement = 10;
 
+// Changed connections are re-ranked one by one with a binary search, unless
+// more than one in this many changed; then they are sorted and merged in.
+static const size_t kMaxIncrementalRankFraction = 16;
+
 cricket::PortInterface::CandidateOrigin GetOrigin(cricket::PortInterface* port,
                                          cricket::PortInterface* origin_port) {
   if (!origin_port)
@@ -148,6 +154,27 @@ bool ShouldSwitch(cricket::Connection* a_conn, cricket::Connection* b_conn) {
   return b_conn->rtt() <= a_conn->rtt() + kMinImprovement;
 }
 
+// A connection and its position in the order before sorting.
+typedef std::pair<cricket::Connection*, uint32> RankedConnection;
+
+// Orders connections like ConnectionCompare, and those it considers equal by
+// their position before sorting.  This is the order a std::stable_sort with
+// ConnectionCompare gives, but it is total, so binary searches and merges of
+// partial lists reproduce it exactly.
+class RankedConnectionCompare {
+ public:
+  bool operator()(const RankedConnection& a, const RankedConnection& b) {
+    if (cmp_(a.first, b.first))
+      return true;
+    if (cmp_(b.first, a.first))
+      return false;
+    return a.second < b.second;
+  }
+
+ private:
+  ConnectionCompare cmp_;
+};
+
 }  // unnamed namespace
 
 namespace cricket {
@@ -202,6 +229,7 @@ void P2PTransportChannel::AddAllocatorSession(PortAllocatorSession* session) {
 
 void P2PTransportChannel::AddConnection(Connection* connection) {
   connections_.push_back(connection);
+  connection_index_.Insert(connection, RankedState());
   connection->set_remote_ice_mode(remote_ice_mode_);
   connection->SignalReadPacket.connect(
       this, &P2PTransportChannel::OnReadPacket);
@@ -318,6 +346,7 @@ void P2PTransportChannel::Reset() {
   allocator_sessions_.clear();
   ports_.clear();
   connections_.clear();
+  connection_index_.Clear();
   best_connection_ = NULL;
 
   // Forget about all of the candidates we got before.
@@ -700,9 +729,7 @@ bool P2PTransportChannel::CreateConnection(PortInterface* port,
 
 bool P2PTransportChannel::FindConnection(
     cricket::Connection* connection) const {
-  std::vector<Connection*>::const_iterator citer =
-      std::find(connections_.begin(), connections_.end(), connection);
-  return citer != connections_.end();
+  return connection_index_.Find(connection) != NULL;
 }
 
 uint32 P2PTransportChannel::GetRemoteCandidateGeneration(
@@ -853,6 +880,8 @@ void P2PTransportChannel::RequestSort() {
 // the number of available connections and the current state.
 void P2PTransportChannel::SortConnections() {
   ASSERT(worker_thread_ == talk_base::Thread::Current());
+  LJ_TRACE_EVENT1(LJ_TRACE_CATEGORY_P2P,
+                  "P2PTransportChannel::SortConnections", connections_.size());
 
   // Make sure the connection states are up-to-date since this affects how they
   // will be sorted.
@@ -861,18 +890,11 @@ void P2PTransportChannel::SortConnections() {
   // Any changes after this point will require a re-sort.
   sort_dirty_ = false;
 
-  // Get a list of the networks that we are using.
-  std::set<talk_base::Network*> networks;
-  for (uint32 i = 0; i < connections_.size(); ++i)
-    networks.insert(connections_[i]->port()->Network());
-
   // Find the best alternative connection by sorting.  It is important to note
   // that amongst equal preference, writable connections, this will choose the
   // one whose estimated latency is lowest.  So it is the only one that we
   // need to consider switching to.
-
-  ConnectionCompare cmp;
-  std::stable_sort(connections_.begin(), connections_.end(), cmp);
+  RankConnections();
   LOG(LS_VERBOSE) << "Sorting available connections:";
   for (uint32 i = 0; i < connections_.size(); ++i) {
     LOG(LS_VERBOSE) << connections_[i]->ToString();
@@ -898,18 +920,23 @@ void P2PTransportChannel::SortConnections() {
   // we would prune out the current best connection).  We leave connections on
   // other networks because they may not be using the same resources and they
   // may represent very distinct paths over which we can switch.
-  std::set<talk_base::Network*>::iterator network;
-  for (network = networks.begin(); network != networks.end(); ++network) {
-    Connection* primier = GetBestConnectionOnNetwork(*network);
-    if (!primier || (primier->write_state() != Connection::STATE_WRITABLE))
-      continue;
-
-    for (uint32 i = 0; i < connections_.size(); ++i) {
-      if ((connections_[i] != primier) &&
-          (connections_[i]->port()->Network() == *network) &&
-          (CompareConnectionCandidates(primier, connections_[i]) >= 0)) {
-        connections_[i]->Prune();
-      }
+  //
+  // The best connection on each network is the current best connection if it
+  // is on that network, and otherwise the top-most in sorted order.
+  typedef std::map<talk_base::Network*, Connection*> NetworkMap;
+  NetworkMap primiers;
+  if (best_connection_)
+    primiers[best_connection_->port()->Network()] = best_connection_;
+  for (uint32 i = 0; i < connections_.size(); ++i)
+    primiers.insert(std::make_pair(connections_[i]->port()->Network(),
+                                   connections_[i]));
+
+  for (uint32 i = 0; i < connections_.size(); ++i) {
+    Connection* primier = primiers[connections_[i]->port()->Network()];
+    if ((primier->write_state() == Connection::STATE_WRITABLE) &&
+        (connections_[i] != primier) &&
+        (CompareConnectionCandidates(primier, connections_[i]) >= 0)) {
+      connections_[i]->Prune();
     }
   }
 
@@ -938,6 +965,57 @@ void P2PTransportChannel::SortConnections() {
 }
 
 
+// Brings |connections_| back into ranking order.  Only the connections whose
+// sort keys changed since the last sort are moved, since with many candidate
+// pairs usually only a few of them change between sorts.
+void P2PTransportChannel::RankConnections() {
+  std::vector<RankedConnection> kept;
+  std::vector<RankedConnection> changed;
+  kept.reserve(connections_.size());
+  for (uint32 i = 0; i < connections_.size(); ++i) {
+    Connection* conn = connections_[i];
+    RankedState* state = connection_index_.Find(conn);
+    ASSERT(state != NULL);
+    int write_state = conn->write_state();
+    uint64 priority = conn->priority();
+    uint32 generation = conn->remote_candidate().generation() +
+                        conn->port()->generation();
+    uint32 rtt = conn->rtt();
+    if (state->ranked && (state->write_state == write_state) &&
+        (state->priority == priority) && (state->generation == generation) &&
+        (state->rtt == rtt)) {
+      kept.push_back(RankedConnection(conn, i));
+    } else {
+      changed.push_back(RankedConnection(conn, i));
+      state->ranked = true;
+      state->write_state = write_state;
+      state->priority = priority;
+      state->generation = generation;
+      state->rtt = rtt;
+    }
+  }
+  if (changed.empty())
+    return;
+
+  // The connections kept are still in order, so the changed ones only have
+  // to be put in their places among them.
+  RankedConnectionCompare cmp;
+  if (changed.size() * kMaxIncrementalRankFraction < kept.size()) {
+    for (uint32 i = 0; i < changed.size(); ++i) {
+      kept.insert(std::upper_bound(kept.begin(), kept.end(), changed[i], cmp),
+                  changed[i]);
+    }
+  } else {
+    size_t num_kept = kept.size();
+    std::sort(changed.begin(), changed.end(), cmp);
+    kept.insert(kept.end(), changed.begin(), changed.end());
+    std::inplace_merge(kept.begin(), kept.begin() + num_kept, kept.end(), cmp);
+  }
+  for (uint32 i = 0; i < kept.size(); ++i) {
+    connections_[i] = kept[i].first;
+  }
+}
+
 // Track the best connection, and let listeners know
 void P2PTransportChannel::SwitchBestConnectionTo(Connection* conn) {
   // Note: if conn is NULL, the previous best_connection_ has been destroyed,
@@ -1005,23 +1083,6 @@ void P2PTransportChannel::HandleAllTimedOut() {
   HandleNotWritable();
 }
 
-// If we have a best connection, return it, otherwise return top one in the
-// list (later we will mark it best).
-Connection* P2PTransportChannel::GetBestConnectionOnNetwork(
-    talk_base::Network* network) {
-  // If the best connection is on this network, then it wins.
-  if (best_connection_ && (best_connection_->port()->Network() == network))
-    return best_connection_;
-
-  // Otherwise, we return the top-most in sorted order.
-  for (uint32 i = 0; i < connections_.size(); ++i) {
-    if (connections_[i]->port()->Network() == network)
-      return connections_[i];
-  }
-
-  return NULL;
-}
-
 // Handle any queued up requests
 void P2PTransportChannel::OnMessage(talk_base::Message *pmsg) {
   switch (pmsg->message_id) {
@@ -1045,6 +1106,7 @@ void P2PTransportChannel::OnSort() {
 
 // Handle queued up ping request
 void P2PTransportChannel::OnPing() {
+  LJ_TRACE_EVENT(LJ_TRACE_CATEGORY_P2P, "P2PTransportChannel::OnPing");
   // Make sure the states of the connections are up-to-date (since this affects
   // which ones are pingable).
   UpdateConnectionStates();
@@ -1119,6 +1181,7 @@ Connection* P2PTransportChannel::FindNextPingableConnection() {
 //      b.1) |conn| is the best_connection AND
 //      b.2) |conn| is writable.
 void P2PTransportChannel::PingConnection(Connection* conn) {
+  LJ_TRACE_EVENT(LJ_TRACE_CATEGORY_P2P, "P2PTransportChannel::PingConnection");
   bool use_candidate = false;
   if (protocol_type_ == ICEPROTO_RFC5245) {
     if (remote_ice_mode_ == ICEMODE_FULL && role_ == ROLE_CONTROLLING) {
@@ -1166,6 +1229,7 @@ void P2PTransportChannel::OnConnectionDestroyed(Connection* connection) {
       std::find(connections_.begin(), connections_.end(), connection);
   ASSERT(iter != connections_.end());
   connections_.erase(iter);
+  connection_index_.Erase(connection);
 
   LOG_J(LS_INFO, this) << "Removed connection ("
     << static_cast<int>(connections_.size()) << " remaining)";
@@ -40,6 +40,7 @@
 #include <map>
 #include <vector>
 #include <string>
+#include "talk/base/openhashmap.h"
 #include "talk/base/sigslot.h"
 #include "talk/p2p/base/candidate.h"
 #include "talk/p2p/base/portinterface.h"
@@ -114,13 +115,13 @@ class P2PTransportChannel : public TransportChannelImpl,
   void UpdateConnectionStates();
   void RequestSort();
   void SortConnections();
+  void RankConnections();
   void SwitchBestConnectionTo(Connection* conn);
   void UpdateChannelState();
   void HandleWritable();
   void HandleNotWritable();
   void HandleAllTimedOut();
 
-  Connection* GetBestConnectionOnNetwork(talk_base::Network* network);
   bool CreateConnections(const Candidate &remote_candidate,
                          PortInterface* origin_port, bool readable);
   bool CreateConnection(PortInterface* port, const Candidate& remote_candidate,
@@ -168,7 +169,30 @@ class P2PTransportChannel : public TransportChannelImpl,
   int error_;
   std::vector<PortAllocatorSession*> allocator_sessions_;
   std::vector<PortInterface *> ports_;
+
+  // The sort keys of a connection as of the last sort, which tell the
+  // connections that have to be re-ranked from those that stay in place.
+  struct RankedState {
+    RankedState()
+        : ranked(false), write_state(0), priority(0), generation(0), rtt(0) {}
+    bool ranked;
+    int write_state;
+    uint64 priority;
+    uint32 generation;
+    uint32 rtt;
+  };
+  struct ConnectionHash {
+    size_t operator()(const Connection* conn) const {
+      return reinterpret_cast<size_t>(conn);
+    }
+  };
+  typedef talk_base::OpenHashMap<Connection*, RankedState, ConnectionHash>
+      ConnectionIndex;
+
+  // In ranking order as of the last sort; newer connections are at the end.
   std::vector<Connection *> connections_;
+  // Every connection in |connections_|, for finding them on each packet.
+  ConnectionIndex connection_index_;
   Connection* best_connection_;
   // Connection selected by the controlling agent. This should be used only
   // at controlled side when protocol type is RFC5245.
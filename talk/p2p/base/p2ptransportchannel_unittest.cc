@@ -25,6 +25,8 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+
 #include "talk/base/fakenetwork.h"
 #include "talk/base/firewallsocketserver.h"
 #include "talk/base/gunit.h"
@@ -1459,3 +1461,178 @@ TEST_F(P2PTransportChannelTest, TestIceConfigWillPassDownToPort) {
 
   TestSendRecv(1);
 }
+
+// Creates many candidate pairs, to measure how the cost of ranking the
+// connections and of finding the one a packet came in on grows with them.
+// The remote candidates are unreachable, so the connections are only
+// touched by the test.
+class P2PTransportChannelScaleTest : public testing::Test,
+                                     public sigslot::has_slots<> {
+ public:
+  P2PTransportChannelScaleTest()
+      : vss_(new talk_base::VirtualSocketServer(NULL)),
+        ss_scope_(vss_.get()),
+        allocator_(&network_manager_),
+        packets_read_(0) {
+    allocator_.set_flags(kOnlyLocalPorts);
+    allocator_.set_step_delay(kMinimumStepDelay);
+  }
+
+ protected:
+  void CreateChannel(int num_local, int num_remote) {
+    for (int i = 0; i < num_local; ++i) {
+      network_manager_.AddInterface(SocketAddress(
+          talk_base::IPAddress(0x0A000001 | (i << 8)), 0));
+    }
+    channel_.reset(new cricket::P2PTransportChannel(
+        "test content name", 1, NULL, &allocator_));
+    channel_->SignalRequestSignaling.connect(
+        this, &P2PTransportChannelScaleTest::OnRequestSignaling);
+    channel_->SignalReadPacket.connect(
+        this, &P2PTransportChannelScaleTest::OnReadPacket);
+    channel_->SetIceProtocolType(cricket::ICEPROTO_RFC5245);
+    channel_->SetIceCredentials(kIceUfrag[0], kIcePwd[0]);
+    channel_->SetRemoteIceCredentials(kIceUfrag[1], kIcePwd[1]);
+    channel_->SetRole(cricket::ROLE_CONTROLLING);
+    channel_->SetTiebreaker(kTiebreaker1);
+    channel_->Connect();
+    EXPECT_EQ_WAIT(static_cast<size_t>(num_local), channel_->ports().size(),
+                   kDefaultTimeout);
+
+    uint32 start = talk_base::Time();
+    for (int i = 0; i < num_remote; ++i) {
+      cricket::Candidate candidate;
+      candidate.set_component(1);
+      candidate.set_protocol("udp");
+      candidate.set_address(SocketAddress(
+          talk_base::IPAddress(0x0B000001 + i), 5000 + i));
+      candidate.set_priority(1000 + i);
+      candidate.set_type(cricket::LOCAL_PORT_TYPE);
+      channel_->OnCandidate(candidate);
+    }
+    LOG(LS_INFO) << "Added " << num_remote << " remote candidates for "
+                 << num_local * num_remote << " connections in "
+                 << talk_base::TimeSince(start) << " ms";
+  }
+
+  // Handles all the messages that are ready, such as the sort the channel
+  // posts when a connection changes.
+  static void ProcessPendingMessages() {
+    talk_base::Thread* thread = talk_base::Thread::Current();
+    talk_base::Message msg;
+    while (thread->Get(&msg, 0)) {
+      thread->Dispatch(&msg);
+    }
+  }
+
+  // Returns the connections of the channel in ranking order.
+  std::vector<cricket::Connection*> GetConnections() {
+    cricket::ConnectionInfos infos;
+    channel_->GetStats(&infos);
+    std::vector<cricket::Connection*> connections;
+    for (size_t i = 0; i < infos.size(); ++i) {
+      connections.push_back(static_cast<cricket::Connection*>(infos[i].key));
+    }
+    return connections;
+  }
+
+  // Times out the writability of |conn|, which ranks it lower. The connection
+  // is made readable first, so that it isn't destroyed.
+  static void TimeOutWrite(cricket::Connection* conn) {
+    uint32 now = talk_base::Time();
+    conn->ReceivedPing();
+    conn->Ping(now);
+    conn->UpdateState(now + cricket::CONNECTION_WRITE_TIMEOUT + 1);
+    ASSERT_EQ(cricket::Connection::STATE_WRITE_TIMEOUT, conn->write_state());
+  }
+
+  // The comparison the channel used to sort all of its connections with,
+  // using std::stable_sort, whenever one changed.
+  struct StableSortCompare {
+    bool operator()(cricket::Connection* a, cricket::Connection* b) const {
+      if (a->write_state() != b->write_state())
+        return a->write_state() < b->write_state();
+      if (a->priority() != b->priority())
+        return a->priority() > b->priority();
+      uint32 a_generation =
+          a->remote_candidate().generation() + a->port()->generation();
+      uint32 b_generation =
+          b->remote_candidate().generation() + b->port()->generation();
+      if (a_generation != b_generation)
+        return a_generation > b_generation;
+      return a->rtt() < b->rtt();
+    }
+  };
+
+  void OnRequestSignaling(cricket::TransportChannelImpl* channel) {
+    channel->OnSignalingReady();
+  }
+  void OnReadPacket(cricket::TransportChannel* channel, const char* data,
+                    size_t len, int flags) {
+    ++packets_read_;
+  }
+
+  talk_base::scoped_ptr<talk_base::VirtualSocketServer> vss_;
+  talk_base::SocketServerScope ss_scope_;
+  talk_base::FakeNetworkManager network_manager_;
+  cricket::BasicPortAllocator allocator_;
+  talk_base::scoped_ptr<cricket::P2PTransportChannel> channel_;
+  int packets_read_;
+};
+
+TEST_F(P2PTransportChannelScaleTest, RankAndReadManyConnectionsPerf) {
+  const int kNumLocal = 50;
+  const int kNumRemote = 60;
+  const int kNumChanges = 500;
+  const int kNumBulkChanges = 1000;
+  const int kNumPackets = 100000;
+  CreateChannel(kNumLocal, kNumRemote);
+
+  std::vector<cricket::Connection*> all = GetConnections();
+  ASSERT_EQ(static_cast<size_t>(kNumLocal * kNumRemote), all.size());
+  all[0]->ReceivedPing();
+  ProcessPendingMessages();
+  EXPECT_TRUE(channel_->readable());
+
+  // The channel must keep its connections in the order that a stable sort
+  // after each change would give. Connections are picked with a stride that
+  // is coprime to their number, so that each one changes at most once.
+  const size_t kStride = 7;
+  std::vector<cricket::Connection*> expected = GetConnections();
+  size_t next = 0;
+
+  // One connection changes per sort; each is re-ranked on its own.
+  uint32 elapsed = 0;
+  for (int i = 0; i < kNumChanges; ++i) {
+    TimeOutWrite(all[next]);
+    next = (next + kStride) % all.size();
+    uint32 start = talk_base::Time();
+    ProcessPendingMessages();
+    elapsed += talk_base::TimeSince(start);
+    std::stable_sort(expected.begin(), expected.end(), StableSortCompare());
+    ASSERT_TRUE(expected == GetConnections()) << "after change " << i;
+  }
+  LOG(LS_INFO) << "Re-ranked " << all.size() << " connections "
+               << kNumChanges << " times in " << elapsed << " ms";
+
+  // Many connections change before one sort, which merges them in.
+  for (int i = 0; i < kNumBulkChanges; ++i) {
+    TimeOutWrite(all[next]);
+    next = (next + kStride) % all.size();
+  }
+  ProcessPendingMessages();
+  std::stable_sort(expected.begin(), expected.end(), StableSortCompare());
+  EXPECT_TRUE(expected == GetConnections());
+
+  // Packets on the connection that is ranked last.
+  cricket::Connection* conn = expected.back();
+  conn->ReceivedPing();
+  const char kData[] = "0123456789abcdef";
+  uint32 start = talk_base::Time();
+  for (int i = 0; i < kNumPackets; ++i) {
+    conn->OnReadPacket(kData, sizeof(kData));
+  }
+  LOG(LS_INFO) << "Read " << kNumPackets << " packets in "
+               << talk_base::TimeSince(start) << " ms";
+  EXPECT_EQ(kNumPackets, packets_read_);
+}
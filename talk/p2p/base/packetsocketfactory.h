@@ -46,6 +46,13 @@ class PacketSocketFactory {
 
   virtual AsyncPacketSocket* CreateUdpSocket(
       const SocketAddress& address, int min_port, int max_port) = 0;
+  // Like CreateUdpSocket(), but the socket receives and sends packets in
+  // batches if the factory supports it (see AsyncUDPSocket::EnableBatching).
+  // Meant for servers that relay many packets per socket.
+  virtual AsyncPacketSocket* CreateBatchedUdpSocket(
+      const SocketAddress& address, int min_port, int max_port) {
+    return CreateUdpSocket(address, min_port, max_port);
+  }
   virtual AsyncPacketSocket* CreateServerTcpSocket(
       const SocketAddress& local_address, int min_port, int max_port,
       int opts) = 0;
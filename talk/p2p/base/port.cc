@@ -342,9 +342,6 @@ bool Port::IsGoogleIce() const {
 bool Port::GetStunMessage(const char* data, size_t size,
                           const talk_base::SocketAddress& addr,
                           IceMessage** out_msg, std::string* out_username) {
-  // NOTE: This could clearly be optimized to avoid allocating any memory.
-  //       However, at the data rates we'll be looking at on the client side,
-  //       this probably isn't worth worrying about.
   ASSERT(out_msg != NULL);
   ASSERT(out_username != NULL);
   *out_msg = NULL;
@@ -357,10 +354,10 @@ bool Port::GetStunMessage(const char* data, size_t size,
   }
 
   // Parse the request message.  If the packet is not a complete and correct
-  // STUN message, then ignore it.
+  // STUN message, then ignore it. The message is parsed in place, as it
+  // doesn't outlive the packet.
   talk_base::scoped_ptr<IceMessage> stun_msg(new IceMessage());
-  talk_base::ByteBuffer buf(data, size);
-  if (!stun_msg->Read(&buf) || (buf.Length() > 0)) {
+  if (!stun_msg->ReadView(data, size)) {
     return false;
   }
 
@@ -324,6 +324,7 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   // with this port's username fragment, msg will contain the parsed STUN
   // message.  Otherwise, the function may send a STUN response internally.
   // remote_username contains the remote fragment of the STUN username.
+  // The message refers to |data|, so it must not outlive it.
   bool GetStunMessage(const char* data, size_t size,
                       const talk_base::SocketAddress& addr,
                       IceMessage** out_msg, std::string* out_username);
@@ -449,7 +450,7 @@ class Connection : public talk_base::MessageHandler,
   // Error if Send() returns < 0
   virtual int GetError() = 0;
 
-  sigslot::signal3<Connection*, const char*, size_t> SignalReadPacket;
+  sigslot::fast_signal3<Connection*, const char*, size_t> SignalReadPacket;
 
   sigslot::signal1<Connection*> SignalReadyToSend;
 
@@ -103,7 +103,7 @@ const uint32 DEFAULT_SND_BUF_SIZE = 90 * 1024;
 //  8 |                     Acknowledgment Number                     |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 //    |               |   |U|A|P|R|S|F|                               |
-// 12 |    Control    |   |R|C|S|S|Y|I|            Window             |
+// 12 |  SACK blocks  |   |R|C|S|S|Y|I|            Window             |
 //    |               |   |G|K|H|T|N|N|                               |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 // 16 |                       Timestamp sending                       |
@@ -113,12 +113,26 @@ const uint32 DEFAULT_SND_BUF_SIZE = 90 * 1024;
 // 24 |                             data                              |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 //
+// The byte at offset 12 (formerly "Control", always 0) is the number of
+// SACK blocks that follow the header. Each block is the left and right
+// edge of a range of data received out of order:
+//
+//    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// 24 |                      Left Edge of Block                       |
+//    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// 28 |                      Right Edge of Block                      |
+//    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//
+// SACK blocks are only sent once both peers have offered
+// TCP_OPT_SACK_PERMITTED, and only on segments without data.
+//
 //////////////////////////////////////////////////////////////////////
 
 #define PSEUDO_KEEPALIVE 0
 
 const uint32 MAX_SEQ = 0xFFFFFFFF;
 const uint32 HEADER_SIZE = 24;
+const uint32 SACK_BLOCK_SIZE = 8;
 const uint32 PACKET_OVERHEAD = HEADER_SIZE + UDP_HEADER_SIZE + IP_HEADER_SIZE + JINGLE_HEADER_SIZE;
 
 const uint32 MIN_RTO   =   250; // 250 ms (RFC1122, Sec 4.2.3.1 "fractions of a second")
@@ -126,6 +140,10 @@ const uint32 DEF_RTO   =  3000; // 3 seconds (RFC1122, Sec 4.2.3.1)
 const uint32 MAX_RTO   = 60000; // 60 seconds
 const uint32 DEF_ACK_DELAY = 100; // 100 milliseconds
 
+// A segment is deemed lost when more than this many segments' worth of data
+// after it has been SACKed (RFC 6675).
+const uint32 DUP_THRESH = 3;
+
 const uint8 FLAG_CTL = 0x02;
 const uint8 FLAG_RST = 0x04;
 
@@ -138,6 +156,7 @@ const uint8 TCP_OPT_EOL = 0;  // End of list.
 const uint8 TCP_OPT_NOOP = 1;  // No-op.
 const uint8 TCP_OPT_MSS = 2;  // Maximum segment size.
 const uint8 TCP_OPT_WND_SCALE = 3;  // Window scale factor.
+const uint8 TCP_OPT_SACK_PERMITTED = 4;  // Selective acknowledgements.
 
 /*
 const uint8 FLAG_FIN = 0x01;
@@ -237,7 +256,8 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
       m_rbuf_len(DEFAULT_RCV_BUF_SIZE),
       m_rbuf(m_rbuf_len),
       m_sbuf_len(DEFAULT_SND_BUF_SIZE),
-      m_sbuf(m_sbuf_len) {
+      m_sbuf(m_sbuf_len),
+      m_cc(new RenoCongestionControl()) {
 
   // Sanity check on buffer sizes (needed for OnTcpWriteable notification logic)
   ASSERT(m_rbuf_len + MIN_PACKET < m_sbuf_len);
@@ -271,6 +291,10 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
   m_dup_acks = 0;
   m_recover = 0;
 
+  m_sack_enabled = false;
+  m_sacked_bytes = m_rexmit_nxt = 0;
+  m_last_rseq = 0;
+
   m_ts_recent = m_ts_lastack = 0;
 
   m_rx_rto = DEF_RTO;
@@ -279,6 +303,7 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
   m_use_nagling = true;
   m_ack_delay = DEF_ACK_DELAY;
   m_support_wnd_scale = true;
+  m_support_sack = true;
 }
 
 PseudoTcp::~PseudoTcp() {
@@ -329,11 +354,18 @@ void PseudoTcp::NotifyClock(uint32 now) {
         return;
       }
 
-      uint32 nInFlight = m_snd_nxt - m_snd_una;
-      m_ssthresh = talk_base::_max(nInFlight / 2, 2 * m_mss);
-      //LOG(LS_INFO) << "m_ssthresh: " << m_ssthresh << "  nInFlight: " << nInFlight << "  m_mss: " << m_mss;
+      m_ssthresh = m_cc->OnLoss(congestionState(), now, true);
       m_cwnd = m_mss;
 
+      if (m_sack_enabled) {
+        // Leave recovery, and resend the holes below the current send point
+        // as the window opens up again, whether or not they were already
+        // retransmitted (RFC 6675, section 5.1).
+        m_dup_acks = 0;
+        m_recover = m_snd_nxt;
+        m_rexmit_nxt = m_slist.front().seq + m_slist.front().len;
+      }
+
       // Back off retransmit timer.  Note: the limit is lower when connecting.
       uint32 rto_limit = (m_state < TCP_ESTABLISHED) ? DEF_RTO : MAX_RTO;
       m_rx_rto = talk_base::_min(rto_limit, m_rx_rto * 2);
@@ -435,6 +467,11 @@ uint32 PseudoTcp::GetRoundTripTimeEstimateMs() const {
   return m_rx_srtt;
 }
 
+void PseudoTcp::SetCongestionControl(PseudoTcpCongestionControl* cc) {
+  ASSERT(cc != NULL);
+  m_cc.reset(cc);
+}
+
 //
 // IPStream Implementation
 //
@@ -542,7 +579,11 @@ IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
   long_to_bytes(m_conv, buffer);
   long_to_bytes(seq, buffer + 4);
   long_to_bytes(m_rcv_nxt, buffer + 8);
-  buffer[12] = 0;
+  uint32 nsacks = 0;
+  if (m_sack_enabled && (len == 0)) {
+    nsacks = writeSackBlocks(buffer + HEADER_SIZE);
+  }
+  buffer[12] = static_cast<uint8>(nsacks);
   buffer[13] = flags;
   short_to_bytes(static_cast<uint16>(m_rcv_wnd >> m_rwnd_scale), buffer + 14);
 
@@ -573,7 +614,8 @@ IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
                << "><LEN=" << len << ">";
 #endif // _DEBUGMSG
 
-  IPseudoTcpNotify::WriteResult wres = m_notify->TcpWritePacket(this, reinterpret_cast<char *>(buffer), len + HEADER_SIZE);
+  uint32 header_size = HEADER_SIZE + nsacks * SACK_BLOCK_SIZE;
+  IPseudoTcpNotify::WriteResult wres = m_notify->TcpWritePacket(this, reinterpret_cast<char *>(buffer), len + header_size);
   // Note: When len is 0, this is an ACK packet.  We don't read the return value for those,
   // and thus we won't retry.  So go ahead and treat the packet as a success (basically simulate
   // as if it were dropped), which will prevent our timers from being messed up.
@@ -604,8 +646,20 @@ bool PseudoTcp::parse(const uint8* buffer, uint32 size) {
   seg.tsval = bytes_to_long(buffer + 16);
   seg.tsecr = bytes_to_long(buffer + 20);
 
-  seg.data = reinterpret_cast<const char *>(buffer) + HEADER_SIZE;
-  seg.len = size - HEADER_SIZE;
+  seg.nsacks = buffer[12];
+  uint32 header_size = HEADER_SIZE + seg.nsacks * SACK_BLOCK_SIZE;
+  if ((seg.nsacks > kMaxSackBlocks) || (size < header_size)) {
+    LOG_F(LS_WARNING) << "invalid SACK blocks";
+    return false;
+  }
+  for (uint8 i = 0; i < seg.nsacks; ++i) {
+    const uint8* block = buffer + HEADER_SIZE + i * SACK_BLOCK_SIZE;
+    seg.sacks[i].left = bytes_to_long(block);
+    seg.sacks[i].right = bytes_to_long(block + 4);
+  }
+
+  seg.data = reinterpret_cast<const char *>(buffer) + header_size;
+  seg.len = size - header_size;
 
 #if _DEBUGMSG >= _DBG_VERBOSE
   LOG(LS_INFO) << "--> <CONV=" << seg.conv
@@ -723,6 +777,10 @@ bool PseudoTcp::process(Segment& seg) {
     m_ts_recent = seg.tsval;
   }
 
+  if (m_sack_enabled && seg.nsacks) {
+    applySackBlocks(seg);
+  }
+
   // Check if this is a valuable ack
   if ((seg.ack > m_snd_una) && (seg.ack <= m_snd_nxt)) {
     // Calculate round-trip time
@@ -760,12 +818,19 @@ bool PseudoTcp::process(Segment& seg) {
     for (uint32 nFree = nAcked; nFree > 0; ) {
       ASSERT(!m_slist.empty());
       if (nFree < m_slist.front().len) {
+        if (m_slist.front().bSacked) {
+          m_sacked_bytes -= nFree;
+        }
         m_slist.front().len -= nFree;
+        m_slist.front().seq += nFree;
         nFree = 0;
       } else {
         if (m_slist.front().len > m_largest) {
           m_largest = m_slist.front().len;
         }
+        if (m_slist.front().bSacked) {
+          m_sacked_bytes -= m_slist.front().len;
+        }
         nFree -= m_slist.front().len;
         m_slist.pop_front();
       }
@@ -783,19 +848,35 @@ bool PseudoTcp::process(Segment& seg) {
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "recovery retransmit";
 #endif // _DEBUGMSG
-        if (!transmit(m_slist.begin(), now)) {
-          closedown(ECONNABORTED);
-          return false;
+        if (m_sack_enabled) {
+          // A partial ACK means the segment after it is lost too (NewReno),
+          // even if not enough was SACKed above it to tell.
+          SList::iterator front = m_slist.begin();
+          if (front->seq >= m_rexmit_nxt) {
+            if (!transmit(front, now)) {
+              closedown(ECONNABORTED);
+              return false;
+            }
+            m_rexmit_nxt = front->seq + front->len;
+          }
+          if (!sackRetransmit(now)) {
+            closedown(ECONNABORTED);
+            return false;
+          }
+        } else {
+          if (!transmit(m_slist.begin(), now)) {
+            closedown(ECONNABORTED);
+            return false;
+          }
+          m_cwnd += m_mss - talk_base::_min(nAcked, m_cwnd);
         }
-        m_cwnd += m_mss - talk_base::_min(nAcked, m_cwnd);
       }
     } else {
       m_dup_acks = 0;
-      // Slow start, congestion avoidance
-      if (m_cwnd < m_ssthresh) {
-        m_cwnd += m_mss;
-      } else {
-        m_cwnd += talk_base::_max<uint32>(1, m_mss * m_mss / m_cwnd);
+      m_cwnd = m_cc->OnAck(congestionState(), nAcked, now);
+      if (m_sacked_bytes && !sackRetransmit(now)) {
+        closedown(ECONNABORTED);
+        return false;
       }
     }
   } else if (seg.ack == m_snd_una) {
@@ -805,8 +886,18 @@ bool PseudoTcp::process(Segment& seg) {
     // Check duplicate acks
     if (seg.len > 0) {
       // it's a dup ack, but with a data payload, so don't modify m_dup_acks
+    } else if (m_sack_enabled && (m_dup_acks < 3) &&
+               (m_snd_una < m_recover)) {
+      // These ACKs are for data sent before a retransmit timeout, which
+      // already cut the window; just repair the holes they show.
+      if (!sackRetransmit(now)) {
+        closedown(ECONNABORTED);
+        return false;
+      }
     } else if (m_snd_una != m_snd_nxt) {
-      m_dup_acks += 1;
+      if (m_dup_acks < 0xFF) {
+        m_dup_acks += 1;
+      }
       if (m_dup_acks == 3) { // (Fast Retransmit)
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "enter recovery";
@@ -817,12 +908,28 @@ bool PseudoTcp::process(Segment& seg) {
           return false;
         }
         m_recover = m_snd_nxt;
-        uint32 nInFlight = m_snd_nxt - m_snd_una;
-        m_ssthresh = talk_base::_max(nInFlight / 2, 2 * m_mss);
-        //LOG(LS_INFO) << "m_ssthresh: " << m_ssthresh << "  nInFlight: " << nInFlight << "  m_mss: " << m_mss;
-        m_cwnd = m_ssthresh + 3 * m_mss;
+        m_ssthresh = m_cc->OnLoss(congestionState(), now, false);
+        if (m_sack_enabled) {
+          // The SACK scoreboard tells how much is in flight, so there is no
+          // need to inflate the window (RFC 6675).
+          m_cwnd = m_ssthresh;
+          m_rexmit_nxt = m_slist.front().seq + m_slist.front().len;
+          if (!sackRetransmit(now)) {
+            closedown(ECONNABORTED);
+            return false;
+          }
+        } else {
+          m_cwnd = m_ssthresh + 3 * m_mss;
+        }
       } else if (m_dup_acks > 3) {
-        m_cwnd += m_mss;
+        if (m_sack_enabled) {
+          if (!sackRetransmit(now)) {
+            closedown(ECONNABORTED);
+            return false;
+          }
+        } else {
+          m_cwnd += m_mss;
+        }
       }
     } else {
       m_dup_acks = 0;
@@ -947,6 +1054,7 @@ bool PseudoTcp::process(Segment& seg) {
         RSegment rseg;
         rseg.seq = seg.seq;
         rseg.len = seg.len;
+        m_last_rseq = seg.seq;
         RList::iterator it = m_rlist.begin();
         while ((it != m_rlist.end()) && (it->seq < rseg.seq)) {
           ++it;
@@ -1044,6 +1152,7 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
 
   if (talk_base::TimeDiff(now, m_lastsend) > static_cast<long>(m_rx_rto)) {
     m_cwnd = m_mss;
+    m_cc->OnRestart();
   }
 
 #if _DEBUGMSG
@@ -1058,7 +1167,12 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
     }
     uint32 nWindow = talk_base::_min(m_snd_wnd, cwnd);
     uint32 nInFlight = m_snd_nxt - m_snd_una;
-    uint32 nUseable = (nInFlight < nWindow) ? (nWindow - nInFlight) : 0;
+    uint32 nPipe = nInFlight;
+    if (m_sacked_bytes) {
+      SList::iterator hole;
+      nPipe = sackPipe(&hole);
+    }
+    uint32 nUseable = (nPipe < nWindow) ? (nWindow - nPipe) : 0;
 
     size_t snd_buffered = 0;
     m_sbuf.GetBuffered(&snd_buffered);
@@ -1164,6 +1278,111 @@ PseudoTcp::adjustMTU() {
   m_cwnd = talk_base::_max(m_cwnd, m_mss);
 }
 
+uint32
+PseudoTcp::writeSackBlocks(uint8* buf) const {
+  // Merge the saved segments into blocks. The block holding the most
+  // recently received segment goes first, so that the sender learns of it
+  // even when there are more blocks than fit (RFC 2018, section 4).
+  SackBlock blocks[kMaxSackBlocks];
+  uint32 nblocks = 1;
+  bool bHaveRecent = false;
+  RList::const_iterator it = m_rlist.begin();
+  while (it != m_rlist.end()) {
+    SackBlock block;
+    block.left = it->seq;
+    block.right = it->seq + it->len;
+    for (++it; (it != m_rlist.end()) && (it->seq <= block.right); ++it) {
+      block.right = talk_base::_max(block.right, it->seq + it->len);
+    }
+    if ((block.left <= m_last_rseq) && (m_last_rseq < block.right)) {
+      blocks[0] = block;
+      bHaveRecent = true;
+    } else if (nblocks < kMaxSackBlocks) {
+      blocks[nblocks++] = block;
+    }
+  }
+
+  uint32 first = bHaveRecent ? 0 : 1;
+  for (uint32 i = first; i < nblocks; ++i) {
+    long_to_bytes(blocks[i].left, buf);
+    long_to_bytes(blocks[i].right, buf + 4);
+    buf += SACK_BLOCK_SIZE;
+  }
+  return nblocks - first;
+}
+
+void
+PseudoTcp::applySackBlocks(const Segment& seg) {
+  for (uint8 i = 0; i < seg.nsacks; ++i) {
+    const SackBlock& block = seg.sacks[i];
+    if ((block.left >= block.right) || (block.left < m_snd_una) ||
+        (block.right > m_snd_nxt)) {
+      continue;
+    }
+    for (SList::iterator it = m_slist.begin();
+         (it != m_slist.end()) && (it->seq < block.right); ++it) {
+      if (!it->bSacked && (it->xmit > 0) && (it->seq >= block.left) &&
+          (it->seq + it->len <= block.right)) {
+        it->bSacked = true;
+        m_sacked_bytes += it->len;
+      }
+    }
+  }
+}
+
+uint32
+PseudoTcp::sackPipe(SList::iterator* hole) {
+  uint32 nPipe = 0;
+  uint32 nSackedAbove = 0;
+  *hole = m_slist.end();
+  for (SList::reverse_iterator it = m_slist.rbegin(); it != m_slist.rend();
+       ++it) {
+    if (it->xmit == 0) {
+      continue;
+    }
+    if (it->bSacked) {
+      nSackedAbove += it->len;
+      continue;
+    }
+    bool bLost = nSackedAbove > (DUP_THRESH - 1) * m_mss;
+    if (!bLost || (it->seq < m_rexmit_nxt)) {
+      nPipe += it->len;
+    } else {
+      *hole = --it.base();
+    }
+  }
+  return nPipe;
+}
+
+bool
+PseudoTcp::sackRetransmit(uint32 now) {
+  while (true) {
+    SList::iterator hole;
+    uint32 nPipe = sackPipe(&hole);
+    if ((hole == m_slist.end()) || (nPipe + m_mss > m_cwnd)) {
+      return true;
+    }
+#if _DEBUGMSG >= _DBG_NORMAL
+    LOG(LS_INFO) << "SACK retransmit " << hole->seq;
+#endif // _DEBUGMSG
+    if (!transmit(hole, now)) {
+      return false;
+    }
+    m_rexmit_nxt = hole->seq + hole->len;
+  }
+}
+
+PseudoTcpCongestionControl::State
+PseudoTcp::congestionState() const {
+  PseudoTcpCongestionControl::State state;
+  state.cwnd = m_cwnd;
+  state.ssthresh = m_ssthresh;
+  state.mss = m_mss;
+  state.bytes_in_flight = m_snd_nxt - m_snd_una;
+  state.srtt = m_rx_srtt;
+  return state;
+}
+
 bool
 PseudoTcp::isReceiveBufferFull() const {
   size_t available_space = 0;
@@ -1176,6 +1395,11 @@ PseudoTcp::disableWindowScale() {
   m_support_wnd_scale = false;
 }
 
+void
+PseudoTcp::disableSack() {
+  m_support_sack = false;
+}
+
 void
 PseudoTcp::queueConnectMessage() {
   talk_base::ByteBuffer buf(talk_base::ByteBuffer::ORDER_NETWORK);
@@ -1186,6 +1410,10 @@ PseudoTcp::queueConnectMessage() {
     buf.WriteUInt8(1);
     buf.WriteUInt8(m_rwnd_scale);
   }
+  if (m_support_sack) {
+    buf.WriteUInt8(TCP_OPT_SACK_PERMITTED);
+    buf.WriteUInt8(0);
+  }
   m_snd_wnd = static_cast<uint32>(buf.Length());
   queue(buf.Data(), static_cast<uint32>(buf.Length()), true);
 }
@@ -1236,6 +1464,9 @@ PseudoTcp::parseOptions(const char* data, uint32 len) {
       m_swnd_scale = 0;
     }
   }
+
+  m_sack_enabled = m_support_sack && (options_specified.find(
+      TCP_OPT_SACK_PERMITTED) != options_specified.end());
 }
 
 void
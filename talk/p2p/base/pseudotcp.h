@@ -31,7 +31,9 @@
 #include <list>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/scoped_ptr.h"
 #include "talk/base/stream.h"
+#include "talk/p2p/base/pseudotcpcongestion.h"
 
 namespace cricket {
 
@@ -124,9 +126,25 @@ class PseudoTcp {
   // Returns current round-trip time estimate in milliseconds.
   uint32 GetRoundTripTimeEstimateMs() const;
 
+  // Replaces the congestion control, taking ownership of |cc|. The default
+  // is RenoCongestionControl.
+  void SetCongestionControl(PseudoTcpCongestionControl* cc);
+
+  // Returns true if both sides support selective acknowledgements. This is
+  // only known once the connect messages have been exchanged.
+  bool IsSackEnabled() const { return m_sack_enabled; }
+
  protected:
   enum SendFlags { sfNone, sfDelayedAck, sfImmediateAck };
 
+  // The most SACK blocks carried by one ACK.
+  enum { kMaxSackBlocks = 4 };
+
+  // A range of sequence numbers received out of order: [left, right).
+  struct SackBlock {
+    uint32 left, right;
+  };
+
   struct Segment {
     uint32 conv, seq, ack;
     uint8 flags;
@@ -134,16 +152,19 @@ class PseudoTcp {
     const char * data;
     uint32 len;
     uint32 tsval, tsecr;
+    uint8 nsacks;
+    SackBlock sacks[kMaxSackBlocks];
   };
 
   struct SSegment {
     SSegment(uint32 s, uint32 l, bool c)
-        : seq(s), len(l), /*tstamp(0),*/ xmit(0), bCtrl(c) {
+        : seq(s), len(l), /*tstamp(0),*/ xmit(0), bCtrl(c), bSacked(false) {
     }
     uint32 seq, len;
     //uint32 tstamp;
     uint8 xmit;
     bool bCtrl;
+    bool bSacked;
   };
   typedef std::list<SSegment> SList;
 
@@ -176,6 +197,22 @@ class PseudoTcp {
 
   void adjustMTU();
 
+  // Selective acknowledgements (RFC 2018, RFC 6675).
+  // Writes the out-of-order data we hold as SACK blocks to |buf|, and
+  // returns the number of blocks.
+  uint32 writeSackBlocks(uint8* buf) const;
+  // Marks the segments covered by the SACK blocks of |seg|.
+  void applySackBlocks(const Segment& seg);
+  // Returns the number of bytes that are still in the network, counting
+  // neither SACKed segments nor segments that are deemed lost and have not
+  // been retransmitted. Sets |hole| to the first such lost segment, or to
+  // the end of |m_slist|.
+  uint32 sackPipe(SList::iterator* hole);
+  // Retransmits lost segments while the congestion window allows.
+  bool sackRetransmit(uint32 now);
+
+  PseudoTcpCongestionControl::State congestionState() const;
+
  protected:
   // This method is used in test only to query receive buffer state.
   bool isReceiveBufferFull() const;
@@ -184,6 +221,10 @@ class PseudoTcp {
   // support for testing backward compatibility.
   void disableWindowScale();
 
+  // This method is only used in tests, to disable selective
+  // acknowledgements for testing backward compatibility.
+  void disableSack();
+
  private:
   // Queue the connect message with TCP options.
   void queueConnectMessage();
@@ -243,6 +284,16 @@ class PseudoTcp {
   uint8 m_dup_acks;
   uint32 m_recover;
   uint32 m_t_ack;
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> m_cc;
+
+  // SACK scoreboard: the number of SACKed bytes in |m_slist|, and the end of
+  // the last retransmitted hole; segments below it are not resent again
+  // until the next timeout.
+  bool m_sack_enabled;
+  uint32 m_sacked_bytes, m_rexmit_nxt;
+  // Start of the last segment received out of order, whose block is
+  // reported first.
+  uint32 m_last_rseq;
 
   // Configuration options
   bool m_use_nagling;
@@ -251,6 +302,8 @@ class PseudoTcp {
   // This is used by unit tests to test backward compatibility of
   // PseudoTcp implementations that don't support window scaling.
   bool m_support_wnd_scale;
+  // Likewise for selective acknowledgements.
+  bool m_support_sack;
 };
 
 }  // namespace cricket
@@ -34,6 +34,7 @@
 #include "talk/base/thread.h"
 #include "talk/base/timeutils.h"
 #include "talk/p2p/base/pseudotcp.h"
+#include "talk/p2p/base/pseudotcpcongestion.h"
 
 using cricket::PseudoTcp;
 
@@ -54,6 +55,10 @@ class PseudoTcpForTest : public cricket::PseudoTcp {
   void disableWindowScale() {
     PseudoTcp::disableWindowScale();
   }
+
+  void disableSack() {
+    PseudoTcp::disableSack();
+  }
 };
 
 class PseudoTcpTestBase : public testing::Test,
@@ -114,6 +119,15 @@ class PseudoTcpTestBase : public testing::Test,
   void DisableLocalWindowScale() {
     local_.disableWindowScale();
   }
+  void DisableRemoteSack() {
+    remote_.disableSack();
+  }
+  void DisableLocalSack() {
+    local_.disableSack();
+  }
+  void SetLocalCongestionControl(cricket::PseudoTcpCongestionControl* cc) {
+    local_.SetCongestionControl(cc);
+  }
 
  protected:
   int Connect() {
@@ -742,6 +756,93 @@ TEST_F(PseudoTcpTest, TestSendVerySmallReceiveBuffer) {
   TestTransfer(100000);
 }
 
+// Test that selective acknowledgements are used when both sides support
+// them, with 10% packet loss.
+TEST_F(PseudoTcpTest, TestSendWithLossAndSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  TestTransfer(100000);
+  EXPECT_TRUE(local_.IsSackEnabled());
+  EXPECT_TRUE(remote_.IsSackEnabled());
+}
+
+// Test sending data with packet loss to a receiver that doesn't support
+// selective acknowledgements.
+TEST_F(PseudoTcpTest, TestSendWithLossRemoteNoSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  DisableRemoteSack();
+  TestTransfer(100000);
+  EXPECT_FALSE(local_.IsSackEnabled());
+  EXPECT_FALSE(remote_.IsSackEnabled());
+}
+
+// Test sending data with packet loss from a sender that doesn't support
+// selective acknowledgements.
+TEST_F(PseudoTcpTest, TestSendWithLossLocalNoSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  DisableLocalSack();
+  TestTransfer(100000);
+  EXPECT_FALSE(local_.IsSackEnabled());
+  EXPECT_FALSE(remote_.IsSackEnabled());
+}
+
+// Test sending data with CUBIC congestion control.
+TEST_F(PseudoTcpTest, TestSendWithCubic) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLocalCongestionControl(new cricket::CubicCongestionControl());
+  TestTransfer(1000000);
+}
+
+// Test sending data with CUBIC congestion control, 50ms delay and 10%
+// packet loss.
+TEST_F(PseudoTcpTest, TestSendWithDelayAndLossCubic) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  SetLocalCongestionControl(new cricket::CubicCongestionControl());
+  TestTransfer(100000);
+}
+
+// Throughput under loss, on a 100ms round trip with 2% packet loss, with
+// Reno and no selective acknowledgements, as before...
+TEST_F(PseudoTcpTest, TestThroughputUnderLossRenoPerf) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(2);
+  DisableLocalSack();
+  TestTransfer(300000);
+}
+
+// ...with Reno and selective acknowledgements...
+TEST_F(PseudoTcpTest, TestThroughputUnderLossSackPerf) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(2);
+  TestTransfer(300000);
+}
+
+// ...and with CUBIC and selective acknowledgements.
+TEST_F(PseudoTcpTest, TestThroughputUnderLossCubicPerf) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(2);
+  SetLocalCongestionControl(new cricket::CubicCongestionControl());
+  TestTransfer(300000);
+}
+
 // Ping-pong (request/response) tests
 
 // Test sending <= 1x MTU of data in each ping/pong.  Should take <10ms.
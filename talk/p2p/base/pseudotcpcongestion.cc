@@ -0,0 +1,136 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/p2p/base/pseudotcpcongestion.h"
+
+#include <math.h>
+
+#include "talk/base/common.h"
+#include "talk/base/timeutils.h"
+
+namespace cricket {
+
+// Multiplicative decrease factor and scaling constant, from RFC 8312.
+const double kCubicBeta = 0.7;
+const double kCubicC = 0.4;
+
+//////////////////////////////////////////////////////////////////////
+// RenoCongestionControl
+//////////////////////////////////////////////////////////////////////
+
+uint32 RenoCongestionControl::OnAck(const State& state, uint32 acked,
+                                    uint32 now) {
+  // Slow start, congestion avoidance
+  if (state.cwnd < state.ssthresh) {
+    return state.cwnd + state.mss;
+  }
+  return state.cwnd +
+      talk_base::_max<uint32>(1, state.mss * state.mss / state.cwnd);
+}
+
+uint32 RenoCongestionControl::OnLoss(const State& state, uint32 now,
+                                     bool timeout) {
+  return talk_base::_max(state.bytes_in_flight / 2, 2 * state.mss);
+}
+
+//////////////////////////////////////////////////////////////////////
+// CubicCongestionControl
+//////////////////////////////////////////////////////////////////////
+
+CubicCongestionControl::CubicCongestionControl()
+    : w_max_(0),
+      w_last_max_(0),
+      w_est_(0),
+      k_(0),
+      in_epoch_(false),
+      epoch_start_(0) {
+}
+
+uint32 CubicCongestionControl::OnAck(const State& state, uint32 acked,
+                                     uint32 now) {
+  if (state.cwnd < state.ssthresh) {
+    return state.cwnd + state.mss;
+  }
+
+  double mss = state.mss;
+  double cwnd = state.cwnd / mss;
+  double segments = acked / mss;
+  if (!in_epoch_) {
+    in_epoch_ = true;
+    epoch_start_ = now;
+    if (cwnd < w_max_) {
+      k_ = pow((w_max_ - cwnd) / kCubicC, 1.0 / 3.0);
+    } else {
+      k_ = 0;
+      w_max_ = cwnd;
+    }
+    w_est_ = cwnd;
+  }
+
+  // The window we want to have one round trip from now.
+  double t = (talk_base::TimeDiff(now, epoch_start_) + state.srtt) / 1000.0;
+  double target = w_max_ + kCubicC * (t - k_) * (t - k_) * (t - k_);
+  target = talk_base::_min(target, 1.5 * cwnd);
+
+  // Don't grow slower than Reno would with the same decrease factor.
+  w_est_ += 3 * (1 - kCubicBeta) / (1 + kCubicBeta) * segments / cwnd;
+  target = talk_base::_max(target, w_est_);
+
+  double increase;
+  if (target > cwnd) {
+    increase = (target - cwnd) / cwnd * segments;
+  } else {
+    increase = segments / (100 * cwnd);
+  }
+  return state.cwnd + static_cast<uint32>(increase * mss);
+}
+
+uint32 CubicCongestionControl::OnLoss(const State& state, uint32 now,
+                                      bool timeout) {
+  // The window is only grown when data is acknowledged, so the flight size
+  // is lower when the sender was limited by the receive window or the
+  // application; cut from that, like Reno does.
+  uint32 window = talk_base::_min(state.cwnd, state.bytes_in_flight);
+  double cwnd = static_cast<double>(window) / state.mss;
+  in_epoch_ = false;
+  // Fast convergence: if the window keeps shrinking, another flow is
+  // taking its share, so give up some more.
+  if (cwnd < w_last_max_) {
+    w_max_ = cwnd * (1 + kCubicBeta) / 2;
+  } else {
+    w_max_ = cwnd;
+  }
+  w_last_max_ = cwnd;
+  return talk_base::_max(static_cast<uint32>(window * kCubicBeta),
+                         2 * state.mss);
+}
+
+void CubicCongestionControl::OnRestart() {
+  in_epoch_ = false;
+}
+
+}  // namespace cricket
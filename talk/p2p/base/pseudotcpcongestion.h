@@ -0,0 +1,102 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_P2P_BASE_PSEUDOTCPCONGESTION_H_
+#define TALK_P2P_BASE_PSEUDOTCPCONGESTION_H_
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+
+namespace cricket {
+
+// Decides how the congestion window of a PseudoTcp grows as data is
+// acknowledged, and how far it is cut when a loss is detected. PseudoTcp
+// still does the bookkeeping of retransmission and loss recovery.
+class PseudoTcpCongestionControl {
+ public:
+  // The sender state, in bytes and milliseconds.
+  struct State {
+    uint32 cwnd;
+    uint32 ssthresh;
+    uint32 mss;
+    uint32 bytes_in_flight;
+    uint32 srtt;
+  };
+
+  virtual ~PseudoTcpCongestionControl() {}
+
+  // Called for an ACK of |acked| new bytes outside of loss recovery.
+  // Returns the new congestion window.
+  virtual uint32 OnAck(const State& state, uint32 acked, uint32 now) = 0;
+  // Called when a loss is detected, by duplicate ACKs or by a retransmit
+  // timeout. Returns the new slow start threshold.
+  virtual uint32 OnLoss(const State& state, uint32 now, bool timeout) = 0;
+  // Called when the window is restarted after an idle period.
+  virtual void OnRestart() {}
+};
+
+// Slow start and additive increase, halving the flight size on loss
+// (RFC 5681). This is what PseudoTcp has always done.
+class RenoCongestionControl : public PseudoTcpCongestionControl {
+ public:
+  RenoCongestionControl() {}
+
+  virtual uint32 OnAck(const State& state, uint32 acked, uint32 now);
+  virtual uint32 OnLoss(const State& state, uint32 now, bool timeout);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RenoCongestionControl);
+};
+
+// CUBIC (RFC 8312). After a loss the window grows as a cubic function of
+// the time since the loss, centered on the window at which the loss
+// happened, so it gets back to that window in a few round trips regardless
+// of the round-trip time, and is cut by 30% rather than by half.
+class CubicCongestionControl : public PseudoTcpCongestionControl {
+ public:
+  CubicCongestionControl();
+
+  virtual uint32 OnAck(const State& state, uint32 acked, uint32 now);
+  virtual uint32 OnLoss(const State& state, uint32 now, bool timeout);
+  virtual void OnRestart();
+
+ private:
+  // The windows are in segments, as in the RFC.
+  double w_max_;
+  double w_last_max_;
+  double w_est_;
+  // Seconds from the start of the epoch until the window reaches |w_max_|.
+  double k_;
+  bool in_epoch_;
+  uint32 epoch_start_;
+
+  DISALLOW_COPY_AND_ASSIGN(CubicCongestionControl);
+};
+
+}  // namespace cricket
+
+#endif  // TALK_P2P_BASE_PSEUDOTCPCONGESTION_H_
@@ -0,0 +1,140 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/gunit.h"
+#include "talk/p2p/base/pseudotcpcongestion.h"
+
+using cricket::CubicCongestionControl;
+using cricket::PseudoTcpCongestionControl;
+using cricket::RenoCongestionControl;
+
+static const uint32 kMss = 1000;
+static const uint32 kRttMs = 100;
+
+static PseudoTcpCongestionControl::State MakeCongestionState(uint32 cwnd,
+                                                            uint32 ssthresh) {
+  PseudoTcpCongestionControl::State state;
+  state.cwnd = cwnd;
+  state.ssthresh = ssthresh;
+  state.mss = kMss;
+  state.bytes_in_flight = cwnd;
+  state.srtt = kRttMs;
+  return state;
+}
+
+// Acknowledges a full window, one segment per ACK, every round trip from
+// |*now| until |end|, and returns the window.
+static uint32 AckWindowsUntil(PseudoTcpCongestionControl* cc,
+                              PseudoTcpCongestionControl::State* state,
+                              uint32* now, uint32 end) {
+  for (; *now < end; *now += kRttMs) {
+    uint32 acks = state->cwnd / kMss;
+    for (uint32 i = 0; i < acks; ++i) {
+      state->cwnd = cc->OnAck(*state, kMss, *now);
+      state->bytes_in_flight = state->cwnd;
+    }
+  }
+  return state->cwnd;
+}
+
+TEST(RenoCongestionControlTest, TestSlowStartAndAvoidance) {
+  RenoCongestionControl reno;
+  PseudoTcpCongestionControl::State state = MakeCongestionState(2 * kMss,
+                                                                10 * kMss);
+  EXPECT_EQ(3 * kMss, reno.OnAck(state, kMss, 0));
+  state.cwnd = 10 * kMss;
+  EXPECT_EQ(10 * kMss + kMss / 10, reno.OnAck(state, kMss, 0));
+}
+
+TEST(RenoCongestionControlTest, TestLossHalvesFlightSize) {
+  RenoCongestionControl reno;
+  PseudoTcpCongestionControl::State state = MakeCongestionState(20 * kMss,
+                                                                10 * kMss);
+  state.bytes_in_flight = 16 * kMss;
+  EXPECT_EQ(8 * kMss, reno.OnLoss(state, 0, false));
+  state.bytes_in_flight = kMss;
+  EXPECT_EQ(2 * kMss, reno.OnLoss(state, 0, true));
+}
+
+TEST(CubicCongestionControlTest, TestSlowStart) {
+  CubicCongestionControl cubic;
+  PseudoTcpCongestionControl::State state = MakeCongestionState(2 * kMss,
+                                                                10 * kMss);
+  EXPECT_EQ(3 * kMss, cubic.OnAck(state, kMss, 0));
+}
+
+TEST(CubicCongestionControlTest, TestLossReducesBy30Percent) {
+  CubicCongestionControl cubic;
+  PseudoTcpCongestionControl::State state = MakeCongestionState(100 * kMss,
+                                                                50 * kMss);
+  EXPECT_EQ(70 * kMss, cubic.OnLoss(state, 0, false));
+  // The reduction is taken from the flight size if that is smaller.
+  state.bytes_in_flight = 50 * kMss;
+  EXPECT_EQ(35 * kMss, cubic.OnLoss(state, 0, false));
+}
+
+// After a loss the window should get back to where it was after K seconds,
+// growing slowly around that point and faster beyond it.
+TEST(CubicCongestionControlTest, TestRecoversToWindowBeforeLoss) {
+  CubicCongestionControl cubic;
+  PseudoTcpCongestionControl::State state = MakeCongestionState(100 * kMss,
+                                                                50 * kMss);
+  state.ssthresh = cubic.OnLoss(state, 0, false);
+  state.cwnd = state.ssthresh;
+  state.bytes_in_flight = state.cwnd;
+
+  // K = cbrt(100 * (1 - 0.7) / 0.4), about 4.2 seconds.
+  uint32 now = 0;
+  uint32 cwnd = AckWindowsUntil(&cubic, &state, &now, 2000);
+  EXPECT_GT(cwnd, 85 * kMss);
+  EXPECT_LT(cwnd, 100 * kMss);
+  cwnd = AckWindowsUntil(&cubic, &state, &now, 4200);
+  EXPECT_GT(cwnd, 97 * kMss);
+  EXPECT_LT(cwnd, 103 * kMss);
+  cwnd = AckWindowsUntil(&cubic, &state, &now, 8000);
+  EXPECT_GT(cwnd, 115 * kMss);
+}
+
+// When windows keep shrinking, the window to get back to is lowered further.
+// The windows are large enough that growing like Reno would be slower.
+TEST(CubicCongestionControlTest, TestFastConvergence) {
+  CubicCongestionControl cubic;
+  PseudoTcpCongestionControl::State state = MakeCongestionState(1000 * kMss,
+                                                                50 * kMss);
+  cubic.OnLoss(state, 0, false);
+  state.cwnd = state.bytes_in_flight = 800 * kMss;
+  state.ssthresh = cubic.OnLoss(state, 0, false);
+  EXPECT_EQ(560 * kMss, state.ssthresh);
+  state.cwnd = state.bytes_in_flight = state.ssthresh;
+
+  // Instead of 800 segments, the window gets back to 800 * 1.7 / 2 = 680
+  // segments after K = cbrt(120 / 0.4) seconds, about 6.7 seconds.
+  uint32 now = 0;
+  uint32 cwnd = AckWindowsUntil(&cubic, &state, &now, 6700);
+  EXPECT_GT(cwnd, 670 * kMss);
+  EXPECT_LT(cwnd, 690 * kMss);
+}
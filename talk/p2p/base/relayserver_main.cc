@@ -27,6 +27,7 @@
 
 #include <iostream>  // NOLINT
 
+#include "talk/base/physicalsocketserver.h"
 #include "talk/base/thread.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/p2p/base/relayserver.h"
@@ -50,6 +51,10 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  // A relay holds many sockets; use the backend that scales with them.
+  talk_base::PhysicalSocketServer ss(
+      talk_base::PhysicalSocketServer::BACKEND_EPOLL);
+  talk_base::SocketServerScope ss_scope(&ss);
   talk_base::Thread *pthMain = talk_base::Thread::Current();
 
   talk_base::scoped_ptr<talk_base::AsyncUDPSocket> int_socket(
@@ -68,6 +73,9 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  int_socket->EnableBatching();
+  ext_socket->EnableBatching();
+
   cricket::RelayServer server(pthMain);
   server.AddInternalSocket(int_socket.get());
   server.AddExternalSocket(ext_socket.get());
@@ -27,7 +27,15 @@
 
 #include "talk/p2p/base/stun.h"
 
+#if defined(WIN32)
+#include "talk/base/win32.h"
+#elif defined(POSIX)
+#include <pthread.h>
+#endif
+
 #include <cstring>
+#include <map>
+#include <new>
 
 #include "talk/base/byteorder.h"
 #include "talk/base/common.h"
@@ -56,22 +64,214 @@ const char TURN_MAGIC_COOKIE_VALUE[] = { '\x72', '\xC6', '\x4B', '\xC6' };
 const char EMPTY_TRANSACTION_ID[] = "0000000000000000";
 const uint32 STUN_FINGERPRINT_XOR_VALUE = 0x5354554E;
 
+// Caches the HMAC contexts of the most recently used keys. ICE checks and
+// TURN requests use the same few passwords for every message, so this saves
+// hashing the padded key for each of them. Each thread has a cache of its own,
+// see CurrentHmacCache().
+class StunHmacCache {
+ public:
+  StunHmacCache() : uses_(0) {}
+  ~StunHmacCache() {
+    for (ContextMap::iterator it = contexts_.begin();
+         it != contexts_.end(); ++it) {
+      delete it->second.context;
+    }
+  }
+
+  // Computes the HMAC-SHA1 of |header| followed by |body| under |key|.
+  size_t ComputeHmac(const char* key, size_t key_len,
+                     const char* header, size_t header_len,
+                     const char* body, size_t body_len,
+                     char* hmac, size_t hmac_len) {
+    talk_base::HmacContext* context = GetContext(std::string(key, key_len));
+    if (!context) {
+      // The digest can't copy its state; hash the key for every message.
+      std::string input(header, header_len);
+      if (body_len > 0) {
+        input.append(body, body_len);
+      }
+      return talk_base::ComputeHmac(talk_base::DIGEST_SHA_1, key, key_len,
+                                    input.data(), input.size(),
+                                    hmac, hmac_len);
+    }
+    context->Update(header, header_len);
+    context->Update(body, body_len);
+    return context->Finish(hmac, hmac_len);
+  }
+
+ private:
+  struct Entry {
+    talk_base::HmacContext* context;
+    uint32 last_use;
+  };
+  typedef std::map<std::string, Entry> ContextMap;
+
+  static const size_t kMaxContexts = 64;
+
+  talk_base::HmacContext* GetContext(const std::string& key) {
+    ContextMap::iterator it = contexts_.find(key);
+    if (it == contexts_.end()) {
+      talk_base::HmacContext* context = talk_base::HmacContext::Create(
+          talk_base::DIGEST_SHA_1, key.data(), key.size());
+      if (!context) {
+        return NULL;
+      }
+      if (contexts_.size() >= kMaxContexts) {
+        // Evict the least recently used key.
+        ContextMap::iterator oldest = contexts_.begin();
+        for (ContextMap::iterator i = contexts_.begin();
+             i != contexts_.end(); ++i) {
+          if (uses_ - i->second.last_use > uses_ - oldest->second.last_use) {
+            oldest = i;
+          }
+        }
+        delete oldest->second.context;
+        contexts_.erase(oldest);
+      }
+      Entry entry = { context, 0 };
+      it = contexts_.insert(std::make_pair(key, entry)).first;
+    }
+    it->second.last_use = ++uses_;
+    return it->second.context;
+  }
+
+  ContextMap contexts_;
+  uint32 uses_;
+
+  DISALLOW_COPY_AND_ASSIGN(StunHmacCache);
+};
+
+// Hands out the cache of the calling thread, which goes away with the thread.
+// Threads that handle messages in parallel, e.g. those of a
+// ShardedTurnServer, thus neither share contexts nor wait for each other.
+class StunHmacCaches {
+ public:
+  StunHmacCaches() {
+#if defined(WIN32)
+    key_ = FlsAlloc(&StunHmacCaches::DeleteCache);
+#elif defined(POSIX)
+    pthread_key_create(&key_, &StunHmacCaches::DeleteCache);
+#endif
+  }
+
+  StunHmacCache* Get() {
+#if defined(WIN32)
+    StunHmacCache* cache = static_cast<StunHmacCache*>(FlsGetValue(key_));
+#elif defined(POSIX)
+    StunHmacCache* cache =
+        static_cast<StunHmacCache*>(pthread_getspecific(key_));
+#endif
+    if (!cache) {
+      cache = new StunHmacCache();
+#if defined(WIN32)
+      FlsSetValue(key_, cache);
+#elif defined(POSIX)
+      pthread_setspecific(key_, cache);
+#endif
+    }
+    return cache;
+  }
+
+ private:
+#if defined(WIN32)
+  static void WINAPI DeleteCache(void* cache) {
+#elif defined(POSIX)
+  static void DeleteCache(void* cache) {
+#endif
+    delete static_cast<StunHmacCache*>(cache);
+  }
+
+#if defined(WIN32)
+  DWORD key_;
+#elif defined(POSIX)
+  pthread_key_t key_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(StunHmacCaches);
+};
+
+static StunHmacCache* CurrentHmacCache() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(StunHmacCaches, caches, ());
+  return caches.Get();
+}
+
+// StunArena
+
+struct StunArena::Block {
+  Block* prev;
+  size_t size;
+  // Keeps the data that follows aligned.
+  uint64 align;
+};
+
+// Attribute classes need no more than pointer or 64-bit alignment.
+static const size_t kStunArenaAlignment = 8;
+
+StunArena::StunArena() : blocks_(NULL), used_(0) {
+}
+
+StunArena::~StunArena() {
+  Reset();
+}
+
+void* StunArena::Allocate(size_t size) {
+  size = (size + kStunArenaAlignment - 1) & ~(kStunArenaAlignment - 1);
+  size_t capacity = blocks_ ? blocks_->size : kInlineSize;
+  if (used_ + size > capacity) {
+    size_t block_size = talk_base::_max(size, kBlockSize);
+    Block* block = static_cast<Block*>(
+        ::operator new(sizeof(Block) + block_size));
+    block->prev = blocks_;
+    block->size = block_size;
+    blocks_ = block;
+    used_ = 0;
+  }
+  char* base = blocks_ ? reinterpret_cast<char*>(blocks_ + 1) :
+      inline_.bytes_;
+  void* p = base + used_;
+  used_ += size;
+  return p;
+}
+
+void StunArena::Reset() {
+  while (blocks_) {
+    Block* prev = blocks_->prev;
+    ::operator delete(blocks_);
+    blocks_ = prev;
+  }
+  used_ = 0;
+}
+
 // StunMessage
 
 StunMessage::StunMessage()
     : type_(0),
       length_(0),
-      transaction_id_(EMPTY_TRANSACTION_ID) {
+      transaction_id_(EMPTY_TRANSACTION_ID),
+      view_attrs_(NULL),
+      view_attr_count_(0),
+      attrs_(NULL) {
   ASSERT(IsValidTransactionId(transaction_id_));
-  attrs_ = new std::vector<StunAttribute*>();
 }
 
 StunMessage::~StunMessage() {
-  for (size_t i = 0; i < attrs_->size(); i++)
-    delete (*attrs_)[i];
+  ClearAttributes();
   delete attrs_;
 }
 
+void StunMessage::ClearAttributes() {
+  for (size_t i = 0; i < view_attr_count_; ++i)
+    view_attrs_[i]->~StunAttribute();
+  view_attrs_ = NULL;
+  view_attr_count_ = 0;
+  arena_.Reset();
+  if (attrs_) {
+    for (size_t i = 0; i < attrs_->size(); ++i)
+      delete (*attrs_)[i];
+    attrs_->clear();
+  }
+}
+
 bool StunMessage::IsLegacy() const {
   if (transaction_id_.size() == kStunLegacyTransactionIdLength)
     return true;
@@ -92,6 +292,8 @@ bool StunMessage::AddAttribute(StunAttribute* attr) {
   if (attr->value_type() != GetAttributeValueType(attr->type())) {
     return false;
   }
+  if (!attrs_)
+    attrs_ = new std::vector<StunAttribute*>();
   attrs_->push_back(attr);
   attr->SetOwner(this);
   size_t attr_length = attr->length();
@@ -186,10 +388,11 @@ bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
     return false;
   }
 
-  // Getting length of the message to calculate Message Integrity.
+  // Getting length of the message to calculate Message Integrity. Only the
+  // header may need to be changed, so only it is copied.
   size_t mi_pos = current_pos;
-  talk_base::scoped_array<char> temp_data(new char[current_pos]);
-  memcpy(temp_data.get(), data, current_pos);
+  char temp_header[kStunHeaderSize];
+  memcpy(temp_header, data, kStunHeaderSize);
   if (size > mi_pos + kStunAttributeHeaderSize + kStunMessageIntegritySize) {
     // Stun message has other attributes after message integrity.
     // Adjust the length parameter in stun message to calculate HMAC.
@@ -203,15 +406,17 @@ bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
     //     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
     //     |0 0|     STUN Message Type     |         Message Length        |
     //     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    talk_base::SetBE16(temp_data.get() + 2,
+    talk_base::SetBE16(temp_header + 2,
                        static_cast<uint16>(new_adjusted_len));
   }
 
   char hmac[kStunMessageIntegritySize];
-  size_t ret = talk_base::ComputeHmac(talk_base::DIGEST_SHA_1,
-                                      password.c_str(), password.size(),
-                                      temp_data.get(), mi_pos,
-                                      hmac, sizeof(hmac));
+  size_t ret = CurrentHmacCache()->ComputeHmac(password.c_str(),
+                                              password.size(),
+                                              temp_header, kStunHeaderSize,
+                                              data + kStunHeaderSize,
+                                              mi_pos - kStunHeaderSize,
+                                              hmac, sizeof(hmac));
   ASSERT(ret == sizeof(hmac));
   if (ret != sizeof(hmac))
     return false;
@@ -242,10 +447,9 @@ bool StunMessage::AddMessageIntegrity(const char* key,
   int msg_len_for_hmac = static_cast<int>(
       buf.Length() - kStunAttributeHeaderSize - msg_integrity_attr->length());
   char hmac[kStunMessageIntegritySize];
-  size_t ret = talk_base::ComputeHmac(talk_base::DIGEST_SHA_1,
-                                      key, keylen,
-                                      buf.Data(), msg_len_for_hmac,
-                                      hmac, sizeof(hmac));
+  size_t ret = CurrentHmacCache()->ComputeHmac(key, keylen,
+                                              buf.Data(), msg_len_for_hmac,
+                                              NULL, 0, hmac, sizeof(hmac));
   ASSERT(ret == sizeof(hmac));
   if (ret != sizeof(hmac)) {
     LOG(LS_ERROR) << "HMAC computation failed. Message-Integrity "
@@ -310,6 +514,18 @@ bool StunMessage::AddFingerprint() {
 }
 
 bool StunMessage::Read(ByteBuffer* buf) {
+  return ReadInternal(buf, false);
+}
+
+bool StunMessage::ReadView(const char* data, size_t size) {
+  ByteBuffer buf(data, size, ByteBuffer::ORDER_NETWORK,
+                 ByteBuffer::STORAGE_VIEW);
+  return ReadInternal(&buf, true);
+}
+
+bool StunMessage::ReadInternal(ByteBuffer* buf, bool view) {
+  ClearAttributes();
+
   if (!buf->ReadUInt16(&type_))
     return false;
 
@@ -322,28 +538,39 @@ bool StunMessage::Read(ByteBuffer* buf) {
   if (!buf->ReadUInt16(&length_))
     return false;
 
-  std::string magic_cookie;
-  if (!buf->ReadString(&magic_cookie, kStunMagicCookieLength))
+  char transaction_id[kStunLegacyTransactionIdLength];
+  if (!buf->ReadBytes(transaction_id,
+                      kStunMagicCookieLength + kStunTransactionIdLength))
     return false;
 
-  std::string transaction_id;
-  if (!buf->ReadString(&transaction_id, kStunTransactionIdLength))
-    return false;
-
-  uint32 magic_cookie_int =
-      *reinterpret_cast<const uint32*>(magic_cookie.data());
-  if (talk_base::NetworkToHost32(magic_cookie_int) != kStunMagicCookie) {
+  if (talk_base::GetBE32(transaction_id) != kStunMagicCookie) {
     // If magic cookie is invalid it means that the peer implements
     // RFC3489 instead of RFC5389.
-    transaction_id.insert(0, magic_cookie);
+    transaction_id_.assign(transaction_id, kStunLegacyTransactionIdLength);
+  } else {
+    transaction_id_.assign(transaction_id + kStunMagicCookieLength,
+                           kStunTransactionIdLength);
   }
-  ASSERT(IsValidTransactionId(transaction_id));
-  transaction_id_ = transaction_id;
+  ASSERT(IsValidTransactionId(transaction_id_));
 
   if (length_ != buf->Length())
     return false;
 
-  attrs_->resize(0);
+  size_t view_attr_capacity = 0;
+  if (view) {
+    // Count the attributes, so that the array of them can go in the arena
+    // as well. The loop below validates the lengths.
+    const char* data = buf->Data();
+    for (size_t pos = 0; pos + kStunAttributeHeaderSize <= length_;
+         ++view_attr_capacity) {
+      size_t attr_length = talk_base::GetBE16(data + pos + 2);
+      pos += kStunAttributeHeaderSize + ((attr_length + 3) & ~3);
+    }
+    view_attrs_ = static_cast<StunAttribute**>(
+        arena_.Allocate(view_attr_capacity * sizeof(StunAttribute*)));
+  } else if (!attrs_) {
+    attrs_ = new std::vector<StunAttribute*>();
+  }
 
   size_t rest = buf->Length() - length_;
   while (buf->Length() > rest) {
@@ -352,8 +579,14 @@ bool StunMessage::Read(ByteBuffer* buf) {
       return false;
     if (!buf->ReadUInt16(&attr_length))
       return false;
+    // Counting above only holds if every attribute takes up the space it
+    // declares, which is checked below.
+    if (view && view_attr_count_ == view_attr_capacity)
+      return false;
 
-    StunAttribute* attr = CreateAttribute(attr_type, attr_length);
+    size_t start = buf->Length();
+    StunAttribute* attr = CreateAttribute(attr_type, attr_length,
+                                          view ? &arena_ : NULL);
     if (!attr) {
       // Skip any unknown or malformed attributes.
       if ((attr_length % 4) != 0) {
@@ -361,11 +594,19 @@ bool StunMessage::Read(ByteBuffer* buf) {
       }
       if (!buf->Consume(attr_length))
         return false;
+    } else if (view) {
+      view_attrs_[view_attr_count_++] = attr;
+      if (!attr->ReadView(buf))
+        return false;
     } else {
+      attrs_->push_back(attr);
       if (!attr->Read(buf))
         return false;
-      attrs_->push_back(attr);
     }
+    // Fixed-size attributes read only their own size, whatever length they
+    // declare; such a mismatch would put the next attribute out of place.
+    if (start - buf->Length() != ((attr_length + 3u) & ~3u))
+      return false;
   }
 
   ASSERT(buf->Length() == rest);
@@ -379,10 +620,13 @@ bool StunMessage::Write(ByteBuffer* buf) const {
     buf->WriteUInt32(kStunMagicCookie);
   buf->WriteString(transaction_id_);
 
-  for (size_t i = 0; i < attrs_->size(); ++i) {
-    buf->WriteUInt16((*attrs_)[i]->type());
-    buf->WriteUInt16(static_cast<uint16>((*attrs_)[i]->length()));
-    if (!(*attrs_)[i]->Write(buf))
+  size_t count = view_attr_count_ + (attrs_ ? attrs_->size() : 0);
+  for (size_t i = 0; i < count; ++i) {
+    const StunAttribute* attr = (i < view_attr_count_) ?
+        view_attrs_[i] : (*attrs_)[i - view_attr_count_];
+    buf->WriteUInt16(attr->type());
+    buf->WriteUInt16(static_cast<uint16>(attr->length()));
+    if (!attr->Write(buf))
       return false;
   }
 
@@ -407,16 +651,23 @@ StunAttributeValueType StunMessage::GetAttributeValueType(int type) const {
   }
 }
 
-StunAttribute* StunMessage::CreateAttribute(int type, size_t length) /*const*/ {
+StunAttribute* StunMessage::CreateAttribute(int type, size_t length,
+                                            StunArena* arena) /*const*/ {
   StunAttributeValueType value_type = GetAttributeValueType(type);
   return StunAttribute::Create(value_type, type,
-                               static_cast<uint16>(length), this);
+                               static_cast<uint16>(length), this, arena);
 }
 
 const StunAttribute* StunMessage::GetAttribute(int type) const {
-  for (size_t i = 0; i < attrs_->size(); ++i) {
-    if ((*attrs_)[i]->type() == type)
-      return (*attrs_)[i];
+  for (size_t i = 0; i < view_attr_count_; ++i) {
+    if (view_attrs_[i]->type() == type)
+      return view_attrs_[i];
+  }
+  if (attrs_) {
+    for (size_t i = 0; i < attrs_->size(); ++i) {
+      if ((*attrs_)[i]->type() == type)
+        return (*attrs_)[i];
+    }
   }
   return NULL;
 }
@@ -450,21 +701,39 @@ void StunAttribute::WritePadding(talk_base::ByteBuffer* buf) const {
 StunAttribute* StunAttribute::Create(StunAttributeValueType value_type,
                                      uint16 type, uint16 length,
                                      StunMessage* owner) {
+  return Create(value_type, type, length, owner, NULL);
+}
+
+// Gets the memory for an attribute from |arena|, or from the heap if NULL.
+static void* AllocateAttribute(size_t size, StunArena* arena) {
+  return arena ? arena->Allocate(size) : ::operator new(size);
+}
+
+StunAttribute* StunAttribute::Create(StunAttributeValueType value_type,
+                                     uint16 type, uint16 length,
+                                     StunMessage* owner, StunArena* arena) {
   switch (value_type) {
     case STUN_VALUE_ADDRESS:
-      return new StunAddressAttribute(type, length);
+      return new(AllocateAttribute(sizeof(StunAddressAttribute), arena))
+          StunAddressAttribute(type, length);
     case STUN_VALUE_XOR_ADDRESS:
-      return new StunXorAddressAttribute(type, length, owner);
+      return new(AllocateAttribute(sizeof(StunXorAddressAttribute), arena))
+          StunXorAddressAttribute(type, length, owner);
     case STUN_VALUE_UINT32:
-      return new StunUInt32Attribute(type);
+      return new(AllocateAttribute(sizeof(StunUInt32Attribute), arena))
+          StunUInt32Attribute(type);
     case STUN_VALUE_UINT64:
-      return new StunUInt64Attribute(type);
+      return new(AllocateAttribute(sizeof(StunUInt64Attribute), arena))
+          StunUInt64Attribute(type);
     case STUN_VALUE_BYTE_STRING:
-      return new StunByteStringAttribute(type, length);
+      return new(AllocateAttribute(sizeof(StunByteStringAttribute), arena))
+          StunByteStringAttribute(type, length);
     case STUN_VALUE_ERROR_CODE:
-      return new StunErrorCodeAttribute(type, length);
+      return new(AllocateAttribute(sizeof(StunErrorCodeAttribute), arena))
+          StunErrorCodeAttribute(type, length);
     case STUN_VALUE_UINT16_LIST:
-      return new StunUInt16ListAttribute(type, length);
+      return new(AllocateAttribute(sizeof(StunUInt16ListAttribute), arena))
+          StunUInt16ListAttribute(type, length);
     default:
       return NULL;
   }
@@ -704,28 +973,29 @@ bool StunUInt64Attribute::Write(ByteBuffer* buf) const {
 }
 
 StunByteStringAttribute::StunByteStringAttribute(uint16 type)
-    : StunAttribute(type, 0), bytes_(NULL) {
+    : StunAttribute(type, 0), bytes_(NULL), owned_(true) {
 }
 
 StunByteStringAttribute::StunByteStringAttribute(uint16 type,
                                                  const std::string& str)
-    : StunAttribute(type, 0), bytes_(NULL) {
+    : StunAttribute(type, 0), bytes_(NULL), owned_(true) {
   CopyBytes(str.c_str(), str.size());
 }
 
 StunByteStringAttribute::StunByteStringAttribute(uint16 type,
                                                  const void* bytes,
                                                  size_t length)
-    : StunAttribute(type, 0), bytes_(NULL) {
+    : StunAttribute(type, 0), bytes_(NULL), owned_(true) {
   CopyBytes(bytes, length);
 }
 
 StunByteStringAttribute::StunByteStringAttribute(uint16 type, uint16 length)
-    : StunAttribute(type, length), bytes_(NULL) {
+    : StunAttribute(type, length), bytes_(NULL), owned_(true) {
 }
 
 StunByteStringAttribute::~StunByteStringAttribute() {
-  delete [] bytes_;
+  if (owned_)
+    delete [] bytes_;
 }
 
 void StunByteStringAttribute::CopyBytes(const char* bytes) {
@@ -735,7 +1005,7 @@ void StunByteStringAttribute::CopyBytes(const char* bytes) {
 void StunByteStringAttribute::CopyBytes(const void* bytes, size_t length) {
   char* new_bytes = new char[length];
   std::memcpy(new_bytes, bytes, length);
-  SetBytes(new_bytes, length);
+  SetBytes(new_bytes, length, true);
 }
 
 uint8 StunByteStringAttribute::GetByte(size_t index) const {
@@ -747,11 +1017,13 @@ uint8 StunByteStringAttribute::GetByte(size_t index) const {
 void StunByteStringAttribute::SetByte(size_t index, uint8 value) {
   ASSERT(bytes_ != NULL);
   ASSERT(index < length());
+  if (!owned_)
+    CopyBytes(bytes_, length());
   bytes_[index] = value;
 }
 
 bool StunByteStringAttribute::Read(ByteBuffer* buf) {
-  bytes_ = new char[length()];
+  SetBytes(new char[length()], length(), true);
   if (!buf->ReadBytes(bytes_, length())) {
     return false;
   }
@@ -760,15 +1032,29 @@ bool StunByteStringAttribute::Read(ByteBuffer* buf) {
   return true;
 }
 
+bool StunByteStringAttribute::ReadView(ByteBuffer* buf) {
+  if (buf->Length() < length()) {
+    return false;
+  }
+  SetBytes(const_cast<char*>(buf->Data()), length(), false);
+  buf->Consume(length());
+
+  ConsumePadding(buf);
+  return true;
+}
+
 bool StunByteStringAttribute::Write(ByteBuffer* buf) const {
   buf->WriteBytes(bytes_, length());
   WritePadding(buf);
   return true;
 }
 
-void StunByteStringAttribute::SetBytes(char* bytes, size_t length) {
-  delete [] bytes_;
+void StunByteStringAttribute::SetBytes(char* bytes, size_t length,
+                                       bool owned) {
+  if (owned_)
+    delete [] bytes_;
   bytes_ = bytes;
+  owned_ = owned;
   SetLength(static_cast<uint16>(length));
 }
 
@@ -36,6 +36,7 @@
 
 #include "talk/base/basictypes.h"
 #include "talk/base/bytebuffer.h"
+#include "talk/base/constructormagic.h"
 #include "talk/base/socketaddress.h"
 
 namespace cricket {
@@ -140,6 +141,39 @@ class StunByteStringAttribute;
 class StunErrorCodeAttribute;
 class StunUInt16ListAttribute;
 
+// A bump allocator for the attributes of a message read with
+// StunMessage::ReadView(). The first kInlineSize bytes are part of the
+// arena itself, so typical messages need no heap allocation; larger ones
+// spill into heap blocks. Allocate() doesn't construct anything, and
+// Reset() doesn't destroy anything; that is up to the caller.
+class StunArena {
+ public:
+  StunArena();
+  ~StunArena();
+
+  // Returns |size| bytes, aligned for any attribute class.
+  void* Allocate(size_t size);
+  // Frees everything that was allocated.
+  void Reset();
+
+ private:
+  struct Block;
+
+  static const size_t kInlineSize = 512;
+  static const size_t kBlockSize = 1024;
+
+  union {
+    char bytes_[kInlineSize];
+    uint64 align_;
+    void* align_ptr_;
+  } inline_;
+  // The block being allocated from; NULL while in |inline_|.
+  Block* blocks_;
+  size_t used_;
+
+  DISALLOW_COPY_AND_ASSIGN(StunArena);
+};
+
 // Records a complete STUN/TURN message.  Each message consists of a type and
 // any number of attributes.  Each attribute is parsed into an instance of an
 // appropriate class (see above).  The Get* methods will return instances of
@@ -197,6 +231,13 @@ class StunMessage {
   // return value indicates whether this was successful.
   bool Read(talk_base::ByteBuffer* buf);
 
+  // Like Read(), but parses |data| in place: byte string attributes point
+  // into |data| rather than holding copies, and all attributes are built in
+  // an arena inside the message, so that a typical message is parsed
+  // without any heap allocation. |data| must outlive the attributes read
+  // from it; modifying one of them makes it copy its bytes.
+  bool ReadView(const char* data, size_t size);
+
   // Writes this object into a STUN packet. The return value indicates whether
   // this was successful.
   bool Write(talk_base::ByteBuffer* buf) const;
@@ -209,14 +250,26 @@ class StunMessage {
   virtual StunAttributeValueType GetAttributeValueType(int type) const;
 
  private:
-  StunAttribute* CreateAttribute(int type, size_t length) /* const*/;
+  StunAttribute* CreateAttribute(int type, size_t length,
+                                 StunArena* arena) /* const*/;
   const StunAttribute* GetAttribute(int type) const;
   static bool IsValidTransactionId(const std::string& transaction_id);
 
+  bool ReadInternal(talk_base::ByteBuffer* buf, bool view);
+  // Deletes all attributes, and resets the arena.
+  void ClearAttributes();
+
   uint16 type_;
   uint16 length_;
   std::string transaction_id_;
+  // Attributes read by ReadView(), which live in |arena_|. Any attributes
+  // added later go into |attrs_|, which is only allocated when needed.
+  StunAttribute** view_attrs_;
+  size_t view_attr_count_;
   std::vector<StunAttribute*>* attrs_;
+  StunArena arena_;
+
+  DISALLOW_COPY_AND_ASSIGN(StunMessage);
 };
 
 // Base class for all STUN/TURN attributes.
@@ -238,6 +291,10 @@ class StunAttribute {
   // the given buffer.  Return value is true if successful.
   virtual bool Read(talk_base::ByteBuffer* buf) = 0;
 
+  // Like Read(), but may refer to the data of |buf| rather than copy it,
+  // in which case that data must outlive the attribute.
+  virtual bool ReadView(talk_base::ByteBuffer* buf) { return Read(buf); }
+
   // Writes the body (not the type or length) to the given buffer.  Return
   // value is true if successful.
   virtual bool Write(talk_base::ByteBuffer* buf) const = 0;
@@ -245,6 +302,11 @@ class StunAttribute {
   // Creates an attribute object with the given type and smallest length.
   static StunAttribute* Create(StunAttributeValueType value_type, uint16 type,
                                uint16 length, StunMessage* owner);
+  // As above, but builds the attribute in |arena|. It then has to be
+  // destroyed with its destructor rather than deleted.
+  static StunAttribute* Create(StunAttributeValueType value_type, uint16 type,
+                               uint16 length, StunMessage* owner,
+                               StunArena* arena);
   // TODO: Allow these create functions to take parameters, to reduce
   // the amount of work callers need to do to initialize attributes.
   static StunAddressAttribute* CreateAddress(uint16 type);
@@ -416,12 +478,16 @@ class StunByteStringAttribute : public StunAttribute {
   void SetByte(size_t index, uint8 value);
 
   virtual bool Read(talk_base::ByteBuffer* buf);
+  virtual bool ReadView(talk_base::ByteBuffer* buf);
   virtual bool Write(talk_base::ByteBuffer* buf) const;
 
  private:
-  void SetBytes(char* bytes, size_t length);
+  void SetBytes(char* bytes, size_t length, bool owned);
 
+  // Points into the packet, rather than to our own copy, if |owned_| is
+  // false.
   char* bytes_;
+  bool owned_;
 };
 
 // Implements STUN attributes that record an error code.
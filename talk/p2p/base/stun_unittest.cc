@@ -25,16 +25,46 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <cstdlib>
+#include <new>
 #include <string>
 
 #include "talk/base/bytebuffer.h"
+#include "talk/base/byteorder.h"
+#include "talk/base/crc32.h"
 #include "talk/base/gunit.h"
 #include "talk/base/logging.h"
 #include "talk/base/messagedigest.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socketaddress.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/p2p/base/stun.h"
 
+// Counts heap allocations, for the ReadViewPerf test.
+static int stun_test_allocations = 0;
+
+#if __cplusplus >= 201103L
+void* operator new(size_t size) {
+#else
+void* operator new(size_t size) throw(std::bad_alloc) {
+#endif
+  ++stun_test_allocations;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+#if __cplusplus >= 201103L
+void operator delete(void* p) noexcept {
+#else
+void operator delete(void* p) throw() {
+#endif
+  free(p);
+}
+
 namespace cricket {
 
 class StunTest : public ::testing::Test {
@@ -280,6 +310,25 @@ static const unsigned char kStunMessageWithSmallLength[] = {
   0x21, 0x12, 0xA4, 0x53,
 };
 
+// Binding request whose first PRIORITY attribute declares far more than the
+// 4 bytes it holds, followed by more PRIORITY attributes. Counting attributes
+// by their declared lengths finds one; reading them by size finds four.
+static const unsigned char kStunMessageWithOverlongUInt32Attribute[] = {
+  0x00, 0x01, 0x00, 0x20,  // binding request, length 32
+  0x21, 0x12, 0xA4, 0x42,  // magic cookie
+  '0', '1', '2', '3',      // transaction id
+  '4', '5', '6', '7',
+  '8', '9', 'a', 'b',
+  0x00, 0x24, 0xFF, 0xF0,  // priority, declared length 0xFFF0
+  0x6e, 0x00, 0x01, 0xff,
+  0x00, 0x24, 0x00, 0x04,  // priority
+  0x6e, 0x00, 0x01, 0xff,
+  0x00, 0x24, 0x00, 0x04,  // priority
+  0x6e, 0x00, 0x01, 0xff,
+  0x00, 0x24, 0x00, 0x04,  // priority
+  0x6e, 0x00, 0x01, 0xff,
+};
+
 // RTCP packet, for testing we correctly ignore non stun packet types.
 // V=2, P=false, RC=0, Type=200, Len=6, Sender-SSRC=85, etc
 static const unsigned char kRtcpPacket[] = {
@@ -1140,6 +1189,8 @@ void CheckFailureToRead(const unsigned char* testcase, size_t length) {
   const char* input = reinterpret_cast<const char*>(testcase);
   talk_base::ByteBuffer buf(input, length);
   ASSERT_FALSE(msg.Read(&buf));
+  StunMessage view_msg;
+  ASSERT_FALSE(view_msg.ReadView(input, length));
 }
 
 TEST_F(StunTest, FailToReadInvalidMessages) {
@@ -1151,6 +1202,12 @@ TEST_F(StunTest, FailToReadInvalidMessages) {
                      kRealLengthOfInvalidLengthTestCases);
 }
 
+// Test that an attribute must take up exactly the length it declares.
+TEST_F(StunTest, FailToReadAttributeWithWrongLength) {
+  CheckFailureToRead(kStunMessageWithOverlongUInt32Attribute,
+                     sizeof(kStunMessageWithOverlongUInt32Attribute));
+}
+
 // Test that we properly fail to read a non-STUN message.
 TEST_F(StunTest, FailToReadRtcpPacket) {
   CheckFailureToRead(kRtcpPacket, sizeof(kRtcpPacket));
@@ -1266,6 +1323,47 @@ TEST_F(StunTest, AddMessageIntegrity) {
         kRfc5769SampleMsgPassword));
 }
 
+// Validates a message over and over, alternating between the right and a
+// wrong password so that the HMAC cache switches keys.
+class IntegrityChecker : public talk_base::Runnable {
+ public:
+  IntegrityChecker() : errors_(0) {}
+
+  virtual void Run(talk_base::Thread* thread) {
+    const char* data = reinterpret_cast<const char*>(kRfc5769SampleRequest);
+    for (int i = 0; i < 1000; ++i) {
+      if (!StunMessage::ValidateMessageIntegrity(
+              data, sizeof(kRfc5769SampleRequest),
+              kRfc5769SampleMsgPassword)) {
+        ++errors_;
+      }
+      if (StunMessage::ValidateMessageIntegrity(
+              data, sizeof(kRfc5769SampleRequest), "wrong password")) {
+        ++errors_;
+      }
+    }
+  }
+
+  int errors() const { return errors_; }
+
+ private:
+  int errors_;
+};
+
+// Each thread computes HMACs with a cache of its own.
+TEST_F(StunTest, ValidateMessageIntegrityOnSeveralThreads) {
+  const int kThreads = 4;
+  talk_base::Thread threads[kThreads];
+  IntegrityChecker checkers[kThreads];
+  for (int i = 0; i < kThreads; ++i) {
+    threads[i].Start(&checkers[i]);
+  }
+  for (int i = 0; i < kThreads; ++i) {
+    threads[i].Stop();
+    EXPECT_EQ(0, checkers[i].errors());
+  }
+}
+
 // Check our STUN message validation code against the RFC5769 test messages.
 TEST_F(StunTest, ValidateFingerprint) {
   EXPECT_TRUE(StunMessage::ValidateFingerprint(
@@ -1317,6 +1415,77 @@ TEST_F(StunTest, AddFingerprint) {
       reinterpret_cast<const char*>(buf1.Data()), buf1.Length()));
 }
 
+// Measures adding and validating MESSAGE-INTEGRITY and FINGERPRINT, against
+// hashing the key for every message and computing the CRC bytewise, and the
+// CRC implementations on a packet-sized buffer.
+TEST_F(StunTest, IntegrityAndFingerprintPerf) {
+  const int kIterations = 20000;
+  talk_base::ByteBuffer out;
+  uint32 start = talk_base::Time();
+  for (int i = 0; i < kIterations; ++i) {
+    IceMessage msg;
+    talk_base::ByteBuffer buf(
+        reinterpret_cast<const char*>(kRfc5769SampleRequestWithoutMI),
+        sizeof(kRfc5769SampleRequestWithoutMI));
+    ASSERT_TRUE(msg.Read(&buf));
+    ASSERT_TRUE(msg.AddMessageIntegrity(kRfc5769SampleMsgPassword));
+    ASSERT_TRUE(msg.AddFingerprint());
+    out.Clear();
+    ASSERT_TRUE(msg.Write(&out));
+  }
+  uint32 encode_time = talk_base::TimeSince(start);
+
+  const char* data = out.Data();
+  size_t size = out.Length();
+  start = talk_base::Time();
+  for (int i = 0; i < kIterations; ++i) {
+    ASSERT_TRUE(StunMessage::ValidateMessageIntegrity(
+        data, size, kRfc5769SampleMsgPassword));
+    ASSERT_TRUE(StunMessage::ValidateFingerprint(data, size));
+  }
+  uint32 validate_time = talk_base::TimeSince(start);
+
+  // The same work as validating, the way it used to be done.
+  const std::string password(kRfc5769SampleMsgPassword);
+  ASSERT_TRUE(talk_base::SetCrc32ImplementationForTest(
+      talk_base::CRC32_BYTEWISE));
+  start = talk_base::Time();
+  char hmac[kStunMessageIntegritySize];
+  uint32 crc = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    talk_base::ComputeHmac(talk_base::DIGEST_SHA_1,
+                           password.data(), password.size(),
+                           data, size - 32, hmac, sizeof(hmac));
+    crc += talk_base::ComputeCrc32(data, size - 8);
+  }
+  uint32 uncached_time = talk_base::TimeSince(start);
+
+  std::string packet(1200, 'x');
+  const int kCrcIterations = 50000;
+  talk_base::Crc32Implementation impls[] = {
+    talk_base::CRC32_BYTEWISE, talk_base::CRC32_SLICE_BY_8,
+    talk_base::CRC32_PCLMUL
+  };
+  const char* names[] = { "bytewise", "slice-by-8", "pclmul" };
+  for (size_t i = 0; i < ARRAY_SIZE(impls); ++i) {
+    if (!talk_base::SetCrc32ImplementationForTest(impls[i])) {
+      continue;
+    }
+    start = talk_base::Time();
+    for (int j = 0; j < kCrcIterations; ++j) {
+      crc += talk_base::ComputeCrc32(packet.data(), packet.size());
+    }
+    LOG(LS_INFO) << kCrcIterations << " CRCs of " << packet.size()
+                 << " bytes, " << names[i] << ": "
+                 << talk_base::TimeSince(start) << " ms";
+  }
+
+  LOG(LS_INFO) << kIterations << " STUN messages of " << size
+               << " bytes: encode " << encode_time << " ms, validate "
+               << validate_time << " ms, uncached HMAC and bytewise CRC "
+               << uncached_time << " ms (" << crc << ")";
+}
+
 // Sample "GTURN" relay message.
 static const unsigned char kRelayMessage[] = {
   0x00, 0x01, 0x00, 88,    // message header
@@ -1465,4 +1634,192 @@ TEST_F(StunTest, ReadRelayMessage) {
   EXPECT_EQ(0, std::memcmp(outstring2.c_str(), input, len2));
 }
 
+// Checks that ReadView() parses |testcase| just like Read().
+static void CheckReadViewMatchesRead(StunMessage* msg, StunMessage* view_msg,
+                                     const unsigned char* testcase,
+                                     size_t size) {
+  const char* input = reinterpret_cast<const char*>(testcase);
+  talk_base::ByteBuffer buf(input, size);
+  ASSERT_TRUE(msg->Read(&buf));
+  ASSERT_TRUE(view_msg->ReadView(input, size));
+  EXPECT_EQ(msg->type(), view_msg->type());
+  EXPECT_EQ(msg->length(), view_msg->length());
+  EXPECT_EQ(msg->transaction_id(), view_msg->transaction_id());
+
+  talk_base::ByteBuffer out, view_out;
+  EXPECT_TRUE(msg->Write(&out));
+  EXPECT_TRUE(view_msg->Write(&view_out));
+  ASSERT_EQ(out.Length(), view_out.Length());
+  EXPECT_EQ(0, std::memcmp(out.Data(), view_out.Data(), out.Length()));
+}
+
+// Test that parsing in place gives the same messages as copying.
+TEST_F(StunTest, ReadViewMatchesRead) {
+  const unsigned char* testcases[] = {
+    kStunMessageWithIPv4MappedAddress, kStunMessageWithIPv6MappedAddress,
+    kStunMessageWithIPv4XorMappedAddress, kStunMessageWithIPv6XorMappedAddress,
+    kStunMessageWithByteStringAttribute, kStunMessageWithUnknownAttribute,
+    kStunMessageWithPaddedByteStringAttribute,
+    kStunMessageWithUInt16ListAttribute, kStunMessageWithErrorAttribute,
+    kRfc5769SampleRequest, kRfc5769SampleResponse, kRfc5769SampleResponseIPv6,
+    kRfc5769SampleRequestLongTermAuth,
+  };
+  const size_t sizes[] = {
+    sizeof(kStunMessageWithIPv4MappedAddress),
+    sizeof(kStunMessageWithIPv6MappedAddress),
+    sizeof(kStunMessageWithIPv4XorMappedAddress),
+    sizeof(kStunMessageWithIPv6XorMappedAddress),
+    sizeof(kStunMessageWithByteStringAttribute),
+    sizeof(kStunMessageWithUnknownAttribute),
+    sizeof(kStunMessageWithPaddedByteStringAttribute),
+    sizeof(kStunMessageWithUInt16ListAttribute),
+    sizeof(kStunMessageWithErrorAttribute),
+    sizeof(kRfc5769SampleRequest), sizeof(kRfc5769SampleResponse),
+    sizeof(kRfc5769SampleResponseIPv6),
+    sizeof(kRfc5769SampleRequestLongTermAuth),
+  };
+  for (size_t i = 0; i < ARRAY_SIZE(testcases); ++i) {
+    SCOPED_TRACE(i);
+    StunMessage msg, view_msg;
+    CheckReadViewMatchesRead(&msg, &view_msg, testcases[i], sizes[i]);
+  }
+
+  RelayMessage relay_msg, relay_view_msg;
+  CheckReadViewMatchesRead(&relay_msg, &relay_view_msg, kRelayMessage,
+                           sizeof(kRelayMessage));
+  const StunAddressAttribute* addr =
+      relay_view_msg.GetAddress(STUN_ATTR_DESTINATION_ADDRESS);
+  ASSERT_TRUE(addr != NULL);
+  EXPECT_EQ(13, addr->port());
+  const StunUInt32Attribute* uval = relay_view_msg.GetUInt32(STUN_ATTR_LIFETIME);
+  ASSERT_TRUE(uval != NULL);
+  EXPECT_EQ(11U, uval->value());
+}
+
+// Test that byte strings read in place point into the packet until they are
+// modified, and that the message can still be added to and reused.
+TEST_F(StunTest, ReadViewByteStrings) {
+  std::string packet(reinterpret_cast<const char*>(kRfc5769SampleRequest),
+                     sizeof(kRfc5769SampleRequest));
+  IceMessage msg;
+  ASSERT_TRUE(msg.ReadView(packet.data(), packet.size()));
+  CheckStunTransactionID(msg, kRfc5769SampleMsgTransactionId,
+                         kStunTransactionIdLength);
+
+  const StunByteStringAttribute* username =
+      msg.GetByteString(STUN_ATTR_USERNAME);
+  ASSERT_TRUE(username != NULL);
+  EXPECT_EQ(kRfc5769SampleMsgUsername, username->GetString());
+  EXPECT_GE(username->bytes(), packet.data());
+  EXPECT_LT(username->bytes(), packet.data() + packet.size());
+
+  // Modifying the attribute leaves the packet alone.
+  const char* software_bytes = msg.GetByteString(STUN_ATTR_SOFTWARE)->bytes();
+  StunByteStringAttribute* software = const_cast<StunByteStringAttribute*>(
+      msg.GetByteString(STUN_ATTR_SOFTWARE));
+  software->SetByte(0, 'X');
+  EXPECT_EQ('X', software->GetByte(0));
+  EXPECT_NE(software_bytes, software->bytes());
+  EXPECT_EQ('S', *software_bytes);
+
+  // Attributes added after reading come after the ones that were read.
+  EXPECT_TRUE(msg.AddAttribute(
+      new StunUInt32Attribute(STUN_ATTR_RETRANSMIT_COUNT, 3)));
+  ASSERT_TRUE(msg.GetUInt32(STUN_ATTR_RETRANSMIT_COUNT) != NULL);
+  talk_base::ByteBuffer out;
+  EXPECT_TRUE(msg.Write(&out));
+  ASSERT_EQ(packet.size() + 8, out.Length());
+  EXPECT_EQ(STUN_ATTR_RETRANSMIT_COUNT,
+            talk_base::GetBE16(out.Data() + packet.size()));
+  EXPECT_EQ(3U, talk_base::GetBE32(out.Data() + packet.size() + 4));
+
+  // Reading again replaces all of the attributes.
+  ASSERT_TRUE(msg.ReadView(
+      reinterpret_cast<const char*>(kRfc5769SampleResponse),
+      sizeof(kRfc5769SampleResponse)));
+  EXPECT_TRUE(msg.GetByteString(STUN_ATTR_USERNAME) == NULL);
+  EXPECT_TRUE(msg.GetUInt32(STUN_ATTR_RETRANSMIT_COUNT) == NULL);
+  ASSERT_TRUE(msg.GetAddress(STUN_ATTR_XOR_MAPPED_ADDRESS) != NULL);
+  EXPECT_EQ(kRfc5769SampleMsgMappedAddress,
+            msg.GetAddress(STUN_ATTR_XOR_MAPPED_ADDRESS)->GetAddress());
+}
+
+// Test a message whose attributes don't fit in the arena of the message.
+TEST_F(StunTest, ReadViewManyAttributes) {
+  StunMessage msg;
+  msg.SetType(STUN_BINDING_RESPONSE);
+  msg.SetTransactionID(std::string(
+      reinterpret_cast<const char*>(kRfc5769SampleMsgTransactionId),
+      kStunTransactionIdLength));
+  for (int i = 0; i < 40; ++i) {
+    StunXorAddressAttribute* addr =
+        StunAttribute::CreateXorAddress(STUN_ATTR_XOR_MAPPED_ADDRESS);
+    addr->SetAddress(talk_base::SocketAddress("1.2.3.4", 1000 + i));
+    EXPECT_TRUE(msg.AddAttribute(addr));
+    EXPECT_TRUE(msg.AddAttribute(new StunByteStringAttribute(
+        STUN_ATTR_SOFTWARE, std::string(i, 'a'))));
+  }
+  talk_base::ByteBuffer out;
+  ASSERT_TRUE(msg.Write(&out));
+
+  StunMessage view_msg;
+  ASSERT_TRUE(view_msg.ReadView(out.Data(), out.Length()));
+  EXPECT_EQ(1000, view_msg.GetAddress(STUN_ATTR_XOR_MAPPED_ADDRESS)->port());
+  talk_base::ByteBuffer view_out;
+  ASSERT_TRUE(view_msg.Write(&view_out));
+  ASSERT_EQ(out.Length(), view_out.Length());
+  EXPECT_EQ(0, std::memcmp(out.Data(), view_out.Data(), out.Length()));
+}
+
+// Compares the heap allocations and time taken to parse a typical ICE check
+// by copying and in place.
+TEST_F(StunTest, ReadViewPerf) {
+  const int kIterations = 100000;
+  IceMessage request;
+  request.SetType(STUN_BINDING_REQUEST);
+  request.SetTransactionID(std::string(
+      reinterpret_cast<const char*>(kRfc5769SampleMsgTransactionId),
+      kStunTransactionIdLength));
+  request.AddAttribute(new StunByteStringAttribute(
+      STUN_ATTR_USERNAME, kRfc5769SampleMsgUsername));
+  request.AddAttribute(new StunUInt32Attribute(STUN_ATTR_PRIORITY, 1));
+  request.AddAttribute(new StunUInt64Attribute(STUN_ATTR_ICE_CONTROLLING, 2));
+  request.AddAttribute(
+      new StunByteStringAttribute(STUN_ATTR_USE_CANDIDATE, NULL, 0));
+  ASSERT_TRUE(request.AddMessageIntegrity(kRfc5769SampleMsgPassword));
+  ASSERT_TRUE(request.AddFingerprint());
+  talk_base::ByteBuffer packet;
+  ASSERT_TRUE(request.Write(&packet));
+
+  int allocations = stun_test_allocations;
+  uint32 start = talk_base::Time();
+  for (int i = 0; i < kIterations; ++i) {
+    talk_base::scoped_ptr<IceMessage> msg(new IceMessage());
+    talk_base::ByteBuffer buf(packet.Data(), packet.Length());
+    ASSERT_TRUE(msg->Read(&buf));
+    ASSERT_TRUE(msg->GetByteString(STUN_ATTR_USERNAME) != NULL);
+  }
+  uint32 copy_time = talk_base::TimeSince(start);
+  int copy_allocations = stun_test_allocations - allocations;
+
+  allocations = stun_test_allocations;
+  start = talk_base::Time();
+  for (int i = 0; i < kIterations; ++i) {
+    talk_base::scoped_ptr<IceMessage> msg(new IceMessage());
+    ASSERT_TRUE(msg->ReadView(packet.Data(), packet.Length()));
+    ASSERT_TRUE(msg->GetByteString(STUN_ATTR_USERNAME) != NULL);
+  }
+  uint32 view_time = talk_base::TimeSince(start);
+  int view_allocations = stun_test_allocations - allocations;
+
+  EXPECT_LT(view_allocations, copy_allocations);
+  LOG(LS_INFO) << kIterations << " ICE checks of " << packet.Length()
+               << " bytes: Read " << copy_time << " ms, "
+               << static_cast<double>(copy_allocations) / kIterations
+               << " allocations per message; ReadView " << view_time
+               << " ms, "
+               << static_cast<double>(view_allocations) / kIterations
+               << " allocations per message";
+}
+
 }  // namespace cricket
@@ -122,9 +122,8 @@ bool StunRequestManager::CheckResponse(const char* data, size_t size) {
 
   // Parse the STUN message and continue processing as usual.
 
-  talk_base::ByteBuffer buf(data, size);
   talk_base::scoped_ptr<StunMessage> response(iter->second->msg_->CreateNew());
-  if (!response->Read(&buf))
+  if (!response->ReadView(data, size))
     return false;
 
   return CheckResponse(response.get());
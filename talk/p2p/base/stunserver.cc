@@ -44,9 +44,8 @@ void StunServer::OnPacket(
     talk_base::AsyncPacketSocket* socket, const char* buf, size_t size,
     const talk_base::SocketAddress& remote_addr) {
   // Parse the STUN message; eat any messages that fail to parse.
-  talk_base::ByteBuffer bbuf(buf, size);
   StunMessage msg;
-  if (!msg.Read(&bbuf)) {
+  if (!msg.ReadView(buf, size)) {
     return;
   }
 
@@ -46,9 +46,10 @@ class TestTurnServer : public TurnAuthInterface {
   TestTurnServer(talk_base::Thread* thread,
                  const talk_base::SocketAddress& udp_int_addr,
                  const talk_base::SocketAddress& udp_ext_addr)
-      : server_(thread) {
-    server_.AddInternalSocket(talk_base::AsyncUDPSocket::Create(
-        thread->socketserver(), udp_int_addr), PROTO_UDP);
+      : server_(thread),
+        udp_int_socket_(talk_base::AsyncUDPSocket::Create(
+            thread->socketserver(), udp_int_addr)) {
+    server_.AddInternalSocket(udp_int_socket_, PROTO_UDP);
     server_.SetExternalSocketFactory(new talk_base::BasicPacketSocketFactory(),
         udp_ext_addr);
     server_.set_realm(kTestRealm);
@@ -61,6 +62,8 @@ class TestTurnServer : public TurnAuthInterface {
   }
 
   TurnServer* server() { return &server_; }
+  // The UDP socket clients talk to; owned by the server.
+  talk_base::AsyncPacketSocket* udp_int_socket() { return udp_int_socket_; }
 
  private:
   // For this test server, succeed if the password is the same as the username.
@@ -71,6 +74,7 @@ class TestTurnServer : public TurnAuthInterface {
   }
 
   TurnServer server_;
+  talk_base::AsyncPacketSocket* udp_int_socket_;
 };
 
 }  // namespace cricket
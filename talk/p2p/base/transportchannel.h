@@ -32,6 +32,7 @@
 #include <vector>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/packetbuffer.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/socket.h"
 #include "talk/base/sslidentity.h"
@@ -85,6 +86,12 @@ class TransportChannel : public sigslot::has_slots<> {
   // TODO: Remove the default argument once channel code is updated.
   virtual int SendPacket(const char* data, size_t len, int flags = 0) = 0;
 
+  // Sends a packet from a PacketBuffer, whose headroom a transport may use to
+  // frame the packet in place. Does not take over the caller's reference.
+  virtual int SendPacketBuffer(talk_base::PacketBuffer* packet, int flags) {
+    return SendPacket(packet->data(), packet->length(), flags);
+  }
+
   // Sets a socket option on this channel.  Note that not all options are
   // supported by all transport types.
   virtual int SetOption(talk_base::Socket::Option opt, int value) = 0;
@@ -126,8 +133,8 @@ class TransportChannel : public sigslot::has_slots<> {
   }
 
   // Signalled each time a packet is received on this channel.
-  sigslot::signal4<TransportChannel*, const char*,
-                   size_t, int> SignalReadPacket;
+  sigslot::fast_signal4<TransportChannel*, const char*,
+                        size_t, int> SignalReadPacket;
 
   // This signal occurs when there is a change in the way that packets are
   // being routed, i.e. to a different remote location. The candidate
@@ -27,7 +27,7 @@
 
 #include "talk/p2p/base/turnport.h"
 
-#include <functional>
+#include <string.h>
 
 #include "talk/base/asyncpacketsocket.h"
 #include "talk/base/byteorder.h"
@@ -48,6 +48,7 @@ static const int TURN_ALLOCATE_ERROR_RESPONSE = STUN_ALLOCATE_ERROR_RESPONSE;
 // TODO(juberti): Extract to turnmessage.h
 static const int TURN_DEFAULT_PORT = 3478;
 static const int TURN_CHANNEL_NUMBER_START = 0x4000;
+static const int TURN_CHANNEL_NUMBER_END = 0x7FFF;
 static const int TURN_PERMISSION_TIMEOUT = 5 * 60 * 1000;  // 5 minutes
 
 static const size_t TURN_CHANNEL_HEADER_SIZE = 4U;
@@ -146,6 +147,7 @@ class TurnEntry : public sigslot::has_slots<> {
 
   TurnPort* port() { return port_; }
 
+  // Zero if the port ran out of channel numbers for this entry.
   int channel_id() const { return channel_id_; }
   const talk_base::SocketAddress& address() const { return ext_addr_; }
   BindState state() const { return state_; }
@@ -153,8 +155,8 @@ class TurnEntry : public sigslot::has_slots<> {
   // Helper methods to send permission and channel bind requests.
   void SendCreatePermissionRequest();
   void SendChannelBindRequest(int delay);
-  // Sends a packet to the given destination address.
-  // This will wrap the packet in STUN if necessary.
+  // Sends a packet to the given destination address. This uses ChannelData
+  // once the channel is bound, and a STUN Send indication until then.
   int Send(const void* data, size_t size, bool payload);
 
   void OnCreatePermissionSuccess();
@@ -194,8 +196,10 @@ TurnPort::TurnPort(talk_base::Thread* thread,
 
 TurnPort::~TurnPort() {
   // TODO(juberti): Should this even be necessary?
-  while (!entries_.empty()) {
-    DestroyEntry(entries_.front()->address());
+  std::vector<TurnEntry*> entries;
+  entries_.GetValues(&entries);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    DestroyEntry(entries[i]->address());
   }
 }
 
@@ -437,9 +441,8 @@ void TurnPort::OnAllocateRequestTimeout() {
 
 void TurnPort::HandleDataIndication(const char* data, size_t size) {
   // Read in the message, and process according to RFC5766, Section 10.4.
-  talk_base::ByteBuffer buf(data, size);
   TurnMessage msg;
-  if (!msg.Read(&buf)) {
+  if (!msg.ReadView(data, size)) {
     LOG_J(LS_WARNING, this) << "Received invalid TURN data indication";
     return;
   }
@@ -550,6 +553,23 @@ int TurnPort::Send(const void* data, size_t len) {
   return socket_->SendTo(data, len, server_address_.address);
 }
 
+int TurnPort::SendChannelData(int channel_id, const void* data, size_t size) {
+  // See RFC5766, Section 11.4; the packet socket adds padding over TCP.
+  if (size > 0xFFFF) {
+    error_ = EMSGSIZE;
+    return SOCKET_ERROR;
+  }
+  size_t len = TURN_CHANNEL_HEADER_SIZE + size;
+  if (send_buffer_.size() < len) {
+    send_buffer_.resize(len);
+  }
+  char* buf = &send_buffer_[0];
+  talk_base::SetBE16(buf, static_cast<uint16>(channel_id));
+  talk_base::SetBE16(buf + 2, static_cast<uint16>(size));
+  memcpy(buf + TURN_CHANNEL_HEADER_SIZE, data, size);
+  return Send(buf, len);
+}
+
 void TurnPort::UpdateHash() {
   VERIFY(ComputeStunCredentialHash(credentials_.username, realm_,
                                    credentials_.password, &hash_));
@@ -579,36 +599,42 @@ bool TurnPort::UpdateNonce(StunMessage* response) {
   return true;
 }
 
-static bool MatchesIP(TurnEntry* e, talk_base::IPAddress ipaddr) {
-  return e->address().ipaddr() == ipaddr;
-}
 bool TurnPort::HasPermission(const talk_base::IPAddress& ipaddr) const {
-  return (std::find_if(entries_.begin(), entries_.end(),
-      std::bind2nd(std::ptr_fun(MatchesIP), ipaddr)) != entries_.end());
+  return permissions_.Find(ipaddr) != NULL;
 }
 
-static bool MatchesAddress(TurnEntry* e, talk_base::SocketAddress addr) {
-  return e->address() == addr;
-}
 TurnEntry* TurnPort::FindEntry(const talk_base::SocketAddress& addr) const {
-  EntryList::const_iterator it = std::find_if(entries_.begin(), entries_.end(),
-      std::bind2nd(std::ptr_fun(MatchesAddress), addr));
-  return (it != entries_.end()) ? *it : NULL;
+  TurnEntry* const* entry = entries_.Find(addr);
+  return entry ? *entry : NULL;
 }
 
-static bool MatchesChannelId(TurnEntry* e, int id) {
-  return e->channel_id() == id;
-}
 TurnEntry* TurnPort::FindEntry(int channel_id) const {
-  EntryList::const_iterator it = std::find_if(entries_.begin(), entries_.end(),
-      std::bind2nd(std::ptr_fun(MatchesChannelId), channel_id));
-  return (it != entries_.end()) ? *it : NULL;
+  size_t index = static_cast<size_t>(channel_id - TURN_CHANNEL_NUMBER_START);
+  return (index < channels_.size()) ? channels_[index] : NULL;
 }
 
 TurnEntry* TurnPort::CreateEntry(const talk_base::SocketAddress& addr) {
   ASSERT(FindEntry(addr) == NULL);
-  TurnEntry* entry = new TurnEntry(this, next_channel_number_++, addr);
-  entries_.push_back(entry);
+  int channel_id = 0;
+  if (next_channel_number_ <= TURN_CHANNEL_NUMBER_END) {
+    channel_id = next_channel_number_++;
+  } else {
+    LOG_J(LS_WARNING, this) << "Out of channel numbers, data to "
+                            << addr.ToSensitiveString()
+                            << " will use send indications";
+  }
+  TurnEntry* entry = new TurnEntry(this, channel_id, addr);
+  entries_.Insert(addr, entry);
+  if (channel_id) {
+    channels_.push_back(entry);
+    ASSERT(FindEntry(channel_id) == entry);
+  }
+  int* count = permissions_.Find(addr.ipaddr());
+  if (count) {
+    ++*count;
+  } else {
+    permissions_.Insert(addr.ipaddr(), 1);
+  }
   return entry;
 }
 
@@ -616,7 +642,15 @@ void TurnPort::DestroyEntry(const talk_base::SocketAddress& addr) {
   TurnEntry* entry = FindEntry(addr);
   ASSERT(entry != NULL);
   entry->SignalDestroyed(entry);
-  entries_.remove(entry);
+  entries_.Erase(addr);
+  if (entry->channel_id()) {
+    channels_[entry->channel_id() - TURN_CHANNEL_NUMBER_START] = NULL;
+  }
+  int* count = permissions_.Find(addr.ipaddr());
+  ASSERT(count != NULL);
+  if (--*count == 0) {
+    permissions_.Erase(addr.ipaddr());
+  }
   delete entry;
 }
 
@@ -875,34 +909,38 @@ void TurnEntry::SendCreatePermissionRequest() {
 }
 
 void TurnEntry::SendChannelBindRequest(int delay) {
+  if (!channel_id_) {
+    return;
+  }
+  if (state_ == STATE_UNBOUND) {
+    state_ = STATE_BINDING;
+  }
   port_->SendRequest(new TurnChannelBindRequest(
       port_, this, channel_id_, ext_addr_), delay);
 }
 
 int TurnEntry::Send(const void* data, size_t size, bool payload) {
+  // Once the channel is bound, use the 4-byte ChannelData header.
+  if (state_ == STATE_BOUND) {
+    return port_->SendChannelData(channel_id_, data, size);
+  }
+
+  // If we haven't bound the channel yet, we have to use a Send Indication.
   talk_base::ByteBuffer buf;
-  if (state_ != STATE_BOUND) {
-    // If we haven't bound the channel yet, we have to use a Send Indication.
-    TurnMessage msg;
-    msg.SetType(TURN_SEND_INDICATION);
-    msg.SetTransactionID(
-        talk_base::CreateRandomString(kStunTransactionIdLength));
-    VERIFY(msg.AddAttribute(new StunXorAddressAttribute(
-        STUN_ATTR_XOR_PEER_ADDRESS, ext_addr_)));
-    VERIFY(msg.AddAttribute(new StunByteStringAttribute(
-        STUN_ATTR_DATA, data, size)));
-    VERIFY(msg.Write(&buf));
-
-    // If we're sending real data, request a channel bind that we can use later.
-    if (state_ == STATE_UNBOUND && payload) {
-      SendChannelBindRequest(0);
-      state_ = STATE_BINDING;
-    }
-  } else {
-    // If the channel is bound, we can send the data as a Channel Message.
-    buf.WriteUInt16(channel_id_);
-    buf.WriteUInt16(static_cast<uint16>(size));
-    buf.WriteBytes(reinterpret_cast<const char*>(data), size);
+  TurnMessage msg;
+  msg.SetType(TURN_SEND_INDICATION);
+  msg.SetTransactionID(
+      talk_base::CreateRandomString(kStunTransactionIdLength));
+  VERIFY(msg.AddAttribute(new StunXorAddressAttribute(
+      STUN_ATTR_XOR_PEER_ADDRESS, ext_addr_)));
+  VERIFY(msg.AddAttribute(new StunByteStringAttribute(
+      STUN_ATTR_DATA, data, size)));
+  VERIFY(msg.Write(&buf));
+
+  // The channel is normally bound as soon as the permission is in place, but
+  // real data may come first, or an earlier bind may have failed.
+  if (state_ == STATE_UNBOUND && payload) {
+    SendChannelBindRequest(0);
   }
   return port_->Send(buf.Data(), buf.Length());
 }
@@ -913,6 +951,12 @@ void TurnEntry::OnCreatePermissionSuccess() {
                         << " succeeded";
   // For success result code will be 0.
   port_->SignalCreatePermissionResult(port_, ext_addr_, 0);
+
+  // Bind the channel right away, so that media never has to be sent in
+  // Send indications.
+  if (state_ == STATE_UNBOUND) {
+    SendChannelBindRequest(0);
+  }
 }
 
 void TurnEntry::OnCreatePermissionError(StunMessage* response, int code) {
@@ -934,6 +978,7 @@ void TurnEntry::OnChannelBindSuccess() {
                         << " succeeded";
   ASSERT(state_ == STATE_BINDING || state_ == STATE_BOUND);
   state_ = STATE_BOUND;
+  port_->SignalChannelBindResult(port_, ext_addr_, 0);
 }
 
 void TurnEntry::OnChannelBindError(StunMessage* response, int code) {
@@ -946,8 +991,12 @@ void TurnEntry::OnChannelBindError(StunMessage* response, int code) {
     if (port_->UpdateNonce(response)) {
       // Send channel bind request with fresh nonce.
       SendChannelBindRequest(0);
+      return;
     }
   }
+  // Fall back to Send indications; the next payload retries the bind.
+  state_ = STATE_UNBOUND;
+  port_->SignalChannelBindResult(port_, ext_addr_, code);
 }
 
 }  // namespace cricket
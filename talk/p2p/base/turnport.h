@@ -30,8 +30,9 @@
 
 #include <stdio.h>
 #include <string>
-#include <list>
+#include <vector>
 
+#include "talk/base/openhashmap.h"
 #include "talk/p2p/base/port.h"
 #include "talk/p2p/client/basicportallocator.h"
 
@@ -90,9 +91,11 @@ class TurnPort : public Port {
   const std::string& hash() const { return hash_; }
   const std::string& nonce() const { return nonce_; }
 
-  // This signal is only for testing purpose.
+  // These signals are only for testing purpose.
   sigslot::signal3<TurnPort*, const talk_base::SocketAddress&, int>
       SignalCreatePermissionResult;
+  sigslot::signal3<TurnPort*, const talk_base::SocketAddress&, int>
+      SignalChannelBindResult;
 
  protected:
   TurnPort(talk_base::Thread* thread,
@@ -106,7 +109,21 @@ class TurnPort : public Port {
            const RelayCredentials& credentials);
 
  private:
-  typedef std::list<TurnEntry*> EntryList;
+  struct SocketAddressHash {
+    size_t operator()(const talk_base::SocketAddress& addr) const {
+      return addr.Hash();
+    }
+  };
+  struct IPAddressHash {
+    size_t operator()(const talk_base::IPAddress& addr) const {
+      return talk_base::HashIP(addr);
+    }
+  };
+  typedef talk_base::OpenHashMap<talk_base::SocketAddress, TurnEntry*,
+                                 SocketAddressHash> EntryMap;
+  // Number of entries for each peer IP, all of which have a permission.
+  typedef talk_base::OpenHashMap<talk_base::IPAddress, int,
+                                 IPAddressHash> PermissionMap;
   typedef std::map<talk_base::Socket::Option, int> SocketOptionsMap;
 
   virtual void OnMessage(talk_base::Message* pmsg);
@@ -139,6 +156,7 @@ class TurnPort : public Port {
   bool ScheduleRefresh(int lifetime);
   void SendRequest(StunRequest* request, int delay);
   int Send(const void* data, size_t size);
+  int SendChannelData(int channel_id, const void* data, size_t size);
   void UpdateHash();
   bool UpdateNonce(StunMessage* response);
 
@@ -163,7 +181,13 @@ class TurnPort : public Port {
   std::string hash_;        // Digest of username:realm:password
 
   int next_channel_number_;
-  EntryList entries_;
+  EntryMap entries_;
+  PermissionMap permissions_;
+  // Entries indexed by channel number - TURN_CHANNEL_NUMBER_START. Channel
+  // numbers are never reused, so a destroyed entry leaves a NULL behind.
+  std::vector<TurnEntry*> channels_;
+  // Reused to frame ChannelData messages, so that sending needs no allocation.
+  std::vector<char> send_buffer_;
 
   bool connected_;
 
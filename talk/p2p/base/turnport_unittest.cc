@@ -27,6 +27,7 @@
 
 #include "talk/base/asynctcpsocket.h"
 #include "talk/base/buffer.h"
+#include "talk/base/byteorder.h"
 #include "talk/base/firewallsocketserver.h"
 #include "talk/base/logging.h"
 #include "talk/base/gunit.h"
@@ -35,6 +36,7 @@
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socketaddress.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/base/virtualsocketserver.h"
 #include "talk/p2p/base/basicpacketsocketfactory.h"
 #include "talk/p2p/base/constants.h"
@@ -86,7 +88,11 @@ class TurnPortTest : public testing::Test,
         turn_error_(false),
         turn_unknown_address_(false),
         turn_create_permission_success_(false),
-        udp_ready_(false) {
+        turn_channel_bind_success_(false),
+        udp_ready_(false),
+        server_indications_(0),
+        server_channel_data_(0),
+        server_data_bytes_(0) {
     network_.AddIP(talk_base::IPAddress(INADDR_ANY));
   }
 
@@ -109,6 +115,12 @@ class TurnPortTest : public testing::Test,
       turn_create_permission_success_ = true;
     }
   }
+  void OnTurnChannelBindResult(TurnPort* port, const SocketAddress& addr,
+                               int code) {
+    if (code == 0) {
+      turn_channel_bind_success_ = true;
+    }
+  }
   void OnTurnReadPacket(Connection* conn, const char* data, size_t size) {
     turn_packets_.push_back(talk_base::Buffer(data, size));
   }
@@ -119,6 +131,21 @@ class TurnPortTest : public testing::Test,
     udp_packets_.push_back(talk_base::Buffer(data, size));
   }
 
+  // Counts the data packets that reach the TURN server, and their bytes.
+  void OnServerReadPacket(talk_base::AsyncPacketSocket* socket,
+                          const char* data, size_t size,
+                          const SocketAddress& addr) {
+    uint16 type = talk_base::GetBE16(data);
+    if ((type & 0xC000) == 0x4000) {
+      ++server_channel_data_;
+    } else if (type == cricket::TURN_SEND_INDICATION) {
+      ++server_indications_;
+    } else {
+      return;
+    }
+    server_data_bytes_ += size;
+  }
+
   talk_base::AsyncSocket* CreateServerSocket(const SocketAddress addr) {
     talk_base::AsyncSocket* socket = ss_->CreateAsyncSocket(SOCK_STREAM);
     EXPECT_GE(socket->Bind(addr), 0);
@@ -142,6 +169,8 @@ class TurnPortTest : public testing::Test,
         &TurnPortTest::OnTurnUnknownAddress);
     turn_port_->SignalCreatePermissionResult.connect(this,
         &TurnPortTest::OnTurnCreatePermissionResult);
+    turn_port_->SignalChannelBindResult.connect(this,
+        &TurnPortTest::OnTurnChannelBindResult);
   }
   void CreateUdpPort() {
     udp_port_.reset(UDPPort::Create(main_, &socket_factory_, &network_,
@@ -246,7 +275,11 @@ class TurnPortTest : public testing::Test,
   bool turn_error_;
   bool turn_unknown_address_;
   bool turn_create_permission_success_;
+  bool turn_channel_bind_success_;
   bool udp_ready_;
+  int server_indications_;
+  int server_channel_data_;
+  size_t server_data_bytes_;
   std::vector<talk_base::Buffer> turn_packets_;
   std::vector<talk_base::Buffer> udp_packets_;
 };
@@ -329,3 +362,90 @@ TEST_F(TurnPortTest, TestTurnSendDataTurnTcpToUdp) {
   CreateTurnPort(kTurnUsername, kTurnPassword, kTurnTcpProtoAddr);
   TestTurnSendData();
 }
+
+// Checks that the channel is bound as soon as the permission is, without
+// waiting for data, and that data then goes out as ChannelData.
+TEST_F(TurnPortTest, TestTurnChannelBoundEagerly) {
+  CreateTurnPort(kTurnUsername, kTurnPassword, kTurnUdpProtoAddr);
+  turn_port_->PrepareAddress();
+  ASSERT_TRUE_WAIT(turn_ready_, kTimeout);
+  CreateUdpPort();
+  udp_port_->PrepareAddress();
+  ASSERT_TRUE_WAIT(udp_ready_, kTimeout);
+  turn_server_.udp_int_socket()->SignalReadPacket.connect(
+      static_cast<TurnPortTest*>(this), &TurnPortTest::OnServerReadPacket);
+
+  ASSERT_TRUE(turn_port_->CreateConnection(
+      udp_port_->Candidates()[0], Port::ORIGIN_MESSAGE) != NULL);
+  EXPECT_TRUE_WAIT(turn_channel_bind_success_, kTimeout);
+  EXPECT_EQ(0, server_indications_);
+
+  char data[100] = {0};
+  EXPECT_EQ(static_cast<int>(sizeof(data)), turn_port_->SendTo(
+      data, sizeof(data), udp_port_->Candidates()[0].address(), true));
+  EXPECT_EQ_WAIT(1, server_channel_data_, kTimeout);
+  EXPECT_EQ(0, server_indications_);
+  EXPECT_EQ(sizeof(data) + 4, server_data_bytes_);
+}
+
+// Compares the per-packet time and header bytes of sending media in Send
+// indications, before the channel is bound, and in ChannelData, after.
+TEST_F(TurnPortTest, TestTurnChannelDataPerf) {
+  const int kBatchSize = 100;
+  const int kNumBatches = 100;
+  const size_t kPacketSize = 160;
+  CreateTurnPort(kTurnUsername, kTurnPassword, kTurnUdpProtoAddr);
+  turn_port_->PrepareAddress();
+  ASSERT_TRUE_WAIT(turn_ready_, kTimeout);
+  CreateUdpPort();
+  udp_port_->PrepareAddress();
+  ASSERT_TRUE_WAIT(udp_ready_, kTimeout);
+  // The peer just drops the data, rather than logging each packet.
+  udp_port_->EnablePortPackets();
+  turn_server_.udp_int_socket()->SignalReadPacket.connect(
+      static_cast<TurnPortTest*>(this), &TurnPortTest::OnServerReadPacket);
+
+  const SocketAddress& peer = udp_port_->Candidates()[0].address();
+  ASSERT_TRUE(turn_port_->CreateConnection(
+      udp_port_->Candidates()[0], Port::ORIGIN_MESSAGE) != NULL);
+  char data[kPacketSize];
+  memset(data, 0x5A, sizeof(data));
+
+  // The permission request has not even been sent yet, so this batch can
+  // only go out as Send indications.
+  uint64 start = talk_base::TimeNanos();
+  for (int i = 0; i < kBatchSize; ++i) {
+    turn_port_->SendTo(data, kPacketSize, peer, false);
+  }
+  uint64 indication_time = talk_base::TimeNanos() - start;
+  ASSERT_TRUE_WAIT(turn_channel_bind_success_, kTimeout);
+  ASSERT_EQ(kBatchSize, server_indications_);
+  size_t indication_bytes = server_data_bytes_;
+
+  // The batches are kept small enough for the virtual network to not drop.
+  server_data_bytes_ = 0;
+  uint64 channel_time = 0;
+  for (int i = 0; i < kNumBatches; ++i) {
+    start = talk_base::TimeNanos();
+    for (int j = 0; j < kBatchSize; ++j) {
+      turn_port_->SendTo(data, kPacketSize, peer, true);
+    }
+    channel_time += talk_base::TimeNanos() - start;
+    main_->ProcessMessages(0);
+  }
+  ASSERT_EQ_WAIT(kBatchSize * kNumBatches, server_channel_data_, kTimeout);
+  EXPECT_EQ(kBatchSize, server_indications_);
+
+  double indication_overhead =
+      static_cast<double>(indication_bytes) / kBatchSize - kPacketSize;
+  double channel_overhead = static_cast<double>(server_data_bytes_) /
+      (kBatchSize * kNumBatches) - kPacketSize;
+  EXPECT_EQ(4.0, channel_overhead);
+  EXPECT_GE(indication_overhead, 36.0);
+  LOG(LS_INFO) << "Send indication: "
+               << indication_time / kBatchSize << " ns and "
+               << indication_overhead << " header bytes per packet; "
+               << "ChannelData: "
+               << channel_time / (kBatchSize * kNumBatches) << " ns and "
+               << channel_overhead << " header bytes per packet";
+}
@@ -31,10 +31,13 @@
 #include "talk/base/helpers.h"
 #include "talk/base/logging.h"
 #include "talk/base/messagedigest.h"
+#include "talk/base/asyncudpsocket.h"
+#include "talk/base/physicalsocketserver.h"
 #include "talk/base/socketadapters.h"
 #include "talk/base/stringencode.h"
 #include "talk/base/thread.h"
 #include "talk/p2p/base/asyncstuntcpsocket.h"
+#include "talk/p2p/base/basicpacketsocketfactory.h"
 #include "talk/p2p/base/common.h"
 #include "talk/p2p/base/packetsocketfactory.h"
 #include "talk/p2p/base/stun.h"
@@ -69,6 +72,22 @@ enum {
   MSG_TIMEOUT,
 };
 
+struct IPAddressHash {
+  size_t operator()(const talk_base::IPAddress& addr) const {
+    return talk_base::HashIP(addr);
+  }
+};
+
+struct SocketAddressHash {
+  size_t operator()(const talk_base::SocketAddress& addr) const {
+    return addr.Hash();
+  }
+};
+
+struct ChannelIdHash {
+  size_t operator()(int id) const { return id; }
+};
+
 // Encapsulates a TURN allocation.
 // The object is created when an allocation request is received, and then
 // handles TURN messages (via HandleTurnMessage) and channel data messages
@@ -98,8 +117,12 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
   sigslot::signal1<Allocation*> SignalDestroyed;
 
  private:
-  typedef std::list<Permission*> PermissionList;
-  typedef std::list<Channel*> ChannelList;
+  // Permissions and channels are looked up for every relayed packet.
+  typedef talk_base::OpenHashMap<talk_base::IPAddress, Permission*,
+                                 IPAddressHash> PermissionMap;
+  typedef talk_base::OpenHashMap<int, Channel*, ChannelIdHash> ChannelIdMap;
+  typedef talk_base::OpenHashMap<talk_base::SocketAddress, Channel*,
+                                 SocketAddressHash> ChannelPeerMap;
 
   void HandleAllocateRequest(const TurnMessage* msg);
   void HandleRefreshRequest(const TurnMessage* msg);
@@ -137,8 +160,9 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
   std::string transaction_id_;
   std::string username_;
   std::string last_nonce_;
-  PermissionList perms_;
-  ChannelList channels_;
+  PermissionMap perms_;
+  ChannelIdMap channels_;
+  ChannelPeerMap channel_peers_;
 };
 
 // Encapsulates a TURN permission.
@@ -209,13 +233,15 @@ TurnServer::TurnServer(talk_base::Thread* thread)
     : thread_(thread),
       nonce_key_(talk_base::CreateRandomString(kNonceKeySize)),
       auth_hook_(NULL),
-      enable_otu_nonce_(false) {
+      enable_otu_nonce_(false),
+      enable_batching_(false) {
 }
 
 TurnServer::~TurnServer() {
-  for (AllocationMap::iterator it = allocations_.begin();
-       it != allocations_.end(); ++it) {
-    delete it->second;
+  std::vector<Allocation*> allocations;
+  allocations_.GetValues(&allocations);
+  for (size_t i = 0; i < allocations.size(); ++i) {
+    delete allocations[i];
   }
 
   for (InternalSocketMap::iterator it = server_sockets_.begin();
@@ -307,8 +333,7 @@ void TurnServer::OnInternalPacket(talk_base::AsyncPacketSocket* socket,
 void TurnServer::HandleStunMessage(Connection* conn, const char* data,
                                    size_t size) {
   TurnMessage msg;
-  talk_base::ByteBuffer buf(data, size);
-  if (!msg.Read(&buf) || (buf.Length() > 0)) {
+  if (!msg.ReadView(data, size)) {
     LOG(LS_WARNING) << "Received invalid STUN message";
     return;
   }
@@ -511,15 +536,21 @@ bool TurnServer::ValidateNonce(const std::string& nonce) const {
 }
 
 TurnServer::Allocation* TurnServer::FindAllocation(Connection* conn) {
-  AllocationMap::const_iterator it = allocations_.find(*conn);
-  return (it != allocations_.end()) ? it->second : NULL;
+  Allocation** allocation = allocations_.Find(*conn);
+  return allocation ? *allocation : NULL;
 }
 
 TurnServer::Allocation* TurnServer::CreateAllocation(Connection* conn,
                                                      int proto,
                                                      const std::string& key) {
-  talk_base::AsyncPacketSocket* external_socket = (external_socket_factory_) ?
-      external_socket_factory_->CreateUdpSocket(external_addr_, 0, 0) : NULL;
+  talk_base::AsyncPacketSocket* external_socket = NULL;
+  if (external_socket_factory_ && enable_batching_) {
+    external_socket = external_socket_factory_->CreateBatchedUdpSocket(
+        external_addr_, 0, 0);
+  } else if (external_socket_factory_) {
+    external_socket = external_socket_factory_->CreateUdpSocket(
+        external_addr_, 0, 0);
+  }
   if (!external_socket) {
     return NULL;
   }
@@ -528,7 +559,7 @@ TurnServer::Allocation* TurnServer::CreateAllocation(Connection* conn,
   Allocation* allocation = new Allocation(this,
       thread_, *conn, external_socket, key);
   allocation->SignalDestroyed.connect(this, &TurnServer::OnAllocationDestroyed);
-  allocations_[*conn] = allocation;
+  allocations_.Insert(*conn, allocation);
   return allocation;
 }
 
@@ -581,9 +612,7 @@ void TurnServer::OnAllocationDestroyed(Allocation* allocation) {
     DestroyInternalSocket(socket);
   }
 
-  AllocationMap::iterator it = allocations_.find(*(allocation->conn()));
-  if (it != allocations_.end())
-    allocations_.erase(it);
+  allocations_.Erase(*(allocation->conn()));
 }
 
 void TurnServer::DestroyInternalSocket(talk_base::AsyncPacketSocket* socket) {
@@ -608,8 +637,8 @@ bool TurnServer::Connection::operator==(const Connection& c) const {
   return src_ == c.src_ && dst_ == c.dst_ && proto_ == c.proto_;
 }
 
-bool TurnServer::Connection::operator<(const Connection& c) const {
-  return src_ < c.src_ || dst_ < c.dst_ || proto_ < c.proto_;
+size_t TurnServer::Connection::Hash() const {
+  return src_.Hash() ^ (dst_.Hash() * 31) ^ proto_;
 }
 
 std::string TurnServer::Connection::ToString() const {
@@ -636,13 +665,15 @@ TurnServer::Allocation::Allocation(TurnServer* server,
 }
 
 TurnServer::Allocation::~Allocation() {
-  for (ChannelList::iterator it = channels_.begin();
-       it != channels_.end(); ++it) {
-    delete *it;
+  std::vector<Channel*> channels;
+  channels_.GetValues(&channels);
+  for (size_t i = 0; i < channels.size(); ++i) {
+    delete channels[i];
   }
-  for (PermissionList::iterator it = perms_.begin();
-       it != perms_.end(); ++it) {
-    delete *it;
+  std::vector<Permission*> perms;
+  perms_.GetValues(&perms);
+  for (size_t i = 0; i < perms.size(); ++i) {
+    delete perms[i];
   }
   thread_->Clear(this, MSG_TIMEOUT);
   LOG_J(LS_INFO, this) << "Allocation destroyed";
@@ -806,7 +837,8 @@ void TurnServer::Allocation::HandleChannelBindRequest(const TurnMessage* msg) {
     channel1 = new Channel(thread_, channel_id, peer_attr->GetAddress());
     channel1->SignalDestroyed.connect(this,
         &TurnServer::Allocation::OnChannelDestroyed);
-    channels_.push_back(channel1);
+    channels_.Insert(channel_id, channel1);
+    channel_peers_.Insert(channel1->peer(), channel1);
   } else {
     channel1->Refresh();
   }
@@ -887,7 +919,7 @@ void TurnServer::Allocation::AddPermission(const talk_base::IPAddress& addr) {
     perm = new Permission(thread_, addr);
     perm->SignalDestroyed.connect(
         this, &TurnServer::Allocation::OnPermissionDestroyed);
-    perms_.push_back(perm);
+    perms_.Insert(addr, perm);
   } else {
     perm->Refresh();
   }
@@ -895,31 +927,19 @@ void TurnServer::Allocation::AddPermission(const talk_base::IPAddress& addr) {
 
 TurnServer::Permission* TurnServer::Allocation::FindPermission(
     const talk_base::IPAddress& addr) const {
-  for (PermissionList::const_iterator it = perms_.begin();
-       it != perms_.end(); ++it) {
-    if ((*it)->peer() == addr)
-      return *it;
-  }
-  return NULL;
+  Permission* const* perm = perms_.Find(addr);
+  return perm ? *perm : NULL;
 }
 
 TurnServer::Channel* TurnServer::Allocation::FindChannel(int channel_id) const {
-  for (ChannelList::const_iterator it = channels_.begin();
-       it != channels_.end(); ++it) {
-    if ((*it)->id() == channel_id)
-      return *it;
-  }
-  return NULL;
+  Channel* const* channel = channels_.Find(channel_id);
+  return channel ? *channel : NULL;
 }
 
 TurnServer::Channel* TurnServer::Allocation::FindChannel(
     const talk_base::SocketAddress& addr) const {
-  for (ChannelList::const_iterator it = channels_.begin();
-       it != channels_.end(); ++it) {
-    if ((*it)->peer() == addr)
-      return *it;
-  }
-  return NULL;
+  Channel* const* channel = channel_peers_.Find(addr);
+  return channel ? *channel : NULL;
 }
 
 void TurnServer::Allocation::SendResponse(TurnMessage* msg) {
@@ -949,16 +969,12 @@ void TurnServer::Allocation::OnMessage(talk_base::Message* msg) {
 }
 
 void TurnServer::Allocation::OnPermissionDestroyed(Permission* perm) {
-  PermissionList::iterator it = std::find(perms_.begin(), perms_.end(), perm);
-  ASSERT(it != perms_.end());
-  perms_.erase(it);
+  VERIFY(perms_.Erase(perm->peer()));
 }
 
 void TurnServer::Allocation::OnChannelDestroyed(Channel* channel) {
-  ChannelList::iterator it =
-      std::find(channels_.begin(), channels_.end(), channel);
-  ASSERT(it != channels_.end());
-  channels_.erase(it);
+  VERIFY(channels_.Erase(channel->id()));
+  VERIFY(channel_peers_.Erase(channel->peer()));
 }
 
 TurnServer::Permission::Permission(talk_base::Thread* thread,
@@ -1003,4 +1019,99 @@ void TurnServer::Channel::OnMessage(talk_base::Message* msg) {
   delete this;
 }
 
+// Each shard has its own socket server, so that its thread waits only on the
+// sockets of its own allocations.
+struct ShardedTurnServer::Shard {
+  Shard()
+      : ss(talk_base::PhysicalSocketServer::BACKEND_EPOLL),
+        thread(&ss),
+        server(&thread) {
+  }
+
+  talk_base::PhysicalSocketServer ss;
+  talk_base::Thread thread;
+  TurnServer server;
+};
+
+ShardedTurnServer::ShardedTurnServer(int num_shards)
+    : num_shards_(num_shards),
+      auth_hook_(NULL),
+      enable_batching_(false) {
+  ASSERT(num_shards_ > 0);
+}
+
+ShardedTurnServer::~ShardedTurnServer() {
+  Stop();
+}
+
+bool ShardedTurnServer::Start(const talk_base::SocketAddress& int_addr,
+                              const talk_base::IPAddress& ext_ip) {
+  ASSERT(shards_.empty());
+  talk_base::SocketAddress addr(int_addr);
+  for (int i = 0; i < num_shards_; ++i) {
+    Shard* shard = new Shard();
+    shards_.push_back(shard);
+
+    // The threads aren't running yet, so the sockets can be set up from here.
+    talk_base::AsyncSocket* socket =
+        shard->ss.CreateAsyncSocket(addr.family(), SOCK_DGRAM);
+    if (!socket) {
+      Stop();
+      return false;
+    }
+    if (num_shards_ > 1 &&
+        socket->SetOption(talk_base::Socket::OPT_REUSEPORT, 1) < 0) {
+      LOG(LS_ERROR) << "Unable to share port between shards, err="
+                    << socket->GetError();
+      delete socket;
+      Stop();
+      return false;
+    }
+    if (socket->Bind(addr) < 0) {
+      LOG(LS_ERROR) << "Shard " << i << " failed to bind to "
+                    << addr.ToString() << ", err=" << socket->GetError();
+      delete socket;
+      Stop();
+      return false;
+    }
+    addr = socket->GetLocalAddress();
+
+    talk_base::AsyncUDPSocket* int_socket =
+        new talk_base::AsyncUDPSocket(socket);
+    if (enable_batching_) {
+      int_socket->EnableBatching(&shard->thread);
+    }
+
+    TurnServer* server = &shard->server;
+    server->set_realm(realm_);
+    server->set_software(software_);
+    server->set_auth_hook(auth_hook_);
+    server->set_enable_batching(enable_batching_);
+    server->AddInternalSocket(int_socket, PROTO_UDP);
+    server->SetExternalSocketFactory(
+        new talk_base::BasicPacketSocketFactory(&shard->thread),
+        talk_base::SocketAddress(ext_ip, 0));
+  }
+
+  int_addr_ = addr;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    shards_[i]->thread.Start();
+  }
+  LOG(LS_INFO) << "Started " << num_shards_ << " TURN shards on "
+               << int_addr_.ToString();
+  return true;
+}
+
+void ShardedTurnServer::Stop() {
+  // Stop all the threads first, so that no shard is still relaying while
+  // another one is torn down.
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    shards_[i]->thread.Stop();
+  }
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    delete shards_[i];
+  }
+  shards_.clear();
+}
+
 }  // namespace cricket
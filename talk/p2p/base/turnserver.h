@@ -32,8 +32,10 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "talk/base/messagequeue.h"
+#include "talk/base/openhashmap.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/socketaddress.h"
 #include "talk/p2p/base/portinterface.h"
@@ -41,6 +43,7 @@
 namespace talk_base {
 class AsyncPacketSocket;
 class ByteBuffer;
+class IPAddress;
 class PacketSocketFactory;
 class Thread;
 }
@@ -85,6 +88,10 @@ class TurnServer : public sigslot::has_slots<> {
 
   void set_enable_otu_nonce(bool enable) { enable_otu_nonce_ = enable; }
 
+  // Whether the external sockets of new allocations receive and send packets
+  // in batches. See PacketSocketFactory::CreateBatchedUdpSocket.
+  void set_enable_batching(bool enable) { enable_batching_ = enable; }
+
   // Starts listening for packets from internal clients.
   void AddInternalSocket(talk_base::AsyncPacketSocket* socket,
                          ProtocolType proto);
@@ -108,7 +115,7 @@ class TurnServer : public sigslot::has_slots<> {
     const talk_base::SocketAddress& src() const { return src_; }
     talk_base::AsyncPacketSocket* socket() { return socket_; }
     bool operator==(const Connection& t) const;
-    bool operator<(const Connection& t) const;
+    size_t Hash() const;
     std::string ToString() const;
 
    private:
@@ -117,10 +124,15 @@ class TurnServer : public sigslot::has_slots<> {
     cricket::ProtocolType proto_;
     talk_base::AsyncPacketSocket* socket_;
   };
+  struct ConnectionHash {
+    size_t operator()(const Connection& conn) const { return conn.Hash(); }
+  };
   class Allocation;
   class Permission;
   class Channel;
-  typedef std::map<Connection, Allocation*> AllocationMap;
+  // Looked up for every packet from a client.
+  typedef talk_base::OpenHashMap<Connection, Allocation*, ConnectionHash>
+      AllocationMap;
 
   void OnInternalPacket(talk_base::AsyncPacketSocket* socket, const char* data,
                         size_t size, const talk_base::SocketAddress& address);
@@ -173,6 +185,7 @@ class TurnServer : public sigslot::has_slots<> {
   // otu - one-time-use. Server will respond with 438 if it's
   // sees the same nonce in next transaction.
   bool enable_otu_nonce_;
+  bool enable_batching_;
   InternalSocketMap server_sockets_;
   ServerSocketMap server_listen_sockets_;
   talk_base::scoped_ptr<talk_base::PacketSocketFactory>
@@ -181,6 +194,52 @@ class TurnServer : public sigslot::has_slots<> {
   AllocationMap allocations_;
 };
 
+// Runs a TurnServer on each of several worker threads, so that one process
+// can relay on all cores. Every shard listens on its own UDP socket bound to
+// the same internal address with SO_REUSEPORT; the kernel hashes the 5-tuple
+// of each client to a fixed socket, and so to a fixed shard, which owns the
+// client's allocation and its relay socket. Nothing on the relay path is
+// shared between shards.
+class ShardedTurnServer {
+ public:
+  explicit ShardedTurnServer(int num_shards);
+  ~ShardedTurnServer();
+
+  int num_shards() const { return num_shards_; }
+
+  // Gets the address that the shards listen on, once started.
+  const talk_base::SocketAddress& internal_address() const {
+    return int_addr_;
+  }
+
+  // These apply to every shard, and must be set before Start.
+  void set_realm(const std::string& realm) { realm_ = realm; }
+  void set_software(const std::string& software) { software_ = software; }
+  // Does not take ownership. The hook is called from all the shard threads,
+  // so it must be thread-safe.
+  void set_auth_hook(TurnAuthInterface* auth_hook) { auth_hook_ = auth_hook; }
+  void set_enable_batching(bool enable) { enable_batching_ = enable; }
+
+  // Binds a socket at |int_addr| for every shard and starts the worker
+  // threads. Relay sockets are created on |ext_ip|. If the port of |int_addr|
+  // is 0, all shards use the port picked for the first one.
+  bool Start(const talk_base::SocketAddress& int_addr,
+             const talk_base::IPAddress& ext_ip);
+  // Stops the worker threads and destroys the shards with their allocations.
+  void Stop();
+
+ private:
+  struct Shard;
+
+  int num_shards_;
+  std::string realm_;
+  std::string software_;
+  TurnAuthInterface* auth_hook_;
+  bool enable_batching_;
+  talk_base::SocketAddress int_addr_;
+  std::vector<Shard*> shards_;
+};
+
 }  // namespace cricket
 
 #endif  // TALK_P2P_BASE_TURNSERVER_H_
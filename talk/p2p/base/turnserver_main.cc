@@ -29,6 +29,7 @@
 
 #include "talk/base/asyncudpsocket.h"
 #include "talk/base/optionsfile.h"
+#include "talk/base/physicalsocketserver.h"
 #include "talk/base/thread.h"
 #include "talk/base/stringencode.h"
 #include "talk/p2p/base/basicpacketsocketfactory.h"
@@ -59,8 +60,8 @@ class TurnFileAuth : public cricket::TurnAuthInterface {
 };
 
 int main(int argc, char **argv) {
-  if (argc != 5) {
-    std::cerr << "usage: turnserver int-addr ext-ip realm auth-file"
+  if (argc != 5 && argc != 6) {
+    std::cerr << "usage: turnserver int-addr ext-ip realm auth-file [threads]"
               << std::endl;
     return 1;
   }
@@ -77,7 +78,42 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  int num_threads = 1;
+  if (argc == 6 &&
+      (!talk_base::FromString(argv[5], &num_threads) || num_threads < 1)) {
+    std::cerr << "Invalid number of threads: " << argv[5] << std::endl;
+    return 1;
+  }
+
+  // Every allocation owns a socket; use the backend that scales with them.
+  talk_base::PhysicalSocketServer ss(
+      talk_base::PhysicalSocketServer::BACKEND_EPOLL);
+  talk_base::SocketServerScope ss_scope(&ss);
   talk_base::Thread* main = talk_base::Thread::Current();
+  TurnFileAuth auth(argv[4]);
+
+  if (num_threads > 1) {
+    // Each worker thread serves the clients that the kernel hashes to its
+    // socket; the main thread has nothing left to do.
+    cricket::ShardedTurnServer server(num_threads);
+    server.set_realm(argv[3]);
+    server.set_software(kSoftware);
+    server.set_auth_hook(&auth);
+    server.set_enable_batching(true);
+    if (!server.Start(int_addr, ext_addr)) {
+      std::cerr << "Failed to start " << num_threads << " threads bound at "
+                << int_addr.ToString() << std::endl;
+      return 1;
+    }
+
+    std::cout << "Listening internally at "
+              << server.internal_address().ToString()
+              << " on " << num_threads << " threads" << std::endl;
+
+    main->Run();
+    return 0;
+  }
+
   talk_base::AsyncUDPSocket* int_socket =
       talk_base::AsyncUDPSocket::Create(main->socketserver(), int_addr);
   if (!int_socket) {
@@ -85,12 +121,13 @@ int main(int argc, char **argv) {
               << int_addr.ToString() << std::endl;
     return 1;
   }
+  int_socket->EnableBatching();
 
   cricket::TurnServer server(main);
-  TurnFileAuth auth(argv[4]);
   server.set_realm(argv[3]);
   server.set_software(kSoftware);
   server.set_auth_hook(&auth);
+  server.set_enable_batching(true);
   server.AddInternalSocket(int_socket, cricket::PROTO_UDP);
   server.SetExternalSocketFactory(new talk_base::BasicPacketSocketFactory(),
                                   talk_base::SocketAddress(ext_addr, 0));
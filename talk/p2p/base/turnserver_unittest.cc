@@ -0,0 +1,460 @@
+/*
+ * libjingle
+ * Copyright 2012, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string>
+#include <vector>
+
+#include "talk/base/asyncudpsocket.h"
+#include "talk/base/bytebuffer.h"
+#include "talk/base/gunit.h"
+#include "talk/base/helpers.h"
+#include "talk/base/logging.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/testclient.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+#include "talk/p2p/base/packetsocketfactory.h"
+#include "talk/p2p/base/stun.h"
+#include "talk/p2p/base/turnserver.h"
+
+using talk_base::AsyncPacketSocket;
+using talk_base::AsyncUDPSocket;
+using talk_base::SocketAddress;
+using talk_base::TestClient;
+using cricket::TurnMessage;
+
+static const SocketAddress kLoopbackAddr("127.0.0.1", 0);
+static const int kNumShards = 4;
+static const int kNumClients = 16;
+
+class ShardedTurnServerTest : public testing::Test {
+ public:
+  ShardedTurnServerTest() : server_(kNumShards) {}
+
+  TestClient* CreateClient() {
+    return new TestClient(AsyncUDPSocket::Create(
+        talk_base::Thread::Current()->socketserver(), kLoopbackAddr));
+  }
+
+  void SendRequest(TestClient* client, int type) {
+    cricket::StunMessage msg;
+    msg.SetType(type);
+    msg.SetTransactionID(
+        talk_base::CreateRandomString(cricket::kStunTransactionIdLength));
+    talk_base::ByteBuffer buf;
+    msg.Write(&buf);
+    client->SendTo(buf.Data(), buf.Length(), server_.internal_address());
+  }
+
+  cricket::StunMessage* Receive(TestClient* client) {
+    talk_base::scoped_ptr<TestClient::Packet> packet(client->NextPacket());
+    if (!packet) {
+      return NULL;
+    }
+    talk_base::ByteBuffer buf(packet->buf, packet->size);
+    talk_base::scoped_ptr<cricket::StunMessage> msg(
+        new cricket::StunMessage());
+    if (!msg->Read(&buf)) {
+      return NULL;
+    }
+    return msg.release();
+  }
+
+ protected:
+  cricket::ShardedTurnServer server_;
+};
+
+// Tests that every client gets an answer, whichever shard it is hashed to.
+TEST_F(ShardedTurnServerTest, TestBindingRequests) {
+  ASSERT_TRUE(server_.Start(kLoopbackAddr, kLoopbackAddr.ipaddr()));
+  EXPECT_NE(0, server_.internal_address().port());
+
+  for (int i = 0; i < kNumClients; ++i) {
+    talk_base::scoped_ptr<TestClient> client(CreateClient());
+    SendRequest(client.get(), cricket::STUN_BINDING_REQUEST);
+    talk_base::scoped_ptr<cricket::StunMessage> msg(Receive(client.get()));
+    ASSERT_TRUE(msg.get() != NULL);
+    EXPECT_EQ(cricket::STUN_BINDING_RESPONSE, msg->type());
+    const cricket::StunAddressAttribute* addr =
+        msg->GetAddress(cricket::STUN_ATTR_XOR_MAPPED_ADDRESS);
+    ASSERT_TRUE(addr != NULL);
+    EXPECT_EQ(client->address(), addr->GetAddress());
+  }
+}
+
+// Tests that allocate requests reach the authentication path of a shard.
+TEST_F(ShardedTurnServerTest, TestAllocateRequiresAuth) {
+  server_.set_realm("example.org");
+  ASSERT_TRUE(server_.Start(kLoopbackAddr, kLoopbackAddr.ipaddr()));
+
+  for (int i = 0; i < kNumClients; ++i) {
+    talk_base::scoped_ptr<TestClient> client(CreateClient());
+    SendRequest(client.get(), cricket::STUN_ALLOCATE_REQUEST);
+    talk_base::scoped_ptr<cricket::StunMessage> msg(Receive(client.get()));
+    ASSERT_TRUE(msg.get() != NULL);
+    EXPECT_EQ(cricket::STUN_ALLOCATE_ERROR_RESPONSE, msg->type());
+    const cricket::StunErrorCodeAttribute* err = msg->GetErrorCode();
+    ASSERT_TRUE(err != NULL);
+    EXPECT_EQ(cricket::STUN_ERROR_UNAUTHORIZED, err->code());
+    EXPECT_TRUE(msg->GetByteString(cricket::STUN_ATTR_NONCE) != NULL);
+  }
+}
+
+// Tests that the shards don't take over a port that is already in use.
+TEST_F(ShardedTurnServerTest, TestStartFailsIfPortTaken) {
+  talk_base::scoped_ptr<TestClient> other(CreateClient());
+  EXPECT_FALSE(server_.Start(other->address(), kLoopbackAddr.ipaddr()));
+
+  // The server can be started again once the port is free.
+  ASSERT_TRUE(server_.Start(kLoopbackAddr, kLoopbackAddr.ipaddr()));
+  server_.Stop();
+}
+
+static const SocketAddress kTurnServerAddr("99.99.99.1", 3478);
+static const talk_base::IPAddress kRelayIP(0x63636302);  // 99.99.99.2
+static const SocketAddress kPeerAddr1("22.22.22.1", 5000);
+static const SocketAddress kPeerAddr2("22.22.22.2", 5000);
+static const char kUsername[] = "test";
+static const char kRealm[] = "example.org";
+static const char kKey[] = "0123456789abcdef";
+static const int kChannel1 = 0x4000;
+static const int kChannel2 = 0x4001;
+
+// A packet socket that records what is sent on it. Packets are "received"
+// by firing SignalReadPacket directly, so tests measure only the server.
+class FakeTurnSocket : public AsyncPacketSocket {
+ public:
+  explicit FakeTurnSocket(const SocketAddress& addr)
+      : addr_(addr), sent_count_(0) {
+  }
+
+  int sent_count() const { return sent_count_; }
+  const std::string& last_packet() const { return last_packet_; }
+  const SocketAddress& last_addr() const { return last_addr_; }
+
+  void Receive(const char* data, size_t size, const SocketAddress& addr) {
+    SignalReadPacket(this, data, size, addr);
+  }
+
+  virtual SocketAddress GetLocalAddress() const { return addr_; }
+  virtual SocketAddress GetRemoteAddress() const { return SocketAddress(); }
+  virtual int Send(const void* pv, size_t cb) {
+    return SendTo(pv, cb, SocketAddress());
+  }
+  virtual int SendTo(const void* pv, size_t cb, const SocketAddress& addr) {
+    ++sent_count_;
+    last_packet_.assign(static_cast<const char*>(pv), cb);
+    last_addr_ = addr;
+    return static_cast<int>(cb);
+  }
+  virtual int Close() { return 0; }
+  virtual State GetState() const { return STATE_BOUND; }
+  virtual int GetOption(talk_base::Socket::Option opt, int* value) {
+    return -1;
+  }
+  virtual int SetOption(talk_base::Socket::Option opt, int value) {
+    return -1;
+  }
+  virtual int GetError() const { return 0; }
+  virtual void SetError(int error) {}
+
+ private:
+  SocketAddress addr_;
+  int sent_count_;
+  std::string last_packet_;
+  SocketAddress last_addr_;
+};
+
+// Hands out FakeTurnSockets for the relayed addresses of allocations. The
+// sockets are owned by the allocations.
+class FakeTurnSocketFactory : public talk_base::PacketSocketFactory {
+ public:
+  FakeTurnSocketFactory() : next_port_(10000) {}
+
+  FakeTurnSocket* socket(size_t index) { return sockets_[index]; }
+
+  virtual AsyncPacketSocket* CreateUdpSocket(
+      const SocketAddress& address, int min_port, int max_port) {
+    FakeTurnSocket* socket =
+        new FakeTurnSocket(SocketAddress(address.ipaddr(), next_port_++));
+    sockets_.push_back(socket);
+    return socket;
+  }
+  virtual AsyncPacketSocket* CreateServerTcpSocket(
+      const SocketAddress& local_address, int min_port, int max_port,
+      int opts) {
+    return NULL;
+  }
+  virtual AsyncPacketSocket* CreateClientTcpSocket(
+      const SocketAddress& local_address, const SocketAddress& remote_address,
+      const talk_base::ProxyInfo& proxy_info, const std::string& user_agent,
+      int opts) {
+    return NULL;
+  }
+
+ private:
+  int next_port_;
+  std::vector<FakeTurnSocket*> sockets_;
+};
+
+class TurnServerTest : public testing::Test,
+                       public cricket::TurnAuthInterface {
+ public:
+  TurnServerTest()
+      : server_(talk_base::Thread::Current()),
+        int_socket_(new FakeTurnSocket(kTurnServerAddr)),
+        factory_(new FakeTurnSocketFactory()) {
+    server_.set_realm(kRealm);
+    server_.set_auth_hook(this);
+    server_.AddInternalSocket(int_socket_, cricket::PROTO_UDP);
+    server_.SetExternalSocketFactory(factory_, SocketAddress(kRelayIP, 0));
+  }
+
+  virtual bool GetKey(const std::string& username, const std::string& realm,
+                      std::string* key) {
+    *key = kKey;
+    return username == kUsername;
+  }
+
+  // Delivers |buf| to the server as if it came from |client|.
+  void SendFromClient(const SocketAddress& client,
+                      const talk_base::ByteBuffer& buf) {
+    int_socket_->Receive(buf.Data(), buf.Length(), client);
+  }
+
+  // Sends |msg| with credentials, and returns the type of the response.
+  int SendRequest(const SocketAddress& client, TurnMessage* msg) {
+    if (nonce_.empty()) {
+      // Get a nonce the way a client would, by sending a request without
+      // credentials. It stays valid for all the requests of a test.
+      TurnMessage req;
+      req.SetType(cricket::STUN_ALLOCATE_REQUEST);
+      req.SetTransactionID(NewTransactionId());
+      talk_base::ByteBuffer buf;
+      req.Write(&buf);
+      SendFromClient(client, buf);
+      TurnMessage resp;
+      if (!ReadResponse(&resp) ||
+          !resp.GetByteString(cricket::STUN_ATTR_NONCE)) {
+        return -1;
+      }
+      nonce_ = resp.GetByteString(cricket::STUN_ATTR_NONCE)->GetString();
+    }
+    msg->SetTransactionID(NewTransactionId());
+    msg->AddAttribute(new cricket::StunByteStringAttribute(
+        cricket::STUN_ATTR_USERNAME, kUsername));
+    msg->AddAttribute(new cricket::StunByteStringAttribute(
+        cricket::STUN_ATTR_REALM, kRealm));
+    msg->AddAttribute(new cricket::StunByteStringAttribute(
+        cricket::STUN_ATTR_NONCE, nonce_));
+    msg->AddMessageIntegrity(kKey);
+    talk_base::ByteBuffer buf;
+    msg->Write(&buf);
+    SendFromClient(client, buf);
+    TurnMessage resp;
+    return ReadResponse(&resp) ? resp.type() : -1;
+  }
+
+  bool ReadResponse(TurnMessage* msg) {
+    talk_base::ByteBuffer buf(int_socket_->last_packet().data(),
+                              int_socket_->last_packet().size());
+    return msg->Read(&buf);
+  }
+
+  bool Allocate(const SocketAddress& client) {
+    TurnMessage msg;
+    msg.SetType(cricket::STUN_ALLOCATE_REQUEST);
+    msg.AddAttribute(new cricket::StunUInt32Attribute(
+        cricket::STUN_ATTR_REQUESTED_TRANSPORT, IPPROTO_UDP << 24));
+    return SendRequest(client, &msg) == cricket::STUN_ALLOCATE_RESPONSE;
+  }
+
+  bool CreatePermission(const SocketAddress& client,
+                        const SocketAddress& peer) {
+    TurnMessage msg;
+    msg.SetType(cricket::TURN_CREATE_PERMISSION_REQUEST);
+    msg.AddAttribute(new cricket::StunXorAddressAttribute(
+        cricket::STUN_ATTR_XOR_PEER_ADDRESS, peer));
+    return SendRequest(client, &msg) ==
+        cricket::TURN_CREATE_PERMISSION_RESPONSE;
+  }
+
+  bool BindChannel(const SocketAddress& client, int id,
+                   const SocketAddress& peer) {
+    TurnMessage msg;
+    msg.SetType(cricket::TURN_CHANNEL_BIND_REQUEST);
+    msg.AddAttribute(new cricket::StunUInt32Attribute(
+        cricket::STUN_ATTR_CHANNEL_NUMBER, id << 16));
+    msg.AddAttribute(new cricket::StunXorAddressAttribute(
+        cricket::STUN_ATTR_XOR_PEER_ADDRESS, peer));
+    return SendRequest(client, &msg) == cricket::TURN_CHANNEL_BIND_RESPONSE;
+  }
+
+  static void WriteChannelData(int id, const std::string& data,
+                               talk_base::ByteBuffer* buf) {
+    buf->WriteUInt16(id);
+    buf->WriteUInt16(static_cast<uint16>(data.size()));
+    buf->WriteString(data);
+  }
+
+ protected:
+  static std::string NewTransactionId() {
+    return talk_base::CreateRandomString(cricket::kStunTransactionIdLength);
+  }
+
+  cricket::TurnServer server_;
+  FakeTurnSocket* int_socket_;
+  FakeTurnSocketFactory* factory_;
+  std::string nonce_;
+};
+
+static const SocketAddress kClientAddr1("11.11.11.11", 1);
+static const SocketAddress kClientAddr2("11.11.11.11", 2);
+
+// Tests that channel data goes to the peer bound to the channel, and that
+// packets from bound peers come back as channel data.
+TEST_F(TurnServerTest, TestChannelDataIsRelayed) {
+  ASSERT_TRUE(Allocate(kClientAddr1));
+  ASSERT_TRUE(BindChannel(kClientAddr1, kChannel1, kPeerAddr1));
+  ASSERT_TRUE(BindChannel(kClientAddr1, kChannel2, kPeerAddr2));
+  FakeTurnSocket* relay = factory_->socket(0);
+
+  talk_base::ByteBuffer buf;
+  WriteChannelData(kChannel2, "hello", &buf);
+  SendFromClient(kClientAddr1, buf);
+  EXPECT_EQ(1, relay->sent_count());
+  EXPECT_EQ(kPeerAddr2, relay->last_addr());
+  EXPECT_EQ("hello", relay->last_packet());
+
+  relay->Receive("world", 5, kPeerAddr1);
+  EXPECT_EQ(kClientAddr1, int_socket_->last_addr());
+  talk_base::ByteBuffer expected;
+  WriteChannelData(kChannel1, "world", &expected);
+  EXPECT_EQ(std::string(expected.Data(), expected.Length()),
+            int_socket_->last_packet());
+
+  // A channel can't be rebound to another peer.
+  EXPECT_FALSE(BindChannel(kClientAddr1, kChannel1, kPeerAddr2));
+}
+
+// Tests that packets from peers with a permission but no channel are sent
+// as data indications, and other packets are dropped.
+TEST_F(TurnServerTest, TestPermissions) {
+  ASSERT_TRUE(Allocate(kClientAddr1));
+  ASSERT_TRUE(CreatePermission(kClientAddr1, kPeerAddr1));
+  FakeTurnSocket* relay = factory_->socket(0);
+
+  // Permissions are per IP address, so any port is fine.
+  SocketAddress peer(kPeerAddr1.ipaddr(), 6000);
+  relay->Receive("data", 4, peer);
+  TurnMessage msg;
+  ASSERT_TRUE(ReadResponse(&msg));
+  EXPECT_EQ(cricket::TURN_DATA_INDICATION, msg.type());
+  ASSERT_TRUE(msg.GetAddress(cricket::STUN_ATTR_XOR_PEER_ADDRESS) != NULL);
+  EXPECT_EQ(peer, msg.GetAddress(
+      cricket::STUN_ATTR_XOR_PEER_ADDRESS)->GetAddress());
+
+  int sent = int_socket_->sent_count();
+  relay->Receive("data", 4, kPeerAddr2);
+  EXPECT_EQ(sent, int_socket_->sent_count());
+}
+
+// Tests that each client 5-tuple gets its own allocation.
+TEST_F(TurnServerTest, TestMultipleAllocations) {
+  ASSERT_TRUE(Allocate(kClientAddr1));
+  ASSERT_TRUE(Allocate(kClientAddr2));
+  ASSERT_TRUE(BindChannel(kClientAddr1, kChannel1, kPeerAddr1));
+  ASSERT_TRUE(BindChannel(kClientAddr2, kChannel1, kPeerAddr2));
+
+  talk_base::ByteBuffer buf;
+  WriteChannelData(kChannel1, "hello", &buf);
+  SendFromClient(kClientAddr2, buf);
+  EXPECT_EQ(0, factory_->socket(0)->sent_count());
+  EXPECT_EQ(1, factory_->socket(1)->sent_count());
+  EXPECT_EQ(kPeerAddr2, factory_->socket(1)->last_addr());
+}
+
+// Measures the per-packet cost of relaying in both directions with many
+// allocations, which is dominated by the allocation and channel lookups.
+TEST_F(TurnServerTest, LookupPerf) {
+  const int kNumAllocations = 10000;
+  const int kChannelsPerAllocation = 1;
+  const int kNumPackets = 1000000;
+
+  uint32 start = talk_base::Time();
+  std::vector<SocketAddress> clients;
+  for (int i = 0; i < kNumAllocations; ++i) {
+    SocketAddress client(talk_base::IPAddress(0x0A000000 + i), 1000 + i % 7);
+    ASSERT_TRUE(Allocate(client));
+    for (int j = 0; j < kChannelsPerAllocation; ++j) {
+      SocketAddress peer(talk_base::IPAddress(0x16000000 + j), 5000 + i);
+      ASSERT_TRUE(BindChannel(client, kChannel1 + j, peer));
+    }
+    clients.push_back(client);
+  }
+  LOG(LS_INFO) << "Set up " << kNumAllocations << " allocations in "
+               << talk_base::TimeSince(start) << " ms";
+
+  std::vector<talk_base::ByteBuffer*> packets;
+  for (int j = 0; j < kChannelsPerAllocation; ++j) {
+    packets.push_back(new talk_base::ByteBuffer());
+    WriteChannelData(kChannel1 + j, std::string(160, 'x'), packets.back());
+  }
+  int sent = 0;
+  start = talk_base::Time();
+  for (int n = 0; n < kNumPackets; ++n) {
+    int i = (n % kNumAllocations) * 7919 % kNumAllocations;
+    SendFromClient(clients[i], *packets[n % kChannelsPerAllocation]);
+  }
+  uint32 elapsed = talk_base::TimeSince(start);
+  for (int i = 0; i < kNumAllocations; ++i) {
+    sent += factory_->socket(i)->sent_count();
+  }
+  EXPECT_EQ(kNumPackets, sent);
+  LOG(LS_INFO) << "Client to peer: " << kNumPackets << " packets in "
+               << elapsed << " ms, "
+               << elapsed * 1000000.0 / kNumPackets << " ns/packet";
+
+  std::string payload(160, 'x');
+  sent = int_socket_->sent_count();
+  start = talk_base::Time();
+  for (int n = 0; n < kNumPackets; ++n) {
+    int i = (n % kNumAllocations) * 7919 % kNumAllocations;
+    int j = n % kChannelsPerAllocation;
+    SocketAddress peer(talk_base::IPAddress(0x16000000 + j), 5000 + i);
+    factory_->socket(i)->Receive(payload.data(), payload.size(), peer);
+  }
+  elapsed = talk_base::TimeSince(start);
+  EXPECT_EQ(kNumPackets, int_socket_->sent_count() - sent);
+  LOG(LS_INFO) << "Peer to client: " << kNumPackets << " packets in "
+               << elapsed << " ms, "
+               << elapsed * 1000000.0 / kNumPackets << " ns/packet";
+
+  for (size_t j = 0; j < packets.size(); ++j) {
+    delete packets[j];
+  }
+}
@@ -31,6 +31,7 @@
 #include "talk/base/byteorder.h"
 #include "talk/base/common.h"
 #include "talk/base/logging.h"
+#include "talk/base/trace.h"
 #include "talk/media/base/rtputils.h"
 #include "talk/p2p/base/transportchannel.h"
 #include "talk/session/media/channelmanager.h"
@@ -85,6 +86,10 @@ static const char kDtlsSrtpExporterLabel[] = "EXTRACTOR-dtls_srtp";
 
 static const int kAgcMinus10db = -10;
 
+// Enough packet buffers for a burst of video packets in flight to the worker
+// thread.
+static const size_t kMaxFreePacketBuffers = 64;
+
 // TODO(hellner): use the device manager for creation of screen capturers when
 // the cl enabling it has landed.
 class NullScreenCapturerFactory : public VideoChannel::ScreenCapturerFactory {
@@ -185,10 +190,6 @@ struct VideoStatsMessageData : public talk_base::MessageData {
   VideoMediaInfo* stats;
 };
 
-struct PacketMessageData : public talk_base::MessageData {
-  talk_base::Buffer packet;
-};
-
 struct AudioRenderMessageData: public talk_base::MessageData {
   AudioRenderMessageData(uint32 s, AudioRenderer* r)
       : ssrc(s), renderer(r), result(false) {}
@@ -399,6 +400,8 @@ BaseChannel::BaseChannel(talk_base::Thread* thread,
       dtls_keyed_(false),
       secure_required_(false) {
   ASSERT(worker_thread_ == talk_base::Thread::Current());
+  packet_pool_ = new talk_base::RefCountedObject<talk_base::PacketBufferPool>(
+      kMaxFreePacketBuffers);
   LOG(LS_INFO) << "Created channel for " << content_name;
 }
 
@@ -580,12 +583,13 @@ void BaseChannel::OnChannelRead(TransportChannel* channel,
                                 const char* data, size_t len, int flags) {
   // OnChannelRead gets called from P2PSocket; now pass data to MediaEngine
   ASSERT(worker_thread_ == talk_base::Thread::Current());
+  LJ_TRACE_EVENT1(LJ_TRACE_CATEGORY_MEDIA, "BaseChannel::OnChannelRead", len);
 
   // When using RTCP multiplexing we might get RTCP packets on the RTP
   // transport. We feed RTP traffic into the demuxer to determine if it is RTCP.
   bool rtcp = PacketIsRtcp(channel, data, len);
-  talk_base::Buffer packet(data, len);
-  HandlePacket(rtcp, &packet);
+  recv_packet_.SetData(data, len);
+  HandlePacket(rtcp, &recv_packet_);
 }
 
 void BaseChannel::OnReadyToSend(TransportChannel* channel) {
@@ -625,6 +629,20 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
     return false;
   }
 
+  // Protect ourselves against crazy data.
+  if (!ValidPacket(rtcp, packet)) {
+    LOG(LS_ERROR) << "Dropping outgoing " << content_name_ << " "
+                  << PacketType(rtcp) << " packet: wrong size="
+                  << packet->length();
+    return false;
+  }
+
+  // Copy the packet into a pooled buffer, which has room for the SRTP auth
+  // tag whatever the capacity of |packet|, and can be handed to the worker
+  // thread without an allocation.
+  talk_base::PacketBuffer* buffer = packet_pool_->Get();
+  VERIFY(buffer->SetData(packet->data(), packet->length()));
+
   // SendPacket gets called from MediaEngine, typically on an encoder thread.
   // If the thread is not our worker thread, we will post to our worker
   // so that the real work happens on our worker. This avoids us having to
@@ -633,14 +651,18 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
   // The only downside is that we can't return a proper failure code if
   // needed. Since UDP is unreliable anyway, this should be a non-issue.
   if (talk_base::Thread::Current() != worker_thread_) {
-    // Avoid a copy by transferring the ownership of the packet data.
+    // The message takes over our reference to the buffer.
     int message_id = (!rtcp) ? MSG_RTPPACKET : MSG_RTCPPACKET;
-    PacketMessageData* data = new PacketMessageData;
-    packet->TransferTo(&data->packet);
-    worker_thread_->Post(this, message_id, data);
+    worker_thread_->Post(this, message_id, buffer);
     return true;
   }
 
+  bool ret = SendPacket_w(rtcp, buffer);
+  buffer->Release();
+  return ret;
+}
+
+bool BaseChannel::SendPacket_w(bool rtcp, talk_base::PacketBuffer* packet) {
   // Now that we are on the correct thread, ensure we have a place to send this
   // packet before doing anything. (We might get RTCP packets that we don't
   // intend to send.) If we've negotiated RTCP mux, send RTCP over the RTP
@@ -651,14 +673,6 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
     return false;
   }
 
-  // Protect ourselves against crazy data.
-  if (!ValidPacket(rtcp, packet)) {
-    LOG(LS_ERROR) << "Dropping outgoing " << content_name_ << " "
-                  << PacketType(rtcp) << " packet: wrong size="
-                  << packet->length();
-    return false;
-  }
-
   // Signal to the media sink before protecting the packet.
   {
     talk_base::CritScope cs(&signal_send_packet_cs_);
@@ -667,13 +681,10 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
 
   // Protect if needed.
   if (srtp_filter_.IsActive()) {
-    bool res;
     char* data = packet->data();
     int len = static_cast<int>(packet->length());
     if (!rtcp) {
-      res = srtp_filter_.ProtectRtp(data, len,
-                                    static_cast<int>(packet->capacity()), &len);
-      if (!res) {
+      if (!srtp_filter_.ProtectRtp(packet)) {
         int seq_num = -1;
         uint32 ssrc = 0;
         GetRtpSeqNum(data, len, &seq_num);
@@ -684,10 +695,7 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
         return false;
       }
     } else {
-      res = srtp_filter_.ProtectRtcp(data, len,
-                                     static_cast<int>(packet->capacity()),
-                                     &len);
-      if (!res) {
+      if (!srtp_filter_.ProtectRtcp(packet)) {
         int type = -1;
         GetRtcpType(data, len, &type);
         LOG(LS_ERROR) << "Failed to protect " << content_name_
@@ -695,9 +703,6 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
         return false;
       }
     }
-
-    // Update the length of the packet now that we've added the auth tag.
-    packet->SetLength(len);
   } else if (secure_required_) {
     // This is a double check for something that supposedly can't happen.
     LOG(LS_ERROR) << "Can't send outgoing " << PacketType(rtcp)
@@ -714,7 +719,7 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
   }
 
   // Bon voyage.
-  int ret = channel->SendPacket(packet->data(), packet->length(),
+  int ret = channel->SendPacketBuffer(packet,
       (secure() && secure_dtls()) ? PF_SRTP_BYPASS : 0);
   if (ret != static_cast<int>(packet->length())) {
     if (channel->GetError() == EWOULDBLOCK) {
@@ -746,8 +751,11 @@ bool BaseChannel::WantsPacket(bool rtcp, talk_base::Buffer* packet) {
 }
 
 void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
-  if (!WantsPacket(rtcp, packet)) {
-    return;
+  {
+    LJ_TRACE_EVENT1(LJ_TRACE_CATEGORY_MEDIA, "BaseChannel::WantsPacket", rtcp);
+    if (!WantsPacket(rtcp, packet)) {
+      return;
+    }
   }
 
   if (!has_received_packet_) {
@@ -763,6 +771,7 @@ void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
 
   // Unprotect the packet, if needed.
   if (srtp_filter_.IsActive()) {
+    LJ_TRACE_EVENT1(LJ_TRACE_CATEGORY_MEDIA, "BaseChannel::Unprotect", rtcp);
     char* data = packet->data();
     int len = static_cast<int>(packet->length());
     bool res;
@@ -813,6 +822,7 @@ void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
   }
 
   // Push it down to the media channel.
+  LJ_TRACE_EVENT1(LJ_TRACE_CATEGORY_MEDIA, "BaseChannel::Deliver", rtcp);
   if (!rtcp) {
     media_channel_->OnPacketReceived(packet);
   } else {
@@ -1361,9 +1371,10 @@ void BaseChannel::OnMessage(talk_base::Message *pmsg) {
 
     case MSG_RTPPACKET:
     case MSG_RTCPPACKET: {
-      PacketMessageData* data = static_cast<PacketMessageData*>(pmsg->pdata);
-      SendPacket(pmsg->message_id == MSG_RTCPPACKET, &data->packet);
-      delete data;  // because it is Posted
+      talk_base::PacketBuffer* packet =
+          static_cast<talk_base::PacketBuffer*>(pmsg->pdata);
+      SendPacket_w(pmsg->message_id == MSG_RTCPPACKET, packet);
+      packet->Release();  // because it is Posted
       break;
     }
     case MSG_FIRSTPACKETRECEIVED: {
@@ -34,6 +34,8 @@
 #include "talk/base/asyncudpsocket.h"
 #include "talk/base/criticalsection.h"
 #include "talk/base/network.h"
+#include "talk/base/packetbuffer.h"
+#include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/window.h"
 #include "talk/media/base/mediachannel.h"
@@ -262,6 +264,7 @@ class BaseChannel
   bool PacketIsRtcp(const TransportChannel* channel, const char* data,
                     size_t len);
   bool SendPacket(bool rtcp, talk_base::Buffer* packet);
+  bool SendPacket_w(bool rtcp, talk_base::PacketBuffer* packet);
   virtual bool WantsPacket(bool rtcp, talk_base::Buffer* packet);
   void HandlePacket(bool rtcp, talk_base::Buffer* packet);
 
@@ -325,6 +328,12 @@ class BaseChannel
   talk_base::CriticalSection signal_send_packet_cs_;
   talk_base::CriticalSection signal_recv_packet_cs_;
 
+  // Outgoing packets are copied into buffers from this pool, which leave
+  // room for the SRTP auth tag. Incoming packets are copied into
+  // |recv_packet_|, which keeps its capacity between packets.
+  talk_base::scoped_refptr<talk_base::PacketBufferPool> packet_pool_;
+  talk_base::Buffer recv_packet_;
+
   talk_base::Thread* worker_thread_;
   MediaEngineInterface* media_engine_;
   BaseSession* session_;
@@ -0,0 +1,308 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/session/media/srtpaesni.h"
+
+#include <cstring>
+
+#include "talk/base/logging.h"
+#include "talk/media/base/cpuid.h"
+
+#ifdef HAVE_SRTP
+#ifdef SRTP_RELATIVE_PATH
+#include "srtp.h"  // NOLINT
+extern "C" {
+#include "aes_icm.h"  // NOLINT
+#include "alloc.h"  // NOLINT
+}
+#else
+#include "third_party/libsrtp/include/srtp.h"
+extern "C" {
+#include "third_party/libsrtp/crypto/include/aes_icm.h"
+#include "third_party/libsrtp/crypto/include/alloc.h"
+}
+#endif  // SRTP_RELATIVE_PATH
+
+// The intrinsics are compiled for AES-NI per function, so that the rest of
+// the build doesn't need to target it; the cipher is only installed when the
+// CPU has the instructions.
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define HAVE_AESNI_CIPHER
+#define AESNI_TARGET
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_AESNI_CIPHER
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+#endif
+#endif  // HAVE_SRTP
+
+#ifdef HAVE_AESNI_CIPHER
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+namespace cricket {
+
+#ifdef HAVE_AESNI_CIPHER
+
+// The portable cipher, from libSRTP.
+extern "C" cipher_type_t aes_icm;
+
+namespace {
+
+const int kAes128KeyAndSaltLen = 30;
+const int kAes128Rounds = 10;
+const int kBlockSize = 16;
+const unsigned int kMaxBlockIndex = 0xffff;
+
+// The counter, offset and keystream buffer are kept in the libSRTP context,
+// so that the portable functions can take over for keys other than AES-128
+// and for setting the IV; only the keystream is generated with AES-NI.
+struct AesNiIcmContext {
+  aes_icm_ctx_t icm;
+  v128_t round_keys[kAes128Rounds + 1];
+  int use_aesni;
+};
+
+extern cipher_type_t aesni_icm;
+
+char aesni_icm_description[] = "aes integer counter mode (aes-ni)";
+
+AESNI_TARGET inline __m128i ExpandKeyStep(__m128i key, __m128i assist) {
+  assist = _mm_shuffle_epi32(assist, 0xff);
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, assist);
+}
+
+// _mm_aeskeygenassist_si128 takes the round constant as an immediate.
+#define EXPAND_KEY(i, rcon) \
+    keys[i] = ExpandKeyStep(keys[i - 1], \
+                            _mm_aeskeygenassist_si128(keys[i - 1], rcon))
+
+AESNI_TARGET void ExpandKey(const uint8_t* key, v128_t* round_keys) {
+  __m128i keys[kAes128Rounds + 1];
+  keys[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+  EXPAND_KEY(1, 0x01);
+  EXPAND_KEY(2, 0x02);
+  EXPAND_KEY(3, 0x04);
+  EXPAND_KEY(4, 0x08);
+  EXPAND_KEY(5, 0x10);
+  EXPAND_KEY(6, 0x20);
+  EXPAND_KEY(7, 0x40);
+  EXPAND_KEY(8, 0x80);
+  EXPAND_KEY(9, 0x1b);
+  EXPAND_KEY(10, 0x36);
+  for (int i = 0; i <= kAes128Rounds; ++i) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&round_keys[i]), keys[i]);
+  }
+}
+
+#undef EXPAND_KEY
+
+// Returns the counter with its block index, the last 16 bits in network
+// order, set to |index|.
+AESNI_TARGET inline __m128i CounterBlock(__m128i counter, unsigned int index) {
+  return _mm_insert_epi16(counter,
+                          static_cast<int>(((index & 0xff) << 8) |
+                                           ((index >> 8) & 0xff)), 7);
+}
+
+AESNI_TARGET inline void XorBlock(uint8_t* buf, __m128i keystream) {
+  __m128i* p = reinterpret_cast<__m128i*>(buf);
+  _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), keystream));
+}
+
+err_status_t AesNiIcmAlloc(cipher_t** c, int key_len) {
+  if (key_len != 30 && key_len != 38 && key_len != 46) {
+    return err_status_bad_param;
+  }
+  int size = sizeof(cipher_t) + sizeof(AesNiIcmContext);
+  uint8_t* pointer = static_cast<uint8_t*>(crypto_alloc(size));
+  if (!pointer) {
+    return err_status_alloc_fail;
+  }
+  *c = reinterpret_cast<cipher_t*>(pointer);
+  (*c)->type = &aesni_icm;
+  (*c)->state = pointer + sizeof(cipher_t);
+  (*c)->key_len = key_len;
+  ++aesni_icm.ref_count;
+  return err_status_ok;
+}
+
+err_status_t AesNiIcmDealloc(cipher_t* c) {
+  memset(c, 0, sizeof(cipher_t) + sizeof(AesNiIcmContext));
+  crypto_free(c);
+  --aesni_icm.ref_count;
+  return err_status_ok;
+}
+
+err_status_t AesNiIcmInit(void* state, const uint8_t* key, int key_len,
+                          cipher_direction_t) {
+  AesNiIcmContext* c = static_cast<AesNiIcmContext*>(state);
+  err_status_t status = aes_icm_context_init(&c->icm, key, key_len);
+  if (status) {
+    return status;
+  }
+  c->use_aesni = (key_len == kAes128KeyAndSaltLen);
+  if (c->use_aesni) {
+    ExpandKey(key, c->round_keys);
+  }
+  return err_status_ok;
+}
+
+// libSRTP passes the state, not the cipher.
+err_status_t AesNiIcmSetIv(cipher_t* state, void* iv) {
+  AesNiIcmContext* c = reinterpret_cast<AesNiIcmContext*>(state);
+  return aes_icm_set_iv(&c->icm, iv);
+}
+
+// Same as aes_icm_encrypt(), but makes four blocks of keystream at a time
+// while there is enough data, which keeps the AES-NI pipeline busy.
+AESNI_TARGET err_status_t AesNiIcmEncrypt(void* state, uint8_t* buf,
+                                          unsigned int* enc_len) {
+  AesNiIcmContext* c = static_cast<AesNiIcmContext*>(state);
+  if (!c->use_aesni) {
+    return aes_icm_encrypt(&c->icm, buf, enc_len);
+  }
+
+  aes_icm_ctx_t* icm = &c->icm;
+  unsigned int bytes = *enc_len;
+  unsigned int index = (icm->counter.v8[14] << 8) | icm->counter.v8[15];
+  if (bytes + index > kMaxBlockIndex) {
+    return err_status_terminus;
+  }
+
+  // Use up the keystream left over from the previous call.
+  if (icm->bytes_in_buffer > 0) {
+    unsigned int left = icm->bytes_in_buffer;
+    unsigned int count = (bytes < left) ? bytes : left;
+    const uint8_t* keystream = icm->keystream_buffer.v8 + kBlockSize - left;
+    for (unsigned int i = 0; i < count; ++i) {
+      buf[i] ^= keystream[i];
+    }
+    buf += count;
+    bytes -= count;
+    icm->bytes_in_buffer -= count;
+    if (!bytes) {
+      return err_status_ok;
+    }
+  }
+
+  __m128i keys[kAes128Rounds + 1];
+  for (int i = 0; i <= kAes128Rounds; ++i) {
+    keys[i] = _mm_loadu_si128(reinterpret_cast<__m128i*>(&c->round_keys[i]));
+  }
+  __m128i counter = _mm_loadu_si128(reinterpret_cast<__m128i*>(&icm->counter));
+
+  for (; bytes >= 4 * kBlockSize; bytes -= 4 * kBlockSize) {
+    __m128i b0 = _mm_xor_si128(CounterBlock(counter, index), keys[0]);
+    __m128i b1 = _mm_xor_si128(CounterBlock(counter, index + 1), keys[0]);
+    __m128i b2 = _mm_xor_si128(CounterBlock(counter, index + 2), keys[0]);
+    __m128i b3 = _mm_xor_si128(CounterBlock(counter, index + 3), keys[0]);
+    for (int i = 1; i < kAes128Rounds; ++i) {
+      b0 = _mm_aesenc_si128(b0, keys[i]);
+      b1 = _mm_aesenc_si128(b1, keys[i]);
+      b2 = _mm_aesenc_si128(b2, keys[i]);
+      b3 = _mm_aesenc_si128(b3, keys[i]);
+    }
+    XorBlock(buf, _mm_aesenclast_si128(b0, keys[kAes128Rounds]));
+    XorBlock(buf + kBlockSize, _mm_aesenclast_si128(b1, keys[kAes128Rounds]));
+    XorBlock(buf + 2 * kBlockSize,
+             _mm_aesenclast_si128(b2, keys[kAes128Rounds]));
+    XorBlock(buf + 3 * kBlockSize,
+             _mm_aesenclast_si128(b3, keys[kAes128Rounds]));
+    buf += 4 * kBlockSize;
+    index += 4;
+  }
+
+  while (bytes > 0) {
+    __m128i b = _mm_xor_si128(CounterBlock(counter, index), keys[0]);
+    for (int i = 1; i < kAes128Rounds; ++i) {
+      b = _mm_aesenc_si128(b, keys[i]);
+    }
+    b = _mm_aesenclast_si128(b, keys[kAes128Rounds]);
+    ++index;
+    if (bytes >= static_cast<unsigned int>(kBlockSize)) {
+      XorBlock(buf, b);
+      buf += kBlockSize;
+      bytes -= kBlockSize;
+    } else {
+      // Keep the rest of the block for the next call.
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&icm->keystream_buffer), b);
+      for (unsigned int i = 0; i < bytes; ++i) {
+        buf[i] ^= icm->keystream_buffer.v8[i];
+      }
+      icm->bytes_in_buffer = kBlockSize - bytes;
+      bytes = 0;
+    }
+  }
+
+  icm->counter.v8[14] = static_cast<uint8_t>(index >> 8);
+  icm->counter.v8[15] = static_cast<uint8_t>(index);
+  return err_status_ok;
+}
+
+cipher_type_t aesni_icm = {
+  AesNiIcmAlloc,
+  AesNiIcmDealloc,
+  AesNiIcmInit,
+  AesNiIcmEncrypt,
+  AesNiIcmEncrypt,
+  AesNiIcmSetIv,
+  aesni_icm_description,
+  0,     // instance count
+  NULL,  // test data, taken from aes_icm when installed
+  NULL,  // debug module
+  AES_ICM
+};
+
+}  // namespace
+
+bool EnableAesNiSrtpCipher(bool enable) {
+  if (enable && !HasAesNi()) {
+    return false;
+  }
+  aesni_icm.test_data = aes_icm.test_data;
+  int err = crypto_kernel_replace_cipher_type(
+      enable ? &aesni_icm : &aes_icm, AES_ICM);
+  if (err != err_status_ok) {
+    LOG(LS_ERROR) << "Failed to replace the SRTP cipher, err=" << err;
+    return false;
+  }
+  return true;
+}
+
+#else  // !HAVE_AESNI_CIPHER
+
+bool EnableAesNiSrtpCipher(bool enable) {
+  return !enable;
+}
+
+#endif  // HAVE_AESNI_CIPHER
+
+}  // namespace cricket
@@ -37,6 +37,7 @@
 #include "talk/base/stringencode.h"
 #include "talk/base/timeutils.h"
 #include "talk/media/base/rtputils.h"
+#include "talk/session/media/srtpaesni.h"
 
 // Enable this line to turn on SRTP debugging
 // #define SRTP_DEBUG
@@ -211,6 +212,24 @@ bool SrtpFilter::ProtectRtcp(void* p, int in_len, int max_len, int* out_len) {
   }
 }
 
+bool SrtpFilter::ProtectRtp(talk_base::PacketBuffer* packet) {
+  int len = static_cast<int>(packet->length());
+  int max_len = len + static_cast<int>(packet->tailroom());
+  if (!ProtectRtp(packet->data(), len, max_len, &len)) {
+    return false;
+  }
+  return packet->SetLength(len);
+}
+
+bool SrtpFilter::ProtectRtcp(talk_base::PacketBuffer* packet) {
+  int len = static_cast<int>(packet->length());
+  int max_len = len + static_cast<int>(packet->tailroom());
+  if (!ProtectRtcp(packet->data(), len, max_len, &len)) {
+    return false;
+  }
+  return packet->SetLength(len);
+}
+
 bool SrtpFilter::UnprotectRtp(void* p, int in_len, int* out_len) {
   if (!IsActive()) {
     LOG(LS_WARNING) << "Failed to UnprotectRtp: SRTP not active";
@@ -231,6 +250,22 @@ bool SrtpFilter::UnprotectRtcp(void* p, int in_len, int* out_len) {
   }
 }
 
+int SrtpFilter::ProtectRtp(SrtpPacket* packets, int count) {
+  if (!IsActive()) {
+    LOG(LS_WARNING) << "Failed to ProtectRtp: SRTP not active";
+    return 0;
+  }
+  return send_session_->ProtectRtp(packets, count);
+}
+
+int SrtpFilter::UnprotectRtp(SrtpPacket* packets, int count) {
+  if (!IsActive()) {
+    LOG(LS_WARNING) << "Failed to UnprotectRtp: SRTP not active";
+    return 0;
+  }
+  return recv_session_->UnprotectRtp(packets, count);
+}
+
 void SrtpFilter::set_signal_silent_time(uint32 signal_silent_time_in_ms) {
   signal_silent_time_in_ms_ = signal_silent_time_in_ms;
   if (state_ == ST_ACTIVE) {
@@ -462,29 +497,50 @@ bool SrtpSession::ProtectRtp(void* p, int in_len, int max_len, int* out_len) {
     return false;
   }
 
-  int need_len = in_len + rtp_auth_tag_len_;  // NOLINT
-  if (max_len < need_len) {
-    LOG(LS_WARNING) << "Failed to protect SRTP packet: The buffer length "
-                    << max_len << " is less than the needed " << need_len;
+  if (!HasRoomForRtpAuthTag(in_len, max_len)) {
     return false;
   }
 
   *out_len = in_len;
   int err = srtp_protect(session_, p, out_len);
-  uint32 ssrc;
-  if (GetRtpSsrc(p, in_len, &ssrc)) {
-    srtp_stat_->AddProtectRtpResult(ssrc, err);
-  }
-  int seq_num;
-  GetRtpSeqNum(p, in_len, &seq_num);
-  if (err != err_status_ok) {
-    LOG(LS_WARNING) << "Failed to protect SRTP packet, seqnum="
-                    << seq_num << ", err=" << err << ", last seqnum="
-                    << last_send_seq_num_;
-    return false;
+  return OnProtectRtpResult(p, in_len, err);
+}
+
+int SrtpSession::ProtectRtp(SrtpPacket* packets, int count) {
+  if (!session_) {
+    LOG(LS_WARNING) << "Failed to protect SRTP packets: no SRTP Session";
+    return 0;
+  }
+
+  int protected_count = 0;
+  srtp_packet_t batch[kMaxBatchSize];
+  SrtpPacket* batched[kMaxBatchSize];
+  int i = 0;
+  while (i < count) {
+    int batch_size = 0;
+    for (; i < count && batch_size < kMaxBatchSize; ++i) {
+      SrtpPacket* packet = &packets[i];
+      packet->ok = false;
+      if (!HasRoomForRtpAuthTag(packet->len, packet->max_len)) {
+        continue;
+      }
+      batch[batch_size].hdr = packet->data;
+      batch[batch_size].len = packet->len;
+      batched[batch_size] = packet;
+      ++batch_size;
+    }
+    srtp_protect_batch(session_, batch, batch_size);
+    for (int j = 0; j < batch_size; ++j) {
+      SrtpPacket* packet = batched[j];
+      packet->ok = OnProtectRtpResult(packet->data, packet->len,
+                                      batch[j].status);
+      if (packet->ok) {
+        packet->len = batch[j].len;
+        ++protected_count;
+      }
+    }
   }
-  last_send_seq_num_ = seq_num;
-  return true;
+  return protected_count;
 }
 
 bool SrtpSession::ProtectRtcp(void* p, int in_len, int max_len, int* out_len) {
@@ -518,15 +574,35 @@ bool SrtpSession::UnprotectRtp(void* p, int in_len, int* out_len) {
 
   *out_len = in_len;
   int err = srtp_unprotect(session_, p, out_len);
-  uint32 ssrc;
-  if (GetRtpSsrc(p, in_len, &ssrc)) {
-    srtp_stat_->AddUnprotectRtpResult(ssrc, err);
+  return OnUnprotectRtpResult(p, in_len, err);
+}
+
+int SrtpSession::UnprotectRtp(SrtpPacket* packets, int count) {
+  if (!session_) {
+    LOG(LS_WARNING) << "Failed to unprotect SRTP packets: no SRTP Session";
+    return 0;
   }
-  if (err != err_status_ok) {
-    LOG(LS_WARNING) << "Failed to unprotect SRTP packet, err=" << err;
-    return false;
+
+  int unprotected_count = 0;
+  srtp_packet_t batch[kMaxBatchSize];
+  for (int i = 0; i < count; i += kMaxBatchSize) {
+    int batch_size = std::min(count - i, kMaxBatchSize);
+    for (int j = 0; j < batch_size; ++j) {
+      batch[j].hdr = packets[i + j].data;
+      batch[j].len = packets[i + j].len;
+    }
+    srtp_unprotect_batch(session_, batch, batch_size);
+    for (int j = 0; j < batch_size; ++j) {
+      SrtpPacket* packet = &packets[i + j];
+      packet->ok = OnUnprotectRtpResult(packet->data, packet->len,
+                                        batch[j].status);
+      if (packet->ok) {
+        packet->len = batch[j].len;
+        ++unprotected_count;
+      }
+    }
   }
-  return true;
+  return unprotected_count;
 }
 
 bool SrtpSession::UnprotectRtcp(void* p, int in_len, int* out_len) {
@@ -549,6 +625,45 @@ void SrtpSession::set_signal_silent_time(uint32 signal_silent_time_in_ms) {
   srtp_stat_->set_signal_silent_time(signal_silent_time_in_ms);
 }
 
+bool SrtpSession::HasRoomForRtpAuthTag(int in_len, int max_len) const {
+  int need_len = in_len + rtp_auth_tag_len_;  // NOLINT
+  if (max_len < need_len) {
+    LOG(LS_WARNING) << "Failed to protect SRTP packet: The buffer length "
+                    << max_len << " is less than the needed " << need_len;
+    return false;
+  }
+  return true;
+}
+
+bool SrtpSession::OnProtectRtpResult(const void* p, int in_len, int err) {
+  uint32 ssrc;
+  if (GetRtpSsrc(p, in_len, &ssrc)) {
+    srtp_stat_->AddProtectRtpResult(ssrc, err);
+  }
+  int seq_num;
+  GetRtpSeqNum(p, in_len, &seq_num);
+  if (err != err_status_ok) {
+    LOG(LS_WARNING) << "Failed to protect SRTP packet, seqnum="
+                    << seq_num << ", err=" << err << ", last seqnum="
+                    << last_send_seq_num_;
+    return false;
+  }
+  last_send_seq_num_ = seq_num;
+  return true;
+}
+
+bool SrtpSession::OnUnprotectRtpResult(const void* p, int in_len, int err) {
+  uint32 ssrc;
+  if (GetRtpSsrc(p, in_len, &ssrc)) {
+    srtp_stat_->AddUnprotectRtpResult(ssrc, err);
+  }
+  if (err != err_status_ok) {
+    LOG(LS_WARNING) << "Failed to unprotect SRTP packet, err=" << err;
+    return false;
+  }
+  return true;
+}
+
 bool SrtpSession::SetKey(int type, const std::string& cs,
                          const uint8* key, int len) {
   if (session_) {
@@ -615,6 +730,10 @@ bool SrtpSession::Init() {
       return false;
     }
 
+    if (EnableAesNiSrtpCipher(true)) {
+      LOG(LS_INFO) << "Using AES-NI for SRTP";
+    }
+
     inited_ = true;
   }
 
@@ -693,6 +812,16 @@ bool SrtpSession::UnprotectRtcp(void* data, int in_len, int* out_len) {
   return SrtpNotAvailable(__FUNCTION__);
 }
 
+int SrtpSession::ProtectRtp(SrtpPacket* packets, int count) {
+  SrtpNotAvailable(__FUNCTION__);
+  return 0;
+}
+
+int SrtpSession::UnprotectRtp(SrtpPacket* packets, int count) {
+  SrtpNotAvailable(__FUNCTION__);
+  return 0;
+}
+
 void SrtpSession::set_signal_silent_time(uint32 signal_silent_time) {
   // Do nothing.
 }
@@ -34,6 +34,7 @@
 #include <vector>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/packetbuffer.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/sigslotrepeater.h"
 #include "talk/media/base/cryptoparams.h"
@@ -66,6 +67,20 @@ class SrtpStat;
 
 void EnableSrtpDebugging();
 
+// A packet in a batch passed to SrtpFilter::ProtectRtp/UnprotectRtp. It is
+// transformed in place; on success, |len| is updated and |ok| set.
+struct SrtpPacket {
+  SrtpPacket() : data(NULL), len(0), max_len(0), ok(false) {}
+  SrtpPacket(void* data, int len, int max_len)
+      : data(data), len(len), max_len(max_len), ok(false) {}
+
+  void* data;
+  int len;
+  // The size of the buffer at |data|; only used for protection.
+  int max_len;
+  bool ok;
+};
+
 // Class to transform SRTP to/from RTP.
 // Initialize by calling SetSend with the local security params, then call
 // SetRecv once the remote security params are received. At that point
@@ -122,10 +137,19 @@ class SrtpFilter {
   // If an HMAC is used, this will increase the packet size.
   bool ProtectRtp(void* data, int in_len, int max_len, int* out_len);
   bool ProtectRtcp(void* data, int in_len, int max_len, int* out_len);
+  // As above, using the tailroom of |packet| for the HMAC.
+  bool ProtectRtp(talk_base::PacketBuffer* packet);
+  bool ProtectRtcp(talk_base::PacketBuffer* packet);
   // Decrypts/verifies an invidiual RTP/RTCP packet.
   // If an HMAC is used, this will decrease the packet size.
   bool UnprotectRtp(void* data, int in_len, int* out_len);
   bool UnprotectRtcp(void* data, int in_len, int* out_len);
+  // Encrypts/signs or decrypts/verifies |count| RTP packets, in place. The
+  // SRTP stream is looked up once per run of packets with the same SSRC
+  // instead of once per packet. A failed packet doesn't stop the others.
+  // Returns the number of packets that succeeded.
+  int ProtectRtp(SrtpPacket* packets, int count);
+  int UnprotectRtp(SrtpPacket* packets, int count);
 
   // Update the silent threshold (in ms) for signaling errors.
   void set_signal_silent_time(uint32 signal_silent_time_in_ms);
@@ -204,6 +228,9 @@ class SrtpSession {
   // If an HMAC is used, this will decrease the packet size.
   bool UnprotectRtp(void* data, int in_len, int* out_len);
   bool UnprotectRtcp(void* data, int in_len, int* out_len);
+  // Batch versions of the above for RTP, see SrtpFilter.
+  int ProtectRtp(SrtpPacket* packets, int count);
+  int UnprotectRtp(SrtpPacket* packets, int count);
 
   // Update the silent threshold (in ms) for signaling errors.
   void set_signal_silent_time(uint32 signal_silent_time_in_ms);
@@ -212,7 +239,16 @@ class SrtpSession {
       SignalSrtpError;
 
  private:
+  // The most packets handed to libsrtp in one call.
+  static const int kMaxBatchSize = 32;
+
   bool SetKey(int type, const std::string& cs, const uint8* key, int len);
+  // Checks that |max_len| leaves room for the auth tag of an RTP packet.
+  bool HasRoomForRtpAuthTag(int in_len, int max_len) const;
+  // Records the result |err| of protecting or unprotecting the RTP packet
+  // |p| of length |in_len|, and returns whether it succeeded.
+  bool OnProtectRtpResult(const void* p, int in_len, int err);
+  bool OnUnprotectRtpResult(const void* p, int in_len, int err);
   static bool Init();
   void HandleEvent(const srtp_event_data_t* ev);
   static void HandleEventThunk(srtp_event_data_t* ev);
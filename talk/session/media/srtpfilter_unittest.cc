@@ -28,9 +28,12 @@
 #include "talk/base/byteorder.h"
 #include "talk/base/gunit.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/media/base/cryptoparams.h"
 #include "talk/media/base/fakertp.h"
 #include "talk/p2p/base/sessiondescription.h"
+#include "talk/media/base/cpuid.h"
+#include "talk/session/media/srtpaesni.h"
 #include "talk/session/media/srtpfilter.h"
 #ifdef SRTP_RELATIVE_PATH
 #include "crypto/include/err.h"
@@ -694,6 +697,206 @@ TEST_F(SrtpSessionTest, TestReplay) {
                              &out_len));
 }
 
+// Writes an RTP packet with sequence number |seqnum| and |payload_len| bytes
+// of payload to |packet|, and returns its length.
+static int MakeRtpPacket(uint16 seqnum, int payload_len, char* packet) {
+  const int kHeaderLen = 12;
+  memcpy(packet, kPcmuFrame, kHeaderLen);
+  talk_base::SetBE16(reinterpret_cast<uint8*>(packet) + 2, seqnum);
+  memset(packet + kHeaderLen, seqnum, payload_len);
+  return kHeaderLen + payload_len;
+}
+
+// Fills |packets| with RTP packets of |payload_len| bytes each, numbered from
+// |seqnum|, backed by |buffer|, which has room for |max_len| bytes per packet.
+static void MakeRtpPackets(uint16 seqnum, int payload_len, int max_len,
+                           char* buffer, cricket::SrtpPacket* packets,
+                           int count) {
+  for (int i = 0; i < count; ++i) {
+    char* packet = buffer + i * max_len;
+    int len = MakeRtpPacket(static_cast<uint16>(seqnum + i), payload_len,
+                            packet);
+    packets[i] = cricket::SrtpPacket(packet, len, max_len);
+  }
+}
+
+// Test that a batch of packets, larger than libsrtp is handed at once, can be
+// protected and unprotected, and that a packet that fails doesn't affect the
+// others.
+TEST_F(SrtpSessionTest, TestBatchProtectUnprotect) {
+  const int kCount = 40;
+  const int kMaxLen = 1100;
+  EXPECT_TRUE(s1_.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+  EXPECT_TRUE(s2_.SetRecv(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+
+  char buffer[kCount * kMaxLen];
+  char original[kCount * kMaxLen];
+  cricket::SrtpPacket packets[kCount];
+  MakeRtpPackets(1, 1000, kMaxLen, buffer, packets, kCount);
+  memcpy(original, buffer, sizeof(buffer));
+  // No room for the auth tag.
+  packets[3].max_len = packets[3].len;
+
+  EXPECT_EQ(kCount - 1, s1_.ProtectRtp(packets, kCount));
+  for (int i = 0; i < kCount; ++i) {
+    EXPECT_EQ(i != 3, packets[i].ok);
+    EXPECT_EQ(1012 + (i != 3 ? rtp_auth_tag_len(CS_AES_CM_128_HMAC_SHA1_80)
+                             : 0), packets[i].len);
+  }
+
+  // The unprotected packet fails authentication.
+  EXPECT_EQ(kCount - 1, s2_.UnprotectRtp(packets, kCount));
+  for (int i = 0; i < kCount; ++i) {
+    EXPECT_EQ(i != 3, packets[i].ok);
+    EXPECT_EQ(1012, packets[i].len);
+    EXPECT_EQ(0, memcmp(original + i * kMaxLen, buffer + i * kMaxLen, 1012));
+  }
+
+  // Replays fail, in a batch as one at a time.
+  MakeRtpPackets(1, 1000, kMaxLen, buffer, packets, 2);
+  EXPECT_EQ(2, s1_.ProtectRtp(packets, 2));
+  EXPECT_EQ(0, s2_.UnprotectRtp(packets, 2));
+}
+
+// Test that a batch mixing the packets of several streams switches between
+// them, and creates the streams it hasn't seen yet.
+TEST_F(SrtpSessionTest, TestBatchProtectSeveralStreams) {
+  const int kCount = 12;
+  const int kMaxLen = 200;
+  EXPECT_TRUE(s1_.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+  EXPECT_TRUE(s2_.SetRecv(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+
+  char buffer[kCount * kMaxLen];
+  char original[kCount * kMaxLen];
+  cricket::SrtpPacket packets[kCount];
+  MakeRtpPackets(1, 100, kMaxLen, buffer, packets, kCount);
+  // Runs of one, two and three packets of three streams.
+  const uint32 kSsrcs[kCount] = { 1, 2, 2, 3, 3, 3, 1, 1, 2, 3, 3, 1 };
+  for (int i = 0; i < kCount; ++i) {
+    talk_base::SetBE32(buffer + i * kMaxLen + 8, kSsrcs[i]);
+  }
+  memcpy(original, buffer, sizeof(buffer));
+
+  EXPECT_EQ(kCount, s1_.ProtectRtp(packets, kCount));
+  EXPECT_EQ(kCount, s2_.UnprotectRtp(packets, kCount));
+  for (int i = 0; i < kCount; ++i) {
+    EXPECT_TRUE(packets[i].ok);
+    EXPECT_EQ(112, packets[i].len);
+    EXPECT_EQ(0, memcmp(original + i * kMaxLen, buffer + i * kMaxLen, 112));
+  }
+
+  // Each stream rejects the replay of its own packet, but not the others.
+  char packet[kMaxLen];
+  int len = MakeRtpPacket(2, 100, packet);
+  talk_base::SetBE32(packet + 8, 2);
+  EXPECT_TRUE(s1_.ProtectRtp(packet, len, kMaxLen, &len));
+  EXPECT_FALSE(s2_.UnprotectRtp(packet, len, &len));
+  len = MakeRtpPacket(2, 100, packet);
+  talk_base::SetBE32(packet + 8, 1);
+  EXPECT_TRUE(s1_.ProtectRtp(packet, len, kMaxLen, &len));
+  EXPECT_TRUE(s2_.UnprotectRtp(packet, len, &len));
+}
+
+// Test that packets protected with the AES-NI cipher can be unprotected with
+// the portable one, and vice versa, for lengths that exercise all the paths.
+TEST_F(SrtpSessionTest, TestAesNiCipherInteroperates) {
+  if (!cricket::HasAesNi()) {
+    LOG(LS_INFO) << "Skipping test: no AES-NI";
+    return;
+  }
+  // Initializes libSRTP, with the AES-NI cipher.
+  cricket::SrtpSession aesni_send, portable_recv;
+  EXPECT_TRUE(s2_.SetRecv(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+  EXPECT_TRUE(aesni_send.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey2,
+                                 kTestKeyLen));
+  ASSERT_TRUE(cricket::EnableAesNiSrtpCipher(false));
+  EXPECT_TRUE(s1_.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+  EXPECT_TRUE(portable_recv.SetRecv(CS_AES_CM_128_HMAC_SHA1_80, kTestKey2,
+                                    kTestKeyLen));
+  EXPECT_TRUE(cricket::EnableAesNiSrtpCipher(true));
+
+  const int kPayloadLens[] = { 0, 1, 4, 15, 16, 17, 52, 64, 100, 1188 };
+  const int kMaxLen = 1500;
+  char packet[kMaxLen];
+  char original[kMaxLen];
+  for (size_t i = 0; i < ARRAY_SIZE(kPayloadLens); ++i) {
+    uint16 seqnum = static_cast<uint16>(i + 1);
+    int len = MakeRtpPacket(seqnum, kPayloadLens[i], packet);
+    int out_len;
+    memcpy(original, packet, len);
+    EXPECT_TRUE(s1_.ProtectRtp(packet, len, kMaxLen, &out_len));
+    EXPECT_TRUE(s2_.UnprotectRtp(packet, out_len, &out_len));
+    EXPECT_EQ(len, out_len);
+    EXPECT_EQ(0, memcmp(original, packet, len));
+
+    MakeRtpPacket(seqnum, kPayloadLens[i], packet);
+    EXPECT_TRUE(aesni_send.ProtectRtp(packet, len, kMaxLen, &out_len));
+    EXPECT_TRUE(portable_recv.UnprotectRtp(packet, out_len, &out_len));
+    EXPECT_EQ(len, out_len);
+    EXPECT_EQ(0, memcmp(original, packet, len));
+  }
+}
+
+// Measures how many 1200 byte packets per second one core protects and
+// unprotects, one at a time and in batches, with and without AES-NI.
+TEST_F(SrtpSessionTest, BatchProtectPerf) {
+  const int kBatchSize = 32;
+  const int kBatches = 500;
+  const int kPayloadLen = 1188;
+  const int kMaxLen = 1500;
+  talk_base::scoped_array<char> buffer(new char[kBatchSize * kMaxLen]);
+  cricket::SrtpPacket packets[kBatchSize];
+
+  // Initializes libSRTP.
+  EXPECT_TRUE(s1_.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
+  bool have_aesni = cricket::HasAesNi();
+  for (int aesni = 0; aesni <= (have_aesni ? 1 : 0); ++aesni) {
+    ASSERT_TRUE(cricket::EnableAesNiSrtpCipher(aesni != 0));
+    for (int batched = 0; batched <= 1; ++batched) {
+      cricket::SrtpSession send, recv;
+      EXPECT_TRUE(send.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1,
+                               kTestKeyLen));
+      EXPECT_TRUE(recv.SetRecv(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1,
+                               kTestKeyLen));
+      uint64 protect_ns = 0, unprotect_ns = 0;
+      for (int i = 0; i < kBatches; ++i) {
+        MakeRtpPackets(static_cast<uint16>(i * kBatchSize), kPayloadLen,
+                       kMaxLen, buffer.get(), packets, kBatchSize);
+        uint64 start = talk_base::TimeNanos();
+        if (batched) {
+          EXPECT_EQ(kBatchSize, send.ProtectRtp(packets, kBatchSize));
+        } else {
+          for (int j = 0; j < kBatchSize; ++j) {
+            EXPECT_TRUE(send.ProtectRtp(packets[j].data, packets[j].len,
+                                        packets[j].max_len, &packets[j].len));
+          }
+        }
+        uint64 middle = talk_base::TimeNanos();
+        if (batched) {
+          EXPECT_EQ(kBatchSize, recv.UnprotectRtp(packets, kBatchSize));
+        } else {
+          for (int j = 0; j < kBatchSize; ++j) {
+            EXPECT_TRUE(recv.UnprotectRtp(packets[j].data, packets[j].len,
+                                          &packets[j].len));
+          }
+        }
+        protect_ns += middle - start;
+        unprotect_ns += talk_base::TimeNanos() - middle;
+      }
+      uint64 count = kBatches * kBatchSize;
+      LOG(LS_INFO) << (batched ? "Batched" : "Single")
+                   << (aesni ? ", AES-NI: " : ", portable AES: ")
+                   << count * talk_base::kNumNanosecsPerSec /
+                      talk_base::_max<uint64>(protect_ns, 1)
+                   << " packets/sec protected, "
+                   << count * talk_base::kNumNanosecsPerSec /
+                      talk_base::_max<uint64>(unprotect_ns, 1)
+                   << " packets/sec unprotected";
+    }
+  }
+  EXPECT_TRUE(cricket::EnableAesNiSrtpCipher(have_aesni));
+}
+
 class SrtpStatTest
     : public testing::Test,
       public sigslot::has_slots<> {
@@ -32,6 +32,7 @@
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/stringutils.h"
 #include "talk/p2p/base/candidate.h"
+#include "talk/p2p/base/pseudotcpcongestion.h"
 #include "talk/p2p/base/transportchannel.h"
 #include "pseudotcpchannel.h"
 
@@ -147,6 +148,9 @@ bool PseudoTcpChannel::Connect(const std::string& content_name,
 
   ASSERT(tcp_ == NULL);
   tcp_ = new PseudoTcp(this, 0);
+  // Tunnels are long-lived bulk transfers over paths that may be lossy;
+  // CUBIC gets back to speed after a loss much faster than Reno.
+  tcp_->SetCongestionControl(new CubicCongestionControl());
   if (session_->initiator()) {
     // Since we may try several protocols and network adapters that won't work,
     // waiting until we get our first writable notification before initiating
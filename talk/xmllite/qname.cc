@@ -27,53 +27,153 @@
 
 #include "talk/xmllite/qname.h"
 
+#include <string.h>
+
+#include "talk/base/criticalsection.h"
+
 namespace buzz {
 
-QName::QName() {
+static const size_t kNamespaceBuckets = 256;
+static const int kMaxInternedNamespaces = 1024;
+
+QName::NamespaceEntry* volatile QName::namespace_table_[kNamespaceBuckets];
+int QName::namespace_count_ = 0;
+
+static size_t HashNamespace(const char* ns, size_t length) {
+  // FNV-1a.
+  size_t hash = 2166136261u;
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(ns[i])) * 16777619u;
+  }
+  return hash;
+}
+
+QName::NamespaceEntry* QName::Intern(const char* ns, size_t length) {
+  const size_t hash = HashNamespace(ns, length);
+  NamespaceEntry* volatile* bucket =
+      &namespace_table_[hash % kNamespaceBuckets];
+  NamespaceEntry* head = talk_base::AtomicOps::AcquireLoadPtr(bucket);
+  NamespaceEntry* searched_to = NULL;
+  NamespaceEntry* entry = NULL;
+  while (true) {
+    for (NamespaceEntry* it = head; it != searched_to;
+         it = talk_base::AtomicOps::AcquireLoadPtr(&it->next)) {
+      if (it->hash == hash && it->ns.length() == length &&
+          memcmp(it->ns.data(), ns, length) == 0) {
+        delete entry;
+        return it;
+      }
+    }
+    if (!entry) {
+      if (talk_base::AtomicOps::Increment(&namespace_count_) >
+          kMaxInternedNamespaces) {
+        talk_base::AtomicOps::Decrement(&namespace_count_);
+        break;
+      }
+      entry = new NamespaceEntry;
+      entry->ns.assign(ns, length);
+      entry->hash = hash;
+      entry->interned = true;
+      entry->ref_count = 0;
+    }
+    entry->next = head;
+    NamespaceEntry* prev =
+        talk_base::AtomicOps::CompareAndSwapPtr(bucket, head, entry);
+    if (prev == head) {
+      return entry;
+    }
+    // Another thread added to the bucket; check what it added, which are
+    // the entries in front of the ones already searched.
+    searched_to = head;
+    head = prev;
+  }
+
+  // The table is full. Entries are only added when a namespace is first
+  // seen, so this takes namespaces beyond the first kMaxInternedNamespaces.
+  entry = new NamespaceEntry;
+  entry->ns.assign(ns, length);
+  entry->hash = hash;
+  entry->next = NULL;
+  entry->interned = false;
+  entry->ref_count = 1;
+  return entry;
+}
+
+void QName::AddRef(NamespaceEntry* entry) {
+  if (!entry->interned) {
+    talk_base::AtomicOps::Increment(&entry->ref_count);
+  }
+}
+
+void QName::Release(NamespaceEntry* entry) {
+  if (!entry->interned &&
+      talk_base::AtomicOps::Decrement(&entry->ref_count) == 0) {
+    delete entry;
+  }
+}
+
+QName::QName() : namespace_(Intern("", 0)) {
 }
 
 QName::QName(const QName& qname)
     : namespace_(qname.namespace_),
       local_part_(qname.local_part_) {
+  AddRef(namespace_);
 }
 
 QName::QName(const StaticQName& const_value)
-    : namespace_(const_value.ns),
+    : namespace_(Intern(const_value.ns, strlen(const_value.ns))),
       local_part_(const_value.local) {
 }
 
 QName::QName(const std::string& ns, const std::string& local)
-    : namespace_(ns),
+    : namespace_(Intern(ns.data(), ns.length())),
+      local_part_(local) {
+}
+
+QName::QName(const char* ns, const char* local)
+    : namespace_(Intern(ns, strlen(ns))),
       local_part_(local) {
 }
 
 QName::QName(const std::string& merged_or_local) {
   size_t i = merged_or_local.rfind(':');
   if (i == std::string::npos) {
+    namespace_ = Intern("", 0);
     local_part_ = merged_or_local;
   } else {
-    namespace_ = merged_or_local.substr(0, i);
+    namespace_ = Intern(merged_or_local.data(), i);
     local_part_ = merged_or_local.substr(i + 1);
   }
 }
 
 QName::~QName() {
+  Release(namespace_);
+}
+
+QName& QName::operator=(const QName& qname) {
+  AddRef(qname.namespace_);
+  Release(namespace_);
+  namespace_ = qname.namespace_;
+  local_part_ = qname.local_part_;
+  return *this;
 }
 
 std::string QName::Merged() const {
-  if (namespace_[0] == '\0')
+  const std::string& ns = namespace_->ns;
+  if (ns.empty())
     return local_part_;
 
   std::string result;
-  result.reserve(namespace_.length() + 1 + local_part_.length());
-  result += namespace_;
+  result.reserve(ns.length() + 1 + local_part_.length());
+  result += ns;
   result += ':';
   result += local_part_;
   return result;
 }
 
 bool QName::IsEmpty() const {
-  return namespace_.empty() && local_part_.empty();
+  return namespace_->ns.empty() && local_part_.empty();
 }
 
 int QName::Compare(const StaticQName& other) const {
@@ -81,7 +181,7 @@ int QName::Compare(const StaticQName& other) const {
   if (result != 0)
     return result;
 
-  return namespace_.compare(other.ns);
+  return namespace_->ns.compare(other.ns);
 }
 
 int QName::Compare(const QName& other) const {
@@ -89,7 +189,21 @@ int QName::Compare(const QName& other) const {
   if (result != 0)
     return result;
 
-  return namespace_.compare(other.namespace_);
+  if (namespace_ == other.namespace_)
+    return 0;
+  return namespace_->ns.compare(other.namespace_->ns);
+}
+
+bool QName::Equals(const QName& other) const {
+  if (local_part_ != other.local_part_)
+    return false;
+
+  if (namespace_ == other.namespace_)
+    return true;
+  // Each interned namespace has a single entry.
+  if (namespace_->interned && other.namespace_->interned)
+    return false;
+  return namespace_->ns == other.namespace_->ns;
 }
 
 }  // namespace buzz
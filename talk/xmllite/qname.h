@@ -55,10 +55,13 @@ class QName {
   QName(const QName& qname);
   QName(const StaticQName& const_value);
   QName(const std::string& ns, const std::string& local);
+  QName(const char* ns, const char* local);
   explicit QName(const std::string& merged_or_local);
   ~QName();
 
-  const std::string& Namespace() const { return namespace_; }
+  QName& operator=(const QName& qname);
+
+  const std::string& Namespace() const { return namespace_->ns; }
   const std::string& LocalPart() const { return local_part_; }
   std::string Merged() const;
   bool IsEmpty() const;
@@ -70,20 +73,45 @@ class QName {
     return Compare(other) == 0;
   }
   bool operator==(const QName& other) const {
-    return Compare(other) == 0;
+    return Equals(other);
   }
   bool operator!=(const StaticQName& other) const {
     return Compare(other) != 0;
   }
   bool operator!=(const QName& other) const {
-    return Compare(other) != 0;
+    return !Equals(other);
   }
   bool operator<(const QName& other) const {
     return Compare(other) < 0;
   }
 
  private:
-  std::string namespace_;
+  // Namespaces are interned in a global table, so that building and copying
+  // QNames doesn't copy namespace strings, and two interned namespaces are
+  // equal only if they are the same entry. The table holds a limited number
+  // of namespaces, as they may come from the network; past that, a namespace
+  // gets an entry of its own, which is reference counted and shared by the
+  // copies of the QName.
+  struct NamespaceEntry {
+    std::string ns;
+    size_t hash;
+    NamespaceEntry* volatile next;
+    bool interned;
+    int ref_count;
+  };
+
+  // The table is an array of buckets, so that it needs no initialization
+  // code. Entries are never removed from it, so it is read without a lock.
+  static NamespaceEntry* volatile namespace_table_[];
+  static int namespace_count_;
+
+  static NamespaceEntry* Intern(const char* ns, size_t length);
+  static void AddRef(NamespaceEntry* entry);
+  static void Release(NamespaceEntry* entry);
+
+  bool Equals(const QName& other) const;
+
+  NamespaceEntry* namespace_;
   std::string local_part_;
 };
 
@@ -25,7 +25,9 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <sstream>
 #include <string>
+#include <vector>
 #include "talk/base/gunit.h"
 #include "talk/xmllite/qname.h"
 
@@ -129,3 +131,31 @@ TEST(QNameTest, TestStaticQName) {
   EXPECT_TRUE(name != name2);
   EXPECT_TRUE(name2 != name);
 }
+
+TEST(QNameTest, TestManyNamespaces) {
+  // More namespaces than are interned, so that the later ones are reference
+  // counted instead. Both kinds must copy and compare the same way.
+  const int kNamespaces = 2000;
+  std::vector<QName> names;
+  for (int i = 0; i < kNamespaces; ++i) {
+    std::ostringstream ns;
+    ns << "urn:test:many-namespaces:" << i;
+    names.push_back(QName(ns.str(), "local"));
+  }
+  for (int i = 0; i < kNamespaces; ++i) {
+    std::ostringstream ns;
+    ns << "urn:test:many-namespaces:" << i;
+    const QName name(ns.str(), "local");
+    EXPECT_EQ(ns.str(), names[i].Namespace());
+    EXPECT_TRUE(name == names[i]);
+    EXPECT_FALSE(name != names[i]);
+    EXPECT_EQ(0, name.Compare(names[i]));
+    EXPECT_FALSE(name == names[(i + 1) % kNamespaces]);
+
+    QName copy(names[i]);
+    EXPECT_TRUE(copy == name);
+    copy = names[(i + 1) % kNamespaces];
+    EXPECT_TRUE(copy == names[(i + 1) % kNamespaces]);
+    EXPECT_FALSE(copy == name);
+  }
+}
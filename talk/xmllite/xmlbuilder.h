@@ -41,6 +41,7 @@
 
 namespace buzz {
 
+class XmlArena;
 class XmlElement;
 class XmlParseContext;
 
@@ -48,9 +49,15 @@ class XmlParseContext;
 class XmlBuilder : public XmlParseHandler {
 public:
   XmlBuilder();
+  // Builds elements in |arena|. The built element must be deleted, and the
+  // builder Reset(), before the arena is.
+  explicit XmlBuilder(XmlArena * arena);
 
   static XmlElement * BuildElement(XmlParseContext * pctx,
                                   const char * name, const char ** atts);
+  static XmlElement * BuildElement(XmlParseContext * pctx,
+                                  const char * name, const char ** atts,
+                                  XmlArena * arena);
   virtual void StartElement(XmlParseContext * pctx,
                             const char * name, const char ** atts);
   virtual void EndElement(XmlParseContext * pctx, const char * name);
@@ -68,6 +75,7 @@ public:
   XmlElement * BuiltElement();
 
 private:
+  XmlArena * arena_;
   XmlElement * pelCurrent_;
   talk_base::scoped_ptr<XmlElement> pelRoot_;
   talk_base::scoped_ptr<std::vector<XmlElement*> > pvParents_;
@@ -30,6 +30,8 @@
 #include <iostream>
 #include "talk/base/common.h"
 #include "talk/base/gunit.h"
+#include "talk/base/logging.h"
+#include "talk/base/timeutils.h"
 #include "talk/xmllite/xmlbuilder.h"
 #include "talk/xmllite/xmlelement.h"
 #include "talk/xmllite/xmlparser.h"
@@ -192,3 +194,71 @@ TEST(XmlBuilderTest, TestAttrCollision3) {
   EXPECT_TRUE(NULL == builder.BuiltElement());
 }
 
+
+// A Jingle session-initiate, as a typical signaling stanza.
+static const char kPerfStanza[] =
+    "<cli:iq xmlns:cli='jabber:client' to='user@domain.com/resource'"
+    " type='set' id='123' from='me@domain.com/resource'>"
+    "<jingle xmlns='urn:xmpp:jingle:1' action='session-initiate'"
+    " initiator='me@domain.com/resource' sid='1234567890'>"
+    "<content name='audio' creator='initiator'>"
+    "<description xmlns='urn:xmpp:jingle:apps:rtp:1' media='audio'>"
+    "<payload-type id='103' name='ISAC' clockrate='16000'/>"
+    "<payload-type id='104' name='ISAC' clockrate='32000'/>"
+    "<payload-type id='0' name='PCMU' clockrate='8000'/>"
+    "<encryption required='true'>"
+    "<crypto crypto-suite='AES_CM_128_HMAC_SHA1_32'"
+    " key-params='inline:hsWuSQJxx7przmb8HM+ZkeNcG3HezSNID7LmfDa9'"
+    " session-params='KDR=5' tag='1'/>"
+    "</encryption>"
+    "</description>"
+    "<transport xmlns='http://www.google.com/transport/p2p'>"
+    "<candidate name='rtp' address='127.0.0.1' port='1234'"
+    " preference='1' username='user0' protocol='udp' generation='0'"
+    " password='pass0' type='local' network='eth0'/>"
+    "<candidate name='rtcp' address='127.0.0.1' port='1235'"
+    " preference='1' username='user1' protocol='udp' generation='0'"
+    " password='pass1' type='local' network='eth0'/>"
+    "</transport>"
+    "</content>"
+    "<group xmlns='urn:xmpp:jingle:apps:grouping:0' type='BUNDLE'>"
+    "<content name='audio'/>"
+    "</group>"
+    "</jingle>"
+    "</cli:iq>";
+
+// Parses a stanza the way XmppStanzaParser does, into an arena that is reset
+// for each stanza, and prints it.
+TEST(XmlBuilderTest, ParseAndPrintStanzaPerf) {
+  const int kIterations = 20000;
+  buzz::XmlArena arena;
+  XmlBuilder builder(&arena);
+  XmlParser parser(&builder);
+  std::string printed;
+
+  uint64 start = talk_base::TimeNanos();
+  for (int i = 0; i < kIterations; ++i) {
+    parser.Reset();
+    builder.Reset();
+    arena.Reset();
+    parser.Parse(kPerfStanza, sizeof(kPerfStanza) - 1, true);
+    ASSERT_TRUE(builder.BuiltElement() != NULL);
+  }
+  uint64 parse_ns = talk_base::TimeNanos() - start;
+
+  start = talk_base::TimeNanos();
+  for (int i = 0; i < kIterations; ++i) {
+    printed = builder.BuiltElement()->Str();
+  }
+  uint64 print_ns = talk_base::TimeNanos() - start;
+
+  // The printed stanza parses back to the same tree.
+  talk_base::scoped_ptr<XmlElement> reparsed(XmlElement::ForStr(printed));
+  ASSERT_TRUE(reparsed.get() != NULL);
+  EXPECT_EQ(printed, reparsed->Str());
+
+  LOG(LS_INFO) << "Parsed a " << sizeof(kPerfStanza) - 1 << " byte stanza in "
+               << parse_ns / kIterations << " ns, printed it in "
+               << print_ns / kIterations << " ns";
+  builder.Reset();
+}
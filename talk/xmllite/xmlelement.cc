@@ -32,6 +32,7 @@
 #include <string>
 #include <vector>
 
+#include "talk/base/basictypes.h"
 #include "talk/base/common.h"
 #include "talk/xmllite/qname.h"
 #include "talk/xmllite/xmlparser.h"
@@ -41,6 +42,92 @@
 
 namespace buzz {
 
+// Each node is preceded by the arena it is in, or NULL if it is on the heap.
+// The header is sized to keep the node aligned for pointers and 64-bit ints.
+union XmlNodeHeader {
+  XmlArena* arena;
+  uint64 align;
+};
+
+struct XmlArena::Block {
+  Block* next;
+  union {
+    char bytes[kBlockSize];
+    uint64 align;
+  } data;
+};
+
+XmlArena::XmlArena()
+    : first_block_(NULL),
+      current_block_(NULL),
+      used_(kBlockSize),
+      live_nodes_(0) {
+}
+
+XmlArena::~XmlArena() {
+  ASSERT(live_nodes_ == 0);
+  while (first_block_) {
+    Block* next = first_block_->next;
+    delete first_block_;
+    first_block_ = next;
+  }
+}
+
+void XmlArena::Reset() {
+  ASSERT(live_nodes_ == 0);
+  if (!first_block_)
+    return;
+  Block* block = first_block_->next;
+  while (block) {
+    Block* next = block->next;
+    delete block;
+    block = next;
+  }
+  first_block_->next = NULL;
+  current_block_ = first_block_;
+  used_ = 0;
+}
+
+void* XmlArena::AllocateInBlock(size_t size) {
+  // Keep every allocation aligned like the header.
+  size = (size + sizeof(XmlNodeHeader) - 1) & ~(sizeof(XmlNodeHeader) - 1);
+  ASSERT(size <= kBlockSize);
+  if (used_ + size > kBlockSize) {
+    Block* block = new Block;
+    block->next = NULL;
+    if (current_block_) {
+      current_block_->next = block;
+    } else {
+      first_block_ = block;
+    }
+    current_block_ = block;
+    used_ = 0;
+  }
+  void* p = current_block_->data.bytes + used_;
+  used_ += size;
+  ++live_nodes_;
+  return p;
+}
+
+void* XmlArena::Allocate(size_t size, XmlArena* arena) {
+  size += sizeof(XmlNodeHeader);
+  XmlNodeHeader* header = static_cast<XmlNodeHeader*>(
+      arena ? arena->AllocateInBlock(size) : ::operator new(size));
+  header->arena = arena;
+  return header + 1;
+}
+
+void XmlArena::Free(void* p) {
+  if (!p)
+    return;
+  XmlNodeHeader* header = static_cast<XmlNodeHeader*>(p) - 1;
+  if (header->arena) {
+    --header->arena->live_nodes_;
+  } else {
+    ::operator delete(header);
+  }
+}
+
 XmlChild::~XmlChild() {
 }
 
@@ -77,6 +164,7 @@ XmlElement::XmlElement(const QName& name) :
     last_attr_(NULL),
     first_child_(NULL),
     last_child_(NULL),
+    arena_(NULL),
     cdata_(false) {
 }
 
@@ -87,6 +175,7 @@ XmlElement::XmlElement(const XmlElement& elt) :
     last_attr_(NULL),
     first_child_(NULL),
     last_child_(NULL),
+    arena_(NULL),
     cdata_(false) {
 
   // copy attributes
@@ -125,9 +214,16 @@ XmlElement::XmlElement(const QName& name, bool useDefaultNs) :
   last_attr_(first_attr_),
   first_child_(NULL),
   last_child_(NULL),
+  arena_(NULL),
   cdata_(false) {
 }
 
+XmlElement* XmlElement::Create(const QName& name, XmlArena* arena) {
+  XmlElement* element = new (arena) XmlElement(name);
+  element->arena_ = arena;
+  return element;
+}
+
 bool XmlElement::IsTextImpl() const {
   return false;
 }
@@ -215,7 +311,7 @@ void XmlElement::SetAttr(const QName& name, const std::string& value) {
       break;
   }
   if (!attr) {
-    attr = new XmlAttr(name, value);
+    attr = new (arena_) XmlAttr(name, value);
     if (last_attr_)
       last_attr_->next_attr_ = attr;
     else
@@ -329,7 +425,7 @@ XmlElement::NextNamed(const StaticQName& name) {
 XmlElement* XmlElement::FindOrAddNamedChild(const QName& name) {
   XmlElement* child = FirstNamed(name);
   if (!child) {
-    child = new XmlElement(name);
+    child = Create(name, arena_);
     AddElement(child);
   }
 
@@ -378,7 +474,7 @@ void XmlElement::AddAttr(const QName& name, const std::string& value) {
   ASSERT(!HasAttr(name));
 
   XmlAttr ** pprev = last_attr_ ? &(last_attr_->next_attr_) : &first_attr_;
-  last_attr_ = (*pprev = new XmlAttr(name, value));
+  last_attr_ = (*pprev = new (arena_) XmlAttr(name, value));
 }
 
 void XmlElement::AddAttr(const QName& name, const std::string& value,
@@ -399,7 +495,7 @@ void XmlElement::AddParsedText(const char* cstr, int len) {
     return;
   }
   XmlChild ** pprev = last_child_ ? &(last_child_->next_child_) : &first_child_;
-  last_child_ = *pprev = new XmlText(cstr, len);
+  last_child_ = *pprev = new (arena_) XmlText(cstr, len);
 }
 
 void XmlElement::AddCDATAText(const char* buf, int len) {
@@ -416,7 +512,7 @@ void XmlElement::AddText(const std::string& text) {
     return;
   }
   XmlChild ** pprev = last_child_ ? &(last_child_->next_child_) : &first_child_;
-  last_child_ = *pprev = new XmlText(text);
+  last_child_ = *pprev = new (arena_) XmlText(text);
 }
 
 void XmlElement::AddText(const std::string& text, int depth) {
@@ -31,6 +31,7 @@
 #include <iosfwd>
 #include <string>
 
+#include "talk/base/constructormagic.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/xmllite/qname.h"
 
@@ -41,8 +42,54 @@ class XmlText;
 class XmlElement;
 class XmlAttr;
 
+// A bump allocator for XML trees that are built and thrown away as a whole,
+// such as incoming stanzas. Nodes built in an arena are deleted as usual,
+// which only destroys them; their memory is reused once the arena is
+// Reset(), which must not happen before all of them are deleted.
+class XmlArena {
+ public:
+  XmlArena();
+  ~XmlArena();
+
+  // Reuses the memory of all the nodes allocated so far.
+  void Reset();
+
+  // Allocates |size| bytes for a node in |arena|, or on the heap if |arena|
+  // is NULL. Either way the memory is released with Free().
+  static void* Allocate(size_t size, XmlArena* arena);
+  static void Free(void* p);
+
+ private:
+  struct Block;
+
+  static const size_t kBlockSize = 4096;
+
+  void* AllocateInBlock(size_t size);
+
+  // The first block is kept across Reset()s; any more are freed.
+  Block* first_block_;
+  Block* current_block_;
+  size_t used_;
+  int live_nodes_;
+
+  DISALLOW_COPY_AND_ASSIGN(XmlArena);
+};
+
 class XmlChild {
  public:
+  static void* operator new(size_t size) {
+    return XmlArena::Allocate(size, NULL);
+  }
+  static void* operator new(size_t size, XmlArena* arena) {
+    return XmlArena::Allocate(size, arena);
+  }
+  static void operator delete(void* p) {
+    XmlArena::Free(p);
+  }
+  static void operator delete(void* p, XmlArena*) {
+    XmlArena::Free(p);
+  }
+
   XmlChild* NextChild() { return next_child_; }
   const XmlChild* NextChild() const { return next_child_; }
 
@@ -107,6 +154,19 @@ class XmlText : public XmlChild {
 
 class XmlAttr {
  public:
+  static void* operator new(size_t size) {
+    return XmlArena::Allocate(size, NULL);
+  }
+  static void* operator new(size_t size, XmlArena* arena) {
+    return XmlArena::Allocate(size, arena);
+  }
+  static void operator delete(void* p) {
+    XmlArena::Free(p);
+  }
+  static void operator delete(void* p, XmlArena*) {
+    XmlArena::Free(p);
+  }
+
   XmlAttr* NextAttr() const { return next_attr_; }
   const QName& Name() const { return name_; }
   const std::string& Value() const { return value_; }
@@ -138,6 +198,10 @@ class XmlElement : public XmlChild {
 
   virtual ~XmlElement();
 
+  // Creates an element in |arena|. The attributes, text and elements added to
+  // it with its methods are created in |arena| too.
+  static XmlElement* Create(const QName& name, XmlArena* arena);
+
   const QName& Name() const { return name_; }
   void SetName(const QName& name) { name_ = name; }
 
@@ -243,6 +307,8 @@ class XmlElement : public XmlChild {
   XmlAttr* last_attr_;
   XmlChild* first_child_;
   XmlChild* last_child_;
+  // Where the nodes created by this element go; NULL for the heap.
+  XmlArena* arena_;
   bool cdata_;
 };
 
@@ -194,6 +194,43 @@ TEST(XmlElementTest, TestCopyConstructor) {
   delete element;
 }
 
+TEST(XmlElementTest, TestArena) {
+  buzz::XmlArena arena;
+  // Builds enough elements to need more than one block of the arena, twice
+  // to reuse it after the Reset().
+  for (int pass = 0; pass < 2; ++pass) {
+    XmlElement * element = XmlElement::Create(QName("test-foo", "root"),
+                                              &arena);
+    element->AddText("This is a ");
+    XmlElement * em = XmlElement::Create(QName("test-foo", "em"), &arena);
+    em->AddAttr(QName("", "a"), "avalue");
+    em->AddText("little ");
+    element->AddElement(em);
+    for (int i = 0; i < 100; ++i) {
+      em->FindOrAddNamedChild(QName("test-foo", "b"))->AddText("little");
+      em->AddElement(XmlElement::Create(QName("test-foo", "i"), &arena));
+    }
+    // Heap elements can be mixed in.
+    em->AddElement(new XmlElement(QName("test-foo", "i")));
+    em->ClearNamedChildren(QName("test-foo", "i"));
+    element->AddText(" test");
+
+    // A copy is on the heap, and outlives the arena's contents.
+    XmlElement * pelCopy = new XmlElement(*element);
+    delete element;
+    arena.Reset();
+
+    std::string little;
+    for (int i = 0; i < 100; ++i) {
+      little += "little";
+    }
+    EXPECT_EQ("<foo:root xmlns:foo=\"test-foo\">This is a "
+              "<foo:em a=\"avalue\">little <foo:b>" + little +
+              "</foo:b></foo:em> test</foo:root>", pelCopy->Str());
+    delete pelCopy;
+  }
+}
+
 TEST(XmlElementTest, TestNameSearch) {
   XmlElement * element = XmlElement::ForStr(
     "<root xmlns='test-foo'>"
@@ -47,6 +47,9 @@ public:
   void Reset();
 
   std::pair<std::string, bool> NsForPrefix(const std::string& prefix);
+  // Like NsForPrefix, but returns the namespace without copying it, or NULL
+  // if there is none. The result is valid until the stack is changed.
+  const char* FindNsForPrefix(const std::string& prefix);
   bool PrefixMatchesNs(const std::string & prefix, const std::string & ns);
   std::pair<std::string, bool> PrefixForNs(const std::string& ns, bool isAttr);
   std::pair<std::string, bool> AddNewPrefix(const std::string& ns, bool isAttr);
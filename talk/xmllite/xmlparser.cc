@@ -225,21 +225,21 @@ XmlParser::ParseContext::ResolveQName(const char* qname, bool isAttr) {
   const char *c;
   for (c = qname; *c; ++c) {
     if (*c == ':') {
-      const std::pair<std::string, bool> result =
-          xmlnsstack_.NsForPrefix(std::string(qname, c - qname));
-      if (!result.second)
+      const char* ns =
+          xmlnsstack_.FindNsForPrefix(std::string(qname, c - qname));
+      if (!ns)
         return QName();
-      return QName(result.first, c + 1);
+      return QName(ns, c + 1);
     }
   }
   if (isAttr)
     return QName(STR_EMPTY, qname);
 
-  std::pair<std::string, bool> result = xmlnsstack_.NsForPrefix(STR_EMPTY);
-  if (!result.second)
+  const char* ns = xmlnsstack_.FindNsForPrefix(STR_EMPTY);
+  if (!ns)
     return QName();
 
-  return QName(result.first, qname);
+  return QName(ns, qname);
 }
 
 void
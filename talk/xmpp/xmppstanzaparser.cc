@@ -43,7 +43,7 @@ XmppStanzaParser::XmppStanzaParser(XmppStanzaParseHandler *psph) :
   innerHandler_(this),
   parser_(&innerHandler_),
   depth_(0),
-  builder_() {
+  builder_(&arena_) {
 }
 
 void
@@ -92,6 +92,9 @@ XmppStanzaParser::IncomingEndElement(
     XmlElement *element = builder_.CreateElement();
     psph_->Stanza(element);
     delete element;
+    // Nothing else is built in the arena between stanzas. This isn't done in
+    // Reset(), which the handler may call while it has the stanza.
+    arena_.Reset();
   }
 }
 
@@ -30,6 +30,7 @@
 
 #include "talk/xmllite/xmlparser.h"
 #include "talk/xmllite/xmlbuilder.h"
+#include "talk/xmllite/xmlelement.h"
 
 
 namespace buzz {
@@ -87,6 +88,9 @@ private:
   ParseHandler innerHandler_;
   XmlParser parser_;
   int depth_;
+  // Stanzas are only used for the duration of XmppStanzaParseHandler::Stanza,
+  // so each one is built in |arena_|, which is reused for the next one.
+  XmlArena arena_;
   XmlBuilder builder_;
 
  };
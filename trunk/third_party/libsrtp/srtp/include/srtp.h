@@ -249,6 +249,22 @@ typedef struct srtp_policy_t {
 typedef struct srtp_ctx_t *srtp_t;
 
 
+/**
+ * @brief An srtp_packet_t describes one packet of a batch passed to
+ * srtp_protect_batch() or srtp_unprotect_batch().
+ *
+ * hdr and len are the packet and its length in octets, as the rtp_hdr
+ * and *len_ptr arguments of srtp_protect() and srtp_unprotect(); len is
+ * updated in place.  status is set to the result for the packet.
+ */
+
+typedef struct {
+  void         *hdr;     /**< the packet, aligned on a 32-bit boundary */
+  int          len;      /**< its length in octets                     */
+  err_status_t status;   /**< the result of processing it              */
+} srtp_packet_t;
+
+
 /**
  * @brief An srtp_stream_t points to an SRTP stream structure.
  *
@@ -368,6 +384,38 @@ srtp_protect(srtp_t ctx, void *rtp_hdr, int *len_ptr);
 err_status_t
 srtp_unprotect(srtp_t ctx, void *srtp_hdr, int *len_ptr);
 
+/**
+ * @brief srtp_protect_batch() applies srtp_protect() to several
+ * packets.
+ *
+ * The function call srtp_protect_batch(ctx, packets, count) protects
+ * packets[0] to packets[count - 1] in order, as srtp_protect() would,
+ * and sets the status of each.  The stream of a packet is only looked
+ * up when its SSRC differs from that of the packet before it, so
+ * batches of packets of one stream save a lookup per packet.
+ *
+ * @return the number of packets whose status is err_status_ok.
+ */
+
+int
+srtp_protect_batch(srtp_t ctx, srtp_packet_t *packets, int count);
+
+/**
+ * @brief srtp_unprotect_batch() applies srtp_unprotect() to several
+ * packets.
+ *
+ * The function call srtp_unprotect_batch(ctx, packets, count)
+ * unprotects packets[0] to packets[count - 1] in order, as
+ * srtp_unprotect() would, and sets the status of each.  The stream of
+ * a packet is only looked up when its SSRC differs from that of the
+ * packet before it.
+ *
+ * @return the number of packets whose status is err_status_ok.
+ */
+
+int
+srtp_unprotect_batch(srtp_t ctx, srtp_packet_t *packets, int count);
+
 
 /**
  * @brief srtp_create() allocates and initializes an SRTP session.
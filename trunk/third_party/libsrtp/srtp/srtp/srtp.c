@@ -711,43 +711,27 @@ srtp_stream_init(srtp_stream_ctx_t *srtp,
    return err_status_ok;
  }
 
- err_status_t
- srtp_protect(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len) {
-   srtp_hdr_t *hdr = (srtp_hdr_t *)rtp_hdr;
-   uint32_t *enc_start;        /* pointer to start of encrypted portion  */
-   uint32_t *auth_start;       /* pointer to start of auth. portion      */
-   unsigned enc_octet_len = 0; /* number of octets in encrypted portion  */
-   xtd_seq_num_t est;          /* estimated xtd_seq_num_t of *hdr        */
-   int delta;                  /* delta of local pkt idx and that in hdr */
-   uint8_t *auth_tag = NULL;   /* location of auth_tag within packet     */
-   err_status_t status;   
-   int tag_len;
+ /*
+  * look up ssrc in srtp_stream list, and process the packet with
+  * the appropriate stream.  if we haven't seen this stream before,
+  * there's a template key for this srtp_session, and the cipher
+  * supports key-sharing, then we assume that a new stream using
+  * that key has just started up
+  */
+ static err_status_t
+ srtp_get_protect_stream(srtp_ctx_t *ctx, uint32_t ssrc,
+			 srtp_stream_ctx_t **stream_ptr) {
    srtp_stream_ctx_t *stream;
-   int prefix_len;
+   err_status_t status;
 
-   debug_print(mod_srtp, "function srtp_protect", NULL);
-
-  /* we assume the hdr is 32-bit aligned to start */
-
-   /* check the packet length - it must at least contain a full header */
-   if (*pkt_octet_len < octets_in_rtp_header)
-     return err_status_bad_param;
-
-   /*
-    * look up ssrc in srtp_stream list, and process the packet with
-    * the appropriate stream.  if we haven't seen this stream before,
-    * there's a template key for this srtp_session, and the cipher
-    * supports key-sharing, then we assume that a new stream using
-    * that key has just started up
-    */
-   stream = srtp_get_stream(ctx, hdr->ssrc);
+   stream = srtp_get_stream(ctx, ssrc);
    if (stream == NULL) {
      if (ctx->stream_template != NULL) {
        srtp_stream_ctx_t *new_stream;
 
        /* allocate and initialize a new stream */
        status = srtp_stream_clone(ctx->stream_template, 
-				  hdr->ssrc, &new_stream); 
+				  ssrc, &new_stream); 
        if (status)
 	 return status;
 
@@ -766,6 +750,28 @@ srtp_stream_init(srtp_stream_ctx_t *srtp,
      } 
    }
 
+   *stream_ptr = stream;
+   return err_status_ok;
+ }
+
+ /*
+  * protects one packet, whose length has been checked, with the
+  * stream that srtp_get_protect_stream() returned for its ssrc
+  */
+ static err_status_t
+ srtp_protect_stream(srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
+		     void *rtp_hdr, int *pkt_octet_len) {
+   srtp_hdr_t *hdr = (srtp_hdr_t *)rtp_hdr;
+   uint32_t *enc_start;        /* pointer to start of encrypted portion  */
+   uint32_t *auth_start;       /* pointer to start of auth. portion      */
+   unsigned enc_octet_len = 0; /* number of octets in encrypted portion  */
+   xtd_seq_num_t est;          /* estimated xtd_seq_num_t of *hdr        */
+   int delta;                  /* delta of local pkt idx and that in hdr */
+   uint8_t *auth_tag = NULL;   /* location of auth_tag within packet     */
+   err_status_t status;   
+   int tag_len;
+   int prefix_len;
+
    /* 
     * verify that stream is for sending traffic - this check will
     * detect SSRC collisions, since a stream that appears in both
@@ -953,9 +959,69 @@ srtp_stream_init(srtp_stream_ctx_t *srtp,
   return err_status_ok;  
 }
 
+ err_status_t
+ srtp_protect(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len) {
+   srtp_hdr_t *hdr = (srtp_hdr_t *)rtp_hdr;
+   srtp_stream_ctx_t *stream;
+   err_status_t status;
+
+   debug_print(mod_srtp, "function srtp_protect", NULL);
 
-err_status_t
-srtp_unprotect(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len) {
+  /* we assume the hdr is 32-bit aligned to start */
+
+   /* check the packet length - it must at least contain a full header */
+   if (*pkt_octet_len < octets_in_rtp_header)
+     return err_status_bad_param;
+
+   status = srtp_get_protect_stream(ctx, hdr->ssrc, &stream);
+   if (status)
+     return status;
+
+   return srtp_protect_stream(ctx, stream, rtp_hdr, pkt_octet_len);
+ }
+
+ int
+ srtp_protect_batch(srtp_ctx_t *ctx, srtp_packet_t *packets, int count) {
+   srtp_stream_ctx_t *stream = NULL;
+   int i, num_ok = 0;
+
+   debug_print(mod_srtp, "function srtp_protect_batch", NULL);
+
+   for (i = 0; i < count; i++) {
+     srtp_packet_t *pkt = &packets[i];
+     srtp_hdr_t *hdr = (srtp_hdr_t *)pkt->hdr;
+
+     if (pkt->len < octets_in_rtp_header) {
+       pkt->status = err_status_bad_param;
+       continue;
+     }
+
+     /* packets of the same stream as the previous one skip the lookup */
+     if (stream == NULL || stream->ssrc != hdr->ssrc) {
+       pkt->status = srtp_get_protect_stream(ctx, hdr->ssrc, &stream);
+       if (pkt->status) {
+	 stream = NULL;
+	 continue;
+       }
+     }
+
+     pkt->status = srtp_protect_stream(ctx, stream, pkt->hdr, &pkt->len);
+     if (pkt->status == err_status_ok)
+       num_ok++;
+   }
+   return num_ok;
+ }
+
+
+/*
+ * unprotects one packet, whose length has been checked, with the
+ * stream that srtp_get_stream() returned for its ssrc, which may be
+ * NULL.  if the packet started a new stream, *stream_ptr is set to
+ * that stream
+ */
+static err_status_t
+srtp_unprotect_stream(srtp_ctx_t *ctx, srtp_stream_ctx_t **stream_ptr,
+		      void *srtp_hdr, int *pkt_octet_len) {
   srtp_hdr_t *hdr = (srtp_hdr_t *)srtp_hdr;
   uint32_t *enc_start;      /* pointer to start of encrypted portion  */
   uint32_t *auth_start;     /* pointer to start of auth. portion      */
@@ -965,26 +1031,16 @@ srtp_unprotect(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len) {
   int delta;                /* delta of local pkt idx and that in hdr */
   v128_t iv;
   err_status_t status;
-  srtp_stream_ctx_t *stream;
+  srtp_stream_ctx_t *stream = *stream_ptr;
   uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
   int tag_len, prefix_len;
 
-  debug_print(mod_srtp, "function srtp_unprotect", NULL);
-
-  /* we assume the hdr is 32-bit aligned to start */
-
-  /* check the packet length - it must at least contain a full header */
-  if (*pkt_octet_len < octets_in_rtp_header)
-    return err_status_bad_param;
-
   /*
-   * look up ssrc in srtp_stream list, and process the packet with 
-   * the appropriate stream.  if we haven't seen this stream before,
-   * there's only one key for this srtp_session, and the cipher
-   * supports key-sharing, then we assume that a new stream using
-   * that key has just started up
+   * process the packet with the stream of its ssrc.  if we haven't
+   * seen this stream before, there's only one key for this
+   * srtp_session, and the cipher supports key-sharing, then we
+   * assume that a new stream using that key has just started up
    */
-  stream = srtp_get_stream(ctx, hdr->ssrc);
   if (stream == NULL) {
     if (ctx->stream_template != NULL) {
       stream = ctx->stream_template;
@@ -1217,6 +1273,7 @@ srtp_unprotect(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len) {
     
     /* set stream (the pointer used in this function) */
     stream = new_stream;
+    *stream_ptr = new_stream;
   }
   
   /* 
@@ -1231,6 +1288,55 @@ srtp_unprotect(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len) {
   return err_status_ok;  
 }
 
+err_status_t
+srtp_unprotect(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len) {
+  srtp_hdr_t *hdr = (srtp_hdr_t *)srtp_hdr;
+  srtp_stream_ctx_t *stream;
+
+  debug_print(mod_srtp, "function srtp_unprotect", NULL);
+
+  /* we assume the hdr is 32-bit aligned to start */
+
+  /* check the packet length - it must at least contain a full header */
+  if (*pkt_octet_len < octets_in_rtp_header)
+    return err_status_bad_param;
+
+  /* look up ssrc in srtp_stream list */
+  stream = srtp_get_stream(ctx, hdr->ssrc);
+  return srtp_unprotect_stream(ctx, &stream, srtp_hdr, pkt_octet_len);
+}
+
+int
+srtp_unprotect_batch(srtp_ctx_t *ctx, srtp_packet_t *packets, int count) {
+  srtp_stream_ctx_t *stream = NULL;
+  uint32_t ssrc = 0;
+  int i, looked_up = 0, num_ok = 0;
+
+  debug_print(mod_srtp, "function srtp_unprotect_batch", NULL);
+
+  for (i = 0; i < count; i++) {
+    srtp_packet_t *pkt = &packets[i];
+    srtp_hdr_t *hdr = (srtp_hdr_t *)pkt->hdr;
+
+    if (pkt->len < octets_in_rtp_header) {
+      pkt->status = err_status_bad_param;
+      continue;
+    }
+
+    /* packets of the same ssrc as the previous one skip the lookup */
+    if (!looked_up || hdr->ssrc != ssrc) {
+      ssrc = hdr->ssrc;
+      stream = srtp_get_stream(ctx, ssrc);
+      looked_up = 1;
+    }
+
+    pkt->status = srtp_unprotect_stream(ctx, &stream, pkt->hdr, &pkt->len);
+    if (pkt->status == err_status_ok)
+      num_ok++;
+  }
+  return num_ok;
+}
+
 err_status_t
 srtp_init() {
   err_status_t status;